@@ -0,0 +1,154 @@
+#ifndef KWARGS_BENCH_H
+#define KWARGS_BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace kwargscpp_bench {
+
+// A benchmark body, called once per iteration. Fixtures live in the closure so setup is not timed.
+using BenchFn = std::function<void()>;
+// Builds the fixture and returns the body to time
+using BenchFactory = std::function<BenchFn()>;
+
+struct Benchmark {
+  std::string name;
+  BenchFactory factory;
+};
+
+// Bytes processed per iteration, set by a factory whose benchmark reports throughput, e.g. the size of the parsed text
+inline size_t& bytes_processed() {
+  static size_t bytes = 0;
+  return bytes;
+}
+
+inline std::vector<Benchmark>& registry() {
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+struct Registrar {
+  Registrar(std::string name, BenchFactory factory) { registry().push_back({std::move(name), std::move(factory)}); }
+};
+
+#define KWARGSCPP_BENCH_CAT2(a, b) a##b
+#define KWARGSCPP_BENCH_CAT(a, b) KWARGSCPP_BENCH_CAT2(a, b)
+// Register a benchmark factory, e.g. KWARGSCPP_BENCHMARK("get/flat", [] { ...; return [=] { ... }; });
+#define KWARGSCPP_BENCHMARK(name, factory) \
+  static ::kwargscpp_bench::Registrar KWARGSCPP_BENCH_CAT(kwargscpp_bench_registrar_, __LINE__)(name, factory)
+
+// Keep the compiler from optimizing away a computed value
+template <typename T>
+inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &value;
+#endif
+}
+
+struct Options {
+  std::string filter;
+  std::string out_path;
+  double min_time = 0.1;  // seconds per repetition
+  int repetitions = 5;
+};
+
+struct Result {
+  std::string name;
+  uint64_t iterations = 0;
+  double real_time = 0;         // median ns per iteration
+  double cpu_time = 0;          // median ns per iteration
+  double min_time = 0;          // fastest repetition, ns per iteration
+  double bytes_per_second = 0;  // median throughput, if the benchmark set bytes_processed()
+};
+
+inline double run_once(const BenchFn& fn, uint64_t iterations, double* cpu_ns) {
+  std::clock_t cpu_start = std::clock();
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; ++i) fn();
+  auto stop = std::chrono::steady_clock::now();
+  std::clock_t cpu_stop = std::clock();
+  *cpu_ns = 1e9 * static_cast<double>(cpu_stop - cpu_start) / CLOCKS_PER_SEC;
+  return std::chrono::duration<double, std::nano>(stop - start).count();
+}
+
+inline Result run_benchmark(const Benchmark& bench, const Options& options) {
+  bytes_processed() = 0;
+  BenchFn fn = bench.factory();
+  const size_t bytes = bytes_processed();
+
+  // Grow the iteration count until one run takes a measurable fraction of the target time
+  uint64_t iterations = 1;
+  double cpu_ns = 0;
+  for (;;) {
+    double ns = run_once(fn, iterations, &cpu_ns);
+    if (ns >= 1e9 * options.min_time / 10 || iterations >= (uint64_t(1) << 40)) {
+      double per_iter = std::max(ns / iterations, 1e-3);
+      iterations = std::max<uint64_t>(1, static_cast<uint64_t>(1e9 * options.min_time / per_iter));
+      break;
+    }
+    iterations *= 10;
+  }
+
+  std::vector<double> real, cpu;
+  for (int r = 0; r < std::max(options.repetitions, 1); ++r) {
+    real.push_back(run_once(fn, iterations, &cpu_ns) / iterations);
+    cpu.push_back(cpu_ns / iterations);
+  }
+  std::sort(real.begin(), real.end());
+  std::sort(cpu.begin(), cpu.end());
+
+  Result result;
+  result.name = bench.name;
+  result.iterations = iterations;
+  result.real_time = real[real.size() / 2];
+  result.cpu_time = cpu[cpu.size() / 2];
+  result.min_time = real.front();
+  result.bytes_per_second = 1e9 * static_cast<double>(bytes) / result.real_time;
+  return result;
+}
+
+// Emit results in the google-benchmark JSON layout so existing comparison tooling can diff two runs
+inline void write_json(std::FILE* out, const std::vector<Result>& results, const Options& options) {
+  std::fprintf(out, "{\n  \"context\": {\n");
+  std::fprintf(out, "    \"executable\": \"kwargscpp_bench\",\n");
+#if defined(__clang__)
+  std::fprintf(out, "    \"compiler\": \"clang %d.%d.%d\",\n", __clang_major__, __clang_minor__, __clang_patchlevel__);
+#elif defined(__GNUC__)
+  std::fprintf(out, "    \"compiler\": \"gcc %d.%d.%d\",\n", __GNUC__, __GNUC_MINOR__, __GNUC_PATCHLEVEL__);
+#elif defined(_MSC_VER)
+  std::fprintf(out, "    \"compiler\": \"msvc %d\",\n", _MSC_VER);
+#endif
+#ifdef NDEBUG
+  std::fprintf(out, "    \"library_build_type\": \"release\",\n");
+#else
+  std::fprintf(out, "    \"library_build_type\": \"debug\",\n");
+#endif
+  std::fprintf(out, "    \"date\": %lld,\n", static_cast<long long>(std::time(nullptr)));
+  std::fprintf(out, "    \"repetitions\": %d,\n", options.repetitions);
+  std::fprintf(out, "    \"min_time\": %g\n", options.min_time);
+  std::fprintf(out, "  },\n  \"benchmarks\": [");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    std::fprintf(out, "%s\n    {\"name\": \"%s\", \"run_type\": \"aggregate\", \"aggregate_name\": \"median\", ",
+                 i ? "," : "", r.name.c_str());
+    std::fprintf(out, "\"iterations\": %llu, \"real_time\": %.3f, \"cpu_time\": %.3f, \"min_time\": %.3f, ",
+                 static_cast<unsigned long long>(r.iterations), r.real_time, r.cpu_time, r.min_time);
+    if (r.bytes_per_second > 0) std::fprintf(out, "\"bytes_per_second\": %.0f, ", r.bytes_per_second);
+    std::fprintf(out, "\"time_unit\": \"ns\"}");
+  }
+  std::fprintf(out, "\n  ]\n}\n");
+}
+
+}  // namespace kwargscpp_bench
+
+#endif  // KWARGS_BENCH_H
@@ -0,0 +1,354 @@
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <variant>
+
+#include "bench.h"
+#include "fixtures.h"
+#include "kwargscpp/fields.h"
+#include "kwargscpp/flat.h"
+#include "kwargscpp/frozen.h"
+#include "kwargscpp/json.h"
+#include "kwargscpp/kwargs.h"
+#include "kwargscpp/msgpack.h"
+#include "kwargscpp/patch.h"
+#include "kwargscpp/path.h"
+#include "kwargscpp/schema.h"
+
+namespace kwargscpp_bench {
+namespace {
+
+// The options of make_flat_dict() as a bound struct
+struct FlatOpts {
+  intmax_t key_0 = 0;
+  double key_1 = 0;
+  bool key_2 = false;
+  std::string key_3;
+  intmax_t key_4 = 0;
+  double key_5 = 0;
+  bool key_6 = false;
+  std::string key_7;
+  intmax_t key_8 = 0;
+  double key_9 = 0;
+  bool key_10 = false;
+  std::string key_11;
+  intmax_t key_12 = 0;
+  double key_13 = 0;
+  bool key_14 = false;
+  std::string key_15;
+};
+KWARGSCPP_FIELDS(FlatOpts, key_0, key_1, key_2, key_3, key_4, key_5, key_6, key_7, key_8, key_9, key_10, key_11, key_12,
+                 key_13, key_14, key_15)
+
+// FlatOpts unpacked by hand, a get() with a default per field
+FlatOpts get_fields(const kwargscpp::DictType& dict) {
+  FlatOpts opts;
+  opts.key_0 = kwargscpp::get(dict, "key_0", opts.key_0);
+  opts.key_1 = kwargscpp::get(dict, "key_1", opts.key_1);
+  opts.key_2 = kwargscpp::get(dict, "key_2", opts.key_2);
+  opts.key_3 = kwargscpp::get(dict, "key_3", opts.key_3);
+  opts.key_4 = kwargscpp::get(dict, "key_4", opts.key_4);
+  opts.key_5 = kwargscpp::get(dict, "key_5", opts.key_5);
+  opts.key_6 = kwargscpp::get(dict, "key_6", opts.key_6);
+  opts.key_7 = kwargscpp::get(dict, "key_7", opts.key_7);
+  opts.key_8 = kwargscpp::get(dict, "key_8", opts.key_8);
+  opts.key_9 = kwargscpp::get(dict, "key_9", opts.key_9);
+  opts.key_10 = kwargscpp::get(dict, "key_10", opts.key_10);
+  opts.key_11 = kwargscpp::get(dict, "key_11", opts.key_11);
+  opts.key_12 = kwargscpp::get(dict, "key_12", opts.key_12);
+  opts.key_13 = kwargscpp::get(dict, "key_13", opts.key_13);
+  opts.key_14 = kwargscpp::get(dict, "key_14", opts.key_14);
+  opts.key_15 = kwargscpp::get(dict, "key_15", opts.key_15);
+  return opts;
+}
+
+// Register one benchmark per dict shape, named "<op>/<shape>"
+template <typename MakeBody>
+int register_for_shapes(const std::string& op, MakeBody make_body) {
+  for (const Shape& shape : shapes()) {
+    auto make = shape.make;
+    registry().push_back({op + "/" + shape.name, [make, make_body] { return make_body(make()); }});
+  }
+  return 0;
+}
+
+// The first 8 options of make_flat_dict(), which every shape has: all required, ints and doubles in [0, 100], strings
+// from a fixed set
+kwargscpp::Schema make_flat_schema() {
+  kwargscpp::Schema schema;
+  for (size_t i = 0; i < 8; ++i) {
+    std::string key = "key_" + std::to_string(i);
+    switch (i % 4) {
+      case 0:
+        schema.required(key, kwargscpp::ValueKind::integer).range(0, 100);
+        break;
+      case 1:
+        schema.required(key, kwargscpp::ValueKind::floating).range(0, 100);
+        break;
+      case 2:
+        schema.required(key, kwargscpp::ValueKind::boolean);
+        break;
+      default:
+        schema.required(key, kwargscpp::ValueKind::string).one_of({"value_3", "value_7", "value_11"});
+        break;
+    }
+  }
+  return schema;
+}
+
+// make_flat_schema() checked by hand, stopping at the first problem
+void check_flat_by_hand(const kwargscpp::DictType& dict) {
+  const auto number = [&](const char* key, auto type) {
+    auto value = kwargscpp::get_or_die<decltype(type)>(dict, key);
+    if (value < 0 || value > 100) throw std::invalid_argument(key);
+  };
+  const auto string = [&](const char* key) {
+    const kwargscpp::String& value = kwargscpp::get_ref<kwargscpp::String>(dict, key);
+    if (value != "value_3" && value != "value_7" && value != "value_11") throw std::invalid_argument(key);
+  };
+  number("key_0", intmax_t());
+  number("key_1", double());
+  kwargscpp::get_or_die<bool>(dict, "key_2");
+  string("key_3");
+  number("key_4", intmax_t());
+  number("key_5", double());
+  kwargscpp::get_or_die<bool>(dict, "key_6");
+  string("key_7");
+}
+
+// to_string as it was before the streaming writer, concatenating a temporary string per node, kept as a baseline
+std::string concat_to_string(const kwargscpp::ValueType& value);
+
+std::string concat_to_string(const kwargscpp::DictType& dict) {
+  std::string result = "{";
+  for (auto it = dict.begin(); it != dict.end(); ++it) {
+    result += "\"" + it->first + "\": " + concat_to_string(it->second);
+    if (std::next(it) != dict.end()) result += ", ";
+  }
+  result += "}";
+  return result;
+}
+
+std::string concat_to_string(const kwargscpp::ValueType& value) {
+  return kwargscpp::visit(
+      [](const auto& arg) -> std::string {
+        using T = std::decay_t<decltype(arg)>;
+        if constexpr (std::is_same_v<T, bool>) {
+          return arg ? "true" : "false";
+        } else if constexpr (std::is_arithmetic_v<T>) {
+          return std::to_string(arg);
+        } else if constexpr (std::is_same_v<T, kwargscpp::String>) {
+          return "\"" + std::string(arg) + "\"";
+        } else if constexpr (std::is_same_v<T, kwargscpp::Cow<kwargscpp::ListType>>) {
+          std::string s = "[";
+          for (auto it = arg.get().begin(); it != arg.get().end(); ++it) {
+            s += concat_to_string(*it);
+            if (std::next(it) != arg.get().end()) s += ", ";
+          }
+          s += "]";
+          return s;
+        } else if constexpr (std::is_same_v<T, kwargscpp::Cow<kwargscpp::DictType>>) {
+          return concat_to_string(arg.get());
+        } else {
+          return "";
+        }
+      },
+      value);
+}
+
+const int registered = [] {
+  register_for_shapes("set", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict]() mutable {
+      kwargscpp::set(dict, "key_7", static_cast<intmax_t>(7));
+      do_not_optimize(dict);
+    };
+  });
+  register_for_shapes("get_or_die/hit", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] { do_not_optimize(kwargscpp::get_or_die<intmax_t>(dict, "key_4")); };
+  });
+  register_for_shapes("get_or_die/hit_key", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] {
+      using namespace kwargscpp::literals;
+      do_not_optimize(kwargscpp::get_or_die<intmax_t>(dict, "key_4"_kw));
+    };
+  });
+  register_for_shapes("get/hit", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] { do_not_optimize(kwargscpp::get<int>(dict, "key_4", -1)); };
+  });
+  register_for_shapes("get/string", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] { do_not_optimize(kwargscpp::get<std::string>(dict, "key_3", "")); };
+  });
+  register_for_shapes("get_view/string", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] { do_not_optimize(kwargscpp::get_view<std::string_view>(dict, "key_3", "")); };
+  });
+  register_for_shapes("get/miss", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] { do_not_optimize(kwargscpp::get<int>(dict, "missing_key", -1)); };
+  });
+  register_for_shapes("get/wrong_type", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] { do_not_optimize(kwargscpp::get<std::string>(dict, "key_4", "")); };
+  });
+  register_for_shapes("from_kwargs", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] { do_not_optimize(kwargscpp::from_kwargs<FlatOpts>(dict)); };
+  });
+  register_for_shapes("from_kwargs/get_fields", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] { do_not_optimize(get_fields(dict)); };
+  });
+  register_for_shapes("validate", [](kwargscpp::DictType dict) -> BenchFn {
+    auto schema = std::make_shared<const kwargscpp::Schema>(make_flat_schema());
+    return [dict, schema] { do_not_optimize(schema->validate(dict)); };
+  });
+  register_for_shapes("validate/get_or_die", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] {
+      check_flat_by_hand(dict);
+      do_not_optimize(dict);
+    };
+  });
+  register_for_shapes("merge", [](kwargscpp::DictType dict) -> BenchFn {
+    kwargscpp::DictType overrides = make_flat_dict(4);
+    return [dict, overrides] { do_not_optimize(kwargscpp::merge(dict, overrides)); };
+  });
+  // layering a small override onto a shared default, which clones only the dicts it changes
+  register_for_shapes("deep_merge_into", [](kwargscpp::DictType dict) -> BenchFn {
+    kwargscpp::DictType overrides = make_flat_dict(4);
+    return [dict, overrides] {
+      kwargscpp::DictType merged = dict;
+      kwargscpp::deep_merge_into(merged, overrides);
+      do_not_optimize(merged);
+    };
+  });
+  register_for_shapes("with_prefix", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] { do_not_optimize(kwargscpp::with_prefix(dict, "prefix_")); };
+  });
+  register_for_shapes("to_string", [](kwargscpp::DictType dict) -> BenchFn {
+    bytes_processed() = kwargscpp::to_string(dict).size();
+    return [dict] { do_not_optimize(kwargscpp::to_string(dict)); };
+  });
+  register_for_shapes("to_string/concat", [](kwargscpp::DictType dict) -> BenchFn {
+    bytes_processed() = concat_to_string(dict).size();
+    return [dict] { do_not_optimize(concat_to_string(dict)); };
+  });
+  // appending to a buffer reused across calls, as when logging every request
+  register_for_shapes("to_json/reused", [](kwargscpp::DictType dict) -> BenchFn {
+    bytes_processed() = kwargscpp::to_json(dict).size();
+    return [dict, out = std::string()]() mutable {
+      out.clear();
+      kwargscpp::to_json(dict, out);
+      do_not_optimize(out);
+    };
+  });
+  register_for_shapes("to_json/sort_keys", [](kwargscpp::DictType dict) -> BenchFn {
+    kwargscpp::JsonOptions options;
+    options.sort_keys = true;
+    bytes_processed() = kwargscpp::to_json(dict).size();
+    return [dict, options, out = std::string()]() mutable {
+      out.clear();
+      kwargscpp::to_json(dict, out, options);
+      do_not_optimize(out);
+    };
+  });
+  register_for_shapes("to_json/ostream", [](kwargscpp::DictType dict) -> BenchFn {
+    bytes_processed() = kwargscpp::to_json(dict).size();
+    auto os = std::make_shared<std::ostringstream>();
+    return [dict, os] {
+      os->seekp(0);
+      kwargscpp::to_json(dict, *os);
+      do_not_optimize(*os);
+    };
+  });
+  register_for_shapes("serialize", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] {
+      std::string out;
+      kwargscpp::serialize(dict, out);
+      do_not_optimize(out);
+    };
+  });
+  register_for_shapes("deserialize", [](kwargscpp::DictType dict) -> BenchFn {
+    std::string data = kwargscpp::serialize(dict);
+    return [data] { do_not_optimize(kwargscpp::deserialize_dict(data)); };
+  });
+  register_for_shapes("to_flat", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] {
+      std::string out;
+      kwargscpp::to_flat(dict, out);
+      do_not_optimize(out);
+    };
+  });
+  register_for_shapes("flat/get_or_die/hit", [](kwargscpp::DictType dict) -> BenchFn {
+    kwargscpp::FlatFile file = kwargscpp::FlatFile::from_bytes(kwargscpp::to_flat(dict));
+    return [file] { do_not_optimize(file.root().get_or_die<intmax_t>("key_4")); };
+  });
+  register_for_shapes("flat/get/miss", [](kwargscpp::DictType dict) -> BenchFn {
+    kwargscpp::FlatFile file = kwargscpp::FlatFile::from_bytes(kwargscpp::to_flat(dict));
+    return [file] { do_not_optimize(file.root().get<int>("missing_key", -1)); };
+  });
+  register_for_shapes("freeze", [](kwargscpp::DictType dict) -> BenchFn {
+    return [dict] { do_not_optimize(kwargscpp::freeze(dict)); };
+  });
+  register_for_shapes("frozen/get_or_die/hit", [](kwargscpp::DictType dict) -> BenchFn {
+    kwargscpp::FrozenDict frozen = kwargscpp::freeze(dict);
+    return [frozen] { do_not_optimize(frozen.get_or_die<intmax_t>("key_4")); };
+  });
+  register_for_shapes("frozen/get_or_die/hit_key", [](kwargscpp::DictType dict) -> BenchFn {
+    kwargscpp::FrozenDict frozen = kwargscpp::freeze(dict);
+    return [frozen] {
+      using namespace kwargscpp::literals;
+      do_not_optimize(frozen.get_or_die<intmax_t>("key_4"_kw));
+    };
+  });
+  register_for_shapes("frozen/get/miss", [](kwargscpp::DictType dict) -> BenchFn {
+    kwargscpp::FrozenDict frozen = kwargscpp::freeze(dict);
+    return [frozen] { do_not_optimize(frozen.get<int>("missing_key", -1)); };
+  });
+  register_for_shapes("from_json", [](kwargscpp::DictType dict) -> BenchFn {
+    std::string text = kwargscpp::to_json(dict);
+    bytes_processed() = text.size();
+    return [text] { do_not_optimize(kwargscpp::from_json_dict(text)); };
+  });
+  // a copy with one leaf changed, the shared rest is skipped
+  register_for_shapes("diff/one_leaf", [](kwargscpp::DictType dict) -> BenchFn {
+    kwargscpp::DictType changed = dict;
+    kwargscpp::set(changed, "key_4", static_cast<intmax_t>(-1));
+    return [dict, changed] { do_not_optimize(kwargscpp::diff(dict, changed)); };
+  });
+  register_for_shapes("apply_patch/one_leaf", [](kwargscpp::DictType dict) -> BenchFn {
+    kwargscpp::Patch patch{{kwargscpp::PatchOp::Kind::replace, {kwargscpp::PatchStep("key_4")}, intmax_t(-1)}};
+    return [dict, patch]() mutable {
+      kwargscpp::apply_patch(dict, patch);
+      do_not_optimize(dict);
+    };
+  });
+  register_for_shapes("copy", [](kwargscpp::DictType dict) -> BenchFn {
+    kwargscpp::ValueType value(dict);
+    return [value] {
+      kwargscpp::ValueType copy(value);
+      do_not_optimize(copy);
+    };
+  });
+  return 0;
+}();
+
+// Reaching a leaf four levels down the nested dict
+KWARGSCPP_BENCHMARK("get_or_die/chain/nested", [] {
+  kwargscpp::DictType dict = make_nested_dict();
+  return BenchFn([dict] {
+    auto level1 = kwargscpp::get_or_die<kwargscpp::DictType>(dict, "child");
+    auto level2 = kwargscpp::get_or_die<kwargscpp::DictType>(level1, "child");
+    auto level3 = kwargscpp::get_or_die<kwargscpp::DictType>(level2, "child");
+    do_not_optimize(kwargscpp::get_or_die<intmax_t>(level3, "key_4"));
+  });
+});
+KWARGSCPP_BENCHMARK("get_path/nested", [] {
+  kwargscpp::DictType dict = make_nested_dict();
+  return BenchFn([dict] { do_not_optimize(kwargscpp::get_path<intmax_t>(dict, "child.child.child.key_4")); });
+});
+KWARGSCPP_BENCHMARK("get_path/parsed/nested", [] {
+  kwargscpp::DictType dict = make_nested_dict();
+  kwargscpp::Path path("child.child.child.key_4");
+  return BenchFn([dict, path] { do_not_optimize(kwargscpp::get_path<intmax_t>(dict, path)); });
+});
+
+}  // namespace
+}  // namespace kwargscpp_bench
@@ -0,0 +1,140 @@
+"""Time kwargs round-trips through the pybind11 and nanobind casters.
+
+Imports the test modules built under tests/ (bind_pybind11, bind_nanobind) from PYTHONPATH,
+skips whichever is missing, and writes the results as JSON in the same layout as kwargscpp_bench.
+"""
+import argparse
+import importlib
+import json
+import sys
+import time
+import timeit
+
+
+def make_flat_dict(num_keys=16):
+    out = {}
+    for i in range(num_keys):
+        key = "key_%d" % i
+        kind = i % 4
+        if kind == 0:
+            out[key] = i
+        elif kind == 1:
+            out[key] = 0.5 * i
+        elif kind == 2:
+            out[key] = i % 3 == 0
+        else:
+            out[key] = "value_%d" % i
+    return out
+
+
+def make_wide_dict(num_keys=1024):
+    return make_flat_dict(num_keys)
+
+
+def make_nested_dict(depth=8, keys_per_level=8):
+    out = make_flat_dict(keys_per_level)
+    for _ in range(1, depth):
+        parent = make_flat_dict(keys_per_level)
+        parent["list"] = [1, 2.5, "three", True]
+        parent["child"] = out
+        out = parent
+    return out
+
+
+def make_large_dict(num_records=256):
+    # a per-call payload of records, each a small nested dict with lists, about 40k values in all
+    out = {}
+    for i in range(num_records):
+        record = make_flat_dict(16)
+        record["values"] = [0.25 * j for j in range(64)]
+        record["tags"] = ["tag_%d" % j for j in range(16)]
+        record["child"] = make_nested_dict(depth=4, keys_per_level=8)
+        out["record_%d" % i] = record
+    return out
+
+
+SHAPES = {
+    "flat": make_flat_dict,
+    "wide": make_wide_dict,
+    "nested": make_nested_dict,
+    "large": make_large_dict,
+}
+
+
+def measure(fn, min_time, repetitions):
+    timer = timeit.Timer(fn)
+    iterations, elapsed = timer.autorange()
+    iterations = max(1, int(iterations * min_time / max(elapsed, 1e-9)))
+    runs = sorted(t / iterations * 1e9 for t in timer.repeat(repeat=repetitions, number=iterations))
+    return iterations, runs[len(runs) // 2], runs[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--filter", default="", help="only run benchmarks whose name contains this")
+    parser.add_argument("--min-time", type=float, default=0.1, help="seconds per repetition")
+    parser.add_argument("--repetitions", type=int, default=5)
+    parser.add_argument("--out", default="", help="write JSON here instead of stdout")
+    args = parser.parse_args()
+
+    cases = []
+    for module_name in ("bind_pybind11", "bind_nanobind"):
+        try:
+            module = importlib.import_module(module_name)
+        except ImportError as e:
+            print("skipping %s: %s" % (module_name, e), file=sys.stderr)
+            continue
+        cases.append(("%s/generate_dict" % module_name, module.generate_dict, 0))
+        for shape, make in SHAPES.items():
+            payload = make()
+            text = json.dumps(payload)
+            cases.append(("%s/echo_dict/%s" % (module_name, shape), lambda m=module, p=payload: m.echo_dict(p), 0))
+            # JSON text to a Python dict, parsing natively vs. json.loads followed by the caster
+            cases.append(("%s/load_json/%s" % (module_name, shape), lambda m=module, t=text: m.load_json(t),
+                          len(text)))
+            cases.append(("%s/json.loads+echo_dict/%s" % (module_name, shape),
+                          lambda m=module, t=text: m.echo_dict(json.loads(t)), len(text)))
+
+    results = []
+    for name, fn, num_bytes in cases:
+        if args.filter and args.filter not in name:
+            continue
+        iterations, median, fastest = measure(fn, args.min_time, args.repetitions)
+        throughput = num_bytes / median * 1e3 if num_bytes else 0.0
+        print("%-48s %12.1f ns %14d iterations%s" % (name, median, iterations,
+                                                     " %9.1f MB/s" % throughput if throughput else ""),
+              file=sys.stderr)
+        result = {
+            "name": name,
+            "run_type": "aggregate",
+            "aggregate_name": "median",
+            "iterations": iterations,
+            "real_time": median,
+            "cpu_time": median,
+            "min_time": fastest,
+            "time_unit": "ns",
+        }
+        if throughput:
+            result["bytes_per_second"] = throughput * 1e6
+        results.append(result)
+
+    report = {
+        "context": {
+            "executable": "bench_python.py",
+            "python": sys.version.split()[0],
+            "date": int(time.time()),
+            "repetitions": args.repetitions,
+            "min_time": args.min_time,
+        },
+        "benchmarks": results,
+    }
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump(report, f, indent=2)
+    else:
+        json.dump(report, sys.stdout, indent=2)
+        print()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,113 @@
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "fixtures.h"
+#include "kwargscpp/kwargs.h"
+#include "kwargscpp/registry.h"
+
+namespace kwargscpp_bench {
+namespace {
+
+// Reads per thread per iteration
+constexpr int kReads = 1000;
+
+// Runs `work(thread_index)` on `threads` threads at once each iteration, the calling thread being one of them, so an
+// iteration lasts as long as its slowest thread: a time that stays flat as threads are added means reads scale.
+class ThreadTeam {
+ public:
+  ThreadTeam(int threads, std::function<void(int)> work) : work_(std::move(work)) {
+    for (int i = 1; i < threads; ++i) workers_.emplace_back([this, i] { loop(i); });
+  }
+
+  ~ThreadTeam() {
+    stop_ = true;
+    for (std::thread& worker : workers_) worker.join();
+  }
+
+  void run() {
+    pending_.store(static_cast<int>(workers_.size()), std::memory_order_relaxed);
+    round_.fetch_add(1, std::memory_order_release);
+    work_(0);
+    while (pending_.load(std::memory_order_acquire)) std::this_thread::yield();
+  }
+
+ private:
+  void loop(int index) {
+    uint64_t seen = 0;
+    for (;;) {
+      uint64_t round;
+      while ((round = round_.load(std::memory_order_acquire)) == seen) {
+        if (stop_) return;
+        std::this_thread::yield();
+      }
+      seen = round;
+      work_(index);
+      pending_.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  std::function<void(int)> work_;
+  std::vector<std::thread> workers_;
+  std::atomic<uint64_t> round_{0};
+  std::atomic<int> pending_{0};
+  std::atomic<bool> stop_{false};
+};
+
+// Register one benchmark per thread count, named "<op>/threads:<n>"; `make_work` returns the per-thread read loop
+template <typename MakeWork>
+int register_for_threads(const std::string& op, MakeWork make_work) {
+  for (int threads : {1, 2, 4, 8}) {
+    registry().push_back({op + "/threads:" + std::to_string(threads), [threads, make_work] {
+                            auto team = std::make_shared<ThreadTeam>(threads, make_work(threads));
+                            return BenchFn([team] { team->run(); });
+                          }});
+  }
+  return 0;
+}
+
+const int registered = [] {
+  // a snapshot per read, one atomic shared_ptr load and reference count round trip
+  register_for_threads("registry/snapshot", [](int) -> std::function<void(int)> {
+    auto config = std::make_shared<kwargscpp::ConfigRegistry>(make_flat_dict());
+    return [config](int) {
+      for (int i = 0; i < kReads; ++i) {
+        kwargscpp::ConfigRegistry::Snapshot snapshot = config->snapshot();
+        do_not_optimize(kwargscpp::get_or_die<intmax_t>(*snapshot, "key_4"));
+      }
+    };
+  });
+  // a ConfigReader per thread, one atomic load of the version number per read
+  register_for_threads("registry/reader", [](int threads) -> std::function<void(int)> {
+    auto config = std::make_shared<kwargscpp::ConfigRegistry>(make_flat_dict());
+    auto readers = std::make_shared<std::vector<kwargscpp::ConfigReader>>(threads, kwargscpp::ConfigReader(*config));
+    return [config, readers](int index) {
+      kwargscpp::ConfigReader& reader = (*readers)[index];
+      for (int i = 0; i < kReads; ++i) do_not_optimize(kwargscpp::get_or_die<intmax_t>(reader.get(), "key_4"));
+    };
+  });
+  // the baseline: one dict behind a mutex
+  register_for_threads("registry/mutex", [](int) -> std::function<void(int)> {
+    struct Locked {
+      std::mutex mutex;
+      kwargscpp::DictType dict = make_flat_dict();
+    };
+    auto locked = std::make_shared<Locked>();
+    return [locked](int) {
+      for (int i = 0; i < kReads; ++i) {
+        std::lock_guard<std::mutex> lock(locked->mutex);
+        do_not_optimize(kwargscpp::get_or_die<intmax_t>(locked->dict, "key_4"));
+      }
+    };
+  });
+  return 0;
+}();
+
+}  // namespace
+}  // namespace kwargscpp_bench
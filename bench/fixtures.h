@@ -0,0 +1,66 @@
+#ifndef KWARGS_BENCH_FIXTURES_H
+#define KWARGS_BENCH_FIXTURES_H
+
+#include <string>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+
+namespace kwargscpp_bench {
+
+// A typical kwargs dict: a handful of scalar options of every type
+inline kwargscpp::DictType make_flat_dict(size_t num_keys = 16) {
+  kwargscpp::DictType dict;
+  for (size_t i = 0; i < num_keys; ++i) {
+    std::string key = "key_" + std::to_string(i);
+    switch (i % 4) {
+      case 0:
+        kwargscpp::set(dict, key, static_cast<intmax_t>(i));
+        break;
+      case 1:
+        kwargscpp::set(dict, key, 0.5 * static_cast<double>(i));
+        break;
+      case 2:
+        kwargscpp::set(dict, key, i % 3 == 0);
+        break;
+      default:
+        kwargscpp::set(dict, key, "value_" + std::to_string(i));
+        break;
+    }
+  }
+  return dict;
+}
+
+// A large flat table, e.g. per-class options
+inline kwargscpp::DictType make_wide_dict(size_t num_keys = 1024) { return make_flat_dict(num_keys); }
+
+// A deep config tree: every level holds a few scalars, a short list and the next level under "child"
+inline kwargscpp::DictType make_nested_dict(size_t depth = 8, size_t keys_per_level = 8) {
+  kwargscpp::DictType dict = make_flat_dict(keys_per_level);
+  for (size_t level = 1; level < depth; ++level) {
+    kwargscpp::DictType parent = make_flat_dict(keys_per_level);
+    std::vector<kwargscpp::ValueType> list = {1, 2.5, "three", true};
+    kwargscpp::set(parent, "list", std::move(list));
+    kwargscpp::set(parent, "child", std::move(dict));
+    dict = std::move(parent);
+  }
+  return dict;
+}
+
+struct Shape {
+  const char* name;
+  kwargscpp::DictType (*make)();
+};
+
+inline const std::vector<Shape>& shapes() {
+  static const std::vector<Shape> all = {
+      {"flat", [] { return make_flat_dict(); }},
+      {"wide", [] { return make_wide_dict(); }},
+      {"nested", [] { return make_nested_dict(); }},
+  };
+  return all;
+}
+
+}  // namespace kwargscpp_bench
+
+#endif  // KWARGS_BENCH_FIXTURES_H
@@ -0,0 +1,67 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+
+namespace {
+
+void print_usage(const char* argv0) {
+  std::fprintf(stderr,
+               "Usage: %s [--filter=<substring>] [--min-time=<seconds>] [--repetitions=<n>] [--out=<file.json>]\n"
+               "Runs the kwargscpp benchmarks and writes the results as JSON (to stdout unless --out is given).\n",
+               argv0);
+}
+
+bool parse_flag(const char* arg, const char* name, std::string* value) {
+  size_t len = std::strlen(name);
+  if (std::strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+  *value = arg + len + 1;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  kwargscpp_bench::Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string value;
+    if (parse_flag(argv[i], "--filter", &value)) {
+      options.filter = value;
+    } else if (parse_flag(argv[i], "--min-time", &value)) {
+      options.min_time = std::atof(value.c_str());
+    } else if (parse_flag(argv[i], "--repetitions", &value)) {
+      options.repetitions = std::atoi(value.c_str());
+    } else if (parse_flag(argv[i], "--out", &value)) {
+      options.out_path = value;
+    } else {
+      print_usage(argv[0]);
+      return std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
+    }
+  }
+
+  std::vector<kwargscpp_bench::Result> results;
+  for (const auto& bench : kwargscpp_bench::registry()) {
+    if (!options.filter.empty() && bench.name.find(options.filter) == std::string::npos) continue;
+    results.push_back(kwargscpp_bench::run_benchmark(bench, options));
+    const auto& r = results.back();
+    std::fprintf(stderr, "%-40s %12.1f ns %14llu iterations", r.name.c_str(), r.real_time,
+                 static_cast<unsigned long long>(r.iterations));
+    if (r.bytes_per_second > 0) std::fprintf(stderr, " %10.1f MB/s", r.bytes_per_second / 1e6);
+    std::fprintf(stderr, "\n");
+  }
+
+  std::FILE* out = stdout;
+  if (!options.out_path.empty()) {
+    out = std::fopen(options.out_path.c_str(), "w");
+    if (!out) {
+      std::fprintf(stderr, "Cannot open %s for writing\n", options.out_path.c_str());
+      return 1;
+    }
+  }
+  kwargscpp_bench::write_json(out, results, options);
+  if (out != stdout) std::fclose(out);
+  return 0;
+}
@@ -0,0 +1,185 @@
+#ifndef KWARGS_ARRAY_H
+#define KWARGS_ARRAY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "kwargscpp/cow.h"
+
+namespace kwargscpp {
+
+// Element type of an Array
+enum class DType : uint8_t { float64, float32, int64, uint8 };
+
+constexpr size_t dtype_size(DType dtype) noexcept {
+  switch (dtype) {
+    case DType::float64:
+    case DType::int64:
+      return 8;
+    case DType::float32:
+      return 4;
+    default:
+      return 1;
+  }
+}
+
+// The DType of a C++ element type
+template <typename T>
+struct dtype_of;
+template <>
+struct dtype_of<double> : std::integral_constant<DType, DType::float64> {};
+template <>
+struct dtype_of<float> : std::integral_constant<DType, DType::float32> {};
+template <>
+struct dtype_of<int64_t> : std::integral_constant<DType, DType::int64> {};
+template <>
+struct dtype_of<uint8_t> : std::integral_constant<DType, DType::uint8> {};
+template <typename T>
+constexpr DType dtype_of_v = dtype_of<T>::value;
+
+namespace detail {
+
+// The dtype, shape and buffer of an Array, held out of line so that an Array is one pointer wide
+struct ArrayState {
+  DType dtype = DType::float64;
+  std::vector<size_t> shape{0};
+  std::shared_ptr<const void> owner;
+  void *data = nullptr;
+  // whether the buffer was allocated by an Array, and so may be written once it is not shared
+  bool owned = false;
+};
+
+}  // namespace detail
+
+// Contiguous, row-major numeric buffer with a shape, for embeddings, weights and the like that would cost a full
+// ValueType per element as a list. Copies share the buffer, which is only cloned by the mutable accessors while
+// shared. The buffer may also be owned by something else, e.g. a mapped file, through the `owner` constructor.
+class Array {
+ public:
+  // an empty 1-D float64 array
+  Array() noexcept = default;
+  // a zero-filled array
+  Array(DType dtype, std::vector<size_t> shape) : state_(make_state(dtype, std::move(shape))) {
+    allocate(*state_);
+    if (nbytes()) std::memset(state_->data, 0, nbytes());
+  }
+  // a copy of `size()` elements at `data`
+  Array(DType dtype, std::vector<size_t> shape, const void *data) : state_(make_state(dtype, std::move(shape))) {
+    allocate(*state_);
+    if (nbytes()) std::memcpy(state_->data, data, nbytes());
+  }
+  // elements at `data` kept alive by `owner`, without copying them
+  Array(DType dtype, std::vector<size_t> shape, std::shared_ptr<const void> owner, const void *data)
+      : state_(make_state(dtype, std::move(shape))) {
+    state_->owner = std::move(owner);
+    state_->data = const_cast<void *>(data);
+  }
+  // a 1-D copy of `values`
+  template <typename T>
+  explicit Array(const std::vector<T> &values) : Array(dtype_of_v<T>, {values.size()}, values.data()) {}
+
+  DType dtype() const noexcept { return state().dtype; }
+  const std::vector<size_t> &shape() const noexcept { return state().shape; }
+  size_t ndim() const noexcept { return shape().size(); }
+  // number of elements
+  size_t size() const noexcept { return count(state()); }
+  size_t itemsize() const noexcept { return dtype_size(dtype()); }
+  size_t nbytes() const noexcept { return size() * itemsize(); }
+
+  const void *data() const noexcept { return state().data; }
+  // writable data, cloned first if other copies share the buffer or it is owned elsewhere
+  void *mutable_data() {
+    if (!state_.unique()) {
+      const Array source = *this;
+      state_ = make_state(source.dtype(), source.shape());
+      allocate(*state_);
+      if (nbytes()) std::memcpy(state_->data, source.data(), nbytes());
+    } else if (!state_->owned || state_->owner.use_count() > 1) {
+      const void *source = state_->data;
+      std::shared_ptr<const void> keep = std::move(state_->owner);
+      allocate(*state_);
+      if (nbytes()) std::memcpy(state_->data, source, nbytes());
+    } else {
+      // written in place: owner.use_count() is a relaxed load, so order the write after the other owners let go
+      std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return state_->data;
+  }
+
+  // typed access, throwing std::bad_variant_access if T does not match dtype()
+  template <typename T>
+  const T *data_as() const {
+    if (dtype() != dtype_of_v<T>) throw std::bad_variant_access();
+    return static_cast<const T *>(data());
+  }
+  template <typename T>
+  T *mutable_data_as() {
+    if (dtype() != dtype_of_v<T>) throw std::bad_variant_access();
+    return static_cast<T *>(mutable_data());
+  }
+
+  // call f with the data as a typed pointer, e.g. visit([&](const auto *data) { ... })
+  template <typename F>
+  decltype(auto) visit(F &&f) const {
+    switch (dtype()) {
+      case DType::float32:
+        return std::invoke(std::forward<F>(f), static_cast<const float *>(data()));
+      case DType::int64:
+        return std::invoke(std::forward<F>(f), static_cast<const int64_t *>(data()));
+      case DType::uint8:
+        return std::invoke(std::forward<F>(f), static_cast<const uint8_t *>(data()));
+      default:
+        return std::invoke(std::forward<F>(f), static_cast<const double *>(data()));
+    }
+  }
+
+  // Equal if dtype, shape and elements are
+  friend bool operator==(const Array &lhs, const Array &rhs) {
+    return lhs.dtype() == rhs.dtype() && lhs.shape() == rhs.shape() &&
+           (lhs.data() == rhs.data() || lhs.nbytes() == 0 || std::memcmp(lhs.data(), rhs.data(), lhs.nbytes()) == 0);
+  }
+  friend bool operator!=(const Array &lhs, const Array &rhs) { return !(lhs == rhs); }
+
+ private:
+  static detail::RefPtr<detail::ArrayState> make_state(DType dtype, std::vector<size_t> shape) {
+    auto state = detail::RefPtr<detail::ArrayState>::make();
+    state->dtype = dtype;
+    state->shape = std::move(shape);
+    return state;
+  }
+
+  static void allocate(detail::ArrayState &state) {
+    const size_t nbytes = count(state) * dtype_size(state.dtype);
+    std::shared_ptr<std::byte[]> buffer(new std::byte[nbytes ? nbytes : 1]);
+    state.data = buffer.get();
+    state.owner = std::move(buffer);
+    state.owned = true;
+  }
+
+  static size_t count(const detail::ArrayState &state) noexcept {
+    size_t count = 1;
+    for (size_t dim : state.shape) count *= dim;
+    return count;
+  }
+
+  // a default constructed or moved-from Array reads as an empty 1-D float64 array
+  const detail::ArrayState &state() const noexcept {
+    static const detail::ArrayState empty{};
+    return state_ ? *state_ : empty;
+  }
+
+  // shared by copies, and replaced rather than written while shared
+  detail::RefPtr<detail::ArrayState> state_;
+};
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_ARRAY_H
@@ -0,0 +1,116 @@
+#ifndef KWARGS_COW_H
+#define KWARGS_COW_H
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace kwargscpp {
+
+namespace detail {
+
+// A T allocated together with its reference count, for RefPtr
+template <typename T>
+struct RefCounted {
+  template <typename... Args>
+  explicit RefCounted(Args &&...args) : value(std::forward<Args>(args)...) {}
+
+  std::atomic<size_t> refs{1};
+  T value;
+};
+
+// Owning pointer to a reference-counted T shared by its copies, like std::shared_ptr but one pointer wide, so Cow and
+// Array fit in a word of ValueType. The count is dropped with release order and unique() reads it with acquire order,
+// so once unique() is true, everything done through the other copies happens before a write through this one.
+template <typename T>
+class RefPtr {
+ public:
+  RefPtr() noexcept = default;
+  RefPtr(const RefPtr &other) noexcept : node_(other.node_) {
+    if (node_) node_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  RefPtr(RefPtr &&other) noexcept : node_(std::exchange(other.node_, nullptr)) {}
+  RefPtr &operator=(RefPtr other) noexcept {
+    std::swap(node_, other.node_);
+    return *this;
+  }
+  ~RefPtr() {
+    if (node_ && node_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete node_;
+  }
+
+  template <typename... Args>
+  static RefPtr make(Args &&...args) {
+    RefPtr ptr;
+    ptr.node_ = new RefCounted<T>(std::forward<Args>(args)...);
+    return ptr;
+  }
+
+  T *get() const noexcept { return node_ ? &node_->value : nullptr; }
+  T &operator*() const noexcept { return node_->value; }
+  T *operator->() const noexcept { return &node_->value; }
+  explicit operator bool() const noexcept { return node_ != nullptr; }
+
+  // whether this is the only pointer to a payload
+  bool unique() const noexcept { return node_ && node_->refs.load(std::memory_order_acquire) == 1; }
+
+  friend bool operator==(const RefPtr &lhs, const RefPtr &rhs) noexcept { return lhs.node_ == rhs.node_; }
+  friend bool operator!=(const RefPtr &lhs, const RefPtr &rhs) noexcept { return lhs.node_ != rhs.node_; }
+
+ private:
+  RefCounted<T> *node_ = nullptr;
+};
+
+}  // namespace detail
+
+// Copy-on-write holder of a list or dict payload in ValueType. Copies share one reference-counted payload, so copying
+// a ValueType is O(1) however large its subtree is, and the payload is only cloned by mutate() while other copies
+// still refer to it. A default constructed or moved-from Cow reads as an empty T.
+//
+// Like std::shared_ptr, distinct Cow objects sharing a payload may be used from different threads, but the same Cow
+// object must not be written while it is read. mutate() tests for other copies with an acquire load of the count,
+// which pairs with the release decrement of the last other copy, so reads made through that copy on another thread
+// happen before the write in place. shared() loads the count the same way, so a caller acting on `false` may write
+// through mutate() too.
+template <typename T>
+class Cow {
+ public:
+  Cow() noexcept = default;
+  // a template taking only T, so checking whether a Cow converts from something else does not instantiate T, which is
+  // still incomplete where ValueType is defined
+  template <typename U, std::enable_if_t<std::is_same_v<std::decay_t<U>, T>, bool> = true>
+  explicit Cow(U &&value) : ptr_(detail::RefPtr<T>::make(std::forward<U>(value))) {}
+
+  const T &get() const noexcept { return ptr_ ? *ptr_ : empty(); }
+  operator const T &() const noexcept { return get(); }
+  const T &operator*() const noexcept { return get(); }
+  const T *operator->() const noexcept { return &get(); }
+
+  // The payload for writing, cloned first if other copies share it
+  T &mutate() {
+    if (!ptr_) {
+      ptr_ = detail::RefPtr<T>::make();
+    } else if (!ptr_.unique()) {
+      ptr_ = detail::RefPtr<T>::make(*ptr_);
+    }
+    return *ptr_;
+  }
+
+  // whether other copies share the payload
+  bool shared() const noexcept { return ptr_ && !ptr_.unique(); }
+
+  friend bool operator==(const Cow &lhs, const Cow &rhs) { return lhs.ptr_ == rhs.ptr_ || lhs.get() == rhs.get(); }
+  friend bool operator!=(const Cow &lhs, const Cow &rhs) { return !(lhs == rhs); }
+
+ private:
+  static const T &empty() {
+    static const T value{};
+    return value;
+  }
+
+  detail::RefPtr<T> ptr_;
+};
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_COW_H
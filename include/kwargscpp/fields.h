@@ -0,0 +1,319 @@
+#ifndef KWARGS_FIELDS_H
+#define KWARGS_FIELDS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+
+// Binding of a DictType into a plain struct and back, declared once per struct instead of a get<T>() per field:
+//
+//   struct TrainOpts {
+//     double lr = 0.001;
+//     int epochs = 10;
+//     std::string name;
+//     std::vector<LayerOpts> layers;
+//   };
+//   KWARGSCPP_FIELDS(TrainOpts, lr, epochs, name, layers)
+//
+//   TrainOpts opts = kwargscpp::from_kwargs<TrainOpts>(dict);
+//
+// from_kwargs walks the dict once, finding each key's field in a hash table built at compile time from the field
+// names (or, for a dict much larger than the struct, looks each field up by its precomputed hash), and converts the
+// value like get_or_die. Keys the dict lacks keep the struct's default member initializers,
+// and keys the struct lacks are ignored. A field can be anything get_or_die returns, another bound struct (from a
+// dict), a std::vector of any of these (from a list, or a 1-D Array for arithmetic elements) or a std::optional.
+namespace kwargscpp {
+
+// A field of a bound struct: its key and member pointer
+template <typename Struct, typename Member>
+struct Field {
+  Key key;
+  Member Struct::*member;
+};
+
+template <typename Struct, typename Member>
+constexpr Field<Struct, Member> field(std::string_view name, Member Struct::*member) noexcept {
+  return {Key(name), member};
+}
+
+// Whether T was bound with KWARGSCPP_FIELDS
+template <typename T, typename = void>
+struct is_bound : std::false_type {};
+template <typename T>
+struct is_bound<T, std::void_t<decltype(kwargs_fields(static_cast<const T *>(nullptr)))>> : std::true_type {};
+template <typename T>
+constexpr bool is_bound_v = is_bound<T>::value;
+
+// a T from its default member initializers and the keys of `dict`, throwing like get_or_die if one does not convert
+template <typename T>
+T from_kwargs(const DictType &dict);
+// overwrite the fields of `out` whose keys `dict` has
+template <typename T>
+void from_kwargs(const DictType &dict, T &out);
+
+// a dict with a key per field, leaving out empty std::optional fields
+template <typename T>
+DictType to_kwargs(const T &value);
+
+namespace detail {
+
+template <typename T>
+struct is_vector : std::false_type {};
+template <typename T, typename A>
+struct is_vector<std::vector<T, A>> : std::true_type {};
+
+template <typename T>
+struct is_optional : std::false_type {};
+template <typename T>
+struct is_optional<std::optional<T>> : std::true_type {};
+
+// The fields of a bound struct with their open-addressing key table, a power of two at least twice their number of
+// slots, each the index of a field plus one, or 0 if empty
+template <typename T>
+struct FieldTable {
+  static constexpr auto fields = kwargs_fields(static_cast<const T *>(nullptr));
+  static constexpr size_t size = std::tuple_size_v<std::remove_const_t<decltype(fields)>>;
+  static_assert(size < 256, "KWARGSCPP_FIELDS supports up to 255 fields");
+
+  static constexpr size_t slot_count() {
+    size_t slots = 1;
+    while (slots < 2 * size) slots *= 2;
+    return slots;
+  }
+  static constexpr size_t mask = slot_count() - 1;
+
+  template <size_t... I>
+  static constexpr std::array<Key, size> make_keys(std::index_sequence<I...>) {
+    return {std::get<I>(fields).key...};
+  }
+  static constexpr std::array<Key, size> keys = make_keys(std::make_index_sequence<size>());
+
+  static constexpr std::array<uint8_t, slot_count()> make_slots() {
+    std::array<uint8_t, slot_count()> slots{};
+    for (size_t i = 0; i < size; ++i) {
+      size_t slot = keys[i].hash & mask;
+      while (slots[slot]) slot = (slot + 1) & mask;
+      slots[slot] = static_cast<uint8_t>(i + 1);
+    }
+    return slots;
+  }
+  static constexpr std::array<uint8_t, slot_count()> slots = make_slots();
+
+  // the index of the field named `name`, or `size` if there is none
+  static size_t find(std::string_view name) noexcept {
+    const size_t hash = hash_key(name);
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+      const size_t index = slots[slot];
+      if (!index) return size;
+      if (keys[index - 1].hash == hash && keys[index - 1].name == name) return index - 1;
+    }
+  }
+};
+
+template <typename M>
+void read_field(const ValueType &value, M &out);
+
+template <typename M>
+void read_elements(const ValueType &value, std::vector<M> &out) {
+  if (const ListType *list = stored<ListType>(value)) {
+    out.resize(list->size());
+    for (size_t i = 0; i < list->size(); ++i) read_field((*list)[i], out[i]);
+    return;
+  }
+  if constexpr (std::is_arithmetic_v<M>) {
+    if (const Array *array = stored<Array>(value)) {
+      if (array->ndim() != 1) throw_error(ErrorCode::wrong_type);
+      array->visit([&](const auto *data) {
+        out.resize(array->size());
+        for (size_t i = 0; i < out.size(); ++i) out[i] = static_cast<M>(data[i]);
+      });
+      return;
+    }
+  }
+  throw_error(ErrorCode::wrong_type);
+}
+
+template <typename M>
+void read_field(const ValueType &value, M &out) {
+  if constexpr (is_bound_v<M>) {
+    const DictType *dict = stored<DictType>(value);
+    if (!dict) throw_error(ErrorCode::wrong_type);
+    from_kwargs(*dict, out);
+  } else if constexpr (is_optional<M>::value) {
+    if (!out) out.emplace();
+    read_field(value, *out);
+  } else if constexpr (is_vector<M>::value && !std::is_same_v<M, ListType>) {
+    read_elements(value, out);
+  } else {
+    Result<M> result = convert<M>(value);
+    if (!result) throw_error(result.error());
+    out = std::move(*result);
+  }
+}
+
+template <typename M>
+ValueType write_field(const M &value) {
+  if constexpr (is_bound_v<M>) {
+    return to_kwargs(value);
+  } else if constexpr (is_vector<M>::value && !std::is_same_v<M, ListType>) {
+    ListType list;
+    list.reserve(value.size());
+    for (const auto &element : value) list.push_back(write_field(element));
+    return list;
+  } else if constexpr (std::is_floating_point_v<M>) {
+    return static_cast<double>(value);
+  } else {
+    static_assert(std::is_constructible_v<ValueType, const M &>, "field type has no ValueType representation");
+    return ValueType(value);
+  }
+}
+
+template <typename T, size_t I>
+void read_field_at(const ValueType &value, T &out) {
+  read_field(value, out.*std::get<I>(FieldTable<T>::fields).member);
+}
+
+// one reader per field, indexed like the key table
+template <typename T, size_t... I>
+constexpr std::array<void (*)(const ValueType &, T &), sizeof...(I)> field_readers(std::index_sequence<I...>) {
+  return {&read_field_at<T, I>...};
+}
+
+template <typename T, typename Member>
+void write_member(DictType &dict, const Field<T, Member> &field, const T &value) {
+  const Member &member = value.*field.member;
+  if constexpr (is_optional<Member>::value) {
+    if (member) dict.emplace(KeyType(field.key.name), write_field(*member));
+  } else {
+    dict.emplace(KeyType(field.key.name), write_field(member));
+  }
+}
+
+}  // namespace detail
+
+template <typename T>
+T from_kwargs(const DictType &dict) {
+  T out{};
+  from_kwargs(dict, out);
+  return out;
+}
+
+template <typename T>
+void from_kwargs(const DictType &dict, T &out) {
+  static_assert(is_bound_v<T>, "T needs KWARGSCPP_FIELDS");
+  using Table = detail::FieldTable<T>;
+  static constexpr auto readers = detail::field_readers<T>(std::make_index_sequence<Table::size>());
+  // a dict much larger than the struct, e.g. shared by several components, is cheaper to probe once per field
+  if (dict.size() > 4 * Table::size) {
+    for (size_t i = 0; i < Table::size; ++i) {
+      auto it = detail::find_key(dict, Table::keys[i]);
+      if (it != dict.end()) readers[i](it->second, out);
+    }
+    return;
+  }
+  for (const auto &item : dict) {
+    const size_t index = Table::find(item.first);
+    if (index != Table::size) readers[index](item.second, out);
+  }
+}
+
+template <typename T>
+DictType to_kwargs(const T &value) {
+  static_assert(is_bound_v<T>, "T needs KWARGSCPP_FIELDS");
+  DictType dict;
+  dict.reserve(detail::FieldTable<T>::size);
+  std::apply([&](const auto &...fields) { (detail::write_member(dict, fields, value), ...); },
+             detail::FieldTable<T>::fields);
+  return dict;
+}
+
+}  // namespace kwargscpp
+
+// Bind the listed members of `Struct`, at namespace scope in the namespace of `Struct`, so from_kwargs and to_kwargs
+// find it by argument-dependent lookup. Each member's key is its name. Up to 32 members.
+#define KWARGSCPP_FIELDS(Struct, ...)                                                          \
+  [[maybe_unused]] constexpr auto kwargs_fields(const Struct *) {                              \
+    return std::make_tuple(KWARGSCPP_DETAIL_MAP(KWARGSCPP_DETAIL_FIELD, Struct, __VA_ARGS__)); \
+  }
+
+#define KWARGSCPP_DETAIL_FIELD(Struct, name) ::kwargscpp::field(#name, &Struct::name)
+
+// KWARGSCPP_DETAIL_MAP(m, s, a, b, ...) expands to m(s, a), m(s, b), ...
+#define KWARGSCPP_DETAIL_EXPAND(x) x
+#define KWARGSCPP_DETAIL_CAT_(a, b) a##b
+#define KWARGSCPP_DETAIL_CAT(a, b) KWARGSCPP_DETAIL_CAT_(a, b)
+#define KWARGSCPP_DETAIL_COUNT_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, \
+                                _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, N, ...) \
+  N
+#define KWARGSCPP_DETAIL_COUNT(...)                                                                                 \
+  KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_COUNT_(__VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, \
+                                                  19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1))
+#define KWARGSCPP_DETAIL_MAP(m, s, ...) \
+  KWARGSCPP_DETAIL_EXPAND(              \
+      KWARGSCPP_DETAIL_CAT(KWARGSCPP_DETAIL_MAP_, KWARGSCPP_DETAIL_COUNT(__VA_ARGS__))(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_1(m, s, x) m(s, x)
+#define KWARGSCPP_DETAIL_MAP_2(m, s, x, ...) m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_1(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_3(m, s, x, ...) m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_2(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_4(m, s, x, ...) m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_3(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_5(m, s, x, ...) m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_4(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_6(m, s, x, ...) m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_5(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_7(m, s, x, ...) m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_6(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_8(m, s, x, ...) m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_7(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_9(m, s, x, ...) m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_8(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_10(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_9(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_11(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_10(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_12(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_11(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_13(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_12(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_14(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_13(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_15(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_14(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_16(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_15(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_17(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_16(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_18(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_17(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_19(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_18(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_20(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_19(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_21(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_20(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_22(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_21(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_23(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_22(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_24(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_23(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_25(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_24(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_26(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_25(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_27(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_26(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_28(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_27(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_29(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_28(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_30(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_29(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_31(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_30(m, s, __VA_ARGS__))
+#define KWARGSCPP_DETAIL_MAP_32(m, s, x, ...) \
+  m(s, x), KWARGSCPP_DETAIL_EXPAND(KWARGSCPP_DETAIL_MAP_31(m, s, __VA_ARGS__))
+
+#endif  // KWARGS_FIELDS_H
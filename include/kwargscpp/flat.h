@@ -0,0 +1,978 @@
+#ifndef KWARGS_FLAT_H
+#define KWARGS_FLAT_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "kwargscpp/kwargs.h"
+#include "kwargscpp/path.h"
+
+// A flat, offset-based layout of a DictType tree that is queried in place, e.g. straight from a read-only mapping of
+// the file, so processes loading the same large config share one page-cache copy and open it in constant time.
+//
+// Everything is in host byte order, 8-byte aligned, and addressed by its offset from the start of the file:
+//   header  "KWFLAT01", uint64 file size, the root slot
+//   slot    uint64 payload, uint8 type (the ValueType index), 7 bytes padding. The payload is the value itself for
+//           numbers and bools, else the offset of its block
+//   string  uint64 size, the bytes, NUL
+//   list    uint64 count, `count` slots
+//   dict    uint64 count, uint64 buckets, `count` entries {uint64 key hash, uint64 key string offset, slot} in the
+//           dict's iteration order, then `buckets` uint32 (entry index + 1, or 0) forming a linear-probing index
+//   Array   uint64 dtype, uint64 ndim, `ndim` uint64 dims, the elements
+// Lists and dicts shared copy-on-write in the tree, and repeated keys, are written once. Opening a file checks the
+// header and the root in constant time; every other block, key and index entry is bounds-checked as it is reached, so
+// a truncated or corrupt file throws std::invalid_argument instead of reading outside the mapping.
+namespace kwargscpp {
+
+class DictView;
+class ListView;
+
+namespace detail {
+
+// The bytes of a flat file, and whatever keeps them alive
+struct FlatData {
+  const char *base;
+  size_t size;
+  std::shared_ptr<const void> owner;
+};
+
+constexpr char flat_magic[8] = {'K', 'W', 'F', 'L', 'A', 'T', '0', '1'};
+constexpr size_t flat_header_size = 32;
+constexpr size_t flat_slot_size = 16;
+constexpr size_t flat_entry_size = 32;
+
+template <typename T>
+T flat_load(const char *at) noexcept {
+  T value;
+  std::memcpy(&value, at, sizeof value);
+  return value;
+}
+
+[[noreturn]] inline void flat_corrupt() { throw std::invalid_argument("corrupt kwargscpp flat file"); }
+
+// Whether the 8-byte aligned `offset` is followed within the file by `header` bytes and `count` items of `item_size`
+// bytes, without overflowing on the sizes read from the file
+inline bool flat_fits(const FlatData *file, uint64_t offset, uint64_t header, uint64_t count = 0,
+                      uint64_t item_size = 1) noexcept {
+  if (offset % 8 != 0 || offset > file->size || header > file->size - offset) return false;
+  return count <= (file->size - offset - header) / item_size;
+}
+
+inline std::string_view flat_string(const FlatData *file, uint64_t offset) {
+  if (!flat_fits(file, offset, 8)) flat_corrupt();
+  const char *block = file->base + offset;
+  const uint64_t size = flat_load<uint64_t>(block);
+  if (!flat_fits(file, offset, 8, size)) flat_corrupt();
+  return std::string_view(block + 8, static_cast<size_t>(size));
+}
+
+// the list block at `offset`, checked to lie within the file
+inline const char *flat_list(const FlatData *file, uint64_t offset) {
+  if (!flat_fits(file, offset, 8)) flat_corrupt();
+  const char *block = file->base + offset;
+  if (!flat_fits(file, offset, 8, flat_load<uint64_t>(block), flat_slot_size)) flat_corrupt();
+  return block;
+}
+
+// the dict block at `offset`, checked to lie within the file with an index of the shape FlatWriter builds: none for
+// an empty dict, else a power of two number of buckets, more than the entries
+inline const char *flat_dict(const FlatData *file, uint64_t offset) {
+  if (!flat_fits(file, offset, 16)) flat_corrupt();
+  const char *block = file->base + offset;
+  const uint64_t count = flat_load<uint64_t>(block);
+  const uint64_t buckets = flat_load<uint64_t>(block + 8);
+  const bool index = count == 0 ? buckets == 0 : (buckets & (buckets - 1)) == 0 && buckets > count;
+  if (!index || !flat_fits(file, offset, 16, count, flat_entry_size) ||
+      !flat_fits(file, offset + 16 + count * flat_entry_size, 0, buckets, sizeof(uint32_t))) {
+    flat_corrupt();
+  }
+  return block;
+}
+
+}  // namespace detail
+
+// A value in a flat file. Views are cheap to copy and stay valid while the FlatFile they came from, or a copy of it,
+// is alive.
+class ValueView {
+ public:
+  ValueView(const detail::FlatData *file, const char *slot) noexcept : file_(file), slot_(slot) {}
+
+  // the ValueType alternative held
+  size_t index() const noexcept { return static_cast<uint8_t>(slot_[8]); }
+  bool is_int() const noexcept { return index() == 0; }
+  bool is_uint() const noexcept { return index() == 1; }
+  bool is_double() const noexcept { return index() == 2; }
+  bool is_bool() const noexcept { return index() == 3; }
+  bool is_string() const noexcept { return index() == 4; }
+  bool is_vector() const noexcept { return index() == 5; }
+  bool is_dict() const noexcept { return index() == 6; }
+  bool is_array() const noexcept { return index() == 7; }
+
+  // these throw std::bad_variant_access if the value is of another type, like ValueType's, and std::invalid_argument
+  // if its block is not within the file
+  intmax_t as_int() const;
+  uintmax_t as_uint() const;
+  double as_double() const;
+  bool as_bool() const;
+  std::string_view as_string() const;
+  ListView as_vector() const;
+  DictView as_dict() const;
+  // the elements in place, keeping the file mapped for as long as the Array is alive
+  Array as_array() const;
+
+  // the value as T without throwing, with the conversions of try_get for numbers and bools, std::string_view or
+  // std::string for a string, the views above, Array, or a ValueType copied out of the file
+  template <typename T>
+  Result<T> try_as() const;
+
+  // copy the subtree out of the file, a block written once for a shared payload read back as one shared payload
+  ValueType to_value() const;
+
+ private:
+  uint64_t payload() const noexcept { return detail::flat_load<uint64_t>(slot_); }
+  void expect(size_t index) const {
+    if (this->index() != index) throw std::bad_variant_access();
+  }
+
+  const detail::FlatData *file_;
+  const char *slot_;
+};
+
+// A list in a flat file
+class ListView {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = ValueView;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = ValueView;
+
+    iterator(const detail::FlatData *file, const char *slot) noexcept : file_(file), slot_(slot) {}
+    ValueView operator*() const noexcept { return ValueView(file_, slot_); }
+    iterator &operator++() noexcept {
+      slot_ += detail::flat_slot_size;
+      return *this;
+    }
+    iterator operator++(int) noexcept {
+      iterator old = *this;
+      ++*this;
+      return old;
+    }
+    friend bool operator==(const iterator &lhs, const iterator &rhs) noexcept { return lhs.slot_ == rhs.slot_; }
+    friend bool operator!=(const iterator &lhs, const iterator &rhs) noexcept { return lhs.slot_ != rhs.slot_; }
+
+   private:
+    const detail::FlatData *file_;
+    const char *slot_;
+  };
+
+  // `block` as checked by detail::flat_list
+  ListView(const detail::FlatData *file, const char *block) noexcept : file_(file), block_(block) {}
+
+  size_t size() const noexcept { return static_cast<size_t>(detail::flat_load<uint64_t>(block_)); }
+  bool empty() const noexcept { return size() == 0; }
+  ValueView operator[](size_t index) const noexcept {
+    return ValueView(file_, slots() + index * detail::flat_slot_size);
+  }
+  // throws std::out_of_range past the end
+  ValueView at(size_t index) const;
+
+  iterator begin() const noexcept { return iterator(file_, slots()); }
+  iterator end() const noexcept { return iterator(file_, slots() + size() * detail::flat_slot_size); }
+
+  // copy the list out of the file
+  ListType to_vector() const;
+
+ private:
+  const char *slots() const noexcept { return block_ + 8; }
+
+  const detail::FlatData *file_;
+  const char *block_;
+};
+
+// A dict in a flat file, with the lookups of a DictType. Keys are hashed with hash_key, so a Key reuses its hash.
+class DictView {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<std::string_view, ValueView>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    iterator(const detail::FlatData *file, const char *entry) noexcept : file_(file), entry_(entry) {}
+    value_type operator*() const {
+      return {detail::flat_string(file_, detail::flat_load<uint64_t>(entry_ + 8)), ValueView(file_, entry_ + 16)};
+    }
+    iterator &operator++() noexcept {
+      entry_ += detail::flat_entry_size;
+      return *this;
+    }
+    iterator operator++(int) noexcept {
+      iterator old = *this;
+      ++*this;
+      return old;
+    }
+    friend bool operator==(const iterator &lhs, const iterator &rhs) noexcept { return lhs.entry_ == rhs.entry_; }
+    friend bool operator!=(const iterator &lhs, const iterator &rhs) noexcept { return lhs.entry_ != rhs.entry_; }
+
+   private:
+    const detail::FlatData *file_;
+    const char *entry_;
+  };
+
+  // `block` as checked by detail::flat_dict
+  DictView(const detail::FlatData *file, const char *block) noexcept : file_(file), block_(block) {}
+
+  size_t size() const noexcept { return static_cast<size_t>(detail::flat_load<uint64_t>(block_)); }
+  bool empty() const noexcept { return size() == 0; }
+
+  // these throw std::invalid_argument if the index or a key probed is not within the file
+  std::optional<ValueView> find(std::string_view key) const { return find(Key(key)); }
+  std::optional<ValueView> find(const Key &key) const;
+  bool has_key(std::string_view key) const { return find(key).has_value(); }
+  bool has_key(const Key &key) const { return find(key).has_value(); }
+
+  // typed lookups as try_get, get_or_die and get
+  template <typename T>
+  Result<T> try_get(std::string_view key) const;
+  template <typename T>
+  Result<T> try_get(const Key &key) const;
+  template <typename T>
+  T get_or_die(std::string_view key) const;
+  template <typename T>
+  T get_or_die(const Key &key) const;
+  template <typename T>
+  T get(std::string_view key, const T &default_value) const;
+  template <typename T>
+  T get(const Key &key, const T &default_value) const;
+
+  // nested lookups as try_get_path and get_path, a malformed `path` reported as ErrorCode::malformed_path
+  template <typename T>
+  Result<T> try_get_path(std::string_view path) const;
+  template <typename T>
+  T get_path(std::string_view path) const;
+  template <typename T>
+  T get_path(std::string_view path, const T &default_value) const;
+
+  iterator begin() const noexcept { return iterator(file_, entries()); }
+  iterator end() const noexcept { return iterator(file_, entries() + size() * detail::flat_entry_size); }
+
+  // copy the dict out of the file
+  DictType to_dict() const;
+
+ private:
+  const char *entries() const noexcept { return block_ + 16; }
+
+  const detail::FlatData *file_;
+  const char *block_;
+};
+
+// A flat file, mapped read-only or held in memory. Copies share the bytes.
+class FlatFile {
+ public:
+  // Map the file at `path` read-only, throwing std::system_error if it cannot be read and std::invalid_argument if
+  // it is not a flat file. Without mmap (Windows) the file is read into memory instead.
+  static FlatFile map(const std::string &path);
+  // a copy of flat bytes, e.g. from to_flat
+  static FlatFile from_bytes(std::string_view bytes);
+
+  DictView root() const noexcept {
+    return DictView(data_.get(), data_->base + detail::flat_load<uint64_t>(data_->base + 16));
+  }
+  // size of the file in bytes
+  size_t size() const noexcept { return data_->size; }
+
+ private:
+  explicit FlatFile(std::shared_ptr<detail::FlatData> data);
+
+  std::shared_ptr<const detail::FlatData> data_;
+};
+
+// write `dict` in the flat layout to `out`, replacing its contents
+void to_flat(const DictType &dict, std::string &out);
+std::string to_flat(const DictType &dict);
+// write `dict` in the flat layout to the file at `path`, throwing std::system_error if it cannot be written
+void save_flat(const DictType &dict, const std::string &path);
+
+namespace detail {
+
+// Writes the flat layout, keeping the lists and dicts whose slots are still to be filled on an explicit stack
+class FlatWriter {
+ public:
+  explicit FlatWriter(std::string &out) : out_(out) {}
+
+  void write(const DictType &dict) {
+    out_.assign(flat_header_size, '\0');
+    std::memcpy(&out_[0], flat_magic, sizeof flat_magic);
+    store<uint64_t>(16, put_dict_block(dict));
+    out_[24] = static_cast<char>(6);
+    while (!stack_.empty()) {
+      Frame &frame = stack_.back();
+      const ValueType *item;
+      if (frame.list) {
+        if (frame.index == frame.list->size()) {
+          stack_.pop_back();
+          continue;
+        }
+        item = &(*frame.list)[frame.index++];
+      } else {
+        if (frame.it == frame.dict->end()) {
+          stack_.pop_back();
+          continue;
+        }
+        item = &(frame.it++)->second;
+      }
+      size_t slot = frame.slot;
+      frame.slot += frame.list ? flat_slot_size : flat_entry_size;
+      // may push, which invalidates `frame`
+      put_value(*item, slot);
+    }
+    store<uint64_t>(8, out_.size());
+  }
+
+ private:
+  struct Frame {
+    const ListType *list;
+    const DictType *dict;
+    size_t index;
+    typename DictType::const_iterator it;
+    // offset of the next slot to fill
+    size_t slot;
+  };
+
+  template <typename T>
+  void store(size_t offset, T value) noexcept {
+    std::memcpy(&out_[offset], &value, sizeof value);
+  }
+
+  // offset of `size` zeroed bytes appended at the next 8-byte boundary
+  size_t allocate(size_t size) {
+    size_t offset = (out_.size() + 7) & ~size_t(7);
+    out_.resize(offset + ((size + 7) & ~size_t(7)), '\0');
+    return offset;
+  }
+
+  void put_value(const ValueType &value, size_t slot) {
+    uint64_t payload = 0;
+    switch (value.index()) {
+      case 0:
+        payload = static_cast<uint64_t>(value.get<intmax_t>());
+        break;
+      case 1:
+        payload = value.get<uintmax_t>();
+        break;
+      case 2: {
+        double number = value.get<double>();
+        std::memcpy(&payload, &number, sizeof payload);
+        break;
+      }
+      case 3:
+        payload = value.get<bool>();
+        break;
+      case 4:
+        payload = put_string(value.get<String>());
+        break;
+      case 5:
+        payload = put_list(value.get<Cow<ListType>>());
+        break;
+      case 6:
+        payload = put_dict(value.get<Cow<DictType>>());
+        break;
+      default:
+        payload = put_array(value.get<Array>());
+        break;
+    }
+    store<uint64_t>(slot, payload);
+    out_[slot + 8] = static_cast<char>(value.index());
+  }
+
+  size_t put_string(std::string_view text) {
+    size_t block = allocate(8 + text.size() + 1);
+    store<uint64_t>(block, text.size());
+    if (!text.empty()) std::memcpy(&out_[block + 8], text.data(), text.size());
+    return block;
+  }
+
+  // lists and dicts shared with other copies may be met again, and are written once
+  size_t put_list(const Cow<ListType> &cow) {
+    const bool shared = cow.shared();
+    if (shared) {
+      auto it = written_.find(&cow.get());
+      if (it != written_.end()) return it->second;
+    }
+    const ListType &list = cow.get();
+    size_t block = allocate(8 + list.size() * flat_slot_size);
+    store<uint64_t>(block, list.size());
+    if (!list.empty()) stack_.push_back({&list, nullptr, 0, {}, block + 8});
+    if (shared) written_.emplace(&list, block);
+    return block;
+  }
+
+  size_t put_dict(const Cow<DictType> &cow) {
+    const bool shared = cow.shared();
+    if (shared) {
+      auto it = written_.find(&cow.get());
+      if (it != written_.end()) return it->second;
+    }
+    size_t block = put_dict_block(cow.get());
+    if (shared) written_.emplace(&cow.get(), block);
+    return block;
+  }
+
+  size_t put_dict_block(const DictType &dict) {
+    const size_t count = dict.size();
+    if (count > UINT32_MAX - 1) throw std::length_error("flat dicts cannot have more than 2^32-2 entries");
+    size_t buckets = 0;
+    if (count) {
+      buckets = 1;
+      while (buckets < 2 * count) buckets <<= 1;
+    }
+    size_t block = allocate(16 + count * flat_entry_size + buckets * sizeof(uint32_t));
+    store<uint64_t>(block, count);
+    store<uint64_t>(block + 8, buckets);
+    const size_t index = block + 16 + count * flat_entry_size;
+    size_t entry = block + 16;
+    uint32_t position = 0;
+    for (const auto &item : dict) {
+      const uint64_t hash = hash_key(item.first);
+      auto key = keys_.find(item.first);
+      if (key == keys_.end()) key = keys_.emplace(item.first, put_string(item.first)).first;
+      store<uint64_t>(entry, hash);
+      store<uint64_t>(entry + 8, key->second);
+      size_t bucket = hash & (buckets - 1);
+      while (flat_load<uint32_t>(&out_[index + bucket * sizeof(uint32_t)]) != 0) bucket = (bucket + 1) & (buckets - 1);
+      store<uint32_t>(index + bucket * sizeof(uint32_t), ++position);
+      entry += flat_entry_size;
+    }
+    if (count) stack_.push_back({nullptr, &dict, 0, dict.begin(), block + 16 + 16});
+    return block;
+  }
+
+  size_t put_array(const Array &array) {
+    size_t block = allocate(16 + 8 * array.ndim() + array.nbytes());
+    store<uint64_t>(block, static_cast<uint64_t>(array.dtype()));
+    store<uint64_t>(block + 8, array.ndim());
+    for (size_t i = 0; i < array.ndim(); ++i) store<uint64_t>(block + 16 + 8 * i, array.shape()[i]);
+    if (array.nbytes()) std::memcpy(&out_[block + 16 + 8 * array.ndim()], array.data(), array.nbytes());
+    return block;
+  }
+
+  std::string &out_;
+  std::vector<Frame> stack_;
+  std::unordered_map<const void *, size_t> written_;
+  std::unordered_map<std::string_view, size_t> keys_;
+};
+
+// Copies a subtree out of a flat file, iteratively like FlatWriter
+class FlatReader {
+ public:
+  explicit FlatReader(const FlatData *file) : file_(file) {}
+
+  void read(const char *slot, ValueType &dest) {
+    read_slot(slot, dest);
+    drain();
+  }
+
+  void read_list(const char *block, ListType &list) {
+    push_list(block, list);
+    drain();
+  }
+
+  void read_dict(const char *block, DictType &dict) {
+    push_dict(block, dict);
+    drain();
+  }
+
+ private:
+  struct Frame {
+    ListType *list;
+    DictType *dict;
+    const char *block;
+    const char *next;
+    size_t remaining;
+  };
+
+  void drain() {
+    while (!stack_.empty()) {
+      Frame &frame = stack_.back();
+      if (frame.remaining == 0) {
+        open_.erase(frame.block);
+        stack_.pop_back();
+        continue;
+      }
+      --frame.remaining;
+      const char *at = frame.next;
+      // read_slot may push, which invalidates `frame`
+      if (frame.list) {
+        frame.next += flat_slot_size;
+        read_slot(at, frame.list->emplace_back());
+      } else {
+        frame.next += flat_entry_size;
+        DictType &dict = *frame.dict;
+        read_slot(at + 16, dict[KeyType(flat_string(file_, flat_load<uint64_t>(at + 8)))]);
+      }
+    }
+  }
+
+  void push_list(const char *block, ListType &list) {
+    size_t count = static_cast<size_t>(flat_load<uint64_t>(block));
+    list.reserve(count);
+    if (count) push({&list, nullptr, block, block + 8, count});
+  }
+
+  void push_dict(const char *block, DictType &dict) {
+    size_t count = static_cast<size_t>(flat_load<uint64_t>(block));
+    dict.reserve(count);
+    if (count) push({nullptr, &dict, block, block + 16, count});
+  }
+
+  // a block already being read contains itself, which FlatWriter never writes and which would be read without end
+  void push(const Frame &frame) {
+    if (!open_.insert(frame.block).second) flat_corrupt();
+    stack_.push_back(frame);
+  }
+
+  void read_slot(const char *slot, ValueType &dest) {
+    ValueView view(file_, slot);
+    const uint64_t offset = flat_load<uint64_t>(slot);
+    switch (view.index()) {
+      case 0:
+        dest = view.as_int();
+        break;
+      case 1:
+        dest = view.as_uint();
+        break;
+      case 2:
+        dest = view.as_double();
+        break;
+      case 3:
+        dest = view.as_bool();
+        break;
+      case 4:
+        dest = view.as_string();
+        break;
+      case 5: {
+        const char *block = flat_list(file_, offset);
+        if (reuse(block, dest)) break;
+        dest = ListType();
+        // the payload is filled through this pointer after the memo below shares it
+        ListType &list = dest.mutable_vector();
+        seen_.emplace(block, dest);
+        push_list(block, list);
+        break;
+      }
+      case 6: {
+        const char *block = flat_dict(file_, offset);
+        if (reuse(block, dest)) break;
+        dest = DictType();
+        DictType &dict = dest.mutable_dict();
+        seen_.emplace(block, dest);
+        push_dict(block, dict);
+        break;
+      }
+      case 7:
+        dest = view.as_array();
+        break;
+      default:
+        flat_corrupt();
+    }
+  }
+
+  // A block FlatWriter wrote once for a shared payload is referenced from several slots. It is read once, and every
+  // later reference shares the payload copy-on-write, so a DAG-shaped file is neither expanded nor read again.
+  bool reuse(const char *block, ValueType &dest) {
+    if (open_.count(block)) flat_corrupt();
+    auto it = seen_.find(block);
+    if (it == seen_.end()) return false;
+    dest = it->second;
+    return true;
+  }
+
+  const FlatData *file_;
+  std::vector<Frame> stack_;
+  std::unordered_set<const char *> open_;
+  // every list and dict block met so far, sharing its payload
+  std::unordered_map<const char *, ValueType> seen_;
+};
+
+}  // namespace detail
+
+inline intmax_t ValueView::as_int() const {
+  expect(0);
+  return static_cast<intmax_t>(payload());
+}
+
+inline uintmax_t ValueView::as_uint() const {
+  expect(1);
+  return static_cast<uintmax_t>(payload());
+}
+
+inline double ValueView::as_double() const {
+  expect(2);
+  uint64_t bits = payload();
+  double number;
+  std::memcpy(&number, &bits, sizeof number);
+  return number;
+}
+
+inline bool ValueView::as_bool() const {
+  expect(3);
+  return payload() != 0;
+}
+
+inline std::string_view ValueView::as_string() const {
+  expect(4);
+  return detail::flat_string(file_, payload());
+}
+
+inline ListView ValueView::as_vector() const {
+  expect(5);
+  return ListView(file_, detail::flat_list(file_, payload()));
+}
+
+inline DictView ValueView::as_dict() const {
+  expect(6);
+  return DictView(file_, detail::flat_dict(file_, payload()));
+}
+
+inline Array ValueView::as_array() const {
+  expect(7);
+  const uint64_t offset = payload();
+  if (!detail::flat_fits(file_, offset, 16)) detail::flat_corrupt();
+  const char *at = file_->base + offset;
+  const uint64_t code = detail::flat_load<uint64_t>(at);
+  const uint64_t ndim = detail::flat_load<uint64_t>(at + 8);
+  if (code > static_cast<uint64_t>(DType::uint8) || !detail::flat_fits(file_, offset, 16, ndim, 8)) {
+    detail::flat_corrupt();
+  }
+  auto dtype = static_cast<DType>(code);
+  // the elements must fit in the bytes left, counted without overflowing; a zero dimension leaves none
+  const uint64_t limit = (file_->size - offset - 16 - 8 * ndim) / dtype_size(dtype);
+  std::vector<size_t> shape(static_cast<size_t>(ndim));
+  uint64_t count = 1;
+  bool fits = true;
+  bool empty = false;
+  for (size_t i = 0; i < shape.size(); ++i) {
+    const uint64_t dim = detail::flat_load<uint64_t>(at + 16 + 8 * i);
+    shape[i] = static_cast<size_t>(dim);
+    if (dim == 0) {
+      empty = true;
+    } else if (count > limit / dim) {
+      fits = false;
+    } else {
+      count *= dim;
+    }
+  }
+  if (!empty && (!fits || count > limit)) detail::flat_corrupt();
+  const char *data = at + 16 + 8 * shape.size();
+  return Array(dtype, std::move(shape), file_->owner, data);
+}
+
+template <typename T>
+Result<T> ValueView::try_as() const {
+  if constexpr (std::is_same_v<T, ValueView>) {
+    return *this;
+  } else if constexpr (std::is_same_v<T, ValueType>) {
+    return to_value();
+  } else if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>) {
+    if (!is_string()) return ErrorCode::wrong_type;
+    return T(as_string());
+  } else if constexpr (std::is_same_v<T, ListView>) {
+    if (!is_vector()) return ErrorCode::wrong_type;
+    return as_vector();
+  } else if constexpr (std::is_same_v<T, DictView>) {
+    if (!is_dict()) return ErrorCode::wrong_type;
+    return as_dict();
+  } else if constexpr (std::is_same_v<T, Array>) {
+    if (!is_array()) return ErrorCode::wrong_type;
+    return as_array();
+  } else {
+    static_assert(std::is_arithmetic_v<T>, "ValueView converts to numbers, strings, views, Array or ValueType");
+    switch (index()) {
+      case 0:
+        return static_cast<T>(as_int());
+      case 1:
+        return static_cast<T>(as_uint());
+      case 2:
+        return static_cast<T>(as_double());
+      case 3:
+        return static_cast<T>(as_bool());
+      default:
+        return ErrorCode::wrong_type;
+    }
+  }
+}
+
+inline ValueType ValueView::to_value() const {
+  ValueType value;
+  detail::FlatReader(file_).read(slot_, value);
+  return value;
+}
+
+inline ValueView ListView::at(size_t index) const {
+  if (index >= size()) throw std::out_of_range("Index out of range");
+  return (*this)[index];
+}
+
+inline ListType ListView::to_vector() const {
+  ListType list;
+  detail::FlatReader(file_).read_list(block_, list);
+  return list;
+}
+
+inline std::optional<ValueView> DictView::find(const Key &key) const {
+  const uint64_t buckets = detail::flat_load<uint64_t>(block_ + 8);
+  if (buckets == 0) return std::nullopt;
+  const char *index = entries() + size() * detail::flat_entry_size;
+  const uint64_t hash = key.hash;
+  uint64_t bucket = hash & (buckets - 1);
+  // FlatWriter leaves an empty bucket to end every probe, so one that goes round the index is corrupt
+  for (uint64_t probes = 0; probes < buckets; ++probes, bucket = (bucket + 1) & (buckets - 1)) {
+    uint32_t position = detail::flat_load<uint32_t>(index + bucket * sizeof(uint32_t));
+    if (position == 0) return std::nullopt;
+    if (position > size()) detail::flat_corrupt();
+    const char *entry = entries() + (position - 1) * detail::flat_entry_size;
+    if (detail::flat_load<uint64_t>(entry) == hash &&
+        detail::flat_string(file_, detail::flat_load<uint64_t>(entry + 8)) == key.name) {
+      return ValueView(file_, entry + 16);
+    }
+  }
+  detail::flat_corrupt();
+}
+
+template <typename T>
+Result<T> DictView::try_get(std::string_view key) const {
+  return try_get<T>(Key(key));
+}
+
+template <typename T>
+Result<T> DictView::try_get(const Key &key) const {
+  std::optional<ValueView> value = find(key);
+  if (!value) return ErrorCode::key_not_found;
+  return value->try_as<T>();
+}
+
+template <typename T>
+T DictView::get_or_die(std::string_view key) const {
+  return try_get<T>(key).value();
+}
+
+template <typename T>
+T DictView::get_or_die(const Key &key) const {
+  return try_get<T>(key).value();
+}
+
+template <typename T>
+T DictView::get(std::string_view key, const T &default_value) const {
+  return try_get<T>(key).value_or(default_value);
+}
+
+template <typename T>
+T DictView::get(const Key &key, const T &default_value) const {
+  return try_get<T>(key).value_or(default_value);
+}
+
+template <typename T>
+Result<T> DictView::try_get_path(std::string_view path) const {
+  std::optional<ValueView> current;
+  ErrorCode status = ErrorCode::ok;
+  const bool valid = detail::parse_path(
+      path,
+      [&](std::string_view key) {
+        if (current && !current->is_dict()) {
+          status = ErrorCode::wrong_type;
+          return false;
+        }
+        current = (current ? current->as_dict() : *this).find(key);
+        if (!current) status = ErrorCode::key_not_found;
+        return status == ErrorCode::ok;
+      },
+      [&](size_t index) {
+        if (!current || !current->is_vector()) {
+          status = ErrorCode::wrong_type;
+          return false;
+        }
+        ListView list = current->as_vector();
+        if (index >= list.size()) {
+          status = ErrorCode::index_out_of_range;
+          return false;
+        }
+        current = list[index];
+        return true;
+      });
+  if (!valid) return ErrorCode::malformed_path;
+  if (status != ErrorCode::ok) return status;
+  return current->try_as<T>();
+}
+
+template <typename T>
+T DictView::get_path(std::string_view path) const {
+  return try_get_path<T>(path).value();
+}
+
+template <typename T>
+T DictView::get_path(std::string_view path, const T &default_value) const {
+  return try_get_path<T>(path).value_or(default_value);
+}
+
+inline DictType DictView::to_dict() const {
+  DictType dict;
+  detail::FlatReader(file_).read_dict(block_, dict);
+  return dict;
+}
+
+inline FlatFile::FlatFile(std::shared_ptr<detail::FlatData> data) {
+  const char *base = data->base;
+  if (data->size < detail::flat_header_size || std::memcmp(base, detail::flat_magic, sizeof detail::flat_magic) != 0 ||
+      detail::flat_load<uint64_t>(base + 8) != data->size || base[24] != 6) {
+    throw std::invalid_argument("not a kwargscpp flat file");
+  }
+  // checked once here, so root() need not
+  detail::flat_dict(data.get(), detail::flat_load<uint64_t>(base + 16));
+  data_ = std::move(data);
+}
+
+inline FlatFile FlatFile::map(const std::string &path) {
+#if defined(_WIN32)
+  std::ifstream file(path, std::ios::binary);
+  if (!file) throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+  std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  return from_bytes(bytes);
+#else
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+  struct stat status;
+  if (::fstat(fd, &status) != 0) {
+    int error = errno;
+    ::close(fd);
+    throw std::system_error(error, std::generic_category(), "cannot stat " + path);
+  }
+  const auto size = static_cast<size_t>(status.st_size);
+  if (size < detail::flat_header_size) {
+    ::close(fd);
+    throw std::invalid_argument("not a kwargscpp flat file");
+  }
+  void *address = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  int error = errno;
+  ::close(fd);
+  if (address == MAP_FAILED) throw std::system_error(error, std::generic_category(), "cannot map " + path);
+  std::shared_ptr<const void> owner(address,
+                                    [size](const void *mapped) { ::munmap(const_cast<void *>(mapped), size); });
+  const char *base = static_cast<const char *>(address);
+  return FlatFile(std::make_shared<detail::FlatData>(detail::FlatData{base, size, std::move(owner)}));
+#endif
+}
+
+inline FlatFile FlatFile::from_bytes(std::string_view bytes) {
+  // a fresh allocation, so the blocks are 8-byte aligned
+  std::shared_ptr<std::byte[]> buffer(new std::byte[bytes.size() ? bytes.size() : 1]);
+  if (!bytes.empty()) std::memcpy(buffer.get(), bytes.data(), bytes.size());
+  const char *base = reinterpret_cast<const char *>(buffer.get());
+  return FlatFile(std::make_shared<detail::FlatData>(detail::FlatData{base, bytes.size(), std::move(buffer)}));
+}
+
+inline void to_flat(const DictType &dict, std::string &out) { detail::FlatWriter(out).write(dict); }
+
+inline std::string to_flat(const DictType &dict) {
+  std::string out;
+  to_flat(dict, out);
+  return out;
+}
+
+namespace detail {
+
+// A name next to `path` for save_flat to write before renaming it over `path`, fresh for every call so concurrent
+// writers, in this process or others, do not share one
+inline std::string flat_temporary(const std::string &path) {
+  static std::atomic<unsigned long long> counter{0};
+  char suffix[48];
+  std::snprintf(suffix, sizeof suffix, ".%llx.%llx.tmp", static_cast<unsigned long long>(std::random_device()()),
+                counter++);
+  return path + suffix;
+}
+
+}  // namespace detail
+
+inline void save_flat(const DictType &dict, const std::string &path) {
+  std::string bytes = to_flat(dict);
+  // written aside and renamed over `path`, so processes that have the old file mapped keep reading it intact, and
+  // of concurrent writers the last rename wins with a whole file
+#if defined(_WIN32)
+  const std::string temporary = detail::flat_temporary(path);
+  std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+  file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  file.close();
+  if (!file) {
+    int error = errno;
+    std::remove(temporary.c_str());
+    throw std::system_error(error, std::generic_category(), "cannot write " + temporary);
+  }
+  std::remove(path.c_str());
+#else
+  // created exclusively, as mkstemp does, but with the permissions a new file at `path` would get
+  std::string temporary;
+  int fd = -1;
+  for (int attempt = 0; fd < 0 && attempt < 100; ++attempt) {
+    temporary = detail::flat_temporary(path);
+    fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (fd < 0 && errno != EEXIST) break;
+  }
+  if (fd < 0) throw std::system_error(errno, std::generic_category(), "cannot create " + temporary);
+  const char *at = bytes.data();
+  size_t left = bytes.size();
+  int failure = 0;
+  while (left && !failure) {
+    const ssize_t written = ::write(fd, at, left);
+    if (written > 0) {
+      at += written;
+      left -= static_cast<size_t>(written);
+    } else if (written < 0 && errno != EINTR) {
+      failure = errno;
+    }
+  }
+  if (::close(fd) != 0 && !failure) failure = errno;
+  if (failure) {
+    ::unlink(temporary.c_str());
+    throw std::system_error(failure, std::generic_category(), "cannot write " + temporary);
+  }
+#endif
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    int error = errno;
+    std::remove(temporary.c_str());
+    throw std::system_error(error, std::generic_category(), "cannot rename " + temporary);
+  }
+}
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_FLAT_H
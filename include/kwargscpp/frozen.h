@@ -0,0 +1,604 @@
+#ifndef KWARGS_FROZEN_H
+#define KWARGS_FROZEN_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+
+// An immutable copy of a DictType tree for configs that are loaded once and then only read, e.g. in inner loops:
+//
+//   const kwargscpp::FrozenDict config = kwargscpp::freeze(dict);
+//   double lr = config.get_or_die<double>("lr"_kw);
+//
+// Each frozen dict stores its entries contiguously, placed by a minimal perfect hash of its keys built at freeze time
+// (hash and displace: a seed per bucket of about two keys), so a lookup hashes the key once, if it is not a Key, and
+// compares exactly one entry. Nested dicts and lists are frozen too, each shared subtree once, and copies of a
+// FrozenDict share it.
+namespace kwargscpp {
+
+class FrozenValue;
+class FrozenDict;
+
+namespace detail {
+struct FrozenTable;
+using FrozenElements = std::vector<FrozenValue>;
+class Freezer;
+class Thawer;
+}  // namespace detail
+
+// A frozen list
+class FrozenList {
+ public:
+  FrozenList();
+
+  size_t size() const noexcept;
+  bool empty() const noexcept { return size() == 0; }
+  const FrozenValue &operator[](size_t index) const noexcept;
+  // throws std::out_of_range past the end
+  const FrozenValue &at(size_t index) const;
+
+  const FrozenValue *begin() const noexcept;
+  const FrozenValue *end() const noexcept;
+
+  // a mutable copy of the list
+  ListType to_vector() const;
+
+ private:
+  friend class detail::Freezer;
+  friend class detail::Thawer;
+  explicit FrozenList(std::shared_ptr<const detail::FrozenElements> elements) noexcept
+      : elements_(std::move(elements)) {}
+
+  std::shared_ptr<const detail::FrozenElements> elements_;
+};
+
+// A frozen dict, with the lookups of a DictType. Keys are hashed with hash_key, so a Key reuses its hash.
+class FrozenDict {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<std::string_view, const FrozenValue &>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    iterator(const detail::FrozenTable *table, const uint32_t *position) noexcept
+        : table_(table), position_(position) {}
+    value_type operator*() const noexcept;
+    iterator &operator++() noexcept {
+      ++position_;
+      return *this;
+    }
+    iterator operator++(int) noexcept {
+      iterator old = *this;
+      ++*this;
+      return old;
+    }
+    friend bool operator==(const iterator &lhs, const iterator &rhs) noexcept {
+      return lhs.position_ == rhs.position_;
+    }
+    friend bool operator!=(const iterator &lhs, const iterator &rhs) noexcept {
+      return lhs.position_ != rhs.position_;
+    }
+
+   private:
+    const detail::FrozenTable *table_;
+    const uint32_t *position_;
+  };
+
+  FrozenDict();
+
+  size_t size() const noexcept;
+  bool empty() const noexcept { return size() == 0; }
+
+  // the value of `key`, nullptr if there is none
+  const FrozenValue *find(std::string_view key) const noexcept { return find(Key(key)); }
+  const FrozenValue *find(const Key &key) const noexcept;
+  bool has_key(std::string_view key) const noexcept { return find(key) != nullptr; }
+  bool has_key(const Key &key) const noexcept { return find(key) != nullptr; }
+
+  // typed lookups as try_get, get_or_die and get
+  template <typename T>
+  Result<T> try_get(std::string_view key) const;
+  template <typename T>
+  Result<T> try_get(const Key &key) const;
+  template <typename T>
+  T get_or_die(std::string_view key) const;
+  template <typename T>
+  T get_or_die(const Key &key) const;
+  template <typename T>
+  T get(std::string_view key, const T &default_value) const;
+  template <typename T>
+  T get(const Key &key, const T &default_value) const;
+
+  // in the iteration order of the dict it was frozen from
+  iterator begin() const noexcept;
+  iterator end() const noexcept;
+
+  // a mutable copy of the dict
+  DictType to_dict() const;
+
+ private:
+  friend class detail::Freezer;
+  friend class detail::Thawer;
+  explicit FrozenDict(std::shared_ptr<const detail::FrozenTable> table) noexcept : table_(std::move(table)) {}
+
+  std::shared_ptr<const detail::FrozenTable> table_;
+};
+
+// A value in a frozen tree, holding the same alternatives as ValueType in the same order, with frozen lists and dicts
+class FrozenValue : public std::variant<intmax_t, uintmax_t, double, bool, std::string, FrozenList, FrozenDict, Array> {
+ public:
+  using variant::variant;
+
+  bool is_int() const noexcept { return index() == 0; }
+  bool is_uint() const noexcept { return index() == 1; }
+  bool is_double() const noexcept { return index() == 2; }
+  bool is_bool() const noexcept { return index() == 3; }
+  bool is_string() const noexcept { return index() == 4; }
+  bool is_vector() const noexcept { return index() == 5; }
+  bool is_dict() const noexcept { return index() == 6; }
+  bool is_array() const noexcept { return index() == 7; }
+
+  // these throw std::bad_variant_access if the value is of another type, like ValueType's
+  intmax_t as_int() const { return std::get<intmax_t>(*this); }
+  uintmax_t as_uint() const { return std::get<uintmax_t>(*this); }
+  double as_double() const { return std::get<double>(*this); }
+  bool as_bool() const { return std::get<bool>(*this); }
+  const std::string &as_string() const { return std::get<std::string>(*this); }
+  const FrozenList &as_vector() const { return std::get<FrozenList>(*this); }
+  const FrozenDict &as_dict() const { return std::get<FrozenDict>(*this); }
+  const Array &as_array() const { return std::get<Array>(*this); }
+
+  // the value as T without throwing, with the conversions of try_get for numbers and bools, std::string_view or
+  // std::string for a string, the frozen list or dict, Array, or a mutable ListType, DictType or ValueType copy
+  template <typename T>
+  Result<T> try_as() const;
+
+  // a mutable copy of the value
+  ValueType to_value() const;
+};
+
+// freeze a copy of `dict`
+FrozenDict freeze(const DictType &dict);
+
+namespace detail {
+
+struct FrozenEntry {
+  size_t hash = 0;
+  KeyType key;
+  FrozenValue value;
+};
+
+// The entries of a frozen dict in the slots the perfect hash gives their keys
+struct FrozenTable {
+  std::vector<FrozenEntry> entries;
+  // a seed per bucket, empty if the keys have no perfect hash (two with equal hashes), then entries are scanned
+  std::vector<uint64_t> seeds;
+  // the slot of each entry in the source dict's iteration order
+  std::vector<uint32_t> order;
+};
+
+constexpr uint64_t frozen_multiplier = 0x9E3779B97F4A7C15ull;
+
+// the inverse of frozen_multiplier modulo 2^64, by Newton's iteration
+constexpr uint64_t frozen_inverse() {
+  uint64_t inverse = frozen_multiplier;
+  for (int i = 0; i < 5; ++i) inverse *= 2 - frozen_multiplier * inverse;
+  return inverse;
+}
+static_assert(frozen_multiplier * frozen_inverse() == 1, "frozen_inverse");
+
+// the finalizer of MurmurHash3, spreading every bit of a key's hash over the bucket and slot bits
+constexpr uint64_t frozen_mix(uint64_t hash) noexcept {
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDull;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// `x` scaled from [0, 2^32) to [0, n), without a division
+constexpr size_t frozen_range(uint32_t x, size_t n) noexcept {
+  return static_cast<size_t>((static_cast<uint64_t>(x) * n) >> 32);
+}
+
+constexpr size_t frozen_slot(uint64_t mixed, uint64_t seed, size_t n) noexcept {
+  return frozen_range(static_cast<uint32_t>(((mixed ^ seed) * frozen_multiplier) >> 32), n);
+}
+
+// the seed placing the key of mixed hash `mixed` in `slot` of `n`
+constexpr uint64_t frozen_seed_for(uint64_t mixed, size_t slot, size_t n) noexcept {
+  const uint64_t scaled = ((static_cast<uint64_t>(slot) << 32) + n - 1) / n;
+  return mixed ^ ((scaled << 32) * frozen_inverse());
+}
+
+// Build the seeds placing `hashes` in distinct slots, returned in `slots`, or return false if two hashes are equal (or,
+// never in practice, a bucket finds no seed).
+// Buckets of several keys, largest first, try seeds until all their keys land in free slots; a bucket of one key
+// gets the seed placing it in a free slot directly, so the last slots never need a search.
+inline bool frozen_perfect_hash(const std::vector<size_t> &hashes, std::vector<uint64_t> &seeds,
+                                std::vector<uint32_t> &slots) {
+  const size_t n = hashes.size();
+  std::vector<size_t> sorted(hashes);
+  std::sort(sorted.begin(), sorted.end());
+  if (n == 0 || std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) return false;
+
+  const size_t bucket_count = (n + 1) / 2;
+  std::vector<uint64_t> mixed(n);
+  std::vector<std::vector<uint32_t>> buckets(bucket_count);
+  for (size_t i = 0; i < n; ++i) {
+    mixed[i] = frozen_mix(hashes[i]);
+    buckets[frozen_range(static_cast<uint32_t>(mixed[i] >> 32), bucket_count)].push_back(static_cast<uint32_t>(i));
+  }
+  std::vector<uint32_t> by_size(bucket_count);
+  for (size_t b = 0; b < bucket_count; ++b) by_size[b] = static_cast<uint32_t>(b);
+  std::stable_sort(by_size.begin(), by_size.end(),
+                   [&](uint32_t lhs, uint32_t rhs) { return buckets[lhs].size() > buckets[rhs].size(); });
+
+  seeds.assign(bucket_count, 0);
+  slots.assign(n, 0);
+  std::vector<bool> taken(n, false);
+  std::vector<size_t> tried;
+  size_t next_free = 0;
+  for (uint32_t b : by_size) {
+    const std::vector<uint32_t> &keys = buckets[b];
+    if (keys.size() == 1) {
+      while (taken[next_free]) ++next_free;
+      taken[next_free] = true;
+      slots[keys[0]] = static_cast<uint32_t>(next_free);
+      seeds[b] = frozen_seed_for(mixed[keys[0]], next_free, n);
+      continue;
+    }
+    if (keys.empty()) continue;
+    bool placed = false;
+    for (uint64_t attempt = 1; !placed; ++attempt) {
+      if (attempt > (uint64_t(1) << 24)) return false;
+      const uint64_t seed = frozen_mix(attempt);
+      tried.clear();
+      placed = true;
+      for (uint32_t key : keys) {
+        size_t slot = frozen_slot(mixed[key], seed, n);
+        if (taken[slot] || std::find(tried.begin(), tried.end(), slot) != tried.end()) {
+          placed = false;
+          break;
+        }
+        tried.push_back(slot);
+      }
+      if (placed) {
+        seeds[b] = seed;
+        for (size_t k = 0; k < keys.size(); ++k) {
+          taken[tried[k]] = true;
+          slots[keys[k]] = static_cast<uint32_t>(tried[k]);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Freezes a tree top down: each list or dict is created with its keys placed, and left on an explicit stack until its
+// values are filled in, so deep trees do not overflow the native stack
+class Freezer {
+ public:
+  FrozenDict run(const DictType &dict) {
+    FrozenDict root = freeze_dict(dict);
+    while (!stack_.empty()) {
+      Pending pending = stack_.back();
+      stack_.pop_back();
+      if (pending.list) {
+        pending.elements->reserve(pending.list->size());
+        for (const ValueType &value : *pending.list) pending.elements->push_back(freeze(value));
+      } else {
+        size_t i = 0;
+        for (const auto &item : *pending.dict) {
+          pending.table->entries[pending.table->order[i++]].value = freeze(item.second);
+        }
+      }
+    }
+    return root;
+  }
+
+ private:
+  struct Pending {
+    const ListType *list;
+    FrozenElements *elements;
+    const DictType *dict;
+    FrozenTable *table;
+  };
+
+  FrozenValue freeze(const ValueType &value) {
+    return visit(
+        [this](const auto &arg) -> FrozenValue {
+          using T = std::decay_t<decltype(arg)>;
+          if constexpr (std::is_same_v<T, Cow<ListType>>) {
+            return freeze_list(arg.get());
+          } else if constexpr (std::is_same_v<T, Cow<DictType>>) {
+            return freeze_dict(arg.get());
+          } else if constexpr (std::is_same_v<T, String>) {
+            return std::string(arg);
+          } else {
+            return arg;
+          }
+        },
+        value);
+  }
+
+  FrozenList freeze_list(const ListType &list) {
+    auto it = lists_.find(&list);
+    if (it != lists_.end()) return it->second;
+    auto elements = std::make_shared<FrozenElements>();
+    stack_.push_back({&list, elements.get(), nullptr, nullptr});
+    FrozenList frozen(std::move(elements));
+    lists_.emplace(&list, frozen);
+    return frozen;
+  }
+
+  FrozenDict freeze_dict(const DictType &dict) {
+    auto it = dicts_.find(&dict);
+    if (it != dicts_.end()) return it->second;
+    auto table = std::make_shared<FrozenTable>();
+    std::vector<size_t> hashes;
+    hashes.reserve(dict.size());
+    for (const auto &item : dict) hashes.push_back(hash_key(item.first));
+    if (!frozen_perfect_hash(hashes, table->seeds, table->order)) {
+      table->seeds.clear();
+      table->order.resize(dict.size());
+      for (size_t i = 0; i < dict.size(); ++i) table->order[i] = static_cast<uint32_t>(i);
+    }
+    table->entries.resize(dict.size());
+    size_t i = 0;
+    for (const auto &item : dict) {
+      FrozenEntry &entry = table->entries[table->order[i]];
+      entry.hash = hashes[i++];
+      entry.key = item.first;
+    }
+    stack_.push_back({nullptr, nullptr, &dict, table.get()});
+    FrozenDict frozen(std::move(table));
+    dicts_.emplace(&dict, frozen);
+    return frozen;
+  }
+
+  std::vector<Pending> stack_;
+  // lists and dicts already frozen, by payload, so shared ones stay shared
+  std::unordered_map<const ListType *, FrozenList> lists_;
+  std::unordered_map<const DictType *, FrozenDict> dicts_;
+};
+
+// Copies a frozen tree back into ValueTypes top down like Freezer, sharing what the frozen tree shares
+class Thawer {
+ public:
+  void run(const FrozenTable &table, DictType &out) {
+    stack_.push_back({nullptr, nullptr, &table, &out});
+    drain();
+  }
+  void run(const FrozenElements &elements, ListType &out) {
+    stack_.push_back({&elements, &out, nullptr, nullptr});
+    drain();
+  }
+  ValueType run(const FrozenValue &value) {
+    ValueType out = thaw(value);
+    drain();
+    return out;
+  }
+
+ private:
+  struct Pending {
+    const FrozenElements *elements;
+    ListType *list;
+    const FrozenTable *table;
+    DictType *dict;
+  };
+
+  void drain() {
+    while (!stack_.empty()) {
+      Pending pending = stack_.back();
+      stack_.pop_back();
+      if (pending.elements) {
+        pending.list->reserve(pending.elements->size());
+        for (const FrozenValue &value : *pending.elements) pending.list->push_back(thaw(value));
+      } else {
+        pending.dict->reserve(pending.table->order.size());
+        for (uint32_t slot : pending.table->order) {
+          const FrozenEntry &entry = pending.table->entries[slot];
+          pending.dict->emplace(entry.key, thaw(entry.value));
+        }
+      }
+    }
+  }
+
+  // the payload of a new list or dict stays put when the ValueType holding it is moved, so it is filled in later
+  ValueType thaw(const FrozenValue &value) {
+    if (const FrozenList *list = std::get_if<FrozenList>(&value)) {
+      auto it = shared_.find(list->elements_.get());
+      if (it != shared_.end()) return it->second;
+      ValueType out{ListType()};
+      stack_.push_back({list->elements_.get(), &out.mutable_vector(), nullptr, nullptr});
+      shared_.emplace(list->elements_.get(), out);
+      return out;
+    }
+    if (const FrozenDict *dict = std::get_if<FrozenDict>(&value)) {
+      auto it = shared_.find(dict->table_.get());
+      if (it != shared_.end()) return it->second;
+      ValueType out{DictType()};
+      stack_.push_back({nullptr, nullptr, dict->table_.get(), &out.mutable_dict()});
+      shared_.emplace(dict->table_.get(), out);
+      return out;
+    }
+    return std::visit(
+        [](const auto &arg) -> ValueType {
+          using T = std::decay_t<decltype(arg)>;
+          if constexpr (std::is_same_v<T, FrozenList> || std::is_same_v<T, FrozenDict>) {
+            return ValueType();
+          } else {
+            return arg;
+          }
+        },
+        static_cast<const FrozenValue::variant &>(value));
+  }
+
+  std::vector<Pending> stack_;
+  std::unordered_map<const void *, ValueType> shared_;
+};
+
+inline const std::shared_ptr<const FrozenElements> &empty_frozen_elements() {
+  static const std::shared_ptr<const FrozenElements> empty = std::make_shared<const FrozenElements>();
+  return empty;
+}
+
+inline const std::shared_ptr<const FrozenTable> &empty_frozen_table() {
+  static const std::shared_ptr<const FrozenTable> empty = std::make_shared<const FrozenTable>();
+  return empty;
+}
+
+}  // namespace detail
+
+inline FrozenList::FrozenList() : elements_(detail::empty_frozen_elements()) {}
+
+inline size_t FrozenList::size() const noexcept { return elements_->size(); }
+
+inline const FrozenValue &FrozenList::operator[](size_t index) const noexcept { return (*elements_)[index]; }
+
+inline const FrozenValue &FrozenList::at(size_t index) const {
+  if (index >= size()) throw std::out_of_range("Index out of range");
+  return (*elements_)[index];
+}
+
+inline const FrozenValue *FrozenList::begin() const noexcept { return elements_->data(); }
+
+inline const FrozenValue *FrozenList::end() const noexcept { return elements_->data() + elements_->size(); }
+
+inline ListType FrozenList::to_vector() const {
+  ListType list;
+  detail::Thawer().run(*elements_, list);
+  return list;
+}
+
+inline FrozenDict::iterator::value_type FrozenDict::iterator::operator*() const noexcept {
+  const detail::FrozenEntry &entry = table_->entries[*position_];
+  return {entry.key, entry.value};
+}
+
+inline FrozenDict::FrozenDict() : table_(detail::empty_frozen_table()) {}
+
+inline size_t FrozenDict::size() const noexcept { return table_->entries.size(); }
+
+inline const FrozenValue *FrozenDict::find(const Key &key) const noexcept {
+  const detail::FrozenTable &table = *table_;
+  if (!table.seeds.empty()) {
+    const uint64_t mixed = detail::frozen_mix(key.hash);
+    const uint64_t seed =
+        table.seeds[detail::frozen_range(static_cast<uint32_t>(mixed >> 32), table.seeds.size())];
+    const detail::FrozenEntry &entry = table.entries[detail::frozen_slot(mixed, seed, table.entries.size())];
+    return entry.hash == key.hash && entry.key == key.name ? &entry.value : nullptr;
+  }
+  for (const detail::FrozenEntry &entry : table.entries) {
+    if (entry.hash == key.hash && entry.key == key.name) return &entry.value;
+  }
+  return nullptr;
+}
+
+template <typename T>
+Result<T> FrozenDict::try_get(std::string_view key) const {
+  return try_get<T>(Key(key));
+}
+
+template <typename T>
+Result<T> FrozenDict::try_get(const Key &key) const {
+  const FrozenValue *value = find(key);
+  if (!value) return ErrorCode::key_not_found;
+  return value->try_as<T>();
+}
+
+template <typename T>
+T FrozenDict::get_or_die(std::string_view key) const {
+  return try_get<T>(key).value();
+}
+
+template <typename T>
+T FrozenDict::get_or_die(const Key &key) const {
+  return try_get<T>(key).value();
+}
+
+template <typename T>
+T FrozenDict::get(std::string_view key, const T &default_value) const {
+  return try_get<T>(key).value_or(default_value);
+}
+
+template <typename T>
+T FrozenDict::get(const Key &key, const T &default_value) const {
+  return try_get<T>(key).value_or(default_value);
+}
+
+inline FrozenDict::iterator FrozenDict::begin() const noexcept {
+  return iterator(table_.get(), table_->order.data());
+}
+
+inline FrozenDict::iterator FrozenDict::end() const noexcept {
+  return iterator(table_.get(), table_->order.data() + table_->order.size());
+}
+
+inline DictType FrozenDict::to_dict() const {
+  DictType dict;
+  detail::Thawer().run(*table_, dict);
+  return dict;
+}
+
+template <typename T>
+Result<T> FrozenValue::try_as() const {
+  if constexpr (std::is_same_v<T, FrozenValue>) {
+    return *this;
+  } else if constexpr (std::is_same_v<T, ValueType>) {
+    return to_value();
+  } else if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>) {
+    if (!is_string()) return ErrorCode::wrong_type;
+    return T(as_string());
+  } else if constexpr (std::is_same_v<T, FrozenList> || std::is_same_v<T, FrozenDict> || std::is_same_v<T, Array>) {
+    const T *value = std::get_if<T>(this);
+    if (!value) return ErrorCode::wrong_type;
+    return *value;
+  } else if constexpr (std::is_same_v<T, ListType>) {
+    if (!is_vector()) return ErrorCode::wrong_type;
+    return as_vector().to_vector();
+  } else if constexpr (std::is_same_v<T, DictType>) {
+    if (!is_dict()) return ErrorCode::wrong_type;
+    return as_dict().to_dict();
+  } else {
+    static_assert(std::is_arithmetic_v<T>, "FrozenValue converts to numbers, strings, frozen or mutable lists and "
+                                           "dicts, Array or ValueType");
+    switch (index()) {
+      case 0:
+        return static_cast<T>(as_int());
+      case 1:
+        return static_cast<T>(as_uint());
+      case 2:
+        return static_cast<T>(as_double());
+      case 3:
+        return static_cast<T>(as_bool());
+      default:
+        return ErrorCode::wrong_type;
+    }
+  }
+}
+
+inline ValueType FrozenValue::to_value() const { return detail::Thawer().run(*this); }
+
+inline FrozenDict freeze(const DictType &dict) { return detail::Freezer().run(dict); }
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_FROZEN_H
@@ -0,0 +1,402 @@
+#ifndef KWARGS_JSON_H
+#define KWARGS_JSON_H
+
+#include <charconv>
+#include <cstddef>
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define KWARGSCPP_JSON_SSE2
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include "kwargscpp/kwargs.h"
+
+// Parsing JSON (RFC 8259) straight into ValueType, without going through Python. Integers become intmax_t, or
+// uintmax_t above its range, or double beyond that; other numbers double; arrays lists and objects DictType, where a
+// repeated key keeps its last value. ValueType has no null, so null is rejected. NaN, Infinity and -Infinity are read
+// as doubles, as Python's json module does, so the non-finite values to_json writes read back.
+namespace kwargscpp {
+
+// parse `text` as one JSON value, throwing std::invalid_argument with the byte offset if it is malformed or holds null
+ValueType from_json(std::string_view text);
+// as from_json, but the value must be an object
+DictType from_json_dict(std::string_view text);
+
+namespace detail {
+
+inline bool json_is_space(char c) noexcept { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+#ifdef KWARGSCPP_JSON_SSE2
+inline int json_lowest_bit(unsigned mask) noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// the first non-whitespace character in [p, end), 16 at a time where SSE2 is available
+inline const char *json_skip_space(const char *p, const char *end) noexcept {
+  // most gaps between tokens are empty or a single space
+  if (p == end || !json_is_space(*p)) return p;
+  ++p;
+#ifdef KWARGSCPP_JSON_SSE2
+  const __m128i space = _mm_set1_epi8(' '), newline = _mm_set1_epi8('\n'), ret = _mm_set1_epi8('\r'),
+                tab = _mm_set1_epi8('\t');
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i is_space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, newline)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(chunk, ret), _mm_cmpeq_epi8(chunk, tab)));
+    unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(is_space)) & 0xffff;
+    if (mask) return p + json_lowest_bit(mask);
+    p += 16;
+  }
+#endif
+  while (p != end && json_is_space(*p)) ++p;
+  return p;
+}
+
+// the first quote, backslash or control character in [p, end), 16 at a time where SSE2 is available
+inline const char *json_scan_string(const char *p, const char *end) noexcept {
+#ifdef KWARGSCPP_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'), control = _mm_set1_epi8(0x1f);
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    // unsigned c <= 0x1f exactly when max(c, 0x1f) == 0x1f
+    __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                   _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+    if (mask) return p + json_lowest_bit(mask);
+    p += 16;
+  }
+#endif
+  while (p != end && !json_is_special(*p)) ++p;
+  return p;
+}
+
+// Single-pass JSON parser, keeping the open arrays and objects on an explicit stack rather than recursing, so deeply
+// nested input does not overflow the native stack
+class JsonParser {
+ public:
+  explicit JsonParser(std::string_view text)
+      : begin_(text.data()), pos_(text.data()), end_(text.data() + text.size()) {}
+
+  void parse(ValueType &value) {
+    pos_ = json_skip_space(pos_, end_);
+    parse_value(value);
+    while (!stack_.empty()) {
+      Frame &frame = stack_.back();
+      pos_ = json_skip_space(pos_, end_);
+      if (!frame.first) {
+        // after an element: a comma or the closing bracket
+        if (pos_ != end_ && *pos_ == (frame.list ? ']' : '}')) {
+          ++pos_;
+          stack_.pop_back();
+          continue;
+        }
+        expect(',');
+        pos_ = json_skip_space(pos_, end_);
+      }
+      frame.first = false;
+      // parse_value may push, which invalidates `frame`
+      if (frame.list) {
+        parse_value(frame.list->emplace_back());
+      } else {
+        DictType &dict = *frame.dict;
+        if (pos_ == end_ || *pos_ != '"') fail("expected a string key");
+        std::string key;
+        parse_string(key);
+        pos_ = json_skip_space(pos_, end_);
+        expect(':');
+        pos_ = json_skip_space(pos_, end_);
+        parse_value(dict[std::move(key)]);
+      }
+    }
+    pos_ = json_skip_space(pos_, end_);
+    if (pos_ != end_) fail("unexpected trailing characters");
+  }
+
+ private:
+  struct Frame {
+    ListType *list;
+    DictType *dict;
+    bool first;
+  };
+
+  [[noreturn]] void fail(const char *what) const {
+    throw std::invalid_argument("invalid JSON at offset " + std::to_string(pos_ - begin_) + ": " + what);
+  }
+
+  void expect(char c) {
+    if (pos_ == end_ || *pos_ != c) fail(c == ',' ? "expected ',' or a closing bracket" : "expected ':'");
+    ++pos_;
+  }
+
+  void expect_literal(std::string_view literal) {
+    if (static_cast<size_t>(end_ - pos_) < literal.size() || std::string_view(pos_, literal.size()) != literal) {
+      fail("unexpected character");
+    }
+    pos_ += literal.size();
+  }
+
+  // scalars are parsed whole, arrays and objects are opened and pushed
+  void parse_value(ValueType &dest) {
+    if (pos_ == end_) fail("unexpected end of input");
+    switch (*pos_) {
+      case '{': {
+        ++pos_;
+        dest = DictType();
+        DictType &dict = dest.mutable_dict();
+        pos_ = json_skip_space(pos_, end_);
+        if (pos_ != end_ && *pos_ == '}') {
+          ++pos_;
+        } else {
+          stack_.push_back({nullptr, &dict, true});
+        }
+        break;
+      }
+      case '[': {
+        ++pos_;
+        dest = ListType();
+        ListType &list = dest.mutable_vector();
+        pos_ = json_skip_space(pos_, end_);
+        if (pos_ != end_ && *pos_ == ']') {
+          ++pos_;
+        } else {
+          stack_.push_back({&list, nullptr, true});
+        }
+        break;
+      }
+      case '"':
+        text_.clear();
+        parse_string(text_);
+        dest = std::string_view(text_);
+        break;
+      case 't':
+        expect_literal("true");
+        dest = true;
+        break;
+      case 'f':
+        expect_literal("false");
+        dest = false;
+        break;
+      case 'n':
+        fail("null has no ValueType");
+      case 'N':
+        expect_literal("NaN");
+        dest = std::numeric_limits<double>::quiet_NaN();
+        break;
+      case 'I':
+        expect_literal("Infinity");
+        dest = std::numeric_limits<double>::infinity();
+        break;
+      default:
+        parse_number(dest);
+        break;
+    }
+  }
+
+  void parse_string(std::string &out) {
+    ++pos_;
+    while (true) {
+      const char *run = pos_;
+      pos_ = json_scan_string(pos_, end_);
+      out.append(run, static_cast<size_t>(pos_ - run));
+      if (pos_ == end_) fail("unterminated string");
+      if (*pos_ == '"') {
+        ++pos_;
+        return;
+      }
+      if (*pos_ != '\\') fail("control character in string");
+      ++pos_;
+      if (pos_ == end_) fail("unterminated string");
+      char escaped = *pos_++;
+      switch (escaped) {
+        case '"':
+        case '\\':
+        case '/':
+          out.push_back(escaped);
+          break;
+        case 'b':
+          out.push_back('\b');
+          break;
+        case 'f':
+          out.push_back('\f');
+          break;
+        case 'n':
+          out.push_back('\n');
+          break;
+        case 'r':
+          out.push_back('\r');
+          break;
+        case 't':
+          out.push_back('\t');
+          break;
+        case 'u':
+          append_utf8(out, parse_code_point());
+          break;
+        default:
+          --pos_;
+          fail("invalid escape");
+      }
+    }
+  }
+
+  uint32_t parse_hex4() {
+    if (end_ - pos_ < 4) fail("invalid \\u escape");
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+      char c = *pos_++;
+      value <<= 4;
+      if (c >= '0' && c <= '9') {
+        value |= static_cast<uint32_t>(c - '0');
+      } else if (c >= 'a' && c <= 'f') {
+        value |= static_cast<uint32_t>(c - 'a' + 10);
+      } else if (c >= 'A' && c <= 'F') {
+        value |= static_cast<uint32_t>(c - 'A' + 10);
+      } else {
+        fail("invalid \\u escape");
+      }
+    }
+    return value;
+  }
+
+  // the code point of a \u escape, the 'u' consumed, combining a surrogate pair
+  uint32_t parse_code_point() {
+    uint32_t unit = parse_hex4();
+    if (unit >= 0xdc00 && unit <= 0xdfff) fail("unpaired surrogate");
+    if (unit < 0xd800 || unit > 0xdbff) return unit;
+    if (end_ - pos_ < 2 || pos_[0] != '\\' || pos_[1] != 'u') fail("unpaired surrogate");
+    pos_ += 2;
+    uint32_t low = parse_hex4();
+    if (low < 0xdc00 || low > 0xdfff) fail("unpaired surrogate");
+    return 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00);
+  }
+
+  static void append_utf8(std::string &out, uint32_t code_point) {
+    if (code_point < 0x80) {
+      out.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+      out.push_back(static_cast<char>(0xc0 | (code_point >> 6)));
+      out.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    } else if (code_point < 0x10000) {
+      out.push_back(static_cast<char>(0xe0 | (code_point >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    } else {
+      out.push_back(static_cast<char>(0xf0 | (code_point >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    }
+  }
+
+  static bool is_digit(char c) noexcept { return c >= '0' && c <= '9'; }
+
+  void skip_digits() {
+    if (pos_ == end_ || !is_digit(*pos_)) fail("invalid number");
+    while (pos_ != end_ && is_digit(*pos_)) ++pos_;
+  }
+
+  void parse_number(ValueType &dest) {
+    const char *start = pos_;
+    const bool negative = *pos_ == '-';
+    if (negative) ++pos_;
+    if (negative && pos_ != end_ && *pos_ == 'I') {
+      expect_literal("Infinity");
+      dest = -std::numeric_limits<double>::infinity();
+      return;
+    }
+    if (pos_ == end_ || !is_digit(*pos_)) fail("unexpected character");
+    // the integer part, accumulated while it fits
+    uint64_t magnitude = 0;
+    bool overflow = false;
+    if (*pos_ == '0') {
+      ++pos_;
+    } else {
+      for (; pos_ != end_ && is_digit(*pos_); ++pos_) {
+        auto digit = static_cast<uint64_t>(*pos_ - '0');
+        if (magnitude > (UINT64_MAX - digit) / 10) overflow = true;
+        magnitude = magnitude * 10 + digit;
+      }
+    }
+    bool integer = true;
+    if (pos_ != end_ && *pos_ == '.') {
+      ++pos_;
+      skip_digits();
+      integer = false;
+    }
+    if (pos_ != end_ && (*pos_ == 'e' || *pos_ == 'E')) {
+      ++pos_;
+      if (pos_ != end_ && (*pos_ == '+' || *pos_ == '-')) ++pos_;
+      skip_digits();
+      integer = false;
+    }
+    if (integer && !overflow) {
+      if (!negative && magnitude <= static_cast<uint64_t>(INTMAX_MAX)) {
+        dest = static_cast<intmax_t>(magnitude);
+        return;
+      }
+      if (!negative) {
+        dest = static_cast<uintmax_t>(magnitude);
+        return;
+      }
+      if (magnitude <= static_cast<uint64_t>(INTMAX_MAX) + 1) {
+        dest = magnitude == 0 ? intmax_t(0) : -static_cast<intmax_t>(magnitude - 1) - 1;
+        return;
+      }
+    }
+    dest = parse_double(start, pos_);
+  }
+
+  // exactly rounded with std::from_chars where the library has it for floating point
+  static double parse_double(const char *first, const char *last) {
+    double value = 0;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto result = std::from_chars(first, last, value);
+    if (result.ec == std::errc() && result.ptr == last) return value;
+#endif
+    // out of range, which strtod turns into infinity or a denormal, or no floating-point from_chars
+    return std::strtod(std::string(first, last).c_str(), nullptr);
+  }
+
+  const char *begin_;
+  const char *pos_;
+  const char *end_;
+  std::vector<Frame> stack_;
+  // unescaped text of the string value being read, copied into a String once complete
+  std::string text_;
+};
+
+}  // namespace detail
+
+inline ValueType from_json(std::string_view text) {
+  ValueType value;
+  detail::JsonParser(text).parse(value);
+  return value;
+}
+
+inline DictType from_json_dict(std::string_view text) {
+  ValueType value = from_json(text);
+  if (!value.is_dict()) throw std::invalid_argument("invalid JSON: not an object");
+  return std::move(value.mutable_dict());
+}
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_JSON_H
@@ -2,35 +2,156 @@
 #define KWARGS_H
 
 #include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iosfwd>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "kwargscpp/array.h"
+#include "kwargscpp/cow.h"
+#include "kwargscpp/string.h"
+#ifdef KWARGSCPP_ORDERED_DICT
+#include "kwargscpp/ordered_dict.h"
+#endif
+
 namespace kwargscpp {
 
 using KeyType = std::string;
-struct ValueType;
-using DictType = std::unordered_map<KeyType, ValueType>;
+class ValueType;
+
+// hash of a key, FNV-1a so it can be computed at compile time
+constexpr size_t hash_key(std::string_view key) noexcept {
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : key) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  return static_cast<size_t>(hash);
+}
+
+// A key with its hash computed once, e.g. `constexpr Key epochs = "epochs"_kw;`, to be reused across lookups
+struct Key {
+  std::string_view name;
+  size_t hash;
+
+  constexpr Key(std::string_view name) noexcept : name(name), hash(hash_key(name)) {}
+  constexpr Key(std::string_view name, size_t hash) noexcept : name(name), hash(hash) {}
+  constexpr operator std::string_view() const noexcept { return name; }
+};
+
+inline namespace literals {
+constexpr Key operator""_kw(const char *name, size_t size) noexcept { return Key(std::string_view(name, size)); }
+}  // namespace literals
+
+namespace detail {
+// Without heterogeneous lookup (before C++20) a std::unordered_map is probed with a reused per-thread key buffer, see
+// detail::probe_key. While it is, KeyHash reports `probe_hash` for that buffer rather than hashing it again.
+inline thread_local const void *probe_buffer = nullptr;
+inline thread_local size_t probe_hash = 0;
+}  // namespace detail
+
+// Transparent hash and equality of DictType, so a std::string_view or Key is looked up without building a KeyType.
+// A Key's hash is taken as is.
+struct KeyHash {
+  using is_transparent = void;
+  size_t operator()(std::string_view key) const noexcept { return hash_key(key); }
+  size_t operator()(const Key &key) const noexcept { return key.hash; }
+#ifndef __cpp_lib_generic_unordered_lookup
+  template <typename Alloc>
+  size_t operator()(const std::basic_string<char, std::char_traits<char>, Alloc> &key) const noexcept {
+    return &key == detail::probe_buffer ? detail::probe_hash : hash_key(key);
+  }
+#endif
+};
+
+struct KeyEqual {
+  using is_transparent = void;
+  bool operator()(std::string_view lhs, std::string_view rhs) const noexcept { return lhs == rhs; }
+};
+
+// Define KWARGSCPP_ORDERED_DICT to use the insertion-ordered OrderedDict instead of std::unordered_map
+#ifdef KWARGSCPP_ORDERED_DICT
+using DictType = OrderedDict<KeyType, ValueType, KeyHash, KeyEqual>;
+#else
+using DictType = std::unordered_map<KeyType, ValueType, KeyHash, KeyEqual>;
+#endif
+using ListType = std::vector<ValueType>;
+// A dict held copy-on-write, as inside ValueType. The Python bindings can expose it as an opaque Mapping (see
+// bind_shared_dict), so it crosses the boundary without converting the tree.
+using SharedDict = Cow<DictType>;
 
-// Definition of ValueType
-struct ValueType
-    : public std::variant<intmax_t, uintmax_t, double, bool, std::string, std::vector<ValueType>, DictType> {
-  using variant::variant;
+namespace detail {
+// position of T among the alternatives of ValueType, as index() reports it
+template <typename T>
+constexpr size_t value_index = size_t(-1);
+template <>
+inline constexpr size_t value_index<intmax_t> = 0;
+template <>
+inline constexpr size_t value_index<uintmax_t> = 1;
+template <>
+inline constexpr size_t value_index<double> = 2;
+template <>
+inline constexpr size_t value_index<bool> = 3;
+template <>
+inline constexpr size_t value_index<String> = 4;
+template <>
+inline constexpr size_t value_index<Cow<ListType>> = 5;
+template <>
+inline constexpr size_t value_index<Cow<DictType>> = 6;
+template <>
+inline constexpr size_t value_index<Array> = 7;
+}  // namespace detail
 
+// Definition of ValueType, a tagged 16-byte value holding one of intmax_t, uintmax_t, double, bool, String,
+// Cow<ListType>, Cow<DictType> or Array, in that index() order. Scalars take the first word and strings of up to
+// String::kInlineCapacity characters are stored inline; longer strings, lists, dicts and Arrays are held by one
+// reference-counted pointer. Lists and dicts are copy-on-write, so copies of a value share its subtree until one of
+// them is written through mutable_vector()/mutable_dict(). The tag is kept in the last byte, whose high bit marks a
+// String (see String).
+//
+// Besides the is_*/as_* accessors, get_if<T>() and get<T>() reach an alternative the way std::get_if and std::get do
+// for a std::variant, and kwargscpp::visit calls a visitor with the held alternative, as std::visit does.
+class ValueType {
+ public:
     // Constructors for convenience
-    ValueType();
+    ValueType() noexcept;
     template <typename T, std::enable_if_t<std::is_integral_v<T>, bool> = true>
-    ValueType(const T &v);
-    ValueType(const double &v);
-    ValueType(const bool &v);
+    ValueType(const T &v) noexcept;
+    ValueType(const double &v) noexcept;
+    ValueType(const bool &v) noexcept;
     ValueType(const std::string &v);
+    ValueType(std::string_view v);
     ValueType(const char *v);
+    ValueType(const String &v) noexcept;
+    ValueType(String &&v) noexcept;
     ValueType(const std::vector<ValueType> &v);
     ValueType(const DictType &v);
+    // Lists and dicts passed by rvalue are moved in, not copied
+    ValueType(std::vector<ValueType> &&v);
+    ValueType(DictType &&v);
+    // A list or dict payload, shared
+    ValueType(const Cow<ListType> &v) noexcept;
+    ValueType(Cow<ListType> &&v) noexcept;
+    ValueType(const Cow<DictType> &v) noexcept;
+    ValueType(Cow<DictType> &&v) noexcept;
+    ValueType(const Array &v) noexcept;
+    ValueType(Array &&v) noexcept;
+
+    ValueType(const ValueType &other) noexcept;
+    ValueType(ValueType &&other) noexcept;
+    ValueType &operator=(const ValueType &other) noexcept;
+    ValueType &operator=(ValueType &&other) noexcept;
+    ~ValueType();
 
     // Member functions
+    size_t index() const noexcept;
     bool is_int() const;
     bool is_uint() const;
     bool is_double() const;
@@ -38,38 +159,246 @@ struct ValueType
     bool is_string() const;
     bool is_vector() const;
     bool is_dict() const;
+    bool is_array() const;
 
     intmax_t as_int() const;
     uintmax_t as_uint() const;
     double as_double() const;
     bool as_bool() const;
-    const std::string& as_string() const;
+    const String& as_string() const;
     const std::vector<ValueType>& as_vector() const;
     const DictType& as_dict() const;
+    const Array& as_array() const;
+
+    // Writable access to a list or dict, which is cloned first if other copies of the value share it
+    std::vector<ValueType>& mutable_vector();
+    DictType& mutable_dict();
+    Array& mutable_array();
+
+    // The alternative T (a scalar, String, Cow<ListType>, Cow<DictType> or Array): nullptr from get_if, and
+    // std::bad_variant_access from get, if another one is held
+    template <typename T>
+    bool holds() const noexcept { return index() == detail::value_index<T>; }
+    template <typename T>
+    const T *get_if() const noexcept { return holds<T>() ? &unchecked<T>() : nullptr; }
+    template <typename T>
+    T *get_if() noexcept { return holds<T>() ? &unchecked<T>() : nullptr; }
+    template <typename T>
+    const T &get() const;
+    template <typename T>
+    T &get();
+
+    friend bool operator==(const ValueType &lhs, const ValueType &rhs);
+    friend bool operator!=(const ValueType &lhs, const ValueType &rhs) { return !(lhs == rhs); }
+
+    template <typename F>
+    friend decltype(auto) visit(F &&f, const ValueType &value);
+    template <typename F>
+    friend decltype(auto) visit(F &&f, ValueType &value);
+
+ private:
+    template <typename T>
+    const T &unchecked() const noexcept;
+    template <typename T>
+    T &unchecked() noexcept {
+      return const_cast<T &>(static_cast<const ValueType *>(this)->unchecked<T>());
+    }
+    unsigned char tag() const noexcept;
+    void set_tag(size_t index) noexcept;
+    void destroy() noexcept;
+
+    union {
+      intmax_t int_;
+      uintmax_t uint_;
+      double double_;
+      bool bool_;
+      String string_;
+      Cow<ListType> list_;
+      Cow<DictType> dict_;
+      Array array_;
+    };
 };
 
+// Call `f` with the alternative held by `value`, like std::visit on a variant
+template <typename F>
+decltype(auto) visit(F &&f, const ValueType &value);
+template <typename F>
+decltype(auto) visit(F &&f, ValueType &value);
+
 // string representation of the dictionary
 std::string to_string(const DictType &dict);
 // string representation of the value
 std::string to_string(const ValueType &value);
 
-// set a key-value pair in the dictionary
-inline void set(DictType &dict, const KeyType &key, const ValueType &value) { dict[key] = value; }
+// How to_json lays out its output
+struct JsonOptions {
+  // write the keys of each dict in byte order rather than iteration order, so equal dicts give equal text
+  bool sort_keys = false;
+};
+
+// Writing values as JSON text, ", " and ": " separated like Python's json.dumps, in one pass over the tree. Strings are
+// escaped, doubles written in the shortest form that reads back exactly, and Arrays as nested lists. JSON has no
+// infinity or NaN, which are written as Infinity, -Infinity and NaN the way Python does, and read back by from_json.
+// to_string is to_json with the defaults.
+
+// append the JSON text of a value or dict to `out`
+void to_json(const ValueType &value, std::string &out, const JsonOptions &options = {});
+void to_json(const DictType &dict, std::string &out, const JsonOptions &options = {});
+// write the JSON text of a value or dict to `os`, through a fixed-size buffer
+void to_json(const ValueType &value, std::ostream &os, const JsonOptions &options = {});
+void to_json(const DictType &dict, std::ostream &os, const JsonOptions &options = {});
+std::string to_json(const ValueType &value, const JsonOptions &options = {});
+std::string to_json(const DictType &dict, const JsonOptions &options = {});
+
+// Keys are taken as std::string_view, so string literals are looked up without a temporary std::string, or as a
+// precomputed Key, whose hash is reused. Before C++20, std::unordered_map has no heterogeneous lookup, so the name is
+// copied into a per-thread KeyType buffer that keeps its capacity across lookups, and KeyHash answers `probe_hash`
+// for that buffer instead of hashing it again (see detail::probe_key). The OrderedDict flavor looks up views directly.
+
+// set a key-value pair in the dictionary, a value passed by rvalue is moved into place
+void set(DictType &dict, std::string_view key, const ValueType &value);
+void set(DictType &dict, std::string_view key, ValueType &&value);
+void set(DictType &dict, const Key &key, const ValueType &value);
+void set(DictType &dict, const Key &key, ValueType &&value);
 // check if a key exists in the dictionary
-inline bool has_key(const DictType &dict, const KeyType &key) { return dict.find(key) != dict.end(); }
+bool has_key(const DictType &dict, std::string_view key);
+bool has_key(const DictType &dict, const Key &key);
+
+// Why a typed lookup found no value
+enum class ErrorCode { ok = 0, key_not_found, wrong_type, index_out_of_range, malformed_path };
+
+// Result of try_get: the value, or the ErrorCode telling why there is none. Accessing the value of an error result
+// throws the exception get_or_die would have thrown.
+template <typename T>
+class Result {
+ public:
+  Result(T value) : value_(std::move(value)), error_(ErrorCode::ok) {}
+  Result(ErrorCode error) noexcept : error_(error) {}
+
+  bool has_value() const noexcept { return value_.has_value(); }
+  explicit operator bool() const noexcept { return has_value(); }
+  ErrorCode error() const noexcept { return error_; }
+
+  const T &value() const &;
+  T &value() &;
+  T &&value() &&;
+  template <typename U>
+  T value_or(U &&default_value) const & { return value_ ? *value_ : static_cast<T>(std::forward<U>(default_value)); }
+  template <typename U>
+  T value_or(U &&default_value) && {
+    return value_ ? std::move(*value_) : static_cast<T>(std::forward<U>(default_value));
+  }
+
+  const T &operator*() const & { return *value_; }
+  T &operator*() & { return *value_; }
+  T &&operator*() && { return std::move(*value_); }
+  const T *operator->() const { return &*value_; }
+  T *operator->() { return &*value_; }
+
+ private:
+  std::optional<T> value_;
+  ErrorCode error_;
+};
+
+// get a value from the dictionary without throwing, with the same conversions as get_or_die
+template <typename T>
+Result<T> try_get(const DictType &dict, std::string_view key);
+template <typename T>
+Result<T> try_get(const DictType &dict, const Key &key);
 
 // get a value from the dictionary
 template <typename T>
-T get_or_die(const DictType &dict, const KeyType &key);
+T get_or_die(const DictType &dict, std::string_view key);
+template <typename T>
+T get_or_die(const DictType &dict, const Key &key);
 // get a value from the dictionary with a default value
 template <typename T>
-T get(const DictType &dict, const KeyType &key, const T &default_value);
+T get(const DictType &dict, std::string_view key, const T &default_value);
+template <typename T>
+T get(const DictType &dict, const Key &key, const T &default_value);
+
+// Non-owning view of a contiguous range, std::span for C++17
+template <typename T>
+class Span {
+ public:
+  constexpr Span() noexcept = default;
+  constexpr Span(T *data, size_t size) noexcept : data_(data), size_(size) {}
+  template <typename Container, typename = decltype(std::declval<Container &>().data())>
+  constexpr Span(Container &container) noexcept : data_(container.data()), size_(container.size()) {}
+
+  constexpr T *data() const noexcept { return data_; }
+  constexpr size_t size() const noexcept { return size_; }
+  constexpr bool empty() const noexcept { return size_ == 0; }
+  constexpr T *begin() const noexcept { return data_; }
+  constexpr T *end() const noexcept { return data_ + size_; }
+  constexpr T &operator[](size_t index) const noexcept { return data_[index]; }
+
+ private:
+  T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Borrowed access, without copying the value out of the dictionary. The results refer into the dictionary and stay
+// valid until it, or the entry, is modified or destroyed.
+
+// a reference to the stored value, which must be of type T exactly (a scalar, String, ListType, DictType or Array),
+// throwing like get_or_die otherwise
+template <typename T>
+const T &get_ref(const DictType &dict, std::string_view key);
+template <typename T>
+const T &get_ref(const DictType &dict, const Key &key);
+// same without throwing: nullptr if there is no such value, in which case `error` is set to the reason
+template <typename T>
+const T *try_get_ref(const DictType &dict, std::string_view key, ErrorCode *error = nullptr) noexcept;
+template <typename T>
+const T *try_get_ref(const DictType &dict, const Key &key, ErrorCode *error = nullptr) noexcept;
+
+// a view of the stored string as std::string_view, of the stored list as Span<const ValueType>, or of the elements
+// of the stored Array as e.g. Span<const float>
+template <typename T>
+Result<T> try_get_view(const DictType &dict, std::string_view key) noexcept;
+template <typename T>
+Result<T> try_get_view(const DictType &dict, const Key &key) noexcept;
+template <typename T>
+T get_view(const DictType &dict, std::string_view key);
+template <typename T>
+T get_view(const DictType &dict, const Key &key);
+template <typename T>
+T get_view(const DictType &dict, std::string_view key, T default_value) noexcept;
+template <typename T>
+T get_view(const DictType &dict, const Key &key, T default_value) noexcept;
 
 // add a prefix to all keys in the dictionary, not recursive to nested dictionaries
 DictType with_prefix(const DictType &dict, const std::string &prefix);
+// same, consuming `dict`: its entries are moved over instead of copied
+DictType with_prefix(DictType &&dict, const std::string &prefix);
 
 // merge two dictionaries, the second dictionary overwrites the first one, not recursive to nested dictionaries
 DictType merge(const DictType &dict, const DictType &other);
+// same, consuming the dictionaries passed by rvalue: their entries are moved into the result instead of copied
+DictType merge(DictType &&dict, const DictType &other);
+DictType merge(DictType &&dict, DictType &&other);
+
+// How deep_merge_into combines two lists at the same key
+enum class ListMerge { replace, append };
+
+struct MergeOptions {
+  ListMerge lists = ListMerge::replace;
+  // Called where both sides hold a value that is not merged recursively, i.e. not two dicts nor two lists appended,
+  // with the dotted path of the key, the target's value and the override's, instead of the override replacing the
+  // target's value. It may keep either, combine them or throw.
+  std::function<void(const std::string &path, ValueType &target, ValueType &&value)> on_conflict;
+};
+
+// Merge `overrides` into `target` recursively: a dict in both is merged key by key, other values of `overrides` replace
+// those of `target`, and keys only in `target` are left alone. Subtrees only in `overrides` are moved in or, from a
+// const dict, shared, and only the shared dicts of `target` that are written to are cloned, so the cost follows the
+// size of `overrides` rather than of `target`.
+void deep_merge_into(DictType &target, DictType &&overrides, const MergeOptions &options = {});
+void deep_merge_into(DictType &target, const DictType &overrides, const MergeOptions &options = {});
+// the layers deep-merged in order, each overriding the ones before, e.g. merge_layers({defaults, site, request})
+DictType merge_layers(std::initializer_list<std::reference_wrapper<const DictType>> layers,
+                      const MergeOptions &options = {});
 
 }  // namespace kwargs
 
@@ -1,195 +1,990 @@
 #ifndef KWARGS_IMPL_H
 #define KWARGS_IMPL_H
 
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <ostream>
+
 #include "kwargs.h"
 
 namespace kwargscpp {
 
 // Constructors for convenience
-inline ValueType::ValueType() : variant() {}
+inline ValueType::ValueType() noexcept : int_(0) { set_tag(0); }
 
 template <typename T, std::enable_if_t<std::is_integral_v<T>, bool>>
-inline ValueType::ValueType(const T &v) : variant(static_cast<std::conditional_t<std::is_signed_v<T>, intmax_t, uintmax_t>>(v)) {}
+inline ValueType::ValueType(const T &v) noexcept {
+  if constexpr (std::is_signed_v<T>) {
+    int_ = v;
+    set_tag(0);
+  } else {
+    uint_ = v;
+    set_tag(1);
+  }
+}
+
+inline ValueType::ValueType(const double &v) noexcept : double_(v) { set_tag(2); }
+inline ValueType::ValueType(const bool &v) noexcept : bool_(v) { set_tag(3); }
+inline ValueType::ValueType(const std::string &v) : string_(v) {}
+inline ValueType::ValueType(std::string_view v) : string_(v) {}
+inline ValueType::ValueType(const char *v) : string_(v) {}
+inline ValueType::ValueType(const String &v) noexcept : string_(v) {}
+inline ValueType::ValueType(String &&v) noexcept : string_(std::move(v)) {}
+inline ValueType::ValueType(const std::vector<ValueType> &v) : list_(v) { set_tag(5); }
+inline ValueType::ValueType(const DictType &v) : dict_(v) { set_tag(6); }
+inline ValueType::ValueType(std::vector<ValueType> &&v) : list_(std::move(v)) { set_tag(5); }
+inline ValueType::ValueType(DictType &&v) : dict_(std::move(v)) { set_tag(6); }
+inline ValueType::ValueType(const Cow<ListType> &v) noexcept : list_(v) { set_tag(5); }
+inline ValueType::ValueType(Cow<ListType> &&v) noexcept : list_(std::move(v)) { set_tag(5); }
+inline ValueType::ValueType(const Cow<DictType> &v) noexcept : dict_(v) { set_tag(6); }
+inline ValueType::ValueType(Cow<DictType> &&v) noexcept : dict_(std::move(v)) { set_tag(6); }
+inline ValueType::ValueType(const Array &v) noexcept : array_(v) { set_tag(7); }
+inline ValueType::ValueType(Array &&v) noexcept : array_(std::move(v)) { set_tag(7); }
+
+// Copy and move. A scalar is copied as its word, the other alternatives through their own constructors.
+inline ValueType::ValueType(const ValueType &other) noexcept {
+  switch (other.index()) {
+    case 4:
+      new (&string_) String(other.string_);
+      return;
+    case 5:
+      new (&list_) Cow<ListType>(other.list_);
+      break;
+    case 6:
+      new (&dict_) Cow<DictType>(other.dict_);
+      break;
+    case 7:
+      new (&array_) Array(other.array_);
+      break;
+    default:
+      std::memcpy(static_cast<void *>(this), &other, sizeof(uintmax_t));
+      break;
+  }
+  set_tag(other.index());
+}
+
+inline ValueType::ValueType(ValueType &&other) noexcept {
+  switch (other.index()) {
+    case 4:
+      new (&string_) String(std::move(other.string_));
+      return;
+    case 5:
+      new (&list_) Cow<ListType>(std::move(other.list_));
+      break;
+    case 6:
+      new (&dict_) Cow<DictType>(std::move(other.dict_));
+      break;
+    case 7:
+      new (&array_) Array(std::move(other.array_));
+      break;
+    default:
+      std::memcpy(static_cast<void *>(this), &other, sizeof(uintmax_t));
+      break;
+  }
+  set_tag(other.index());
+}
+
+// `other` may live inside the subtree of this value, so it is taken before this value is destroyed
+inline ValueType &ValueType::operator=(const ValueType &other) noexcept {
+  if (this != &other) {
+    ValueType copy(other);
+    destroy();
+    new (this) ValueType(std::move(copy));
+  }
+  return *this;
+}
+
+inline ValueType &ValueType::operator=(ValueType &&other) noexcept {
+  if (this != &other) {
+    ValueType value(std::move(other));
+    destroy();
+    new (this) ValueType(std::move(value));
+  }
+  return *this;
+}
 
-inline ValueType::ValueType(const double &v) : variant(v) {}
-inline ValueType::ValueType(const bool &v) : variant(v) {}
-inline ValueType::ValueType(const std::string &v) : variant(v) {}
-inline ValueType::ValueType(const char *v) : variant(std::string(v)) {}
-inline ValueType::ValueType(const std::vector<ValueType> &v) : variant(v) {}
-inline ValueType::ValueType(const DictType &v) : variant(v) {}
+inline ValueType::~ValueType() { destroy(); }
+
+inline void ValueType::destroy() noexcept {
+  switch (index()) {
+    case 4:
+      string_.~String();
+      break;
+    case 5:
+      list_.~Cow<ListType>();
+      break;
+    case 6:
+      dict_.~Cow<DictType>();
+      break;
+    case 7:
+      array_.~Array();
+      break;
+    default:
+      break;
+  }
+}
+
+// The tag is the last byte of the value, also the last byte of a String, which has its high bit set
+inline unsigned char ValueType::tag() const noexcept { return reinterpret_cast<const unsigned char *>(this)[15]; }
+
+inline void ValueType::set_tag(size_t index) noexcept {
+  reinterpret_cast<unsigned char *>(this)[15] = static_cast<unsigned char>(index);
+}
+
+inline size_t ValueType::index() const noexcept {
+  const unsigned char t = tag();
+  return t & 0x80 ? detail::value_index<String> : t;
+}
+
+template <typename T>
+inline const T &ValueType::unchecked() const noexcept {
+  static_assert(detail::value_index<T> != size_t(-1),
+                "not an alternative of ValueType: intmax_t, uintmax_t, double, bool, String, Cow<ListType>, "
+                "Cow<DictType> or Array");
+  if constexpr (std::is_same_v<T, intmax_t>) {
+    return int_;
+  } else if constexpr (std::is_same_v<T, uintmax_t>) {
+    return uint_;
+  } else if constexpr (std::is_same_v<T, double>) {
+    return double_;
+  } else if constexpr (std::is_same_v<T, bool>) {
+    return bool_;
+  } else if constexpr (std::is_same_v<T, String>) {
+    return string_;
+  } else if constexpr (std::is_same_v<T, Cow<ListType>>) {
+    return list_;
+  } else if constexpr (std::is_same_v<T, Cow<DictType>>) {
+    return dict_;
+  } else {
+    return array_;
+  }
+}
+
+template <typename T>
+inline const T &ValueType::get() const {
+  if (!holds<T>()) throw std::bad_variant_access();
+  return unchecked<T>();
+}
+
+template <typename T>
+inline T &ValueType::get() {
+  if (!holds<T>()) throw std::bad_variant_access();
+  return unchecked<T>();
+}
+
+template <typename F>
+decltype(auto) visit(F &&f, const ValueType &value) {
+  switch (value.index()) {
+    case 0:
+      return std::invoke(std::forward<F>(f), value.int_);
+    case 1:
+      return std::invoke(std::forward<F>(f), value.uint_);
+    case 2:
+      return std::invoke(std::forward<F>(f), value.double_);
+    case 3:
+      return std::invoke(std::forward<F>(f), value.bool_);
+    case 4:
+      return std::invoke(std::forward<F>(f), value.string_);
+    case 5:
+      return std::invoke(std::forward<F>(f), value.list_);
+    case 6:
+      return std::invoke(std::forward<F>(f), value.dict_);
+    default:
+      return std::invoke(std::forward<F>(f), value.array_);
+  }
+}
+
+template <typename F>
+decltype(auto) visit(F &&f, ValueType &value) {
+  switch (value.index()) {
+    case 0:
+      return std::invoke(std::forward<F>(f), value.int_);
+    case 1:
+      return std::invoke(std::forward<F>(f), value.uint_);
+    case 2:
+      return std::invoke(std::forward<F>(f), value.double_);
+    case 3:
+      return std::invoke(std::forward<F>(f), value.bool_);
+    case 4:
+      return std::invoke(std::forward<F>(f), value.string_);
+    case 5:
+      return std::invoke(std::forward<F>(f), value.list_);
+    case 6:
+      return std::invoke(std::forward<F>(f), value.dict_);
+    default:
+      return std::invoke(std::forward<F>(f), value.array_);
+  }
+}
+
+// Equal if the same alternative is held and compares equal, lists and dicts by content
+inline bool operator==(const ValueType &lhs, const ValueType &rhs) {
+  if (lhs.index() != rhs.index()) return false;
+  return visit([&rhs](const auto &arg) { return arg == rhs.unchecked<std::decay_t<decltype(arg)>>(); }, lhs);
+}
+
+static_assert(sizeof(ValueType) == 16, "ValueType is two words");
 
 // Implementation of member functions
 inline bool ValueType::is_int() const {
-    return std::holds_alternative<intmax_t>(*this);
+    return holds<intmax_t>();
 }
 
 inline bool ValueType::is_uint() const {
-    return std::holds_alternative<uintmax_t>(*this);
+    return holds<uintmax_t>();
 }
 
 inline bool ValueType::is_double() const {
-    return std::holds_alternative<double>(*this);
+    return holds<double>();
 }
 
 inline bool ValueType::is_bool() const {
-    return std::holds_alternative<bool>(*this);
+    return holds<bool>();
 }
 
 inline bool ValueType::is_string() const {
-    return std::holds_alternative<std::string>(*this);
+    return holds<String>();
 }
 
 inline bool ValueType::is_vector() const {
-    return std::holds_alternative<std::vector<ValueType>>(*this);
+    return holds<Cow<ListType>>();
 }
 
 inline bool ValueType::is_dict() const {
-    return std::holds_alternative<DictType>(*this);
+    return holds<Cow<DictType>>();
+}
+
+inline bool ValueType::is_array() const {
+    return holds<Array>();
 }
 
 inline intmax_t ValueType::as_int() const {
-    return std::get<intmax_t>(*this);
+    return get<intmax_t>();
 }
 
 inline uintmax_t ValueType::as_uint() const {
-    return std::get<uintmax_t>(*this);
+    return get<uintmax_t>();
 }
 
 inline double ValueType::as_double() const {
-    return std::get<double>(*this);
+    return get<double>();
 }
 
 inline bool ValueType::as_bool() const {
-    return std::get<bool>(*this);
+    return get<bool>();
 }
 
-inline const std::string& ValueType::as_string() const {
-    return std::get<std::string>(*this);
+inline const String& ValueType::as_string() const {
+    return get<String>();
 }
 
 inline const std::vector<ValueType>& ValueType::as_vector() const {
-    return std::get<std::vector<ValueType>>(*this);
+    return get<Cow<ListType>>().get();
 }
 
 inline const DictType& ValueType::as_dict() const {
-    return std::get<DictType>(*this);
+    return get<Cow<DictType>>().get();
 }
 
-template <typename T>
-T get_or_die(const DictType &dict, const KeyType &key) {
-  auto it = dict.find(key);
+inline const Array& ValueType::as_array() const {
+    return get<Array>();
+}
+
+inline std::vector<ValueType>& ValueType::mutable_vector() {
+    return get<Cow<ListType>>().mutate();
+}
+
+inline DictType& ValueType::mutable_dict() {
+    return get<Cow<DictType>>().mutate();
+}
+
+inline Array& ValueType::mutable_array() {
+    return get<Array>();
+}
+
+namespace detail {
+
+// Look up `name` with its `hash` in a std::unordered_map without heterogeneous lookup, through `buffer`, a key kept
+// for reuse so no KeyType is allocated or rehashed per lookup
+template <typename Dict>
+auto probe_key(Dict &dict, typename Dict::key_type &buffer, std::string_view name, size_t hash) {
+  buffer.assign(name.data(), name.size());
+  probe_buffer = &buffer;
+  probe_hash = hash;
+  auto it = dict.find(buffer);
+  probe_buffer = nullptr;
+  return it;
+}
+
+// Look up `key`, a std::string_view or Key, without building a KeyType, reusing the hash of a Key
+template <typename Dict, typename K>
+auto find_key(Dict &dict, const K &key) {
+#if defined(KWARGSCPP_ORDERED_DICT) || defined(__cpp_lib_generic_unordered_lookup)
+  return dict.find(key);
+#else
+  thread_local KeyType buffer;
+  return probe_key(dict, buffer, std::string_view(key), KeyHash()(key));
+#endif
+}
+
+template <typename K, typename V>
+void set(DictType &dict, const K &key, V &&value) {
+  auto it = find_key(dict, key);
   if (it != dict.end()) {
-    return std::visit(
-        [](auto &&arg) -> T {
+    it->second = std::forward<V>(value);
+  } else {
+    dict.emplace(KeyType(std::string_view(key)), std::forward<V>(value));
+  }
+}
+
+// Convert a stored value to T: the value itself, the stored type, a std::string from a String, or any arithmetic type
+// (bool included) from an arithmetic value. Anything else, e.g. a string asked for as a number, is a wrong type.
+// Asking for a ValueType is O(1) for lists and dicts too, since it shares their payload.
+template <typename T>
+Result<T> convert(const ValueType &value) {
+  if constexpr (std::is_same_v<T, ValueType>) {
+    return value;
+  } else {
+    return visit(
+        [](const auto &arg) -> Result<T> {
           using ArgType = std::decay_t<decltype(arg)>;
           // If the requested type matches the stored type, return it directly
           if constexpr (std::is_same_v<T, ArgType>) {
             return arg;
+          } else if constexpr (std::is_same_v<Cow<T>, ArgType>) {
+            return arg.get();
+          } else if constexpr (std::is_same_v<T, std::string> && std::is_same_v<ArgType, String>) {
+            return std::string(arg);
           }
           // Handle conversions between numeric types and bool
-          else if constexpr ((std::is_integral_v<T> && std::is_arithmetic_v<ArgType>) ||
-                             (std::is_floating_point_v<T> && std::is_arithmetic_v<ArgType>) ||
-                             (std::is_same_v<T, bool> && std::is_arithmetic_v<ArgType>)) {
-            // Perform static_cast for valid conversions
+          else if constexpr (std::is_arithmetic_v<T> && std::is_arithmetic_v<ArgType>) {
             return static_cast<T>(arg);
-          }
-          // Handle conversion from bool to numeric types
-          else if constexpr (std::is_floating_point_v<T> && std::is_same_v<ArgType, bool>) {
-            return arg ? static_cast<T>(1) : static_cast<T>(0);
-          } else if constexpr (std::is_integral_v<T> && std::is_same_v<ArgType, bool>) {
-            return arg ? static_cast<T>(1) : static_cast<T>(0);
-          }
-          // Handle nested DictType
-          else if constexpr (std::is_same_v<T, DictType>) {
-            if constexpr (std::is_same_v<ArgType, DictType>) {
-              return arg;
-            } else {
-              throw std::bad_variant_access();
-            }
-          }
-          // For strings, do not attempt conversion; throw an exception
-          else if constexpr (std::is_same_v<T, std::string>) {
-            throw std::bad_variant_access();  // Or a custom exception/message
           } else {
-            // If conversion is not possible, throw an exception
-            throw std::bad_variant_access();
+            return ErrorCode::wrong_type;
           }
         },
-        it->second);
+        value);
+  }
+}
+
+template <typename T, typename K>
+Result<T> try_get(const DictType &dict, const K &key) {
+  auto it = find_key(dict, key);
+  if (it == dict.end()) return ErrorCode::key_not_found;
+  return convert<T>(it->second);
+}
+
+// The stored value if it is a T, looking through the Cow of lists and dicts
+template <typename T>
+const T *stored(const ValueType &value) noexcept {
+  static_assert(!std::is_same_v<T, std::string>, "strings are stored as kwargscpp::String");
+  if constexpr (std::is_same_v<T, ListType> || std::is_same_v<T, DictType>) {
+    const auto *payload = value.get_if<Cow<T>>();
+    return payload ? &payload->get() : nullptr;
+  } else {
+    return value.get_if<T>();
+  }
+}
+
+template <typename T, typename K>
+const T *try_get_ref(const DictType &dict, const K &key, ErrorCode *error) noexcept {
+  const T *value = nullptr;
+  ErrorCode status = ErrorCode::key_not_found;
+  auto it = find_key(dict, key);
+  if (it != dict.end()) {
+    value = stored<T>(it->second);
+    status = value ? ErrorCode::ok : ErrorCode::wrong_type;
   }
-  throw std::runtime_error("Key not found in dictionary");
+  if (error) *error = status;
+  return value;
 }
 
 template <typename T>
-T get(const DictType &dict, const KeyType &key, const T &default_value) {
-  try {
-    return get_or_die<T>(dict, key);
-  } catch (const std::exception &e) {
-    return default_value;
+struct is_span : std::false_type {};
+template <typename T>
+struct is_span<Span<T>> : std::true_type {};
+
+template <typename T, typename K>
+Result<T> try_get_view(const DictType &dict, const K &key) noexcept {
+  static_assert(std::is_same_v<T, std::string_view> || is_span<T>::value,
+                "get_view supports std::string_view and Span<const T>");
+  ErrorCode error;
+  if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, Span<const ValueType>>) {
+    using Stored = std::conditional_t<std::is_same_v<T, std::string_view>, String, ListType>;
+    const Stored *value = try_get_ref<Stored>(dict, key, &error);
+    return value ? Result<T>(T(*value)) : Result<T>(error);
+  } else {
+    using Element = std::remove_const_t<typename std::remove_pointer_t<decltype(T().data())>>;
+    const Array *value = try_get_ref<Array>(dict, key, &error);
+    if (!value) return error;
+    if (value->dtype() != dtype_of_v<Element>) return ErrorCode::wrong_type;
+    return T(static_cast<const Element *>(value->data()), value->size());
+  }
+}
+
+// whether `c` is written escaped in a JSON string, and ends a run of characters copied as is when reading one
+inline bool json_is_special(char c) noexcept { return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20; }
+
+// a quoted, escaped JSON string through `sink(const char *data, size_t size)`, copying the runs in between escapes
+template <typename Sink>
+void json_put_string(Sink &sink, std::string_view text) {
+  static constexpr char hex[] = "0123456789abcdef";
+  sink("\"", 1);
+  const char *run = text.data(), *end = text.data() + text.size();
+  for (const char *p = run; p != end; ++p) {
+    if (!json_is_special(*p)) continue;
+    sink(run, p - run);
+    run = p + 1;
+    switch (*p) {
+      case '"':
+        sink("\\\"", 2);
+        break;
+      case '\\':
+        sink("\\\\", 2);
+        break;
+      case '\b':
+        sink("\\b", 2);
+        break;
+      case '\f':
+        sink("\\f", 2);
+        break;
+      case '\n':
+        sink("\\n", 2);
+        break;
+      case '\r':
+        sink("\\r", 2);
+        break;
+      case '\t':
+        sink("\\t", 2);
+        break;
+      default: {
+        char escape[6] = {'\\', 'u', '0', '0', hex[(*p >> 4) & 0xf], hex[*p & 0xf]};
+        sink(escape, sizeof escape);
+      }
+    }
+  }
+  sink(run, end - run);
+  sink("\"", 1);
+}
+
+// size of a buffer that holds any number formatted by json_format_number
+constexpr size_t json_number_size = 32;
+
+// `number` as JSON text in `buffer`, returning the end. Floating-point numbers take the shortest form that reads back
+// exactly, with ".0" added to whole ones so they still read back as floating-point.
+template <typename T>
+char *json_format_number(char *buffer, T number) {
+  if constexpr (std::is_integral_v<T>) {
+    return std::to_chars(buffer, buffer + json_number_size, number).ptr;
+  } else {
+    if (std::isnan(number)) return std::copy_n("NaN", 3, buffer);
+    if (std::isinf(number)) {
+      return number < 0 ? std::copy_n("-Infinity", 9, buffer) : std::copy_n("Infinity", 8, buffer);
+    }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    char *end = std::to_chars(buffer, buffer + json_number_size, number).ptr;
+#else
+    // round trips too, though not always in the fewest digits
+    char *end = buffer + std::snprintf(buffer, json_number_size, "%.*g", std::numeric_limits<T>::max_digits10,
+                                       static_cast<double>(number));
+#endif
+    if (std::find_if(buffer, end, [](char c) { return c == '.' || c == 'e'; }) == end) end = std::copy_n(".0", 2, end);
+    return end;
+  }
+}
+
+template <typename Sink, typename T>
+void json_put_number(Sink &sink, T number) {
+  char buffer[json_number_size];
+  sink(buffer, json_format_number(buffer, number) - buffer);
+}
+
+// Writes JSON text through `sink(const char *data, size_t size)`, keeping the containers being written on an explicit
+// stack rather than recursing, so deep trees do not overflow the native stack
+template <typename Sink>
+class JsonEncoder {
+ public:
+  JsonEncoder(Sink &sink, const JsonOptions &options) : sink_(sink), options_(options) {}
+
+  void encode(const ValueType &value) {
+    put_value(value);
+    drain();
+  }
+
+  void encode(const DictType &dict) {
+    put_dict(dict);
+    drain();
+  }
+
+ private:
+  using Entry = typename DictType::value_type;
+
+  struct Frame {
+    const ListType *list;
+    const DictType *dict;
+    // elements written so far
+    size_t index;
+    typename DictType::const_iterator it;
+    // where the dict's entries start in sorted_, with sort_keys
+    size_t sorted;
+  };
+
+  void drain() {
+    while (!stack_.empty()) {
+      Frame &frame = stack_.back();
+      if (frame.list) {
+        if (frame.index == frame.list->size()) {
+          sink_("]", 1);
+          stack_.pop_back();
+          continue;
+        }
+        if (frame.index) sink_(", ", 2);
+        // may push, which invalidates `frame`
+        put_value((*frame.list)[frame.index++]);
+      } else {
+        if (frame.index == frame.dict->size()) {
+          sink_("}", 1);
+          if (options_.sort_keys) sorted_.resize(frame.sorted);
+          stack_.pop_back();
+          continue;
+        }
+        if (frame.index) sink_(", ", 2);
+        const Entry &item = options_.sort_keys ? *sorted_[frame.sorted + frame.index] : *frame.it++;
+        ++frame.index;
+        json_put_string(sink_, item.first);
+        sink_(": ", 2);
+        put_value(item.second);
+      }
+    }
+  }
+
+  // scalars are written whole, containers get their opening bracket written and are pushed
+  void put_value(const ValueType &value) {
+    switch (value.index()) {
+      case 0:
+        json_put_number(sink_, value.get<intmax_t>());
+        break;
+      case 1:
+        json_put_number(sink_, value.get<uintmax_t>());
+        break;
+      case 2:
+        json_put_number(sink_, value.get<double>());
+        break;
+      case 3:
+        if (value.get<bool>()) {
+          sink_("true", 4);
+        } else {
+          sink_("false", 5);
+        }
+        break;
+      case 4:
+        json_put_string(sink_, value.get<String>());
+        break;
+      case 5:
+        sink_("[", 1);
+        stack_.push_back({&value.get<Cow<ListType>>().get(), nullptr, 0, {}, 0});
+        break;
+      case 6:
+        put_dict(value.get<Cow<DictType>>().get());
+        break;
+      default:
+        put_array(value.get<Array>());
+        break;
+    }
+  }
+
+  void put_dict(const DictType &dict) {
+    sink_("{", 1);
+    Frame frame{nullptr, &dict, 0, dict.begin(), sorted_.size()};
+    if (options_.sort_keys) {
+      for (const Entry &item : dict) sorted_.push_back(&item);
+      std::sort(sorted_.begin() + frame.sorted, sorted_.end(),
+                [](const Entry *a, const Entry *b) { return a->first < b->first; });
+    }
+    stack_.push_back(frame);
+  }
+
+  // nested lists following the shape, bounded in depth by ndim
+  void put_array(const Array &array) {
+    array.visit([&](const auto *data) {
+      if (array.ndim() == 0) return json_put_number(sink_, data[0]);
+      size_t offset = 0;
+      const auto write = [&](const auto &self, size_t dim) -> void {
+        sink_("[", 1);
+        for (size_t i = 0; i < array.shape()[dim]; ++i) {
+          if (i) sink_(", ", 2);
+          if (dim + 1 < array.ndim()) {
+            self(self, dim + 1);
+          } else {
+            json_put_number(sink_, data[offset++]);
+          }
+        }
+        sink_("]", 1);
+      };
+      write(write, 0);
+    });
+  }
+
+  Sink &sink_;
+  const JsonOptions &options_;
+  std::vector<Frame> stack_;
+  // dict entries in key order, a block per open dict, with sort_keys
+  std::vector<const Entry *> sorted_;
+};
+
+// Buffers the encoder's output on the stack and hands it to a std::string or std::ostream in blocks, which is cheaper
+// than appending each token
+template <typename Out>
+class JsonBufferSink {
+ public:
+  explicit JsonBufferSink(Out &out) : out_(out) {}
+  ~JsonBufferSink() { flush(); }
+  JsonBufferSink(const JsonBufferSink &) = delete;
+  JsonBufferSink &operator=(const JsonBufferSink &) = delete;
+
+  void operator()(const char *data, size_t size) {
+    if (size > sizeof buffer_ - used_) {
+      flush();
+      // too long to be worth copying, e.g. a long string
+      if (size >= sizeof buffer_) {
+        write(data, size);
+        return;
+      }
+    }
+    std::memcpy(buffer_ + used_, data, size);
+    used_ += size;
   }
+
+  void flush() {
+    if (used_) write(buffer_, used_);
+    used_ = 0;
+  }
+
+ private:
+  void write(const char *data, size_t size) {
+    if constexpr (std::is_same_v<Out, std::string>) {
+      out_.append(data, size);
+    } else {
+      out_.write(data, static_cast<std::streamsize>(size));
+    }
+  }
+
+  Out &out_;
+  char buffer_[4096];
+  size_t used_ = 0;
+};
+
+// Merges dicts of overrides into dicts of a target, keeping the pairs still to merge on an explicit stack. A frame's
+// overrides are moved from when `movable` is set, i.e. the caller gave them up and no other value shares them.
+class DeepMerger {
+ public:
+  explicit DeepMerger(const MergeOptions &options) : options_(options) {}
+
+  void run(DictType &target, DictType *movable, const DictType &overrides) {
+    stack_.push_back({&target, &overrides, movable, {}});
+    while (!stack_.empty()) {
+      Frame frame = std::move(stack_.back());
+      stack_.pop_back();
+      if (frame.movable) {
+        for (auto &item : *frame.movable) merge_item(frame, item.first, item.second);
+      } else {
+        for (const auto &item : *frame.overrides) merge_item(frame, item.first, item.second);
+      }
+    }
+  }
+
+ private:
+  struct Frame {
+    DictType *target;
+    const DictType *overrides;
+    DictType *movable;
+    // dotted path of the dicts, only kept for on_conflict
+    std::string path;
+  };
+
+  // `value` is a ValueType to move from or a const ValueType to share
+  template <typename V>
+  void merge_item(const Frame &frame, const KeyType &key, V &value) {
+    constexpr bool movable = !std::is_const_v<V>;
+    auto it = find_key(*frame.target, key);
+    if (it == frame.target->end()) {
+      frame.target->emplace(key, std::move(value));
+      return;
+    }
+    ValueType &existing = it->second;
+    if (existing.is_dict() && value.is_dict()) {
+      // the same payload on both sides has nothing to merge
+      if (&existing.as_dict() == &value.as_dict()) return;
+      std::string path = options_.on_conflict ? child_path(frame.path, key) : std::string();
+      DictType *source = nullptr;
+      if constexpr (movable) {
+        if (!value.template get<Cow<DictType>>().shared()) source = &value.mutable_dict();
+      }
+      stack_.push_back({&existing.mutable_dict(), &value.as_dict(), source, std::move(path)});
+    } else if (existing.is_vector() && value.is_vector() && options_.lists == ListMerge::append) {
+      ListType &list = existing.mutable_vector();
+      if constexpr (movable) {
+        if (!value.template get<Cow<ListType>>().shared()) {
+          ListType &source = value.mutable_vector();
+          list.insert(list.end(), std::make_move_iterator(source.begin()), std::make_move_iterator(source.end()));
+          return;
+        }
+      }
+      list.insert(list.end(), value.as_vector().begin(), value.as_vector().end());
+    } else if (options_.on_conflict) {
+      options_.on_conflict(child_path(frame.path, key), existing, ValueType(std::move(value)));
+    } else {
+      existing = std::move(value);
+    }
+  }
+
+  static std::string child_path(const std::string &path, const KeyType &key) {
+    return path.empty() ? std::string(key) : path + "." + key;
+  }
+
+  const MergeOptions &options_;
+  std::vector<Frame> stack_;
+};
+
+[[noreturn]] inline void throw_error(ErrorCode error) {
+  if (error == ErrorCode::key_not_found) throw std::runtime_error("Key not found in dictionary");
+  if (error == ErrorCode::index_out_of_range) throw std::out_of_range("Index out of range");
+  if (error == ErrorCode::malformed_path) throw std::invalid_argument("Malformed path");
+  throw std::bad_variant_access();
+}
+
+}  // namespace detail
+
+inline void set(DictType &dict, std::string_view key, const ValueType &value) { detail::set(dict, key, value); }
+inline void set(DictType &dict, std::string_view key, ValueType &&value) { detail::set(dict, key, std::move(value)); }
+inline void set(DictType &dict, const Key &key, const ValueType &value) { detail::set(dict, key, value); }
+inline void set(DictType &dict, const Key &key, ValueType &&value) { detail::set(dict, key, std::move(value)); }
+
+inline bool has_key(const DictType &dict, std::string_view key) { return detail::find_key(dict, key) != dict.end(); }
+inline bool has_key(const DictType &dict, const Key &key) { return detail::find_key(dict, key) != dict.end(); }
+
+template <typename T>
+const T &Result<T>::value() const & {
+  if (!value_) detail::throw_error(error_);
+  return *value_;
+}
+
+template <typename T>
+T &Result<T>::value() & {
+  if (!value_) detail::throw_error(error_);
+  return *value_;
+}
+
+template <typename T>
+T &&Result<T>::value() && {
+  if (!value_) detail::throw_error(error_);
+  return std::move(*value_);
+}
+
+template <typename T>
+Result<T> try_get(const DictType &dict, std::string_view key) {
+  return detail::try_get<T>(dict, key);
+}
+
+template <typename T>
+Result<T> try_get(const DictType &dict, const Key &key) {
+  return detail::try_get<T>(dict, key);
+}
+
+template <typename T>
+T get_or_die(const DictType &dict, std::string_view key) {
+  return detail::try_get<T>(dict, key).value();
+}
+
+template <typename T>
+T get_or_die(const DictType &dict, const Key &key) {
+  return detail::try_get<T>(dict, key).value();
+}
+
+template <typename T>
+T get(const DictType &dict, std::string_view key, const T &default_value) {
+  return detail::try_get<T>(dict, key).value_or(default_value);
+}
+
+template <typename T>
+T get(const DictType &dict, const Key &key, const T &default_value) {
+  return detail::try_get<T>(dict, key).value_or(default_value);
+}
+
+template <typename T>
+const T &get_ref(const DictType &dict, std::string_view key) {
+  ErrorCode error;
+  const T *value = detail::try_get_ref<T>(dict, key, &error);
+  if (!value) detail::throw_error(error);
+  return *value;
+}
+
+template <typename T>
+const T &get_ref(const DictType &dict, const Key &key) {
+  ErrorCode error;
+  const T *value = detail::try_get_ref<T>(dict, key, &error);
+  if (!value) detail::throw_error(error);
+  return *value;
+}
+
+template <typename T>
+const T *try_get_ref(const DictType &dict, std::string_view key, ErrorCode *error) noexcept {
+  return detail::try_get_ref<T>(dict, key, error);
+}
+
+template <typename T>
+const T *try_get_ref(const DictType &dict, const Key &key, ErrorCode *error) noexcept {
+  return detail::try_get_ref<T>(dict, key, error);
+}
+
+template <typename T>
+Result<T> try_get_view(const DictType &dict, std::string_view key) noexcept {
+  return detail::try_get_view<T>(dict, key);
+}
+
+template <typename T>
+Result<T> try_get_view(const DictType &dict, const Key &key) noexcept {
+  return detail::try_get_view<T>(dict, key);
+}
+
+template <typename T>
+T get_view(const DictType &dict, std::string_view key) {
+  return detail::try_get_view<T>(dict, key).value();
+}
+
+template <typename T>
+T get_view(const DictType &dict, const Key &key) {
+  return detail::try_get_view<T>(dict, key).value();
+}
+
+template <typename T>
+T get_view(const DictType &dict, std::string_view key, T default_value) noexcept {
+  return detail::try_get_view<T>(dict, key).value_or(default_value);
+}
+
+template <typename T>
+T get_view(const DictType &dict, const Key &key, T default_value) noexcept {
+  return detail::try_get_view<T>(dict, key).value_or(default_value);
 }
 
 inline DictType with_prefix(const DictType &dict, const std::string &prefix) {
   DictType out_dict;
+  out_dict.reserve(dict.size());
   for (const auto &[key, value] : dict) {
-    out_dict[prefix + key] = value;
+    out_dict.emplace(prefix + key, value);
   }
   return out_dict;
 }
 
+inline DictType with_prefix(DictType &&dict, const std::string &prefix) {
+  DictType out_dict;
+  out_dict.reserve(dict.size());
+#ifdef KWARGSCPP_ORDERED_DICT
+  for (auto &[key, value] : dict) {
+    out_dict.emplace(prefix + key, std::move(value));
+  }
+#else
+  // rename the nodes of `dict` in place and relink them, nothing is allocated but the new keys
+  while (!dict.empty()) {
+    auto node = dict.extract(dict.begin());
+    node.key().insert(0, prefix);
+    out_dict.insert(std::move(node));
+  }
+#endif
+  dict.clear();
+  return out_dict;
+}
+
 inline DictType merge(const DictType &dict, const DictType &other) {
   DictType out_dict(dict);
   for (const auto &[key, value] : other) {
-    out_dict[key] = value;
+    out_dict.insert_or_assign(key, value);
   }
   return out_dict;
 }
 
-inline std::string to_string(const DictType &dict) {
-    std::string result = "{";
-    for (auto it = dict.begin(); it != dict.end(); ++it) {
-        result += "\"" + it->first + "\": " + to_string(it->second);
-        if (std::next(it) != dict.end()) {
-            result += ", ";
-        }
-    }
-    result += "}";
-    return result;
+inline DictType merge(DictType &&dict, const DictType &other) {
+  DictType out_dict(std::move(dict));
+  for (const auto &[key, value] : other) {
+    out_dict.insert_or_assign(key, value);
+  }
+  return out_dict;
 }
 
-inline std::string to_string(const ValueType &value) {
-    return std::visit([](auto&& arg) -> std::string {
-        using T = std::decay_t<decltype(arg)>;
-        if constexpr (std::is_same_v<T, intmax_t> || std::is_same_v<T, uintmax_t> || 
-                      std::is_same_v<T, double>) {
-            return std::to_string(arg);
-        }
-        else if constexpr (std::is_same_v<T, bool>) {
-            return arg ? "true" : "false";
-        }
-        else if constexpr (std::is_same_v<T, std::string>) {
-            return "\"" + arg + "\"";
-        }
-        else if constexpr (std::is_same_v<T, std::vector<ValueType>>) {
-            std::string s = "[";
-            for (auto it = arg.begin(); it != arg.end(); ++it) {
-                s += to_string(*it);
-                if (std::next(it) != arg.end()) {
-                    s += ", ";
-                }
-            }
-            s += "]";
-            return s;
-        }
-        else if constexpr (std::is_same_v<T, DictType>) {
-            return to_string(arg);
-        }
-        else {
-            return "";
-        }
-    }, value);
+inline DictType merge(DictType &&dict, DictType &&other) {
+  DictType out_dict(std::move(dict));
+#ifdef KWARGSCPP_ORDERED_DICT
+  for (auto &[key, value] : other) {
+    out_dict.insert_or_assign(std::move(key), std::move(value));
+  }
+#else
+  // relink the nodes of `other`, only the values of keys present in both are moved
+  while (!other.empty()) {
+    auto result = out_dict.insert(other.extract(other.begin()));
+    if (!result.inserted) result.position->second = std::move(result.node.mapped());
+  }
+#endif
+  other.clear();
+  return out_dict;
+}
+
+inline void deep_merge_into(DictType &target, DictType &&overrides, const MergeOptions &options) {
+  detail::DeepMerger(options).run(target, &overrides, overrides);
+  overrides.clear();
+}
+
+inline void deep_merge_into(DictType &target, const DictType &overrides, const MergeOptions &options) {
+  detail::DeepMerger(options).run(target, nullptr, overrides);
+}
+
+inline DictType merge_layers(std::initializer_list<std::reference_wrapper<const DictType>> layers,
+                             const MergeOptions &options) {
+  if (layers.size() == 0) return DictType();
+  DictType out_dict(layers.begin()->get());
+  for (auto it = layers.begin() + 1; it != layers.end(); ++it) deep_merge_into(out_dict, it->get(), options);
+  return out_dict;
+}
+
+inline void to_json(const ValueType &value, std::string &out, const JsonOptions &options) {
+  detail::JsonBufferSink<std::string> sink(out);
+  detail::JsonEncoder<detail::JsonBufferSink<std::string>>(sink, options).encode(value);
+}
+
+inline void to_json(const DictType &dict, std::string &out, const JsonOptions &options) {
+  detail::JsonBufferSink<std::string> sink(out);
+  detail::JsonEncoder<detail::JsonBufferSink<std::string>>(sink, options).encode(dict);
+}
+
+inline void to_json(const ValueType &value, std::ostream &os, const JsonOptions &options) {
+  detail::JsonBufferSink<std::ostream> sink(os);
+  detail::JsonEncoder<detail::JsonBufferSink<std::ostream>>(sink, options).encode(value);
 }
 
+inline void to_json(const DictType &dict, std::ostream &os, const JsonOptions &options) {
+  detail::JsonBufferSink<std::ostream> sink(os);
+  detail::JsonEncoder<detail::JsonBufferSink<std::ostream>>(sink, options).encode(dict);
+}
+
+inline std::string to_json(const ValueType &value, const JsonOptions &options) {
+  std::string out;
+  to_json(value, out, options);
+  return out;
+}
+
+inline std::string to_json(const DictType &dict, const JsonOptions &options) {
+  std::string out;
+  to_json(dict, out, options);
+  return out;
+}
+
+inline std::string to_string(const DictType &dict) { return to_json(dict); }
+
+inline std::string to_string(const ValueType &value) { return to_json(value); }
+
 }  // namespace kwargscpp
 
 #endif  // KWARGS_IMPL_H
\ No newline at end of file
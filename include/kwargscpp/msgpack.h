@@ -0,0 +1,535 @@
+#ifndef KWARGS_MSGPACK_H
+#define KWARGS_MSGPACK_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+
+// Binary serialization as MessagePack (https://msgpack.org), so the output is compact, self-describing and readable by
+// any MessagePack implementation. Values map to
+//   intmax_t   the smallest int format, never uint 64; uintmax_t always uint 64, which is how the two are told apart
+//   double     float 64
+//   bool       true/false
+//   string     str
+//   list       array
+//   dict       map with str keys, in the dict's iteration order
+//   Array      ext type 1: dtype (uint8), ndim (uint8), ndim dims (uint64), then the elements in host byte order
+// Containers are length-prefixed, so the reader sizes them up front. Reading also accepts float 32, and bin as a
+// string, but not nil or other ext types.
+namespace kwargscpp {
+
+// MessagePack ext type code of an Array
+constexpr int8_t msgpack_array_ext = 1;
+
+// Streams MessagePack into a caller-provided buffer, handing the buffer to `flush` whenever it is full and on flush(),
+// so a value of any size is written without building it in memory first.
+class MsgpackWriter {
+ public:
+  using Flush = std::function<void(const char *data, size_t size)>;
+
+  // `capacity` must not be 0
+  MsgpackWriter(char *buffer, size_t capacity, Flush flush);
+  ~MsgpackWriter() = default;
+  MsgpackWriter(const MsgpackWriter &) = delete;
+  MsgpackWriter &operator=(const MsgpackWriter &) = delete;
+
+  void write(const ValueType &value);
+  void write(const DictType &dict);
+  // hand what is buffered to `flush`
+  void flush();
+
+ private:
+  void put(const void *data, size_t size);
+
+  char *buffer_;
+  size_t capacity_;
+  size_t used_ = 0;
+  Flush flush_;
+};
+
+// append the encoding of a value or dict to `out`
+void serialize(const ValueType &value, std::string &out);
+void serialize(const DictType &dict, std::string &out);
+std::string serialize(const ValueType &value);
+std::string serialize(const DictType &dict);
+
+// decode exactly one value, throwing std::invalid_argument if `data` is malformed, truncated or has trailing bytes
+ValueType deserialize(std::string_view data);
+// as deserialize, but the value must be a map
+DictType deserialize_dict(std::string_view data);
+
+namespace detail {
+
+// Writes MessagePack through `sink(const void *data, size_t size)`, keeping the containers being written on an
+// explicit stack rather than recursing, so deep trees do not overflow the native stack.
+template <typename Sink>
+class MsgpackEncoder {
+ public:
+  explicit MsgpackEncoder(Sink &sink) : sink_(sink) {}
+
+  void encode(const ValueType &value) {
+    put_value(value);
+    drain();
+  }
+
+  void encode(const DictType &dict) {
+    put_dict(dict);
+    drain();
+  }
+
+ private:
+  struct Frame {
+    const ListType *list;
+    const DictType *dict;
+    size_t index;
+    typename DictType::const_iterator it;
+  };
+
+  void drain() {
+    while (!stack_.empty()) {
+      Frame &frame = stack_.back();
+      if (frame.list) {
+        if (frame.index == frame.list->size()) {
+          stack_.pop_back();
+          continue;
+        }
+        // may push, which invalidates `frame`
+        put_value((*frame.list)[frame.index++]);
+      } else {
+        if (frame.it == frame.dict->end()) {
+          stack_.pop_back();
+          continue;
+        }
+        const auto &item = *frame.it++;
+        put_str(item.first);
+        put_value(item.second);
+      }
+    }
+  }
+
+  // scalars are written whole, containers get their header written and are pushed
+  void put_value(const ValueType &value) {
+    switch (value.index()) {
+      case 0:
+        put_int(value.get<intmax_t>());
+        break;
+      case 1:
+        put_be(0xcf, static_cast<uint64_t>(value.get<uintmax_t>()));
+        break;
+      case 2: {
+        uint64_t bits;
+        double number = value.get<double>();
+        std::memcpy(&bits, &number, sizeof bits);
+        put_be(0xcb, bits);
+        break;
+      }
+      case 3:
+        put_byte(value.get<bool>() ? 0xc3 : 0xc2);
+        break;
+      case 4:
+        put_str(value.get<String>());
+        break;
+      case 5: {
+        const ListType &list = value.get<Cow<ListType>>().get();
+        put_header(list.size(), 0x90, 16, 0xdc);
+        stack_.push_back({&list, nullptr, 0, {}});
+        break;
+      }
+      case 6:
+        put_dict(value.get<Cow<DictType>>().get());
+        break;
+      default:
+        put_array(value.get<Array>());
+        break;
+    }
+  }
+
+  void put_dict(const DictType &dict) {
+    put_header(dict.size(), 0x80, 16, 0xde);
+    stack_.push_back({nullptr, &dict, 0, dict.begin()});
+  }
+
+  void put_int(intmax_t number) {
+    if (number >= 0) {
+      if (number < 0x80) {
+        put_byte(static_cast<uint8_t>(number));
+      } else if (number <= 0xff) {
+        put_be(0xcc, static_cast<uint8_t>(number));
+      } else if (number <= 0xffff) {
+        put_be(0xcd, static_cast<uint16_t>(number));
+      } else if (number <= 0xffffffff) {
+        put_be(0xce, static_cast<uint32_t>(number));
+      } else {
+        put_be(0xd3, static_cast<uint64_t>(number));
+      }
+    } else if (number >= -32) {
+      put_byte(static_cast<uint8_t>(number));
+    } else if (number >= INT8_MIN) {
+      put_be(0xd0, static_cast<uint8_t>(number));
+    } else if (number >= INT16_MIN) {
+      put_be(0xd1, static_cast<uint16_t>(number));
+    } else if (number >= INT32_MIN) {
+      put_be(0xd2, static_cast<uint32_t>(number));
+    } else {
+      put_be(0xd3, static_cast<uint64_t>(number));
+    }
+  }
+
+  void put_str(std::string_view text) {
+    if (text.size() < 32) {
+      put_byte(static_cast<uint8_t>(0xa0 | text.size()));
+    } else if (text.size() <= 0xff) {
+      put_be(0xd9, static_cast<uint8_t>(text.size()));
+    } else {
+      put_size(text.size(), 0xda, 0xdb);
+    }
+    sink_(text.data(), text.size());
+  }
+
+  // a fix header up to `fix_limit` elements, else 16 or 32 bit
+  void put_header(size_t size, uint8_t fix, size_t fix_limit, uint8_t wide) {
+    if (size < fix_limit) {
+      put_byte(static_cast<uint8_t>(fix | size));
+    } else {
+      put_size(size, wide, static_cast<uint8_t>(wide + 1));
+    }
+  }
+
+  void put_size(size_t size, uint8_t tag16, uint8_t tag32) {
+    if (size <= 0xffff) {
+      put_be(tag16, static_cast<uint16_t>(size));
+    } else if (size <= 0xffffffff) {
+      put_be(tag32, static_cast<uint32_t>(size));
+    } else {
+      throw std::length_error("MessagePack cannot hold more than 2^32-1 bytes or elements in one value");
+    }
+  }
+
+  void put_array(const Array &array) {
+    if (array.ndim() > 0xff) throw std::length_error("MessagePack Array cannot have more than 255 dimensions");
+    size_t size = 2 + 8 * array.ndim() + array.nbytes();
+    if (size <= 0xff) {
+      put_be(0xc7, static_cast<uint8_t>(size));
+    } else {
+      put_size(size, 0xc8, 0xc9);
+    }
+    uint8_t head[3] = {static_cast<uint8_t>(msgpack_array_ext), static_cast<uint8_t>(array.dtype()),
+                       static_cast<uint8_t>(array.ndim())};
+    sink_(head, sizeof head);
+    for (size_t dim : array.shape()) put_be_raw(static_cast<uint64_t>(dim));
+    if (array.nbytes()) sink_(array.data(), array.nbytes());
+  }
+
+  void put_byte(uint8_t byte) { sink_(&byte, 1); }
+
+  // a tag byte followed by a big-endian number
+  template <typename U>
+  void put_be(uint8_t tag, U number) {
+    uint8_t bytes[1 + sizeof(U)];
+    bytes[0] = tag;
+    for (size_t i = 0; i < sizeof(U); ++i) bytes[sizeof(U) - i] = static_cast<uint8_t>(number >> (8 * i));
+    sink_(bytes, sizeof bytes);
+  }
+
+  void put_be_raw(uint64_t number) {
+    uint8_t bytes[8];
+    for (size_t i = 0; i < 8; ++i) bytes[7 - i] = static_cast<uint8_t>(number >> (8 * i));
+    sink_(bytes, sizeof bytes);
+  }
+
+  Sink &sink_;
+  std::vector<Frame> stack_;
+};
+
+// Reads one MessagePack value into a ValueType, iteratively like MsgpackEncoder
+class MsgpackDecoder {
+ public:
+  explicit MsgpackDecoder(std::string_view data)
+      : pos_(reinterpret_cast<const uint8_t *>(data.data())), end_(pos_ + data.size()) {}
+
+  void decode(ValueType &value) {
+    get_value(value);
+    while (!stack_.empty()) {
+      Frame &frame = stack_.back();
+      if (frame.remaining == 0) {
+        stack_.pop_back();
+        continue;
+      }
+      --frame.remaining;
+      // get_value may push, which invalidates `frame`
+      if (frame.list) {
+        get_value(frame.list->emplace_back());
+      } else {
+        DictType &dict = *frame.dict;
+        get_value(dict[get_key()]);
+      }
+    }
+    if (pos_ != end_) fail("trailing bytes after the value");
+  }
+
+ private:
+  struct Frame {
+    ListType *list;
+    DictType *dict;
+    size_t remaining;
+  };
+
+  [[noreturn]] static void fail(const char *what) {
+    throw std::invalid_argument(std::string("invalid MessagePack data: ") + what);
+  }
+
+  const uint8_t *take(size_t size) {
+    if (static_cast<size_t>(end_ - pos_) < size) fail("truncated");
+    const uint8_t *bytes = pos_;
+    pos_ += size;
+    return bytes;
+  }
+
+  uint64_t get_be(size_t size) {
+    const uint8_t *bytes = take(size);
+    uint64_t number = 0;
+    for (size_t i = 0; i < size; ++i) number = (number << 8) | bytes[i];
+    return number;
+  }
+
+  template <typename S>
+  intmax_t get_signed() {
+    return static_cast<S>(get_be(sizeof(S)));
+  }
+
+  std::string get_key() {
+    uint8_t tag = *take(1);
+    std::string key;
+    if (!get_str(tag, key)) fail("dict keys must be strings");
+    return key;
+  }
+
+  bool get_str(uint8_t tag, std::string &out) {
+    size_t size;
+    if ((tag & 0xe0) == 0xa0) {
+      size = tag & 0x1f;
+    } else if (tag == 0xd9 || tag == 0xc4) {
+      size = get_be(1);
+    } else if (tag == 0xda || tag == 0xc5) {
+      size = get_be(2);
+    } else if (tag == 0xdb || tag == 0xc6) {
+      size = get_be(4);
+    } else {
+      return false;
+    }
+    out.assign(reinterpret_cast<const char *>(take(size)), size);
+    return true;
+  }
+
+  // at most one element per remaining byte, so a bogus length cannot reserve more than the input could hold
+  size_t bounded(size_t count) const { return std::min(count, static_cast<size_t>(end_ - pos_)); }
+
+  void push_list(ValueType &value, size_t count) {
+    value = ListType();
+    ListType &list = value.mutable_vector();
+    list.reserve(bounded(count));
+    if (count) stack_.push_back({&list, nullptr, count});
+  }
+
+  void push_dict(ValueType &value, size_t count) {
+    value = DictType();
+    DictType &dict = value.mutable_dict();
+    dict.reserve(bounded(count));
+    if (count) stack_.push_back({nullptr, &dict, count});
+  }
+
+  void get_value(ValueType &value) {
+    uint8_t tag = *take(1);
+    if (tag < 0x80) {
+      value = static_cast<intmax_t>(tag);
+    } else if (tag >= 0xe0) {
+      value = static_cast<intmax_t>(static_cast<int8_t>(tag));
+    } else if ((tag & 0xf0) == 0x90) {
+      push_list(value, tag & 0x0f);
+    } else if ((tag & 0xf0) == 0x80) {
+      push_dict(value, tag & 0x0f);
+    } else {
+      if (get_str(tag, text_)) {
+        value = std::string_view(text_);
+        return;
+      }
+      switch (tag) {
+        case 0xc2:
+          value = false;
+          break;
+        case 0xc3:
+          value = true;
+          break;
+        case 0xca: {
+          auto bits = static_cast<uint32_t>(get_be(4));
+          float number;
+          std::memcpy(&number, &bits, sizeof number);
+          value = static_cast<double>(number);
+          break;
+        }
+        case 0xcb: {
+          uint64_t bits = get_be(8);
+          double number;
+          std::memcpy(&number, &bits, sizeof number);
+          value = number;
+          break;
+        }
+        case 0xcc:
+        case 0xcd:
+        case 0xce:
+          value = static_cast<intmax_t>(get_be(size_t(1) << (tag - 0xcc)));
+          break;
+        case 0xcf:
+          value = static_cast<uintmax_t>(get_be(8));
+          break;
+        case 0xd0:
+          value = get_signed<int8_t>();
+          break;
+        case 0xd1:
+          value = get_signed<int16_t>();
+          break;
+        case 0xd2:
+          value = get_signed<int32_t>();
+          break;
+        case 0xd3:
+          value = get_signed<int64_t>();
+          break;
+        case 0xdc:
+        case 0xdd:
+          push_list(value, get_be(tag == 0xdc ? 2 : 4));
+          break;
+        case 0xde:
+        case 0xdf:
+          push_dict(value, get_be(tag == 0xde ? 2 : 4));
+          break;
+        case 0xc7:
+        case 0xc8:
+        case 0xc9:
+          get_array(value, get_be(size_t(1) << (tag - 0xc7)));
+          break;
+        case 0xd4:
+        case 0xd5:
+        case 0xd6:
+        case 0xd7:
+        case 0xd8:
+          get_array(value, size_t(1) << (tag - 0xd4));
+          break;
+        case 0xc0:
+          fail("nil has no ValueType");
+        default:
+          fail("unsupported type");
+      }
+    }
+  }
+
+  void get_array(ValueType &value, size_t size) {
+    if (static_cast<int8_t>(*take(1)) != msgpack_array_ext) fail("unsupported ext type");
+    const uint8_t *payload = take(size);
+    if (size < 2 || payload[0] > static_cast<uint8_t>(DType::uint8)) fail("bad Array header");
+    auto dtype = static_cast<DType>(payload[0]);
+    size_t ndim = payload[1];
+    if (size < 2 + 8 * ndim) fail("bad Array header");
+    std::vector<size_t> shape(ndim);
+    size_t count = 1;
+    for (size_t i = 0; i < ndim; ++i) {
+      uint64_t dim = 0;
+      for (size_t j = 0; j < 8; ++j) dim = (dim << 8) | payload[2 + 8 * i + j];
+      if (dim && count > std::numeric_limits<size_t>::max() / dim) fail("bad Array shape");
+      shape[i] = static_cast<size_t>(dim);
+      count *= shape[i];
+    }
+    size_t offset = 2 + 8 * ndim;
+    if (count > (size - offset) / dtype_size(dtype) || count * dtype_size(dtype) != size - offset) {
+      fail("Array shape does not match its data");
+    }
+    value = Array(dtype, std::move(shape), payload + offset);
+  }
+
+  const uint8_t *pos_;
+  const uint8_t *end_;
+  std::vector<Frame> stack_;
+  // the string value being read, copied into a String
+  std::string text_;
+};
+
+}  // namespace detail
+
+inline MsgpackWriter::MsgpackWriter(char *buffer, size_t capacity, Flush flush)
+    : buffer_(buffer), capacity_(capacity), flush_(std::move(flush)) {
+  if (capacity_ == 0) throw std::invalid_argument("MsgpackWriter needs a buffer of at least one byte");
+}
+
+inline void MsgpackWriter::write(const ValueType &value) {
+  auto sink = [this](const void *data, size_t size) { put(data, size); };
+  detail::MsgpackEncoder<decltype(sink)>(sink).encode(value);
+}
+
+inline void MsgpackWriter::write(const DictType &dict) {
+  auto sink = [this](const void *data, size_t size) { put(data, size); };
+  detail::MsgpackEncoder<decltype(sink)>(sink).encode(dict);
+}
+
+inline void MsgpackWriter::flush() {
+  if (used_) flush_(buffer_, used_);
+  used_ = 0;
+}
+
+inline void MsgpackWriter::put(const void *data, size_t size) {
+  auto bytes = static_cast<const char *>(data);
+  while (size) {
+    if (used_ == capacity_) flush();
+    size_t count = std::min(size, capacity_ - used_);
+    std::memcpy(buffer_ + used_, bytes, count);
+    used_ += count;
+    bytes += count;
+    size -= count;
+  }
+}
+
+inline void serialize(const ValueType &value, std::string &out) {
+  auto sink = [&out](const void *data, size_t size) { out.append(static_cast<const char *>(data), size); };
+  detail::MsgpackEncoder<decltype(sink)>(sink).encode(value);
+}
+
+inline void serialize(const DictType &dict, std::string &out) {
+  auto sink = [&out](const void *data, size_t size) { out.append(static_cast<const char *>(data), size); };
+  detail::MsgpackEncoder<decltype(sink)>(sink).encode(dict);
+}
+
+inline std::string serialize(const ValueType &value) {
+  std::string out;
+  serialize(value, out);
+  return out;
+}
+
+inline std::string serialize(const DictType &dict) {
+  std::string out;
+  serialize(dict, out);
+  return out;
+}
+
+inline ValueType deserialize(std::string_view data) {
+  ValueType value;
+  detail::MsgpackDecoder(data).decode(value);
+  return value;
+}
+
+inline DictType deserialize_dict(std::string_view data) {
+  ValueType value = deserialize(data);
+  if (!value.is_dict()) throw std::invalid_argument("invalid MessagePack data: not a map");
+  return std::move(value.mutable_dict());
+}
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_MSGPACK_H
@@ -2,15 +2,25 @@
 #define KWARGS_NANOBIND_H
 
 #include <nanobind/nanobind.h>
+#include <nanobind/ndarray.h>
+#include <nanobind/stl/string.h>
+#include <nanobind/stl/string_view.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 
 #include "kwargscpp/kwargs.h"
+#include "kwargscpp/msgpack.h"
+#include "kwargscpp/patch.h"
+#include "kwargscpp/pmr.h"
 
 namespace nb = nanobind;
 
 namespace nanobind {
 namespace detail {
 
-// Overloaded helper for std::visit (C++17)
+// Overloaded helper for std::visit and kwargscpp::visit (C++17)
 template <class... Ts>
 struct overloaded : Ts... {
   using Ts::operator()...;
@@ -28,113 +38,874 @@ struct type_caster<kwargscpp::ValueType> {
  public:
   NB_TYPE_CASTER(kwargscpp::ValueType, const_name("kwargs::ValueType"));
 
-  bool from_python(nb::handle src, uint8_t flags, cleanup_list* cleanup) noexcept {
-    if (nb::isinstance<nb::int_>(src)) {
-      value = nb::cast<intmax_t>(src);
-      return true;
-    } else if (nb::isinstance<nb::float_>(src)) {
-      value = nb::cast<double>(src);
-      return true;
-    } else if (nb::isinstance<nb::bool_>(src)) {
-      value = nb::cast<bool>(src);
-      return true;
-    } else if (nb::isinstance<nb::str>(src)) {
-      value = nb::cast<std::string>(src);
-      return true;
-    } else if (nb::isinstance<nb::list>(src)) {
-      std::vector<kwargscpp::ValueType> list;
-      nb::object obj = nb::borrow<nb::object>(src);
-      if (load_list(obj, list, flags, cleanup)) {
-        value = list;
-        return true;
+  bool from_python(nb::handle src, uint8_t, cleanup_list*) noexcept {
+    try {
+      return load_value(src.ptr(), value);
+    } catch (...) {
+      return false;
+    }
+  }
+
+  // Conversion in both directions runs off an explicit stack instead of recursing, so deep trees cannot overflow the
+  // native stack, and a container that contains itself fails the conversion instead of crashing.
+  static nb::handle from_cpp(const kwargscpp::ValueType& src, rv_policy, cleanup_list*) noexcept {
+    try {
+      CastStack stack;
+      nb::object root = nb::steal(cast_node(src, stack));
+      if (!root.is_valid() || !cast_pending(stack)) {
+        return nb::handle();  // Handle casting failure
+      }
+      return root.release();
+    } catch (...) {
+      return nb::handle();
+    }
+  }
+
+  // Convert kwargscpp::DictType to Python dict, in the dict's iteration order
+  static nb::handle from_cpp_dict(const kwargscpp::DictType& dict, rv_policy, cleanup_list*) noexcept {
+    try {
+      CastStack stack;
+      nb::object root = nb::steal(PyDict_New());
+      if (!root.is_valid()) {
+        return nb::handle();
+      }
+      stack.frames.push_back({nullptr, &dict, 0, dict.begin(), root.ptr()});
+      if (!cast_pending(stack)) {
+        return nb::handle();  // Handle casting failure
       }
-    } else if (nb::isinstance<nb::dict>(src)) {
-      // Recursively load the dictionary
-      kwargscpp::DictType dict;
-      nb::object obj = nb::borrow<nb::object>(src);
-      if (load_dict(obj, dict, flags, cleanup)) {
-        value = dict;
+      return root.release();
+    } catch (...) {
+      return nb::handle();
+    }
+  }
+
+  // Load the Python object `src` into `dest`. A list or dict referenced from several places is loaded once and
+  // shared copy-on-write by the other references; one that contains itself fails the load.
+  static bool load_value(PyObject* src, kwargscpp::ValueType& dest) {
+    LoadStack stack;
+    return load_node(src, dest, stack) && load_pending(stack);
+  }
+
+  // Load the Python dict `src` into `dest`, building each value in its slot
+  static bool load_dict(PyObject* src, kwargscpp::DictType& dest) {
+    if (!PyDict_Check(src)) return false;
+
+    LoadStack stack;
+    return push_dict(src, nullptr, dest, stack, false) && load_pending(stack);
+  }
+
+  // Python ints within intmax_t load as intmax_t, larger ones within uintmax_t as uintmax_t, others fail. Shared
+  // with the pmr caster, so `Value` is either flavor of ValueType.
+  template <typename Value>
+  static bool load_int(PyObject* src, Value& dest) {
+    int overflow = 0;
+    long long v = PyLong_AsLongLongAndOverflow(src, &overflow);
+    if (overflow == 0) {
+      if (v == -1 && PyErr_Occurred()) {
+        PyErr_Clear();
+        return false;
+      }
+      dest = Value(static_cast<intmax_t>(v));
+      return true;
+    }
+    if (overflow > 0) {
+      unsigned long long u = PyLong_AsUnsignedLongLong(src);
+      if (!(u == static_cast<unsigned long long>(-1) && PyErr_Occurred())) {
+        dest = Value(static_cast<uintmax_t>(u));
         return true;
       }
     }
+    PyErr_Clear();
     return false;
   }
 
-  static nb::handle from_cpp(const kwargscpp::ValueType& src, rv_policy policy, cleanup_list* cleanup) noexcept {
-    return std::visit(
-        overloaded{[&](intmax_t v) { return nb::int_(v).release(); },
-                   [&](uintmax_t v) { return nb::int_(v).release(); },
-                   [&](double v) { return nb::float_(v).release(); },
-                   [&](bool v) { return nb::bool_(v).release(); },
-                   [&](const std::string& v) { return nb::str(v.c_str(), v.length()).release(); },
-                   [&](const std::vector<kwargscpp::ValueType>& vec) -> nb::handle {
-                     // Convert kwargscpp::ValueType to Python list
-                     nb::list py_list;
-                     for (const auto& val : vec) {
-                       nb::handle h = type_caster<kwargscpp::ValueType>::from_cpp(val, policy, cleanup);
-                       if (!h) {
-                         return nb::handle();  // Handle casting failure
-                       }
-                       py_list.append(h);
-                     }
-                     return py_list.release();
+  // The next item of the list or dict `frame` loads as new references, false past the end. Items are never borrowed,
+  // since on a free-threaded build another thread may replace one while it is loaded; a list that shrank meanwhile
+  // ends early. Shared with the pmr caster, whose frames have the same members.
+  template <typename Frame>
+  static bool next_item(Frame& frame, nb::object& key, nb::object& item) {
+    if (frame.remaining == 0) return false;
+    if (frame.list) {
+#ifdef Py_GIL_DISABLED
+      item = nb::steal(PyList_GetItemRef(frame.src.ptr(), frame.pos));
+#else
+      item = nb::borrow(PyList_GetItem(frame.src.ptr(), frame.pos));
+#endif
+      if (!item.is_valid()) {
+        PyErr_Clear();
+        return false;
+      }
+      ++frame.pos;
+    } else if (frame.items.is_valid()) {
+      PyObject* pair = PyList_GetItem(frame.items.ptr(), frame.pos);
+      if (!pair) {
+        PyErr_Clear();
+        return false;
+      }
+      key = nb::borrow(PyTuple_GetItem(pair, 0));
+      item = nb::borrow(PyTuple_GetItem(pair, 1));
+      // the snapshot is private; dropping the pair leaves the value referenced as it would be through PyDict_Next
+      PyList_SetItem(frame.items.ptr(), frame.pos++, nb::none().release().ptr());
+    } else {
+      PyObject* k = nullptr;
+      PyObject* v = nullptr;
+      if (!PyDict_Next(frame.src.ptr(), &frame.pos, &k, &v)) return false;
+      key = nb::borrow(k);
+      item = nb::borrow(v);
+    }
+    --frame.remaining;
+    return true;
+  }
+
+  // The size of the dict `src` and, on a free-threaded build where PyDict_Next is not safe, a snapshot of its items
+  // for next_item to walk. False if the snapshot cannot be taken.
+  static bool dict_items(PyObject* src, Py_ssize_t& size, [[maybe_unused]] nb::object& items) {
+#ifdef Py_GIL_DISABLED
+    items = nb::steal(PyDict_Items(src));
+    if (!items.is_valid()) {
+      PyErr_Clear();
+      return false;
+    }
+    size = PyList_Size(items.ptr());
+#else
+    size = PyDict_Size(src);
+#endif
+    return true;
+  }
+
+  // Convert kwargscpp::Array to a read-only NumPy array sharing its buffer, which stays alive through a copy of the
+  // Array held by the NumPy array's owner capsule. Read-only, since copies on the C++ side may share the buffer.
+  static nb::handle from_cpp_array(const kwargscpp::Array& array) noexcept {
+    try {
+      auto* owner = new kwargscpp::Array(array);
+      nb::capsule base(owner, [](void* ptr) noexcept { delete static_cast<kwargscpp::Array*>(ptr); });
+      nb::ndarray<nb::numpy, nb::ro> result(owner->data(), owner->ndim(), owner->shape().data(), base, nullptr,
+                                            array_dtype(owner->dtype()));
+      return nb::cast(std::move(result)).release();
+    } catch (...) {
+      return nb::handle();
+    }
+  }
+
+ private:
+  static nb::dlpack::dtype array_dtype(kwargscpp::DType dtype) noexcept {
+    switch (dtype) {
+      case kwargscpp::DType::float32:
+        return nb::dtype<float>();
+      case kwargscpp::DType::int64:
+        return nb::dtype<int64_t>();
+      case kwargscpp::DType::uint8:
+        return nb::dtype<uint8_t>();
+      default:
+        return nb::dtype<double>();
+    }
+  }
+
+  // Helper function to load a C-contiguous float64/float32/int64/uint8 buffer into kwargscpp::Array with one copy
+  static bool load_array(nb::handle src, kwargscpp::Array& dest) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(src.ptr(), &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+      PyErr_Clear();
+      return false;
+    }
+    kwargscpp::DType dtype;
+    bool supported = buffer_dtype(view, dtype);
+    if (supported) {
+      dest = kwargscpp::Array(dtype, std::vector<size_t>(view.shape, view.shape + view.ndim), view.buf);
+    }
+    PyBuffer_Release(&view);
+    return supported;
+  }
+
+  // The DType of a buffer's native-order struct format, false if there is none
+  static bool buffer_dtype(const Py_buffer& view, kwargscpp::DType& dtype) noexcept {
+    const char* format = view.format ? view.format : "B";
+    if (*format == '@' || *format == '=') ++format;
+    if (format[0] == '\0' || format[1] != '\0') return false;
+    switch (format[0]) {
+      case 'd':
+        dtype = kwargscpp::DType::float64;
+        return view.itemsize == 8;
+      case 'f':
+        dtype = kwargscpp::DType::float32;
+        return view.itemsize == 4;
+      case 'q':
+      case 'l':
+      case 'n':
+        dtype = kwargscpp::DType::int64;
+        return view.itemsize == 8;
+      case 'B':
+        dtype = kwargscpp::DType::uint8;
+        return view.itemsize == 1;
+      default:
+        return false;
+    }
+  }
+
+  // A list or dict being converted to Python: `out` is filled from `list` or `dict`, resuming at `index` or `it`
+  struct CastFrame {
+    const kwargscpp::ListType* list;
+    const kwargscpp::DictType* dict;
+    size_t index;
+    kwargscpp::DictType::const_iterator it;
+    PyObject* out;  // owned by its parent or the root
+  };
+  struct CastStack {
+    std::vector<CastFrame> frames;
+
+    // Whether `payload` is being converted, i.e. contains itself. Only a shared payload can, as one that is not has
+    // no other reference that could be its own descendant, so the frames are only searched for those.
+    bool open(const void* payload) const {
+      return std::any_of(frames.begin(), frames.end(),
+                         [&](const CastFrame& frame) { return frame.list == payload || frame.dict == payload; });
+    }
+  };
+
+  // A new reference to `src` converted, or to the empty list or dict to be filled from a frame pushed for it
+  static PyObject* cast_node(const kwargscpp::ValueType& src, CastStack& stack) {
+    return kwargscpp::visit(
+        overloaded{[&](intmax_t v) -> PyObject* { return PyLong_FromLongLong(v); },
+                   [&](uintmax_t v) -> PyObject* { return PyLong_FromUnsignedLongLong(v); },
+                   [&](double v) -> PyObject* { return PyFloat_FromDouble(v); },
+                   [&](bool v) -> PyObject* { return nb::bool_(v).release().ptr(); },
+                   [&](const kwargscpp::String& v) -> PyObject* {
+                     return PyUnicode_FromStringAndSize(v.data(), static_cast<Py_ssize_t>(v.size()));
                    },
-                   [&](const kwargscpp::DictType& dict) -> nb::handle {
-                     // Convert kwargscpp::DictType to Python dict
-                     nb::dict py_dict;
-                     for (const auto& [key, val] : dict) {
-                       nb::handle h = type_caster<kwargscpp::ValueType>::from_cpp(val, policy, cleanup);
-                       if (!h) {
-                         return nb::handle();  // Handle casting failure
-                       }
-                       py_dict[key.c_str()] = h;
-                     }
-                     return py_dict.release();
-                   }},
+                   [&](const kwargscpp::Cow<kwargscpp::ListType>& vec) -> PyObject* {
+                     if (vec.shared() && stack.open(&vec.get())) return cycle_error();
+                     // created at its final size, the items are set by cast_pending
+                     PyObject* out = PyList_New(static_cast<Py_ssize_t>(vec->size()));
+                     if (out) stack.frames.push_back({&vec.get(), nullptr, 0, {}, out});
+                     return out;
+                   },
+                   [&](const kwargscpp::Cow<kwargscpp::DictType>& dict) -> PyObject* {
+                     if (dict.shared() && stack.open(&dict.get())) return cycle_error();
+                     PyObject* out = PyDict_New();
+                     if (out) stack.frames.push_back({nullptr, &dict.get(), 0, dict->begin(), out});
+                     return out;
+                   },
+                   [&](const kwargscpp::Array& array) -> PyObject* { return from_cpp_array(array).ptr(); }},
         src);
   }
 
- private:
-  // Helper function to recursively load a Python list into std::vector<kwargscpp::ValueType>
-  bool load_list(nb::object src, std::vector<kwargscpp::ValueType>& dest, uint8_t flags, cleanup_list* cleanup) {
-    if (!nb::isinstance<nb::list>(src)) return false;
-
-    nb::list py_list = nb::borrow<nb::list>(src);
-    for (auto item : py_list) {
-      kwargscpp::ValueType val;
-      nb::handle value_handle = item;
-      type_caster<kwargscpp::ValueType> value_caster;
-      if (!value_caster.from_python(value_handle, flags, cleanup)) {
+  // Fill the containers of the pushed frames, depth first
+  static bool cast_pending(CastStack& stack) {
+    while (!stack.frames.empty()) {
+      CastFrame& frame = stack.frames.back();
+      PyObject* out = frame.out;
+      if (frame.list) {
+        if (frame.index == frame.list->size()) {
+          stack.frames.pop_back();
+          continue;
+        }
+        const size_t index = frame.index++;
+        PyObject* item = cast_node((*frame.list)[index], stack);  // may push, invalidating `frame`
+        if (!item) return false;
+        if (PyList_SetItem(out, static_cast<Py_ssize_t>(index), item) != 0) return false;  // steals item
+      } else {
+        if (frame.it == frame.dict->end()) {
+          stack.frames.pop_back();
+          continue;
+        }
+        const auto& [key, val] = *frame.it++;
+        nb::object py_key = nb::steal(PyUnicode_FromStringAndSize(key.data(), static_cast<Py_ssize_t>(key.size())));
+        nb::object item = nb::steal(cast_node(val, stack));
+        if (!py_key.is_valid() || !item.is_valid() || PyDict_SetItem(out, py_key.ptr(), item.ptr()) != 0) return false;
+      }
+    }
+    return true;
+  }
+
+  static PyObject* cycle_error() {
+    PyErr_SetString(PyExc_ValueError, "kwargscpp: cannot convert a list or dict that contains itself");
+    return nullptr;
+  }
+
+  // A list or dict being loaded from Python into `list` or `dict`, the payload of `dest`
+  struct LoadFrame {
+    nb::object src;  // held, so no other thread can free it while it is loaded
+    kwargscpp::ValueType* dest;  // null for the dict of the DictType caster
+    kwargscpp::ListType* list;
+    kwargscpp::DictType* dict;
+    Py_ssize_t pos;
+    // items left to load, never more than were reserved, so the slots of loaded items stay in place
+    Py_ssize_t remaining;
+    bool shared;  // whether `src` has other references than its parent, so it may be met again
+    nb::object items;  // snapshot of a dict's items, walked instead of PyDict_Next on free-threaded builds
+  };
+  struct LoadStack {
+    std::vector<LoadFrame> frames;
+    // shared lists and dicts loaded so far, mapped to their value. Their sources are held, so an address is not
+    // reused by another object while the load runs.
+    std::unordered_map<PyObject*, const kwargscpp::ValueType*> loaded;
+    std::vector<nb::object> held;
+
+    // Whether `src` is being loaded, i.e. contains itself
+    bool open(PyObject* src) const {
+      return std::any_of(frames.begin(), frames.end(),
+                         [&](const LoadFrame& frame) { return frame.src.ptr() == src; });
+    }
+  };
+
+  // Load `src` into `dest`. Exact built-in types are dispatched on their type pointer and read through the limited
+  // CPython API, so the common case never goes through isinstance or nb::cast; subclasses and buffer objects take the
+  // slower checks after that. bool is tested before int, since bool subclasses int. Lists and dicts are loaded by
+  // frames pushed on `stack`.
+  static bool load_node(PyObject* src, kwargscpp::ValueType& dest, LoadStack& stack) {
+    PyTypeObject* type = Py_TYPE(src);
+    if (type == &PyBool_Type) {
+      dest = kwargscpp::ValueType(src == Py_True);
+    } else if (type == &PyLong_Type) {
+      return load_int(src, dest);
+    } else if (type == &PyFloat_Type) {
+      dest = kwargscpp::ValueType(PyFloat_AsDouble(src));
+    } else if (type == &PyUnicode_Type) {
+      return load_str(src, dest);
+    } else if (type == &PyList_Type) {
+      return push_list(src, dest, stack);
+    } else if (type == &PyDict_Type) {
+      return push_dict(src, dest, stack);
+    } else if (nb::isinstance<kwargscpp::SharedDict>(src)) {
+      // a dict bound by kwargscpp::bind_shared_dict, whose payload is shared rather than converted
+      dest = kwargscpp::ValueType(*nb::inst_ptr<kwargscpp::SharedDict>(src));
+    } else if (PyBool_Check(src)) {
+      dest = kwargscpp::ValueType(src == Py_True);
+    } else if (PyLong_Check(src)) {
+      return load_int(src, dest);
+    } else if (PyFloat_Check(src)) {
+      dest = kwargscpp::ValueType(PyFloat_AsDouble(src));
+    } else if (PyUnicode_Check(src)) {
+      return load_str(src, dest);
+    } else if (PyList_Check(src)) {
+      return push_list(src, dest, stack);
+    } else if (PyDict_Check(src)) {
+      return push_dict(src, dest, stack);
+    } else if (PyObject_CheckBuffer(src)) {
+      // NumPy arrays and other buffer-protocol objects
+      kwargscpp::Array array;
+      if (!load_array(nb::handle(src), array)) {
         return false;
       }
-      val = value_caster.value;
+      dest = kwargscpp::ValueType(std::move(array));
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  // Whether the list or dict `src` has references other than its parent and the one load_pending holds on it
+  static bool is_shared(PyObject* src) { return Py_REFCNT(src) > 2; }
 
-      dest.push_back(val);
+  // Whether `src`, a list or dict referenced from elsewhere as well, was met before. If it was loaded, its value is
+  // shared into `dest`; if it is still being loaded, it contains itself and `ok` is set to fail the load.
+  static bool met_before(PyObject* src, kwargscpp::ValueType& dest, const LoadStack& stack, bool& ok) {
+    auto it = stack.loaded.find(src);
+    if (it != stack.loaded.end()) {
+      dest = *it->second;
+      return true;
     }
+    ok = !stack.open(src);
+    return !ok;
+  }
+
+  // Start loading the Python list `src` into a reserved kwargscpp::ListType in `dest`
+  static bool push_list(PyObject* src, kwargscpp::ValueType& dest, LoadStack& stack) {
+    const bool shared = is_shared(src);
+    bool ok = true;
+    if (shared && met_before(src, dest, stack, ok)) return ok;
+
+    const Py_ssize_t size = PyList_Size(src);
+    dest = kwargscpp::ValueType(kwargscpp::ListType());
+    kwargscpp::ListType& list = dest.mutable_vector();
+    list.reserve(static_cast<size_t>(size));
+    stack.frames.push_back({nb::borrow(src), &dest, &list, nullptr, 0, size, shared, nb::object()});
     return true;
   }
-  // Helper function to recursively load a Python dict into kwargscpp::DictType
-  bool load_dict(nb::object src, kwargscpp::DictType& dest, uint8_t flags, cleanup_list* cleanup) {
-    if (!nb::isinstance<nb::dict>(src)) return false;
 
-    nb::dict py_dict = nb::borrow<nb::dict>(src);
-    for (auto item : py_dict) {
-      std::string key = nb::cast<std::string>(item.first);
+  // Start loading the Python dict `src` into a reserved kwargscpp::DictType in `dest`
+  static bool push_dict(PyObject* src, kwargscpp::ValueType& dest, LoadStack& stack) {
+    const bool shared = is_shared(src);
+    bool ok = true;
+    if (shared && met_before(src, dest, stack, ok)) return ok;
 
-      kwargscpp::ValueType val;
-      nb::handle value_handle = item.second;
-      type_caster<kwargscpp::ValueType> value_caster;
-      if (!value_caster.from_python(value_handle, flags, cleanup)) {
+    dest = kwargscpp::ValueType(kwargscpp::DictType());
+    return push_dict(src, &dest, dest.mutable_dict(), stack, shared);
+  }
+  static bool push_dict(PyObject* src, kwargscpp::ValueType* dest, kwargscpp::DictType& dict, LoadStack& stack,
+                        bool shared) {
+    Py_ssize_t size = 0;
+    nb::object items;
+    if (!dict_items(src, size, items)) return false;
+    dict.reserve(static_cast<size_t>(size));
+    stack.frames.push_back({nb::borrow(src), dest, nullptr, &dict, 0, size, shared, std::move(items)});
+    return true;
+  }
+
+  // Load the items of the pushed frames, depth first, so a list or dict is complete before it is met again
+  static bool load_pending(LoadStack& stack) {
+    while (!stack.frames.empty()) {
+      LoadFrame& frame = stack.frames.back();
+      nb::object key;
+      nb::object item;
+      if (!next_item(frame, key, item)) {
+        // nothing is loaded after the root, so it is not recorded
+        if (frame.shared && stack.frames.size() > 1) {
+          stack.loaded.emplace(frame.src.ptr(), frame.dest);
+          stack.held.push_back(std::move(frame.src));
+        }
+        stack.frames.pop_back();
+        continue;
+      }
+      if (frame.list) {
+        if (!load_node(item.ptr(), frame.list->emplace_back(), stack)) {  // may push, invalidating `frame`
+          return false;
+        }
+      } else {
+        Py_ssize_t size = 0;
+        const char* data = PyUnicode_Check(key.ptr()) ? PyUnicode_AsUTF8AndSize(key.ptr(), &size) : nullptr;
+        if (!data) {
+          PyErr_Clear();
+          return false;
+        }
+        if (!load_node(item.ptr(), (*frame.dict)[kwargscpp::KeyType(data, static_cast<size_t>(size))], stack)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Copy the UTF-8 buffer cached on a Python str
+  static bool load_str(PyObject* src, kwargscpp::ValueType& dest) {
+    Py_ssize_t size = 0;
+    const char* data = PyUnicode_AsUTF8AndSize(src, &size);
+    if (!data) {
+      PyErr_Clear();
+      return false;
+    }
+    dest = kwargscpp::ValueType(std::string_view(data, static_cast<size_t>(size)));
+    return true;
+  }
+};
+
+// Type caster for DictType, used for arguments and results instead of the STL map caster so the dict's iteration
+// order is kept and the OrderedDict flavor (KWARGSCPP_ORDERED_DICT) is covered as well
+template <>
+struct type_caster<kwargscpp::DictType> {
+ public:
+  NB_TYPE_CASTER(kwargscpp::DictType, const_name("dict[str, kwargs::ValueType]"));
+
+  bool from_python(nb::handle src, uint8_t, cleanup_list*) noexcept {
+    try {
+      if (nb::isinstance<kwargscpp::SharedDict>(src)) {
+        // copies the top level only, nested lists and dicts are shared
+        value = nb::inst_ptr<kwargscpp::SharedDict>(src)->get();
+        return true;
+      }
+      value.clear();
+      return type_caster<kwargscpp::ValueType>::load_dict(src.ptr(), value);
+    } catch (...) {
+      return false;
+    }
+  }
+
+  static nb::handle from_cpp(const kwargscpp::DictType& src, rv_policy policy, cleanup_list* cleanup) noexcept {
+    return type_caster<kwargscpp::ValueType>::from_cpp_dict(src, policy, cleanup);
+  }
+};
+
+// Type caster for the allocator-aware ValueType. Loads allocate from kwargscpp::pmr::current_resource(), so a
+// whole argument tree lands in the arena of the active kwargscpp::pmr::ResourceScope.
+template <>
+struct type_caster<kwargscpp::pmr::ValueType> {
+ public:
+  NB_TYPE_CASTER(kwargscpp::pmr::ValueType, const_name("kwargs::pmr::ValueType"));
+
+  bool from_python(nb::handle src, uint8_t, cleanup_list*) noexcept {
+    try {
+      kwargscpp::pmr::ValueType loaded(
+          kwargscpp::pmr::ValueType::allocator_type(kwargscpp::pmr::current_resource()));
+      if (!load_value(src, loaded)) {
         return false;
       }
-      val = value_caster.value;
+      kwargscpp::pmr::detail::replace_with_allocator(value, std::move(loaded));
+      return true;
+    } catch (...) {
+      return false;
+    }
+  }
+
+  // Both directions run off an explicit stack like the heap-flavor caster, so deep trees cannot overflow the native
+  // stack, and a Python container that contains itself fails the load.
+  static nb::handle from_cpp(const kwargscpp::pmr::ValueType& src, rv_policy, cleanup_list*) noexcept {
+    try {
+      CastStack stack;
+      nb::object root = nb::steal(cast_node(src, stack));
+      if (!root.is_valid() || !cast_pending(stack)) {
+        return nb::handle();  // Handle casting failure
+      }
+      return root.release();
+    } catch (...) {
+      return nb::handle();
+    }
+  }
 
-      dest[key] = val;
+  static nb::handle from_cpp_dict(const kwargscpp::pmr::DictType& dict, rv_policy, cleanup_list*) noexcept {
+    try {
+      CastStack stack;
+      nb::object root = nb::steal(PyDict_New());
+      if (!root.is_valid()) {
+        return nb::handle();
+      }
+      stack.push_back({nullptr, &dict, 0, dict.begin(), root.ptr()});
+      if (!cast_pending(stack)) {
+        return nb::handle();  // Handle casting failure
+      }
+      return root.release();
+    } catch (...) {
+      return nb::handle();
+    }
+  }
+
+  // Load `src` into `dest`, allocating from the resource of `dest`
+  static bool load_value(nb::handle src, kwargscpp::pmr::ValueType& dest) {
+    LoadStack stack;
+    return load_node(src.ptr(), dest, stack) && load_pending(stack);
+  }
+
+  // Load the Python dict `src` into `dest`, allocating from the resource of `dest`
+  static bool load_dict(nb::handle src, kwargscpp::pmr::DictType& dest) {
+    if (!PyDict_Check(src.ptr())) return false;
+
+    LoadStack stack;
+    return push_dict(src.ptr(), dest, stack) && load_pending(stack);
+  }
+
+ private:
+  using Heap = type_caster<kwargscpp::ValueType>;
+
+  // A list or dict being converted to Python: `out` is filled from `list` or `dict`, resuming at `index` or `it`
+  struct CastFrame {
+    const kwargscpp::pmr::ListType* list;
+    const kwargscpp::pmr::DictType* dict;
+    size_t index;
+    kwargscpp::pmr::DictType::const_iterator it;
+    PyObject* out;  // owned by its parent or the root
+  };
+  using CastStack = std::vector<CastFrame>;
+
+  // A new reference to `src` converted, or to the empty list or dict to be filled from a frame pushed for it
+  static PyObject* cast_node(const kwargscpp::pmr::ValueType& src, CastStack& stack) {
+    return std::visit(
+        overloaded{[&](intmax_t v) -> PyObject* { return PyLong_FromLongLong(v); },
+                   [&](uintmax_t v) -> PyObject* { return PyLong_FromUnsignedLongLong(v); },
+                   [&](double v) -> PyObject* { return PyFloat_FromDouble(v); },
+                   [&](bool v) -> PyObject* { return nb::bool_(v).release().ptr(); },
+                   [&](const std::pmr::string& v) -> PyObject* {
+                     return PyUnicode_FromStringAndSize(v.data(), static_cast<Py_ssize_t>(v.size()));
+                   },
+                   [&](const kwargscpp::pmr::ListType& vec) -> PyObject* {
+                     // created at its final size, the items are set by cast_pending
+                     PyObject* out = PyList_New(static_cast<Py_ssize_t>(vec.size()));
+                     if (out) stack.push_back({&vec, nullptr, 0, {}, out});
+                     return out;
+                   },
+                   [&](const kwargscpp::pmr::DictType& dict) -> PyObject* {
+                     PyObject* out = PyDict_New();
+                     if (out) stack.push_back({nullptr, &dict, 0, dict.begin(), out});
+                     return out;
+                   }},
+        static_cast<const kwargscpp::pmr::ValueType::variant&>(src));
+  }
+
+  // Fill the containers of the pushed frames, depth first
+  static bool cast_pending(CastStack& stack) {
+    while (!stack.empty()) {
+      CastFrame& frame = stack.back();
+      PyObject* out = frame.out;
+      if (frame.list) {
+        if (frame.index == frame.list->size()) {
+          stack.pop_back();
+          continue;
+        }
+        const size_t index = frame.index++;
+        PyObject* item = cast_node((*frame.list)[index], stack);  // may push, invalidating `frame`
+        if (!item) return false;
+        if (PyList_SetItem(out, static_cast<Py_ssize_t>(index), item) != 0) return false;  // steals item
+      } else {
+        if (frame.it == frame.dict->end()) {
+          stack.pop_back();
+          continue;
+        }
+        const auto& [key, val] = *frame.it++;
+        nb::object py_key = nb::steal(PyUnicode_FromStringAndSize(key.data(), static_cast<Py_ssize_t>(key.size())));
+        nb::object item = nb::steal(cast_node(val, stack));
+        if (!py_key.is_valid() || !item.is_valid() || PyDict_SetItem(out, py_key.ptr(), item.ptr()) != 0) return false;
+      }
     }
     return true;
   }
+
+  // A list or dict being loaded from Python into `list` or `dict`, with the members Heap::next_item walks
+  struct LoadFrame {
+    nb::object src;  // held, so no other thread can free it while it is loaded
+    kwargscpp::pmr::ListType* list;
+    kwargscpp::pmr::DictType* dict;
+    Py_ssize_t pos;
+    // items left to load, never more than were reserved, so the slots of loaded items stay in place
+    Py_ssize_t remaining;
+    nb::object items;  // snapshot of a dict's items on free-threaded builds
+  };
+  struct LoadStack {
+    std::vector<LoadFrame> frames;
+
+    // Whether `src` is being loaded, i.e. contains itself. This flavor copies a list or dict met again rather than
+    // sharing it, so only the open frames are searched.
+    bool open(PyObject* src) const {
+      return std::any_of(frames.begin(), frames.end(),
+                         [&](const LoadFrame& frame) { return frame.src.ptr() == src; });
+    }
+  };
+
+  // Load `src` into `dest`, dispatching on the built-in types like the heap-flavor caster. Lists and dicts are loaded
+  // by frames pushed on `stack`.
+  static bool load_node(PyObject* src, kwargscpp::pmr::ValueType& dest, LoadStack& stack) {
+    if (PyBool_Check(src)) {
+      dest = kwargscpp::pmr::ValueType(src == Py_True);
+    } else if (PyLong_Check(src)) {
+      return Heap::load_int(src, dest);
+    } else if (PyFloat_Check(src)) {
+      dest = kwargscpp::pmr::ValueType(PyFloat_AsDouble(src));
+    } else if (PyUnicode_Check(src)) {
+      std::string_view str;
+      if (!load_str(src, str)) {
+        return false;
+      }
+      dest = kwargscpp::pmr::ValueType(str, dest.get_allocator());
+    } else if (PyList_Check(src) || PyDict_Check(src)) {
+      // one that contains itself is referenced by its parent, its frame and load_pending at least
+      if (Py_REFCNT(src) > 2 && stack.open(src)) return false;
+      if (PyList_Check(src)) {
+        const Py_ssize_t size = PyList_Size(src);
+        dest = kwargscpp::pmr::ValueType(kwargscpp::pmr::ListType(dest.get_allocator()));
+        auto& list = std::get<kwargscpp::pmr::ListType>(dest);
+        list.reserve(static_cast<size_t>(size));
+        stack.frames.push_back({nb::borrow(src), &list, nullptr, 0, size, nb::object()});
+      } else {
+        dest = kwargscpp::pmr::ValueType(kwargscpp::pmr::DictType(dest.get_allocator()));
+        return push_dict(src, std::get<kwargscpp::pmr::DictType>(dest), stack);
+      }
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  static bool push_dict(PyObject* src, kwargscpp::pmr::DictType& dict, LoadStack& stack) {
+    Py_ssize_t size = 0;
+    nb::object items;
+    if (!Heap::dict_items(src, size, items)) return false;
+    dict.reserve(static_cast<size_t>(size));
+    stack.frames.push_back({nb::borrow(src), nullptr, &dict, 0, size, std::move(items)});
+    return true;
+  }
+
+  // Load the items of the pushed frames, depth first
+  static bool load_pending(LoadStack& stack) {
+    while (!stack.frames.empty()) {
+      LoadFrame& frame = stack.frames.back();
+      nb::object key;
+      nb::object item;
+      if (!Heap::next_item(frame, key, item)) {
+        stack.frames.pop_back();
+        continue;
+      }
+      if (frame.list) {
+        // the element is built with the list's allocator, the std::pmr containers pass it on
+        if (!load_node(item.ptr(), frame.list->emplace_back(), stack)) {  // may push, invalidating `frame`
+          return false;
+        }
+      } else {
+        std::string_view name;
+        if (!load_str(key.ptr(), name)) {
+          return false;
+        }
+        kwargscpp::pmr::DictType& dict = *frame.dict;
+        if (!load_node(item.ptr(), dict[kwargscpp::pmr::KeyType(name, dict.get_allocator())], stack)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // View the UTF-8 buffer cached on a Python str, valid as long as the str is alive
+  static bool load_str(PyObject* src, std::string_view& out) {
+    if (!PyUnicode_Check(src)) return false;
+    Py_ssize_t size = 0;
+    const char* data = PyUnicode_AsUTF8AndSize(src, &size);
+    if (!data) {
+      PyErr_Clear();
+      return false;
+    }
+    out = std::string_view(data, static_cast<size_t>(size));
+    return true;
+  }
+};
+
+// Type caster for the allocator-aware DictType, loading into kwargscpp::pmr::current_resource()
+template <>
+struct type_caster<kwargscpp::pmr::DictType> {
+ public:
+  NB_TYPE_CASTER(kwargscpp::pmr::DictType, const_name("dict[str, kwargs::pmr::ValueType]"));
+
+  bool from_python(nb::handle src, uint8_t flags, cleanup_list* cleanup) noexcept {
+    try {
+      kwargscpp::pmr::DictType loaded(kwargscpp::pmr::current_resource());
+      if (!type_caster<kwargscpp::pmr::ValueType>::load_dict(src, loaded)) {
+        return false;
+      }
+      kwargscpp::pmr::detail::replace_with_allocator(value, std::move(loaded));
+      return true;
+    } catch (...) {
+      return false;
+    }
+  }
+
+  static nb::handle from_cpp(const kwargscpp::pmr::DictType& src, rv_policy policy, cleanup_list* cleanup) noexcept {
+    return type_caster<kwargscpp::pmr::ValueType>::from_cpp_dict(src, policy, cleanup);
+  }
 };
 }  // namespace detail
 }  // namespace nanobind
 
+namespace kwargscpp {
+namespace detail {
+
+inline nb::bytes to_bytes(const DictType& dict) {
+  std::string data = serialize(dict);
+  return nb::bytes(data.data(), data.size());
+}
+
+inline std::string_view bytes_view(const nb::bytes& data) { return std::string_view(data.c_str(), data.size()); }
+
+// The UTF-8 view of the Python key `key`, false for one that is not a str and so is never in a SharedDict
+inline bool key_view(nb::handle key, std::string_view& out) {
+  Py_ssize_t size = 0;
+  const char* data = PyUnicode_Check(key.ptr()) ? PyUnicode_AsUTF8AndSize(key.ptr(), &size) : nullptr;
+  if (!data) {
+    PyErr_Clear();
+    return false;
+  }
+  out = std::string_view(data, static_cast<size_t>(size));
+  return true;
+}
+
+// The UTF-8 view of the Python key `key` to store, raising TypeError for one that is not a str
+inline std::string_view key_to_store(nb::handle key) {
+  std::string_view name;
+  if (!key_view(key, name)) throw nb::type_error("Dict keys must be str");
+  return name;
+}
+
+// Raise KeyError(key), as a dict does for a key it does not hold
+[[noreturn]] inline void throw_missing_key(nb::handle key) {
+  // passed in a tuple, since a tuple given as the value would be taken as the arguments
+  nb::object args = nb::steal(PyTuple_Pack(1, key.ptr()));
+  if (args.is_valid()) PyErr_SetObject(PyExc_KeyError, args.ptr());
+  throw nb::python_error();
+}
+
+}  // namespace detail
+
+// Bind SharedDict as the Python class `name` in `m`: a collections.abc.MutableMapping over the C++ dict that converts
+// a value only when it is read, so a large tree returned to Python costs O(keys touched) instead of O(tree). Nested
+// dicts are read as further instances sharing the subtree copy-on-write; writing to one does not change the dict it
+// was read from. The casters accept instances without converting them, a SharedDict or ValueType parameter shares
+// the payload and a DictType parameter copies its top level. Instances pickle as MessagePack, and take structural
+// patches through apply_patch and diff.
+inline nb::class_<SharedDict> bind_shared_dict(nb::module_& m, const char* name = "Dict") {
+  using Caster = nb::detail::type_caster<ValueType>;
+  nb::class_<SharedDict> cls(m, name);
+  cls.def(nb::init<>())
+      .def("__init__", [](SharedDict* self, DictType dict) { new (self) SharedDict(std::move(dict)); },
+           nb::arg("dict"))
+      .def("__len__", [](const SharedDict& self) { return self->size(); })
+      // keys of any type are looked up, as in a dict, and one that is not a str is never found
+      .def("__contains__",
+           [](const SharedDict& self, nb::handle key) {
+             std::string_view name;
+             return detail::key_view(key, name) && has_key(*self, name);
+           })
+      .def("__getitem__",
+           [](const SharedDict& self, nb::handle key) -> nb::object {
+             std::string_view name;
+             auto it = detail::key_view(key, name) ? detail::find_key(*self, name) : self->end();
+             if (it == self->end()) detail::throw_missing_key(key);
+             if (const auto* dict = it->second.get_if<SharedDict>()) {
+               return nb::cast(SharedDict(*dict));
+             }
+             nb::object item = nb::steal(Caster::from_cpp(it->second, nb::rv_policy::automatic, nullptr));
+             if (!item.is_valid()) throw nb::python_error();
+             return item;
+           })
+      .def("__setitem__",
+           [](SharedDict& self, nb::handle key, ValueType value) {
+             set(self.mutate(), detail::key_to_store(key), std::move(value));
+           })
+      .def("__delitem__",
+           [](SharedDict& self, nb::handle key) {
+             std::string_view name;
+             if (!detail::key_view(key, name) || !has_key(*self, name)) detail::throw_missing_key(key);
+             DictType& dict = self.mutate();
+             dict.erase(detail::find_key(dict, name));
+           })
+      .def("__iter__",
+           [](const SharedDict& self) {
+             // iterate over a snapshot of the keys, so writes while iterating are safe
+             nb::object keys = nb::steal(PyList_New(static_cast<Py_ssize_t>(self->size())));
+             if (!keys.is_valid()) throw nb::python_error();
+             Py_ssize_t i = 0;
+             for (const auto& item : *self) {
+               PyList_SetItem(keys.ptr(), i++, nb::str(item.first.data(), item.first.size()).release().ptr());
+             }
+             return nb::iter(keys);
+           })
+      .def("to_dict",
+           [](const SharedDict& self) {
+             nb::object dict = nb::steal(Caster::from_cpp_dict(*self, nb::rv_policy::automatic, nullptr));
+             if (!dict.is_valid()) throw nb::python_error();
+             return dict;
+           })
+      .def("__repr__", [](const SharedDict& self) { return to_string(*self); })
+      // structural patches, see kwargscpp/patch.h, so a caller can send what changed rather than the whole dict
+      .def(
+          "apply_patch",
+          [](SharedDict& self, const ValueType& patch) { apply_patch(self.mutate(), patch_from_value(patch)); },
+          nb::arg("patch"))
+      .def(
+          "diff", [](const SharedDict& self, const DictType& other) { return patch_to_value(diff(*self, other)); },
+          nb::arg("other"))
+      // MessagePack, see kwargscpp/msgpack.h, which also backs pickling
+      .def("to_bytes", [](const SharedDict& self) { return detail::to_bytes(*self); })
+      .def_static(
+          "from_bytes", [](nb::bytes data) { return SharedDict(deserialize_dict(detail::bytes_view(data))); },
+          nb::arg("data"))
+      .def("__getstate__", [](const SharedDict& self) { return detail::to_bytes(*self); })
+      .def("__setstate__", [](SharedDict& self, nb::bytes state) {
+        new (&self) SharedDict(deserialize_dict(detail::bytes_view(state)));
+      });
+
+  // keys, items, get, update and the other mixin methods are taken from MutableMapping, built on the methods above
+  nb::object mapping = nb::module_::import_("collections.abc").attr("MutableMapping");
+  for (const char* method :
+       {"keys", "items", "values", "get", "__eq__", "__ne__", "pop", "popitem", "clear", "update", "setdefault"}) {
+    nb::setattr(cls, method, mapping.attr(method));
+  }
+  mapping.attr("register")(cls);
+  return cls;
+}
+
+}  // namespace kwargscpp
+
 #endif  // KWARGS_NANOBIND_H
\ No newline at end of file
@@ -0,0 +1,517 @@
+#ifndef KWARGS_ORDERED_DICT_H
+#define KWARGS_ORDERED_DICT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace kwargscpp {
+namespace detail {
+
+// A vector that holds up to N elements inline and moves them to the heap past that. Moving or swapping one with its
+// elements inline moves the elements, so unlike std::vector it invalidates iterators and references.
+template <typename T, std::size_t N>
+class InlineVector {
+  static_assert(N > 0, "the inline buffer is never empty");
+  static_assert(std::is_nothrow_move_constructible_v<T>, "elements are moved between buffers without a fallback");
+
+ public:
+  InlineVector() noexcept = default;
+  InlineVector(const InlineVector &other) {
+    reserve(other.size_);
+    for (const T &item : other) emplace_back(item);
+  }
+  InlineVector(InlineVector &&other) noexcept { take(other); }
+  InlineVector &operator=(const InlineVector &other) {
+    if (this != &other) {
+      InlineVector copy(other);
+      release();
+      take(copy);
+    }
+    return *this;
+  }
+  InlineVector &operator=(InlineVector &&other) noexcept {
+    if (this != &other) {
+      release();
+      take(other);
+    }
+    return *this;
+  }
+  ~InlineVector() { release(); }
+
+  T *data() noexcept { return data_; }
+  const T *data() const noexcept { return data_; }
+  T *begin() noexcept { return data_; }
+  T *end() noexcept { return data_ + size_; }
+  const T *begin() const noexcept { return data_; }
+  const T *end() const noexcept { return data_ + size_; }
+  T &operator[](std::size_t pos) noexcept { return data_[pos]; }
+  const T &operator[](std::size_t pos) const noexcept { return data_[pos]; }
+  std::size_t size() const noexcept { return size_; }
+  std::size_t capacity() const noexcept { return capacity_; }
+  bool empty() const noexcept { return size_ == 0; }
+
+  void reserve(std::size_t count) {
+    if (count > capacity_) reallocate(count, nullptr);
+  }
+
+  template <typename... Args>
+  T &emplace_back(Args &&...args) {
+    if (size_ < capacity_) {
+      T *item = ::new (static_cast<void *>(data_ + size_)) T(std::forward<Args>(args)...);
+      ++size_;
+      return *item;
+    }
+    // the new element is built first, so `args` may still refer into the old buffer
+    const std::size_t count = capacity_ * 2;
+    T *fresh = std::allocator<T>().allocate(count);
+    try {
+      ::new (static_cast<void *>(fresh + size_)) T(std::forward<Args>(args)...);
+    } catch (...) {
+      std::allocator<T>().deallocate(fresh, count);
+      throw;
+    }
+    reallocate(count, fresh);
+    return data_[size_++];
+  }
+  void push_back(const T &item) { emplace_back(item); }
+  void pop_back() noexcept { data_[--size_].~T(); }
+
+  // drop the elements past the first `count`
+  void truncate(std::size_t count) noexcept {
+    while (size_ > count) pop_back();
+  }
+  void clear() noexcept { truncate(0); }
+
+  void swap(InlineVector &other) noexcept {
+    InlineVector moved(std::move(other));
+    other = std::move(*this);
+    *this = std::move(moved);
+  }
+
+ private:
+  T *inline_data() noexcept { return reinterpret_cast<T *>(storage_); }
+  // a heap buffer is always larger than the inline one
+  bool is_inline() const noexcept { return capacity_ == N; }
+
+  // move the elements into `fresh`, a heap buffer of `count` elements, keeping the size
+  void reallocate(std::size_t count, T *fresh) {
+    if (!fresh) fresh = std::allocator<T>().allocate(count);
+    for (std::size_t i = 0; i < size_; ++i) {
+      ::new (static_cast<void *>(fresh + i)) T(std::move(data_[i]));
+      data_[i].~T();
+    }
+    if (!is_inline()) std::allocator<T>().deallocate(data_, capacity_);
+    data_ = fresh;
+    capacity_ = count;
+  }
+
+  void take(InlineVector &other) noexcept {
+    if (other.is_inline()) {
+      for (std::size_t i = 0; i < other.size_; ++i) {
+        ::new (static_cast<void *>(data_ + i)) T(std::move(other.data_[i]));
+      }
+      size_ = other.size_;
+      other.clear();
+    } else {
+      data_ = std::exchange(other.data_, other.inline_data());
+      size_ = std::exchange(other.size_, 0);
+      capacity_ = std::exchange(other.capacity_, N);
+    }
+  }
+
+  void release() noexcept {
+    clear();
+    if (!is_inline()) std::allocator<T>().deallocate(data_, capacity_);
+    data_ = inline_data();
+    capacity_ = N;
+  }
+
+  alignas(T) unsigned char storage_[N * sizeof(T)];
+  T *data_ = inline_data();
+  std::size_t size_ = 0;
+  std::size_t capacity_ = N;
+};
+
+}  // namespace detail
+
+// Insertion-ordered hash map laid out like CPython's dict: entries live in one dense array in insertion order, with
+// their hashes in a parallel array, and an open-addressing table of entry indices. The table is built lazily, once
+// the dict grows past kIndexThreshold entries; below that, lookups are a linear scan over the contiguous hashes,
+// which beats hashing into buckets for the handful of keys a typical kwargs dict holds. Up to kIndexThreshold entries
+// and their hashes are held inline in the dict itself, so a small dict allocates nothing; past that both arrays move
+// to the heap. Iteration walks the dense array.
+//
+// As in CPython, erase leaves a tombstone in the entry array and the table instead of shifting the entries after it,
+// so it is O(1). Tombstones are skipped by iteration and reclaimed when an insert would otherwise grow the arrays.
+//
+// Define KWARGSCPP_ORDERED_DICT before including kwargs.h to use it as kwargscpp::DictType.
+//
+// Differences to std::unordered_map: inserting may invalidate iterators and references (the entry array grows like a
+// std::vector and is also compacted then), so may moving or swapping a dict whose entries are inline, and the key of
+// an entry must not be modified through an iterator.
+template <typename Key, typename T, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class OrderedDict {
+  // an entry, disengaged once erased
+  using slot_type = std::optional<std::pair<Key, T>>;
+
+ public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<Key, T>;
+  using size_type = std::size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using reference = value_type &;
+  using const_reference = const value_type &;
+
+  // Forward iterator over the live entries in insertion order
+  template <bool Const>
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = OrderedDict::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference = std::conditional_t<Const, const value_type &, value_type &>;
+    using pointer = std::conditional_t<Const, const value_type *, value_type *>;
+
+    Iterator() noexcept = default;
+    // an iterator converts to a const_iterator
+    template <bool C = Const, typename = std::enable_if_t<C>>
+    Iterator(const Iterator<false> &other) noexcept : slot_(other.slot_), end_(other.end_) {}
+
+    reference operator*() const noexcept { return **slot_; }
+    pointer operator->() const noexcept { return &**slot_; }
+    Iterator &operator++() noexcept {
+      ++slot_;
+      skip();
+      return *this;
+    }
+    Iterator operator++(int) noexcept {
+      Iterator before = *this;
+      ++*this;
+      return before;
+    }
+
+    friend bool operator==(const Iterator &lhs, const Iterator &rhs) noexcept { return lhs.slot_ == rhs.slot_; }
+    friend bool operator!=(const Iterator &lhs, const Iterator &rhs) noexcept { return lhs.slot_ != rhs.slot_; }
+
+   private:
+    friend class OrderedDict;
+    template <bool>
+    friend class Iterator;
+    using slot_pointer = std::conditional_t<Const, const slot_type *, slot_type *>;
+
+    Iterator(slot_pointer slot, slot_pointer end) noexcept : slot_(slot), end_(end) { skip(); }
+    void skip() noexcept {
+      while (slot_ != end_ && !*slot_) ++slot_;
+    }
+
+    slot_pointer slot_ = nullptr;
+    slot_pointer end_ = nullptr;
+  };
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  // Dicts up to this size are looked up by scanning, the index table is only built past it
+  static constexpr size_type kIndexThreshold = 16;
+
+  OrderedDict() = default;
+  OrderedDict(const OrderedDict &other) = default;
+  // a moved-from dict is empty
+  OrderedDict(OrderedDict &&other) noexcept
+      : entries_(std::move(other.entries_)),
+        hashes_(std::move(other.hashes_)),
+        index_(std::move(other.index_)),
+        size_(std::exchange(other.size_, 0)),
+        first_(std::exchange(other.first_, 0)) {}
+  OrderedDict &operator=(const OrderedDict &other) = default;
+  OrderedDict &operator=(OrderedDict &&other) noexcept {
+    if (this != &other) {
+      OrderedDict moved(std::move(other));
+      swap(moved);
+    }
+    return *this;
+  }
+  OrderedDict(std::initializer_list<value_type> init) {
+    reserve(init.size());
+    for (const auto &item : init) insert(item);
+  }
+
+  iterator begin() noexcept { return make_iterator(first_); }
+  iterator end() noexcept { return make_iterator(entries_.size()); }
+  const_iterator begin() const noexcept { return make_iterator(first_); }
+  const_iterator end() const noexcept { return make_iterator(entries_.size()); }
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+
+  size_type size() const noexcept { return size_; }
+  bool empty() const noexcept { return size_ == 0; }
+
+  void clear() noexcept {
+    entries_.clear();
+    hashes_.clear();
+    index_.clear();
+    size_ = 0;
+    first_ = 0;
+  }
+
+  void reserve(size_type count) {
+    if (count > entries_.capacity() && size_ != entries_.size()) compact();
+    entries_.reserve(count);
+    hashes_.reserve(count);
+    if (count > kIndexThreshold && index_.size() < index_size_for(count)) rebuild_index(count);
+  }
+
+  iterator find(const Key &key) { return find_hashed(key, hasher()(key)); }
+  const_iterator find(const Key &key) const { return find_hashed(key, hasher()(key)); }
+  // Heterogeneous lookup, if Hash and KeyEqual are transparent
+  template <typename K, typename H = Hash, typename = typename H::is_transparent>
+  iterator find(const K &key) {
+    return find_hashed(key, hasher()(key));
+  }
+  template <typename K, typename H = Hash, typename = typename H::is_transparent>
+  const_iterator find(const K &key) const {
+    return find_hashed(key, hasher()(key));
+  }
+
+  // Look up with a hash computed beforehand by hash_function()
+  template <typename K>
+  iterator find_hashed(const K &key, size_t hash) {
+    size_type pos = find_position(key, hash);
+    return pos == npos ? end() : make_iterator(pos);
+  }
+  template <typename K>
+  const_iterator find_hashed(const K &key, size_t hash) const {
+    size_type pos = find_position(key, hash);
+    return pos == npos ? end() : make_iterator(pos);
+  }
+
+  size_type count(const Key &key) const { return find(key) != end() ? 1 : 0; }
+  bool contains(const Key &key) const { return find(key) != end(); }
+
+  T &at(const Key &key) {
+    auto it = find(key);
+    if (it == end()) throw std::out_of_range("OrderedDict::at");
+    return it->second;
+  }
+  const T &at(const Key &key) const {
+    auto it = find(key);
+    if (it == end()) throw std::out_of_range("OrderedDict::at");
+    return it->second;
+  }
+
+  T &operator[](const Key &key) { return try_emplace(key).first->second; }
+  T &operator[](Key &&key) { return try_emplace(std::move(key)).first->second; }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key &key, Args &&...args) {
+    return try_emplace_hashed(key, hasher()(key), std::forward<Args>(args)...);
+  }
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(Key &&key, Args &&...args) {
+    size_t hash = hasher()(key);
+    return try_emplace_hashed(std::move(key), hash, std::forward<Args>(args)...);
+  }
+
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const Key &key, M &&obj) {
+    return assign_hashed(key, hasher()(key), std::forward<M>(obj));
+  }
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(Key &&key, M &&obj) {
+    size_t hash = hasher()(key);
+    return assign_hashed(std::move(key), hash, std::forward<M>(obj));
+  }
+
+  std::pair<iterator, bool> insert(const value_type &item) { return try_emplace(item.first, item.second); }
+  std::pair<iterator, bool> insert(value_type &&item) {
+    return try_emplace(std::move(item.first), std::move(item.second));
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args &&...args) {
+    value_type item(std::forward<Args>(args)...);
+    return insert(std::move(item));
+  }
+
+  // Leaves a tombstone, so only iterators and references to the erased entry are invalidated
+  iterator erase(const_iterator pos) {
+    const size_type offset = static_cast<size_type>(pos.slot_ - entries_.data());
+    if (!index_.empty()) index_[index_slot(offset)] = kTombstone;
+    entries_[offset].reset();
+    if (--size_ == 0) {
+      clear();
+      return end();
+    }
+    if (offset == first_) first_ = static_cast<size_type>(begin().slot_ - entries_.data());
+    return make_iterator(offset + 1);
+  }
+
+  size_type erase(const Key &key) {
+    auto it = find(key);
+    if (it == end()) return 0;
+    erase(it);
+    return 1;
+  }
+
+  void swap(OrderedDict &other) noexcept {
+    entries_.swap(other.entries_);
+    hashes_.swap(other.hashes_);
+    index_.swap(other.index_);
+    std::swap(size_, other.size_);
+    std::swap(first_, other.first_);
+  }
+
+  hasher hash_function() const { return hasher(); }
+  key_equal key_eq() const { return key_equal(); }
+
+  // Equal if both hold the same key-value pairs, regardless of order, like Python dicts
+  friend bool operator==(const OrderedDict &lhs, const OrderedDict &rhs) {
+    if (lhs.size() != rhs.size()) return false;
+    for (size_type i = lhs.first_; i < lhs.entries_.size(); ++i) {
+      if (!lhs.entries_[i]) continue;
+      size_type pos = rhs.find_position(lhs.entries_[i]->first, lhs.hashes_[i]);
+      if (pos == npos || !(rhs.entries_[pos]->second == lhs.entries_[i]->second)) return false;
+    }
+    return true;
+  }
+  friend bool operator!=(const OrderedDict &lhs, const OrderedDict &rhs) { return !(lhs == rhs); }
+
+ private:
+  static constexpr size_type npos = static_cast<size_type>(-1);
+  // index slot of an erased entry, which a probe passes over
+  static constexpr uint32_t kTombstone = static_cast<uint32_t>(-1);
+
+  iterator make_iterator(size_type pos) noexcept {
+    return iterator(entries_.data() + pos, entries_.data() + entries_.size());
+  }
+  const_iterator make_iterator(size_type pos) const noexcept {
+    return const_iterator(entries_.data() + pos, entries_.data() + entries_.size());
+  }
+
+  // Insert unless present, `key` can be anything the entry key is constructible from and comparable with
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace_hashed(K &&key, size_t hash, Args &&...args) {
+    size_type pos = find_position(key, hash);
+    if (pos != npos) return {make_iterator(pos), false};
+    // Reclaim tombstones rather than grow, then grow the index first so a failed allocation leaves the dict untouched
+    if (size_ != entries_.size() && entries_.size() == entries_.capacity()) compact();
+    const size_type count = entries_.size() + 1;
+    if (count > kIndexThreshold && index_.size() < index_size_for(count)) rebuild_index(count * 2);
+    hashes_.push_back(hash);
+    try {
+      entries_.emplace_back(std::in_place, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+    } catch (...) {
+      hashes_.pop_back();
+      throw;
+    }
+    if (!index_.empty()) insert_index(count - 1, hash);
+    ++size_;
+    return {make_iterator(count - 1), true};
+  }
+
+  template <typename K, typename M>
+  std::pair<iterator, bool> assign_hashed(K &&key, size_t hash, M &&obj) {
+    size_type pos = find_position(key, hash);
+    if (pos != npos) {
+      entries_[pos]->second = std::forward<M>(obj);
+      return {make_iterator(pos), false};
+    }
+    return try_emplace_hashed(std::forward<K>(key), hash, std::forward<M>(obj));
+  }
+
+  // Keep the index at most 2/3 full, counting tombstones
+  static size_type index_size_for(size_type count) {
+    size_type size = 8;
+    while (size * 2 < count * 3) size *= 2;
+    return size;
+  }
+
+  template <typename K>
+  size_type find_position(const K &key, size_t hash) const {
+    if (index_.empty()) {
+      for (size_type i = first_; i < hashes_.size(); ++i) {
+        if (hashes_[i] == hash && entries_[i] && key_equal()(entries_[i]->first, key)) return i;
+      }
+      return npos;
+    }
+    const size_t mask = index_.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+      uint32_t entry = index_[slot];
+      if (entry == 0) return npos;
+      if (entry != kTombstone && hashes_[entry - 1] == hash && key_equal()(entries_[entry - 1]->first, key)) {
+        return entry - 1;
+      }
+    }
+  }
+
+  // the index slot that points at entry `pos`
+  size_t index_slot(size_type pos) const noexcept {
+    const size_t mask = index_.size() - 1;
+    size_t slot = hashes_[pos] & mask;
+    while (index_[slot] != pos + 1) slot = (slot + 1) & mask;
+    return slot;
+  }
+
+  static void insert_index(std::vector<uint32_t> &index, size_type pos, size_t hash) noexcept {
+    const size_t mask = index.size() - 1;
+    size_t slot = hash & mask;
+    while (index[slot] != 0) slot = (slot + 1) & mask;
+    index[slot] = static_cast<uint32_t>(pos + 1);
+  }
+  void insert_index(size_type pos, size_t hash) noexcept { insert_index(index_, pos, hash); }
+
+  void rebuild_index(size_type capacity) {
+    std::vector<uint32_t> index(index_size_for(capacity), 0);
+    for (size_type i = first_; i < hashes_.size(); ++i) {
+      if (entries_[i]) insert_index(index, i, hashes_[i]);
+    }
+    index_.swap(index);
+  }
+
+  // Drop the tombstones, keeping the live entries in order, and rebuild the index without them
+  void compact() {
+    size_type live = 0;
+    for (size_type i = first_; i < entries_.size(); ++i) {
+      if (!entries_[i]) continue;
+      if (live != i) {
+        entries_[live] = std::move(entries_[i]);
+        hashes_[live] = hashes_[i];
+      }
+      ++live;
+    }
+    entries_.truncate(live);
+    hashes_.truncate(live);
+    first_ = 0;
+    if (live > kIndexThreshold) {
+      rebuild_index(live);
+    } else {
+      index_.clear();
+    }
+  }
+
+  detail::InlineVector<slot_type, kIndexThreshold> entries_;
+  detail::InlineVector<size_t, kIndexThreshold> hashes_;
+  // 1-based positions into entries_, 0 marks an empty slot and kTombstone an erased entry
+  std::vector<uint32_t> index_;
+  // number of live entries
+  size_type size_ = 0;
+  // no live entry comes before this position, so begin() does not rescan a run of erased ones
+  size_type first_ = 0;
+};
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_ORDERED_DICT_H
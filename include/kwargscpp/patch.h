@@ -0,0 +1,283 @@
+#ifndef KWARGS_PATCH_H
+#define KWARGS_PATCH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+
+// Structural diff and patch of DictType trees, so a caller that changes a few leaves of a large dict sends and applies
+// only those changes. Nested dicts are compared key by key and lists position by position, and a list or dict that
+// both trees share is skipped without looking inside, so diffing a modified copy costs about as much as its changes.
+//
+// As a ValueType, e.g. to or from Python, a patch is a list of ops like JSON Patch (RFC 6902), but with paths as lists
+// of keys and indices, which any key can appear in:
+//   [{"op": "replace", "path": ["model", "layers", 2, "units"], "value": 128}, {"op": "remove", "path": ["debug"]}]
+namespace kwargscpp {
+
+// A key into a dict or an index into a list
+using PatchStep = std::variant<KeyType, size_t>;
+
+struct PatchOp {
+  enum class Kind : uint8_t {
+    // set a key of a dict, or insert into a list at an index up to its size
+    add,
+    // erase a key of a dict or an element of a list
+    remove,
+    // overwrite an existing key or element
+    replace,
+  };
+
+  Kind kind;
+  std::vector<PatchStep> path;
+  // the new value, unused by remove
+  ValueType value;
+};
+
+using Patch = std::vector<PatchOp>;
+
+// the ops turning `from` into `to`, applied in order
+Patch diff(const DictType &from, const DictType &to);
+
+// apply `patch` to `dict` in order, cloning only the shared lists and dicts on the paths it writes to. A path that does
+// not resolve throws like get_or_die: std::runtime_error for a missing key, std::out_of_range for an index past the
+// end, std::bad_variant_access for a step into a scalar or of the wrong kind; the ops before it stay applied.
+void apply_patch(DictType &dict, const Patch &patch);
+
+// a patch as a list of {"op", "path", "value"} dicts, and back, throwing std::invalid_argument if `value` is not one
+ValueType patch_to_value(const Patch &patch);
+Patch patch_from_value(const ValueType &value);
+
+namespace detail {
+
+// Collects the ops of diff(), keeping the pairs of lists or dicts still to compare on an explicit stack rather than
+// recursing, so deep trees do not overflow the native stack
+class PatchDiffer {
+ public:
+  explicit PatchDiffer(Patch &patch) : patch_(patch) {}
+
+  void run(const DictType &from, const DictType &to) {
+    diff_dicts(from, to, {});
+    while (!stack_.empty()) {
+      Pending pending = std::move(stack_.back());
+      stack_.pop_back();
+      if (pending.from_list) {
+        diff_lists(*pending.from_list, *pending.to_list, pending.path);
+      } else {
+        diff_dicts(*pending.from_dict, *pending.to_dict, pending.path);
+      }
+    }
+  }
+
+ private:
+  struct Pending {
+    const ListType *from_list;
+    const ListType *to_list;
+    const DictType *from_dict;
+    const DictType *to_dict;
+    std::vector<PatchStep> path;
+  };
+
+  void diff_dicts(const DictType &from, const DictType &to, const std::vector<PatchStep> &path) {
+    for (const auto &item : from) {
+      auto it = find_key(to, item.first);
+      if (it == to.end()) {
+        add_op(PatchOp::Kind::remove, path, item.first, ValueType());
+      } else {
+        diff_values(item.second, it->second, path, item.first);
+      }
+    }
+    for (const auto &item : to) {
+      if (find_key(from, item.first) == from.end()) add_op(PatchOp::Kind::add, path, item.first, item.second);
+    }
+  }
+
+  // elements at the same index are compared, then the tail of the longer list is added or removed from the back
+  void diff_lists(const ListType &from, const ListType &to, const std::vector<PatchStep> &path) {
+    const size_t common = std::min(from.size(), to.size());
+    for (size_t i = 0; i < common; ++i) diff_values(from[i], to[i], path, i);
+    for (size_t i = common; i < to.size(); ++i) add_op(PatchOp::Kind::add, path, i, to[i]);
+    for (size_t i = from.size(); i > to.size(); --i) add_op(PatchOp::Kind::remove, path, i - 1, ValueType());
+  }
+
+  void diff_values(const ValueType &from, const ValueType &to, const std::vector<PatchStep> &path, PatchStep step) {
+    const auto *from_list = from.get_if<Cow<ListType>>();
+    const auto *to_list = to.get_if<Cow<ListType>>();
+    const auto *from_dict = from.get_if<Cow<DictType>>();
+    const auto *to_dict = to.get_if<Cow<DictType>>();
+    // a payload both sides share is equal without looking inside
+    if (from_list && to_list) {
+      if (&from_list->get() != &to_list->get()) {
+        stack_.push_back({&from_list->get(), &to_list->get(), nullptr, nullptr, extend(path, std::move(step))});
+      }
+    } else if (from_dict && to_dict) {
+      if (&from_dict->get() != &to_dict->get()) {
+        stack_.push_back({nullptr, nullptr, &from_dict->get(), &to_dict->get(), extend(path, std::move(step))});
+      }
+    } else if (!(from == to)) {
+      add_op(PatchOp::Kind::replace, path, std::move(step), to);
+    }
+  }
+
+  void add_op(PatchOp::Kind kind, const std::vector<PatchStep> &path, PatchStep step, ValueType value) {
+    patch_.push_back({kind, extend(path, std::move(step)), std::move(value)});
+  }
+
+  static std::vector<PatchStep> extend(const std::vector<PatchStep> &path, PatchStep step) {
+    std::vector<PatchStep> out;
+    out.reserve(path.size() + 1);
+    out.insert(out.end(), path.begin(), path.end());
+    out.push_back(std::move(step));
+    return out;
+  }
+
+  Patch &patch_;
+  std::vector<Pending> stack_;
+};
+
+// the op's name in the ValueType form
+inline const char *patch_op_name(PatchOp::Kind kind) {
+  switch (kind) {
+    case PatchOp::Kind::add:
+      return "add";
+    case PatchOp::Kind::remove:
+      return "remove";
+    default:
+      return "replace";
+  }
+}
+
+}  // namespace detail
+
+inline Patch diff(const DictType &from, const DictType &to) {
+  Patch patch;
+  detail::PatchDiffer(patch).run(from, to);
+  return patch;
+}
+
+inline void apply_patch(DictType &dict, const Patch &patch) {
+  for (const PatchOp &op : patch) {
+    if (op.path.empty()) throw std::invalid_argument("Patch path is empty");
+    // the list or dict holding the last step, reached by writable access so shared payloads are cloned on the way
+    DictType *parent_dict = &dict;
+    ListType *parent_list = nullptr;
+    for (size_t i = 0; i + 1 < op.path.size(); ++i) {
+      ValueType *next;
+      if (const KeyType *key = std::get_if<KeyType>(&op.path[i])) {
+        if (!parent_dict) detail::throw_error(ErrorCode::wrong_type);
+        auto it = detail::find_key(*parent_dict, *key);
+        if (it == parent_dict->end()) detail::throw_error(ErrorCode::key_not_found);
+        next = &it->second;
+      } else {
+        size_t index = std::get<size_t>(op.path[i]);
+        if (!parent_list) detail::throw_error(ErrorCode::wrong_type);
+        if (index >= parent_list->size()) detail::throw_error(ErrorCode::index_out_of_range);
+        next = &(*parent_list)[index];
+      }
+      parent_dict = next->is_dict() ? &next->mutable_dict() : nullptr;
+      parent_list = next->is_vector() ? &next->mutable_vector() : nullptr;
+      if (!parent_dict && !parent_list) detail::throw_error(ErrorCode::wrong_type);
+    }
+
+    const PatchStep &last = op.path.back();
+    if (const KeyType *key = std::get_if<KeyType>(&last)) {
+      if (!parent_dict) detail::throw_error(ErrorCode::wrong_type);
+      auto it = detail::find_key(*parent_dict, *key);
+      if (op.kind == PatchOp::Kind::add) {
+        set(*parent_dict, *key, op.value);
+      } else if (it == parent_dict->end()) {
+        detail::throw_error(ErrorCode::key_not_found);
+      } else if (op.kind == PatchOp::Kind::replace) {
+        it->second = op.value;
+      } else {
+        parent_dict->erase(it);
+      }
+    } else {
+      size_t index = std::get<size_t>(last);
+      if (!parent_list) detail::throw_error(ErrorCode::wrong_type);
+      if (index > parent_list->size() || (op.kind != PatchOp::Kind::add && index == parent_list->size())) {
+        detail::throw_error(ErrorCode::index_out_of_range);
+      }
+      if (op.kind == PatchOp::Kind::add) {
+        parent_list->insert(parent_list->begin() + static_cast<std::ptrdiff_t>(index), op.value);
+      } else if (op.kind == PatchOp::Kind::replace) {
+        (*parent_list)[index] = op.value;
+      } else {
+        parent_list->erase(parent_list->begin() + static_cast<std::ptrdiff_t>(index));
+      }
+    }
+  }
+}
+
+inline ValueType patch_to_value(const Patch &patch) {
+  ListType ops;
+  ops.reserve(patch.size());
+  for (const PatchOp &op : patch) {
+    ListType path;
+    path.reserve(op.path.size());
+    for (const PatchStep &step : op.path) {
+      if (const KeyType *key = std::get_if<KeyType>(&step)) {
+        path.emplace_back(*key);
+      } else {
+        path.emplace_back(static_cast<intmax_t>(std::get<size_t>(step)));
+      }
+    }
+    DictType item;
+    set(item, "op", detail::patch_op_name(op.kind));
+    set(item, "path", std::move(path));
+    if (op.kind != PatchOp::Kind::remove) set(item, "value", op.value);
+    ops.emplace_back(std::move(item));
+  }
+  return ValueType(std::move(ops));
+}
+
+inline Patch patch_from_value(const ValueType &value) {
+  const auto fail = [](const std::string &what) -> void { throw std::invalid_argument("Invalid patch: " + what); };
+  if (!value.is_vector()) fail("not a list of ops");
+  Patch patch;
+  patch.reserve(value.as_vector().size());
+  for (const ValueType &item : value.as_vector()) {
+    if (!item.is_dict()) fail("op is not a dict");
+    const DictType &op = item.as_dict();
+    Result<std::string> name = try_get<std::string>(op, "op");
+    Result<ListType> path = try_get<ListType>(op, "path");
+    if (!name || !path) fail("op needs an \"op\" string and a \"path\" list");
+
+    PatchOp out{PatchOp::Kind::replace, {}, ValueType()};
+    if (*name == "add") {
+      out.kind = PatchOp::Kind::add;
+    } else if (*name == "remove") {
+      out.kind = PatchOp::Kind::remove;
+    } else if (*name != "replace") {
+      fail("unknown op \"" + *name + "\"");
+    }
+    out.path.reserve(path->size());
+    for (const ValueType &step : *path) {
+      if (step.is_string()) {
+        out.path.emplace_back(std::in_place_type<KeyType>, step.as_string());
+      } else if (step.is_int() && step.as_int() >= 0) {
+        out.path.emplace_back(static_cast<size_t>(step.as_int()));
+      } else {
+        fail("path step is neither a key nor an index");
+      }
+    }
+    if (out.kind != PatchOp::Kind::remove) {
+      auto it = detail::find_key(op, std::string_view("value"));
+      if (it == op.end()) fail("\"" + *name + "\" op has no \"value\"");
+      out.value = it->second;
+    }
+    patch.push_back(std::move(out));
+  }
+  return patch;
+}
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_PATCH_H
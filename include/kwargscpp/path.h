@@ -0,0 +1,217 @@
+#ifndef KWARGS_PATH_H
+#define KWARGS_PATH_H
+
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+
+// Lookup into nested dicts and lists by a dotted path like "model.encoder.layers[3].dropout". The tree is walked by
+// reference, so reaching a leaf copies nothing but the leaf itself. Keys containing '.' or '[' cannot be addressed.
+namespace kwargscpp {
+
+// A path parsed once, with the hash of every key computed up front, to be reused across lookups
+class Path {
+ public:
+  // throws std::invalid_argument if `path` is malformed
+  explicit Path(std::string_view path);
+
+  const std::string &str() const noexcept { return path_; }
+  // number of keys and indices in the path
+  size_t size() const noexcept { return segments_.size(); }
+
+ private:
+  friend const ValueType *find_path(const DictType &dict, const Path &path, ErrorCode *error);
+
+  struct Segment {
+    bool is_index;
+    size_t offset;  // of the key in path_
+    size_t size;
+    size_t hash;    // of the key, or the index
+  };
+
+  std::string path_;
+  std::vector<Segment> segments_;
+};
+
+// find the value at `path`, nullptr if there is none, in which case `error` is set to the reason, malformed_path if
+// `path` cannot be parsed
+const ValueType *find_path(const DictType &dict, std::string_view path, ErrorCode *error = nullptr);
+const ValueType *find_path(const DictType &dict, const Path &path, ErrorCode *error = nullptr);
+
+// get a value at `path` without throwing, with the same conversions as try_get
+template <typename T>
+Result<T> try_get_path(const DictType &dict, std::string_view path);
+template <typename T>
+Result<T> try_get_path(const DictType &dict, const Path &path);
+
+// get a value at `path`, throwing like get_or_die, std::out_of_range for an index past the end of a list, or
+// std::invalid_argument for a malformed path
+template <typename T>
+T get_path(const DictType &dict, std::string_view path);
+template <typename T>
+T get_path(const DictType &dict, const Path &path);
+// get a value at `path` with a default value
+template <typename T>
+T get_path(const DictType &dict, std::string_view path, const T &default_value);
+template <typename T>
+T get_path(const DictType &dict, const Path &path, const T &default_value);
+
+namespace detail {
+
+// Split `path` into keys and [indices], calling on_key(std::string_view) and on_index(size_t) in order until one of
+// them returns false. Returns false if the path is malformed, including an index that does not fit a size_t, and may
+// have called them for the segments before the fault.
+template <typename OnKey, typename OnIndex>
+bool scan_path(std::string_view path, OnKey &&on_key, OnIndex &&on_index) {
+  size_t pos = 0;
+  while (true) {
+    size_t end = pos;
+    while (end < path.size() && path[end] != '.' && path[end] != '[') ++end;
+    if (end == pos) return false;
+    if (!on_key(path.substr(pos, end - pos))) return true;
+    pos = end;
+    while (pos < path.size() && path[pos] == '[') {
+      size_t close = path.find(']', pos);
+      if (close == std::string_view::npos || close == pos + 1) return false;
+      size_t index = 0;
+      for (size_t i = pos + 1; i < close; ++i) {
+        if (path[i] < '0' || path[i] > '9') return false;
+        const size_t digit = static_cast<size_t>(path[i] - '0');
+        if (index > (std::numeric_limits<size_t>::max() - digit) / 10) return false;
+        index = index * 10 + digit;
+      }
+      if (!on_index(index)) return true;
+      pos = close + 1;
+    }
+    if (pos == path.size()) return true;
+    if (path[pos] != '.') return false;
+    ++pos;
+  }
+}
+
+// scan_path, but checking the whole path first, so neither callback is called for a malformed one
+template <typename OnKey, typename OnIndex>
+bool parse_path(std::string_view path, OnKey &&on_key, OnIndex &&on_index) {
+  if (!scan_path(path, [](std::string_view) { return true; }, [](size_t) { return true; })) return false;
+  return scan_path(path, std::forward<OnKey>(on_key), std::forward<OnIndex>(on_index));
+}
+
+// One step of a walk from the root dict, where `current` is nullptr. Both return false and set `error` if there is
+// nothing to step to.
+template <typename K>
+bool step_key(const DictType &root, const ValueType *&current, const K &key, ErrorCode &error) {
+  if (current && !current->is_dict()) {
+    error = ErrorCode::wrong_type;
+    return false;
+  }
+  const DictType &dict = current ? current->as_dict() : root;
+  auto it = find_key(dict, key);
+  if (it == dict.end()) {
+    error = ErrorCode::key_not_found;
+    return false;
+  }
+  current = &it->second;
+  return true;
+}
+
+inline bool step_index(const ValueType *&current, size_t index, ErrorCode &error) {
+  if (!current || !current->is_vector()) {
+    error = ErrorCode::wrong_type;
+    return false;
+  }
+  const auto &list = current->as_vector();
+  if (index >= list.size()) {
+    error = ErrorCode::index_out_of_range;
+    return false;
+  }
+  current = &list[index];
+  return true;
+}
+
+}  // namespace detail
+
+inline Path::Path(std::string_view path) : path_(path) {
+  const bool valid = detail::parse_path(
+      path_,
+      [&](std::string_view key) {
+        segments_.push_back({false, static_cast<size_t>(key.data() - path_.data()), key.size(), hash_key(key)});
+        return true;
+      },
+      [&](size_t index) {
+        segments_.push_back({true, 0, 0, index});
+        return true;
+      });
+  if (!valid) throw std::invalid_argument("Malformed path: \"" + path_ + "\"");
+}
+
+inline const ValueType *find_path(const DictType &dict, std::string_view path, ErrorCode *error) {
+  const ValueType *current = nullptr;
+  ErrorCode status = ErrorCode::ok;
+  if (!detail::parse_path(
+          path, [&](std::string_view key) { return detail::step_key(dict, current, key, status); },
+          [&](size_t index) { return detail::step_index(current, index, status); })) {
+    status = ErrorCode::malformed_path;
+  }
+  if (error) *error = status;
+  return status == ErrorCode::ok ? current : nullptr;
+}
+
+inline const ValueType *find_path(const DictType &dict, const Path &path, ErrorCode *error) {
+  const ValueType *current = nullptr;
+  ErrorCode status = ErrorCode::ok;
+  for (const auto &segment : path.segments_) {
+    bool found = segment.is_index
+                     ? detail::step_index(current, segment.hash, status)
+                     : detail::step_key(dict, current,
+                                        Key(std::string_view(path.path_).substr(segment.offset, segment.size),
+                                            segment.hash),
+                                        status);
+    if (!found) break;
+  }
+  if (error) *error = status;
+  return status == ErrorCode::ok ? current : nullptr;
+}
+
+template <typename T>
+Result<T> try_get_path(const DictType &dict, std::string_view path) {
+  ErrorCode error;
+  const ValueType *value = find_path(dict, path, &error);
+  return value ? detail::convert<T>(*value) : Result<T>(error);
+}
+
+template <typename T>
+Result<T> try_get_path(const DictType &dict, const Path &path) {
+  ErrorCode error;
+  const ValueType *value = find_path(dict, path, &error);
+  return value ? detail::convert<T>(*value) : Result<T>(error);
+}
+
+template <typename T>
+T get_path(const DictType &dict, std::string_view path) {
+  return try_get_path<T>(dict, path).value();
+}
+
+template <typename T>
+T get_path(const DictType &dict, const Path &path) {
+  return try_get_path<T>(dict, path).value();
+}
+
+template <typename T>
+T get_path(const DictType &dict, std::string_view path, const T &default_value) {
+  return try_get_path<T>(dict, path).value_or(default_value);
+}
+
+template <typename T>
+T get_path(const DictType &dict, const Path &path, const T &default_value) {
+  return try_get_path<T>(dict, path).value_or(default_value);
+}
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_PATH_H
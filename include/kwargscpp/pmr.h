@@ -0,0 +1,466 @@
+#ifndef KWARGS_PMR_H
+#define KWARGS_PMR_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <utility>
+
+#include "kwargscpp/kwargs.h"
+
+// Allocator-aware flavor of ValueType/DictType. Every node, key, string and list of a tree is allocated from the
+// std::pmr::memory_resource the tree was built with, so a per-request tree built into a
+// std::pmr::monotonic_buffer_resource is released all at once when the resource is reset.
+//
+// The allocator is sticky, as for the std::pmr containers: copying or assigning into an existing value, list or
+// dict copies the data into the target's resource, while move construction adopts the source's resource.
+namespace kwargscpp {
+namespace pmr {
+
+using KeyType = std::pmr::string;
+using kwargscpp::ErrorCode;
+using kwargscpp::Result;
+struct ValueType;
+using ListType = std::pmr::vector<ValueType>;
+// hashed like kwargscpp::DictType, so a std::string_view is looked up without building a KeyType
+using DictType = std::pmr::unordered_map<KeyType, ValueType, KeyHash, KeyEqual>;
+
+struct ValueType : public std::variant<intmax_t, uintmax_t, double, bool, std::pmr::string, ListType, DictType> {
+  using variant = std::variant<intmax_t, uintmax_t, double, bool, std::pmr::string, ListType, DictType>;
+  using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+  // Constructors, all with an optional allocator; without one the default resource is used
+  ValueType() noexcept;
+  explicit ValueType(const allocator_type &alloc) noexcept;
+  template <typename T, std::enable_if_t<std::is_integral_v<T>, bool> = true>
+  ValueType(const T &v, const allocator_type &alloc = {});
+  ValueType(const double &v, const allocator_type &alloc = {});
+  ValueType(const bool &v, const allocator_type &alloc = {});
+  ValueType(const char *v, const allocator_type &alloc = {});
+  ValueType(std::string_view v, const allocator_type &alloc = {});
+  ValueType(const std::pmr::string &v, const allocator_type &alloc = {});
+  ValueType(const ListType &v, const allocator_type &alloc = {});
+  ValueType(const DictType &v, const allocator_type &alloc = {});
+  // Containers passed by rvalue are adopted together with their resource
+  ValueType(std::pmr::string &&v) noexcept;
+  ValueType(ListType &&v) noexcept;
+  ValueType(DictType &&v) noexcept;
+
+  // Copy and move, with the std::pmr semantics described above
+  ValueType(const ValueType &other);
+  ValueType(const ValueType &other, const allocator_type &alloc);
+  ValueType(ValueType &&other) noexcept;
+  ValueType(ValueType &&other, const allocator_type &alloc);
+  ValueType &operator=(const ValueType &other);
+  ValueType &operator=(ValueType &&other);
+
+  allocator_type get_allocator() const noexcept { return alloc_; }
+
+  // Member functions
+  bool is_int() const;
+  bool is_uint() const;
+  bool is_double() const;
+  bool is_bool() const;
+  bool is_string() const;
+  bool is_vector() const;
+  bool is_dict() const;
+
+  intmax_t as_int() const;
+  uintmax_t as_uint() const;
+  double as_double() const;
+  bool as_bool() const;
+  const std::pmr::string &as_string() const;
+  const ListType &as_vector() const;
+  const DictType &as_dict() const;
+
+ private:
+  allocator_type alloc_;
+};
+
+// string representation of the dictionary
+std::string to_string(const DictType &dict);
+// string representation of the value
+std::string to_string(const ValueType &value);
+
+// set a key-value pair in the dictionary, the value is copied into the dictionary's resource
+void set(DictType &dict, std::string_view key, const ValueType &value);
+void set(DictType &dict, std::string_view key, ValueType &&value);
+// check if a key exists in the dictionary
+bool has_key(const DictType &dict, std::string_view key);
+
+// get a value from the dictionary without throwing, with the same coercions as kwargscpp::try_get. Strings can be
+// read as either std::pmr::string or std::string.
+template <typename T>
+Result<T> try_get(const DictType &dict, std::string_view key);
+// get a value from the dictionary, with the same coercions as try_get
+template <typename T>
+T get_or_die(const DictType &dict, std::string_view key);
+// get a value from the dictionary with a default value
+template <typename T>
+T get(const DictType &dict, std::string_view key, const T &default_value);
+
+// add a prefix to all keys in the dictionary, not recursive to nested dictionaries. The result is allocated from
+// the resource of `dict`.
+DictType with_prefix(const DictType &dict, std::string_view prefix);
+
+// merge two dictionaries, the second dictionary overwrites the first one, not recursive to nested dictionaries. The
+// result is allocated from the resource of `dict`.
+DictType merge(const DictType &dict, const DictType &other);
+
+// deep copy between the heap and the allocator-aware flavors. This flavor has no array type, so an Array becomes a
+// flat list of its elements in row-major order: its dtype and shape are lost, and from_pmr gives back that list.
+ValueType to_pmr(const kwargscpp::ValueType &value, const ValueType::allocator_type &alloc = {});
+DictType to_pmr(const kwargscpp::DictType &dict, const ValueType::allocator_type &alloc = {});
+kwargscpp::ValueType from_pmr(const ValueType &value);
+kwargscpp::DictType from_pmr(const DictType &dict);
+
+// The resource the Python casters load into on this thread, std::pmr::get_default_resource() unless a
+// ResourceScope is active.
+std::pmr::memory_resource *current_resource() noexcept;
+
+// Route caster loads on this thread into `resource` for the lifetime of the scope, e.g.
+//   std::pmr::monotonic_buffer_resource arena;
+//   kwargscpp::pmr::ResourceScope scope(&arena);
+//   auto kwargs = py::cast<kwargscpp::pmr::DictType>(obj);
+class ResourceScope {
+ public:
+  explicit ResourceScope(std::pmr::memory_resource *resource) noexcept;
+  ~ResourceScope();
+  ResourceScope(const ResourceScope &) = delete;
+  ResourceScope &operator=(const ResourceScope &) = delete;
+
+ private:
+  std::pmr::memory_resource *previous_;
+};
+
+namespace detail {
+
+inline std::pmr::memory_resource *&current_resource_slot() noexcept {
+  static thread_local std::pmr::memory_resource *resource = nullptr;
+  return resource;
+}
+
+// Replace `target` by `source` including its allocator, which plain assignment of pmr types never changes. Used by
+// the casters, whose storage is default constructed before the target resource is known.
+template <typename T>
+void replace_with_allocator(T &target, T &&source) noexcept {
+  target.~T();
+  ::new (static_cast<void *>(&target)) T(std::move(source));
+}
+
+// Look up `key` without building a KeyType. Before C++20 the probe buffer is kept on the heap rather than on the
+// default resource, which may be a short-lived arena when the buffer is first used.
+template <typename Dict>
+auto find_key(Dict &dict, std::string_view key) {
+#ifdef __cpp_lib_generic_unordered_lookup
+  return dict.find(key);
+#else
+  thread_local KeyType buffer(std::pmr::new_delete_resource());
+  return kwargscpp::detail::probe_key(dict, buffer, key, hash_key(key));
+#endif
+}
+
+// the same text as kwargscpp::to_json, appended to `out`
+inline void append_json(const DictType &dict, std::string &out);
+
+inline void append_json(const ValueType &value, std::string &out) {
+  auto sink = [&out](const char *data, size_t size) { out.append(data, size); };
+  std::visit(
+      [&](auto &&arg) {
+        using T = std::decay_t<decltype(arg)>;
+        if constexpr (std::is_same_v<T, bool>) {
+          out += arg ? "true" : "false";
+        } else if constexpr (std::is_arithmetic_v<T>) {
+          kwargscpp::detail::json_put_number(sink, arg);
+        } else if constexpr (std::is_same_v<T, std::pmr::string>) {
+          kwargscpp::detail::json_put_string(sink, arg);
+        } else if constexpr (std::is_same_v<T, ListType>) {
+          out += '[';
+          for (auto it = arg.begin(); it != arg.end(); ++it) {
+            if (it != arg.begin()) out += ", ";
+            append_json(*it, out);
+          }
+          out += ']';
+        } else {
+          append_json(arg, out);
+        }
+      },
+      static_cast<const ValueType::variant &>(value));
+}
+
+inline void append_json(const DictType &dict, std::string &out) {
+  auto sink = [&out](const char *data, size_t size) { out.append(data, size); };
+  out += '{';
+  for (auto it = dict.begin(); it != dict.end(); ++it) {
+    if (it != dict.begin()) out += ", ";
+    kwargscpp::detail::json_put_string(sink, it->first);
+    out += ": ";
+    append_json(it->second, out);
+  }
+  out += '}';
+}
+
+}  // namespace detail
+
+// Constructors
+inline ValueType::ValueType() noexcept : variant(), alloc_() {}
+inline ValueType::ValueType(const allocator_type &alloc) noexcept : variant(), alloc_(alloc) {}
+
+template <typename T, std::enable_if_t<std::is_integral_v<T>, bool>>
+inline ValueType::ValueType(const T &v, const allocator_type &alloc)
+    : variant(static_cast<std::conditional_t<std::is_signed_v<T>, intmax_t, uintmax_t>>(v)), alloc_(alloc) {}
+
+inline ValueType::ValueType(const double &v, const allocator_type &alloc) : variant(v), alloc_(alloc) {}
+inline ValueType::ValueType(const bool &v, const allocator_type &alloc) : variant(v), alloc_(alloc) {}
+inline ValueType::ValueType(const char *v, const allocator_type &alloc)
+    : variant(std::in_place_type<std::pmr::string>, v, alloc), alloc_(alloc) {}
+inline ValueType::ValueType(std::string_view v, const allocator_type &alloc)
+    : variant(std::in_place_type<std::pmr::string>, v, alloc), alloc_(alloc) {}
+inline ValueType::ValueType(const std::pmr::string &v, const allocator_type &alloc)
+    : variant(std::in_place_type<std::pmr::string>, v, alloc), alloc_(alloc) {}
+inline ValueType::ValueType(const ListType &v, const allocator_type &alloc)
+    : variant(std::in_place_type<ListType>, v, alloc), alloc_(alloc) {}
+inline ValueType::ValueType(const DictType &v, const allocator_type &alloc)
+    : variant(std::in_place_type<DictType>, v, alloc), alloc_(alloc) {}
+
+inline ValueType::ValueType(std::pmr::string &&v) noexcept
+    : variant(std::in_place_type<std::pmr::string>, std::move(v)),
+      alloc_(std::get<std::pmr::string>(*this).get_allocator()) {}
+inline ValueType::ValueType(ListType &&v) noexcept
+    : variant(std::in_place_type<ListType>, std::move(v)),
+      alloc_(std::get<ListType>(*this).get_allocator()) {}
+inline ValueType::ValueType(DictType &&v) noexcept
+    : variant(std::in_place_type<DictType>, std::move(v)),
+      alloc_(std::get<DictType>(*this).get_allocator()) {}
+
+inline ValueType::ValueType(const ValueType &other) : ValueType(other, allocator_type()) {}
+
+inline ValueType::ValueType(const ValueType &other, const allocator_type &alloc) : variant(), alloc_(alloc) {
+  std::visit(
+      [&](const auto &arg) {
+        using T = std::decay_t<decltype(arg)>;
+        if constexpr (std::is_same_v<T, std::pmr::string> || std::is_same_v<T, ListType> ||
+                      std::is_same_v<T, DictType>) {
+          // the containers propagate the allocator to their elements by uses-allocator construction
+          variant::template emplace<T>(arg, alloc_);
+        } else {
+          variant::template emplace<T>(arg);
+        }
+      },
+      static_cast<const variant &>(other));
+}
+
+inline ValueType::ValueType(ValueType &&other) noexcept
+    : variant(static_cast<variant &&>(other)), alloc_(other.alloc_) {}
+
+inline ValueType::ValueType(ValueType &&other, const allocator_type &alloc) : variant(), alloc_(alloc) {
+  if (alloc_ == other.alloc_) {
+    variant::operator=(static_cast<variant &&>(other));
+  } else {
+    *this = ValueType(other, alloc_);
+  }
+}
+
+inline ValueType &ValueType::operator=(const ValueType &other) {
+  if (this != &other) {
+    ValueType copy(other, alloc_);
+    variant::operator=(static_cast<variant &&>(copy));
+  }
+  return *this;
+}
+
+inline ValueType &ValueType::operator=(ValueType &&other) {
+  if (this == &other) return *this;
+  if (alloc_ == other.alloc_) {
+    variant::operator=(static_cast<variant &&>(other));
+  } else {
+    ValueType copy(other, alloc_);
+    variant::operator=(static_cast<variant &&>(copy));
+  }
+  return *this;
+}
+
+// Implementation of member functions
+inline bool ValueType::is_int() const { return std::holds_alternative<intmax_t>(*this); }
+inline bool ValueType::is_uint() const { return std::holds_alternative<uintmax_t>(*this); }
+inline bool ValueType::is_double() const { return std::holds_alternative<double>(*this); }
+inline bool ValueType::is_bool() const { return std::holds_alternative<bool>(*this); }
+inline bool ValueType::is_string() const { return std::holds_alternative<std::pmr::string>(*this); }
+inline bool ValueType::is_vector() const { return std::holds_alternative<ListType>(*this); }
+inline bool ValueType::is_dict() const { return std::holds_alternative<DictType>(*this); }
+
+inline intmax_t ValueType::as_int() const { return std::get<intmax_t>(*this); }
+inline uintmax_t ValueType::as_uint() const { return std::get<uintmax_t>(*this); }
+inline double ValueType::as_double() const { return std::get<double>(*this); }
+inline bool ValueType::as_bool() const { return std::get<bool>(*this); }
+inline const std::pmr::string &ValueType::as_string() const { return std::get<std::pmr::string>(*this); }
+inline const ListType &ValueType::as_vector() const { return std::get<ListType>(*this); }
+inline const DictType &ValueType::as_dict() const { return std::get<DictType>(*this); }
+
+inline void set(DictType &dict, std::string_view key, const ValueType &value) {
+  auto it = detail::find_key(dict, key);
+  if (it != dict.end()) {
+    it->second = value;
+  } else {
+    dict.emplace(KeyType(key, dict.get_allocator()), value);
+  }
+}
+
+inline void set(DictType &dict, std::string_view key, ValueType &&value) {
+  auto it = detail::find_key(dict, key);
+  if (it != dict.end()) {
+    it->second = std::move(value);
+  } else {
+    dict.emplace(KeyType(key, dict.get_allocator()), std::move(value));
+  }
+}
+
+inline bool has_key(const DictType &dict, std::string_view key) { return detail::find_key(dict, key) != dict.end(); }
+
+template <typename T>
+Result<T> try_get(const DictType &dict, std::string_view key) {
+  auto it = detail::find_key(dict, key);
+  if (it == dict.end()) return ErrorCode::key_not_found;
+  return std::visit(
+      [](auto &&arg) -> Result<T> {
+        using ArgType = std::decay_t<decltype(arg)>;
+        // If the requested type matches the stored type, return it directly
+        if constexpr (std::is_same_v<T, ArgType>) {
+          return arg;
+        }
+        // Strings can also be read into a heap std::string
+        else if constexpr (std::is_same_v<T, std::string> && std::is_same_v<ArgType, std::pmr::string>) {
+          return T(arg.data(), arg.size());
+        }
+        // Handle conversions between numeric types and bool
+        else if constexpr (std::is_arithmetic_v<T> && std::is_arithmetic_v<ArgType>) {
+          return static_cast<T>(arg);
+        } else {
+          return ErrorCode::wrong_type;
+        }
+      },
+      static_cast<const ValueType::variant &>(it->second));
+}
+
+template <typename T>
+T get_or_die(const DictType &dict, std::string_view key) {
+  return try_get<T>(dict, key).value();
+}
+
+template <typename T>
+T get(const DictType &dict, std::string_view key, const T &default_value) {
+  return try_get<T>(dict, key).value_or(default_value);
+}
+
+inline DictType with_prefix(const DictType &dict, std::string_view prefix) {
+  DictType out_dict(dict.get_allocator());
+  out_dict.reserve(dict.size());
+  for (const auto &[key, value] : dict) {
+    KeyType prefixed(prefix, dict.get_allocator());
+    prefixed += key;
+    out_dict.emplace(std::move(prefixed), value);
+  }
+  return out_dict;
+}
+
+inline DictType merge(const DictType &dict, const DictType &other) {
+  DictType out_dict(dict, dict.get_allocator());
+  for (const auto &[key, value] : other) {
+    out_dict.insert_or_assign(key, value);
+  }
+  return out_dict;
+}
+
+inline ValueType to_pmr(const kwargscpp::ValueType &value, const ValueType::allocator_type &alloc) {
+  return kwargscpp::visit(
+      [&](const auto &arg) -> ValueType {
+        using T = std::decay_t<decltype(arg)>;
+        if constexpr (std::is_same_v<T, Cow<kwargscpp::ListType>>) {
+          ListType list(alloc);
+          list.reserve(arg->size());
+          for (const auto &item : *arg) list.push_back(to_pmr(item, alloc));
+          return ValueType(std::move(list));
+        } else if constexpr (std::is_same_v<T, Cow<kwargscpp::DictType>>) {
+          return ValueType(to_pmr(*arg, alloc));
+        } else if constexpr (std::is_same_v<T, Array>) {
+          // this flavor has no array type, the elements become a flat list
+          ListType list(alloc);
+          list.reserve(arg.size());
+          arg.visit([&](const auto *data) {
+            for (size_t i = 0; i < arg.size(); ++i) list.emplace_back(data[i]);
+          });
+          return ValueType(std::move(list));
+        } else if constexpr (std::is_same_v<T, String>) {
+          return ValueType(std::string_view(arg), alloc);
+        } else {
+          return ValueType(arg, alloc);
+        }
+      },
+      value);
+}
+
+inline DictType to_pmr(const kwargscpp::DictType &dict, const ValueType::allocator_type &alloc) {
+  DictType out_dict(alloc);
+  out_dict.reserve(dict.size());
+  for (const auto &[key, value] : dict) {
+    out_dict.emplace(KeyType(key, alloc), to_pmr(value, alloc));
+  }
+  return out_dict;
+}
+
+inline kwargscpp::ValueType from_pmr(const ValueType &value) {
+  return std::visit(
+      [](const auto &arg) -> kwargscpp::ValueType {
+        using T = std::decay_t<decltype(arg)>;
+        if constexpr (std::is_same_v<T, std::pmr::string>) {
+          return std::string_view(arg);
+        } else if constexpr (std::is_same_v<T, ListType>) {
+          std::vector<kwargscpp::ValueType> list;
+          list.reserve(arg.size());
+          for (const auto &item : arg) list.push_back(from_pmr(item));
+          return list;
+        } else if constexpr (std::is_same_v<T, DictType>) {
+          return from_pmr(arg);
+        } else {
+          return arg;
+        }
+      },
+      static_cast<const ValueType::variant &>(value));
+}
+
+inline kwargscpp::DictType from_pmr(const DictType &dict) {
+  kwargscpp::DictType out_dict;
+  out_dict.reserve(dict.size());
+  for (const auto &[key, value] : dict) {
+    out_dict.emplace(kwargscpp::KeyType(key.data(), key.size()), from_pmr(value));
+  }
+  return out_dict;
+}
+
+inline std::string to_string(const DictType &dict) {
+  std::string out;
+  detail::append_json(dict, out);
+  return out;
+}
+
+inline std::string to_string(const ValueType &value) {
+  std::string out;
+  detail::append_json(value, out);
+  return out;
+}
+
+inline std::pmr::memory_resource *current_resource() noexcept {
+  std::pmr::memory_resource *resource = detail::current_resource_slot();
+  return resource ? resource : std::pmr::get_default_resource();
+}
+
+inline ResourceScope::ResourceScope(std::pmr::memory_resource *resource) noexcept
+    : previous_(std::exchange(detail::current_resource_slot(), resource)) {}
+
+inline ResourceScope::~ResourceScope() { detail::current_resource_slot() = previous_; }
+
+}  // namespace pmr
+}  // namespace kwargscpp
+
+#endif  // KWARGS_PMR_H
@@ -2,18 +2,26 @@
 #define KWARGS_PYBIND11_H
 
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 #include <pybind11/stl_bind.h>
 #include <pybind11/functional.h>
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
 #include "kwargscpp/kwargs.h"
+#include "kwargscpp/msgpack.h"
+#include "kwargscpp/patch.h"
+#include "kwargscpp/pmr.h"
 
 namespace py = pybind11;
 
 namespace pybind11 {
 namespace detail {
 
-// Overloaded helper for std::visit (C++17)
+// Overloaded helper for std::visit and kwargscpp::visit (C++17)
 template <class... Ts>
 struct overloaded : Ts... {
   using Ts::operator()...;
@@ -31,113 +39,769 @@ struct type_caster<kwargscpp::ValueType> {
  public:
   PYBIND11_TYPE_CASTER(kwargscpp::ValueType, _("kwargs::ValueType"));
 
-  bool load(py::handle src, bool convert) {
-    if (py::isinstance<py::int_>(src)) {
-      value = py::cast<intmax_t>(src);
-      return true;
-    } else if (py::isinstance<py::float_>(src)) {
-      value = py::cast<double>(src);
-      return true;
-    } else if (py::isinstance<py::bool_>(src)) {
-      value = py::cast<bool>(src);
-      return true;
-    } else if (py::isinstance<py::str>(src)) {
-      value = py::cast<std::string>(src);
-      return true;
-    } else if (py::isinstance<py::list>(src)) {
-      std::vector<kwargscpp::ValueType> list;
-      py::object obj = py::reinterpret_borrow<py::object>(src);
-      if (load_list(obj, list, convert)) {
-        value = list;
-        return true;
+  bool load(py::handle src, bool) { return load_value(src.ptr(), value); }
+
+  // Conversion in both directions runs off an explicit stack instead of recursing, so deep trees cannot overflow the
+  // native stack, and a container that contains itself fails the conversion instead of crashing.
+  static py::handle cast(const kwargscpp::ValueType& src, py::return_value_policy, py::handle) {
+    CastStack stack;
+    py::object root = py::reinterpret_steal<py::object>(cast_node(src, stack));
+    if (!root || !cast_pending(stack)) {
+      return py::handle();  // Handle casting failure
+    }
+    return root.release();
+  }
+
+  // Convert kwargscpp::DictType to Python dict, in the dict's iteration order
+  static py::handle cast_dict(const kwargscpp::DictType& dict, py::return_value_policy, py::handle) {
+    CastStack stack;
+    py::object root = py::reinterpret_steal<py::object>(PyDict_New());
+    if (!root) {
+      return py::handle();
+    }
+    stack.frames.push_back({nullptr, &dict, 0, dict.begin(), root.ptr()});
+    if (!cast_pending(stack)) {
+      return py::handle();  // Handle casting failure
+    }
+    return root.release();
+  }
+
+  // Load the Python object `src` into `dest`. A list or dict referenced from several places is loaded once and
+  // shared copy-on-write by the other references; one that contains itself fails the load.
+  static bool load_value(PyObject* src, kwargscpp::ValueType& dest) {
+    LoadStack stack;
+    return load_node(src, dest, stack) && load_pending(stack);
+  }
+
+  // Load the Python dict `src` into `dest`, building each value in its slot
+  static bool load_dict(PyObject* src, kwargscpp::DictType& dest) {
+    if (!PyDict_Check(src)) return false;
+
+    LoadStack stack;
+    push_dict(src, nullptr, dest, stack, false);
+    return load_pending(stack);
+  }
+
+  // Python ints within intmax_t load as intmax_t, larger ones within uintmax_t as uintmax_t, others fail. Shared
+  // with the pmr caster, so `Value` is either flavor of ValueType.
+  template <typename Value>
+  static bool load_int(PyObject* src, Value& dest) {
+    int overflow = 0;
+    long long v = PyLong_AsLongLongAndOverflow(src, &overflow);
+    if (overflow == 0) {
+      if (v == -1 && PyErr_Occurred()) {
+        PyErr_Clear();
+        return false;
       }
-    } else if (py::isinstance<py::dict>(src)) {
-      // Recursively load the dictionary
-      kwargscpp::DictType dict;
-      py::object obj = py::reinterpret_borrow<py::object>(src);
-      if (load_dict(obj, dict, convert)) {
-        value = dict;
+      dest = Value(static_cast<intmax_t>(v));
+      return true;
+    }
+    if (overflow > 0) {
+      unsigned long long u = PyLong_AsUnsignedLongLong(src);
+      if (!(u == static_cast<unsigned long long>(-1) && PyErr_Occurred())) {
+        dest = Value(static_cast<uintmax_t>(u));
         return true;
       }
     }
+    PyErr_Clear();
     return false;
   }
 
-  static py::handle cast(const kwargscpp::ValueType& src, py::return_value_policy policy, py::handle parent) {
-    return std::visit(
-        overloaded{[&](intmax_t v) { return py::int_(v).release(); },
-                   [&](uintmax_t v) { return py::int_(v).release(); },
-                   [&](double v) { return py::float_(v).release(); },
-                   [&](bool v) { return py::bool_(v).release(); },
-                   [&](const std::string& v) { return py::str(v.c_str(), v.length()).release(); },
-                   [&](const std::vector<kwargscpp::ValueType>& vec) -> py::handle {
-                     // Convert kwargscpp::ValueType to Python list
-                     py::list py_list;
-                     for (const auto& val : vec) {
-                       py::handle h = type_caster<kwargscpp::ValueType>::cast(val, policy, parent);
-                       if (!h) {
-                         return py::handle();  // Handle casting failure
-                       }
-                       py_list.append(h);
-                     }
-                     return py_list.release();
+  // Convert kwargscpp::Array to a read-only NumPy array sharing its buffer, which stays alive through a copy of the
+  // Array held by the NumPy array's base capsule. Read-only, since copies on the C++ side may share the buffer.
+  static py::handle cast_array(const kwargscpp::Array& array) {
+    auto* owner = new kwargscpp::Array(array);
+    py::capsule base(owner, [](void* ptr) { delete static_cast<kwargscpp::Array*>(ptr); });
+    std::vector<py::ssize_t> shape(owner->shape().begin(), owner->shape().end());
+    py::array result(array_dtype(owner->dtype()), std::move(shape), owner->data(), base);
+    result.attr("setflags")(py::arg("write") = false);
+    return result.release();
+  }
+
+ private:
+  static py::dtype array_dtype(kwargscpp::DType dtype) {
+    switch (dtype) {
+      case kwargscpp::DType::float32:
+        return py::dtype::of<float>();
+      case kwargscpp::DType::int64:
+        return py::dtype::of<int64_t>();
+      case kwargscpp::DType::uint8:
+        return py::dtype::of<uint8_t>();
+      default:
+        return py::dtype::of<double>();
+    }
+  }
+
+  // Helper function to load a C-contiguous float64/float32/int64/uint8 buffer into kwargscpp::Array with one copy
+  static bool load_array(py::handle src, kwargscpp::Array& dest) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(src.ptr(), &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+      PyErr_Clear();
+      return false;
+    }
+    kwargscpp::DType dtype;
+    bool supported = buffer_dtype(view, dtype);
+    if (supported) {
+      dest = kwargscpp::Array(dtype, std::vector<size_t>(view.shape, view.shape + view.ndim), view.buf);
+    }
+    PyBuffer_Release(&view);
+    return supported;
+  }
+
+  // The DType of a buffer's native-order struct format, false if there is none
+  static bool buffer_dtype(const Py_buffer& view, kwargscpp::DType& dtype) noexcept {
+    const char* format = view.format ? view.format : "B";
+    if (*format == '@' || *format == '=') ++format;
+    if (format[0] == '\0' || format[1] != '\0') return false;
+    switch (format[0]) {
+      case 'd':
+        dtype = kwargscpp::DType::float64;
+        return view.itemsize == 8;
+      case 'f':
+        dtype = kwargscpp::DType::float32;
+        return view.itemsize == 4;
+      case 'q':
+      case 'l':
+      case 'n':
+        dtype = kwargscpp::DType::int64;
+        return view.itemsize == 8;
+      case 'B':
+        dtype = kwargscpp::DType::uint8;
+        return view.itemsize == 1;
+      default:
+        return false;
+    }
+  }
+
+  // A list or dict being converted to Python: `out` is filled from `list` or `dict`, resuming at `index` or `it`
+  struct CastFrame {
+    const kwargscpp::ListType* list;
+    const kwargscpp::DictType* dict;
+    size_t index;
+    kwargscpp::DictType::const_iterator it;
+    PyObject* out;  // owned by its parent or the root
+  };
+  struct CastStack {
+    std::vector<CastFrame> frames;
+
+    // Whether `payload` is being converted, i.e. contains itself. Only a shared payload can, as one that is not has
+    // no other reference that could be its own descendant, so the frames are only searched for those.
+    bool open(const void* payload) const {
+      return std::any_of(frames.begin(), frames.end(),
+                         [&](const CastFrame& frame) { return frame.list == payload || frame.dict == payload; });
+    }
+  };
+
+  // A new reference to `src` converted, or to the empty list or dict to be filled from a frame pushed for it
+  static PyObject* cast_node(const kwargscpp::ValueType& src, CastStack& stack) {
+    return kwargscpp::visit(
+        overloaded{[&](intmax_t v) -> PyObject* { return PyLong_FromLongLong(v); },
+                   [&](uintmax_t v) -> PyObject* { return PyLong_FromUnsignedLongLong(v); },
+                   [&](double v) -> PyObject* { return PyFloat_FromDouble(v); },
+                   [&](bool v) -> PyObject* { return py::bool_(v).release().ptr(); },
+                   [&](const kwargscpp::String& v) -> PyObject* {
+                     return PyUnicode_FromStringAndSize(v.data(), static_cast<Py_ssize_t>(v.size()));
                    },
-                   [&](const kwargscpp::DictType& dict) -> py::handle {
-                     // Convert kwargscpp::DictType to Python dict
-                     py::dict py_dict;
-                     for (const auto& [key, val] : dict) {
-                       py::handle h = type_caster<kwargscpp::ValueType>::cast(val, policy, parent);
-                       if (!h) {
-                         return py::handle();  // Handle casting failure
-                       }
-                       py_dict[key.c_str()] = h;
-                     }
-                     return py_dict.release();
-                   }},
+                   [&](const kwargscpp::Cow<kwargscpp::ListType>& vec) -> PyObject* {
+                     if (vec.shared() && stack.open(&vec.get())) return cycle_error();
+                     // created at its final size, the items are set by cast_pending
+                     PyObject* out = PyList_New(static_cast<Py_ssize_t>(vec->size()));
+                     if (out) stack.frames.push_back({&vec.get(), nullptr, 0, {}, out});
+                     return out;
+                   },
+                   [&](const kwargscpp::Cow<kwargscpp::DictType>& dict) -> PyObject* {
+                     if (dict.shared() && stack.open(&dict.get())) return cycle_error();
+                     PyObject* out = PyDict_New();
+                     if (out) stack.frames.push_back({nullptr, &dict.get(), 0, dict->begin(), out});
+                     return out;
+                   },
+                   [&](const kwargscpp::Array& array) -> PyObject* { return cast_array(array).ptr(); }},
         src);
   }
 
- private:
-  // Helper function to recursively load a Python list into std::vector<kwargscpp::ValueType>
-  bool load_list(py::object src, std::vector<kwargscpp::ValueType>& dest, bool convert) {
-    if (!py::isinstance<py::list>(src)) return false;
-
-    py::list py_list = py::reinterpret_borrow<py::list>(src);
-    for (auto item : py_list) {
-      kwargscpp::ValueType val;
-      py::handle value_handle = item;
-      type_caster<kwargscpp::ValueType> value_caster;
-      if (!value_caster.load(value_handle, convert)) {
+  // Fill the containers of the pushed frames, depth first
+  static bool cast_pending(CastStack& stack) {
+    while (!stack.frames.empty()) {
+      CastFrame& frame = stack.frames.back();
+      PyObject* out = frame.out;
+      if (frame.list) {
+        if (frame.index == frame.list->size()) {
+          stack.frames.pop_back();
+          continue;
+        }
+        const size_t index = frame.index++;
+        PyObject* item = cast_node((*frame.list)[index], stack);  // may push, invalidating `frame`
+        if (!item) return false;
+        PyList_SET_ITEM(out, static_cast<Py_ssize_t>(index), item);  // steals item
+      } else {
+        if (frame.it == frame.dict->end()) {
+          stack.frames.pop_back();
+          continue;
+        }
+        const auto& [key, val] = *frame.it++;
+        py::object py_key = py::reinterpret_steal<py::object>(
+            PyUnicode_FromStringAndSize(key.data(), static_cast<Py_ssize_t>(key.size())));
+        py::object item = py::reinterpret_steal<py::object>(cast_node(val, stack));
+        if (!py_key || !item || PyDict_SetItem(out, py_key.ptr(), item.ptr()) != 0) return false;
+      }
+    }
+    return true;
+  }
+
+  static PyObject* cycle_error() {
+    PyErr_SetString(PyExc_ValueError, "kwargscpp: cannot convert a list or dict that contains itself");
+    return nullptr;
+  }
+
+  // A list or dict being loaded from Python into `list` or `dict`, the payload of `dest`
+  struct LoadFrame {
+    PyObject* src;
+    kwargscpp::ValueType* dest;  // null for the dict of the DictType caster
+    kwargscpp::ListType* list;
+    kwargscpp::DictType* dict;
+    Py_ssize_t pos;
+    // items left to load, never more than were reserved, so the slots of loaded items stay in place
+    Py_ssize_t remaining;
+    bool shared;  // whether `src` has other references than its parent, so it may be met again
+  };
+  struct LoadStack {
+    std::vector<LoadFrame> frames;
+    // shared lists and dicts loaded so far, mapped to their value
+    std::unordered_map<PyObject*, const kwargscpp::ValueType*> loaded;
+
+    // Whether `src` is being loaded, i.e. contains itself
+    bool open(PyObject* src) const {
+      return std::any_of(frames.begin(), frames.end(), [&](const LoadFrame& frame) { return frame.src == src; });
+    }
+  };
+
+  // Load `src` into `dest`. Exact built-in types are dispatched on their type pointer and read through the CPython
+  // API, so the common case never goes through isinstance or py::cast; subclasses and buffer objects take the slower
+  // checks after that. bool is tested before int, since bool subclasses int. Lists and dicts are loaded by frames
+  // pushed on `stack`.
+  static bool load_node(PyObject* src, kwargscpp::ValueType& dest, LoadStack& stack) {
+    PyTypeObject* type = Py_TYPE(src);
+    if (type == &PyBool_Type) {
+      dest = kwargscpp::ValueType(src == Py_True);
+    } else if (type == &PyLong_Type) {
+      return load_int(src, dest);
+    } else if (type == &PyFloat_Type) {
+      dest = kwargscpp::ValueType(PyFloat_AS_DOUBLE(src));
+    } else if (type == &PyUnicode_Type) {
+      return load_str(src, dest);
+    } else if (type == &PyList_Type) {
+      return push_list(src, dest, stack);
+    } else if (type == &PyDict_Type) {
+      return push_dict(src, dest, stack);
+    } else if (py::isinstance<kwargscpp::SharedDict>(src)) {
+      // a dict bound by kwargscpp::bind_shared_dict, whose payload is shared rather than converted
+      dest = kwargscpp::ValueType(py::handle(src).cast<const kwargscpp::SharedDict&>());
+    } else if (PyBool_Check(src)) {
+      dest = kwargscpp::ValueType(src == Py_True);
+    } else if (PyLong_Check(src)) {
+      return load_int(src, dest);
+    } else if (PyFloat_Check(src)) {
+      dest = kwargscpp::ValueType(PyFloat_AsDouble(src));
+    } else if (PyUnicode_Check(src)) {
+      return load_str(src, dest);
+    } else if (PyList_Check(src)) {
+      return push_list(src, dest, stack);
+    } else if (PyDict_Check(src)) {
+      return push_dict(src, dest, stack);
+    } else if (PyObject_CheckBuffer(src)) {
+      // NumPy arrays and other buffer-protocol objects
+      kwargscpp::Array array;
+      if (!load_array(src, array)) {
         return false;
       }
-      val = value_caster.value;
+      dest = kwargscpp::ValueType(std::move(array));
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  // Whether `src`, a list or dict referenced from elsewhere as well, was met before. If it was loaded, its value is
+  // shared into `dest`; if it is still being loaded, it contains itself and `ok` is set to fail the load.
+  static bool met_before(PyObject* src, kwargscpp::ValueType& dest, const LoadStack& stack, bool& ok) {
+    auto it = stack.loaded.find(src);
+    if (it != stack.loaded.end()) {
+      dest = *it->second;
+      return true;
+    }
+    ok = !stack.open(src);
+    return !ok;
+  }
+
+  // Start loading the Python list `src` into a reserved kwargscpp::ListType in `dest`
+  static bool push_list(PyObject* src, kwargscpp::ValueType& dest, LoadStack& stack) {
+    const bool shared = Py_REFCNT(src) > 1;
+    bool ok = true;
+    if (shared && met_before(src, dest, stack, ok)) return ok;
+
+    const Py_ssize_t size = PyList_GET_SIZE(src);
+    dest = kwargscpp::ValueType(kwargscpp::ListType());
+    kwargscpp::ListType& list = dest.mutable_vector();
+    list.reserve(static_cast<size_t>(size));
+    stack.frames.push_back({src, &dest, &list, nullptr, 0, size, shared});
+    return true;
+  }
+
+  // Start loading the Python dict `src` into a reserved kwargscpp::DictType in `dest`
+  static bool push_dict(PyObject* src, kwargscpp::ValueType& dest, LoadStack& stack) {
+    const bool shared = Py_REFCNT(src) > 1;
+    bool ok = true;
+    if (shared && met_before(src, dest, stack, ok)) return ok;
+
+    dest = kwargscpp::ValueType(kwargscpp::DictType());
+    push_dict(src, &dest, dest.mutable_dict(), stack, shared);
+    return true;
+  }
+  static void push_dict(PyObject* src, kwargscpp::ValueType* dest, kwargscpp::DictType& dict, LoadStack& stack,
+                        bool shared) {
+    const Py_ssize_t size = PyDict_Size(src);
+    dict.reserve(static_cast<size_t>(size));
+    stack.frames.push_back({src, dest, nullptr, &dict, 0, size, shared});
+  }
+
+  // Load the items of the pushed frames, depth first, so a list or dict is complete before it is met again
+  static bool load_pending(LoadStack& stack) {
+    while (!stack.frames.empty()) {
+      LoadFrame& frame = stack.frames.back();
+      PyObject* key = nullptr;
+      PyObject* item = nullptr;
+      bool more = frame.remaining > 0;
+      if (more) {
+        more = frame.list ? frame.pos < PyList_GET_SIZE(frame.src) : PyDict_Next(frame.src, &frame.pos, &key, &item);
+      }
+      if (!more) {
+        // nothing is loaded after the root, so it is not recorded
+        if (frame.shared && stack.frames.size() > 1) stack.loaded.emplace(frame.src, frame.dest);
+        stack.frames.pop_back();
+        continue;
+      }
+      --frame.remaining;
+      if (frame.list) {
+        item = PyList_GET_ITEM(frame.src, frame.pos++);
+        if (!load_node(item, frame.list->emplace_back(), stack)) {  // may push, invalidating `frame`
+          return false;
+        }
+      } else {
+        Py_ssize_t size = 0;
+        const char* data = PyUnicode_Check(key) ? PyUnicode_AsUTF8AndSize(key, &size) : nullptr;
+        if (!data) {
+          PyErr_Clear();
+          return false;
+        }
+        if (!load_node(item, (*frame.dict)[kwargscpp::KeyType(data, static_cast<size_t>(size))], stack)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
 
-      dest.push_back(val);
+  // Copy the UTF-8 buffer cached on a Python str
+  static bool load_str(PyObject* src, kwargscpp::ValueType& dest) {
+    Py_ssize_t size = 0;
+    const char* data = PyUnicode_AsUTF8AndSize(src, &size);
+    if (!data) {
+      PyErr_Clear();
+      return false;
     }
+    dest = kwargscpp::ValueType(std::string_view(data, static_cast<size_t>(size)));
     return true;
   }
-  // Helper function to recursively load a Python dict into kwargscpp::DictType
-  bool load_dict(py::object src, kwargscpp::DictType& dest, bool convert) {
-    if (!py::isinstance<py::dict>(src)) return false;
+};
 
-    py::dict py_dict = py::reinterpret_borrow<py::dict>(src);
-    for (auto item : py_dict) {
-      std::string key = py::cast<std::string>(item.first);
+// Type caster for DictType, used for arguments and results instead of the STL map caster so the dict's iteration
+// order is kept and the OrderedDict flavor (KWARGSCPP_ORDERED_DICT) is covered as well
+template <>
+struct type_caster<kwargscpp::DictType> {
+ public:
+  PYBIND11_TYPE_CASTER(kwargscpp::DictType, _("dict[str, kwargs::ValueType]"));
 
-      kwargscpp::ValueType val;
-      py::handle value_handle = item.second;
-      type_caster<kwargscpp::ValueType> value_caster;
-      if (!value_caster.load(value_handle, convert)) {
+  bool load(py::handle src, bool) {
+    if (py::isinstance<kwargscpp::SharedDict>(src)) {
+      // copies the top level only, nested lists and dicts are shared
+      value = src.cast<const kwargscpp::SharedDict&>().get();
+      return true;
+    }
+    value.clear();
+    return type_caster<kwargscpp::ValueType>::load_dict(src.ptr(), value);
+  }
+
+  static py::handle cast(const kwargscpp::DictType& src, py::return_value_policy policy, py::handle parent) {
+    return type_caster<kwargscpp::ValueType>::cast_dict(src, policy, parent);
+  }
+};
+
+// Type caster for the allocator-aware ValueType. Loads allocate from kwargscpp::pmr::current_resource(), so a
+// whole argument tree lands in the arena of the active kwargscpp::pmr::ResourceScope.
+template <>
+struct type_caster<kwargscpp::pmr::ValueType> {
+ public:
+  PYBIND11_TYPE_CASTER(kwargscpp::pmr::ValueType, _("kwargs::pmr::ValueType"));
+
+  bool load(py::handle src, bool convert) {
+    kwargscpp::pmr::ValueType loaded(kwargscpp::pmr::ValueType::allocator_type(kwargscpp::pmr::current_resource()));
+    if (!load_value(src, loaded, convert)) {
+      return false;
+    }
+    kwargscpp::pmr::detail::replace_with_allocator(value, std::move(loaded));
+    return true;
+  }
+
+  // Both directions run off an explicit stack like the heap-flavor caster, so deep trees cannot overflow the native
+  // stack, and a Python container that contains itself fails the load.
+  static py::handle cast(const kwargscpp::pmr::ValueType& src, py::return_value_policy, py::handle) {
+    CastStack stack;
+    py::object root = py::reinterpret_steal<py::object>(cast_node(src, stack));
+    if (!root || !cast_pending(stack)) {
+      return py::handle();  // Handle casting failure
+    }
+    return root.release();
+  }
+
+  static py::handle cast_dict(const kwargscpp::pmr::DictType& dict, py::return_value_policy, py::handle) {
+    CastStack stack;
+    py::object root = py::reinterpret_steal<py::object>(PyDict_New());
+    if (!root) {
+      return py::handle();
+    }
+    stack.push_back({nullptr, &dict, 0, dict.begin(), root.ptr()});
+    if (!cast_pending(stack)) {
+      return py::handle();  // Handle casting failure
+    }
+    return root.release();
+  }
+
+  // Load `src` into `dest`, allocating from the resource of `dest`
+  static bool load_value(py::handle src, kwargscpp::pmr::ValueType& dest, bool) {
+    LoadStack stack;
+    return load_node(src.ptr(), dest, stack) && load_pending(stack);
+  }
+
+  // Load the Python dict `src` into `dest`, allocating from the resource of `dest`
+  static bool load_dict(py::handle src, kwargscpp::pmr::DictType& dest, bool) {
+    if (!PyDict_Check(src.ptr())) return false;
+
+    LoadStack stack;
+    push_dict(src.ptr(), dest, stack);
+    return load_pending(stack);
+  }
+
+ private:
+  // A list or dict being converted to Python: `out` is filled from `list` or `dict`, resuming at `index` or `it`
+  struct CastFrame {
+    const kwargscpp::pmr::ListType* list;
+    const kwargscpp::pmr::DictType* dict;
+    size_t index;
+    kwargscpp::pmr::DictType::const_iterator it;
+    PyObject* out;  // owned by its parent or the root
+  };
+  using CastStack = std::vector<CastFrame>;
+
+  // A new reference to `src` converted, or to the empty list or dict to be filled from a frame pushed for it
+  static PyObject* cast_node(const kwargscpp::pmr::ValueType& src, CastStack& stack) {
+    return std::visit(
+        overloaded{[&](intmax_t v) -> PyObject* { return PyLong_FromLongLong(v); },
+                   [&](uintmax_t v) -> PyObject* { return PyLong_FromUnsignedLongLong(v); },
+                   [&](double v) -> PyObject* { return PyFloat_FromDouble(v); },
+                   [&](bool v) -> PyObject* { return py::bool_(v).release().ptr(); },
+                   [&](const std::pmr::string& v) -> PyObject* {
+                     return PyUnicode_FromStringAndSize(v.data(), static_cast<Py_ssize_t>(v.size()));
+                   },
+                   [&](const kwargscpp::pmr::ListType& vec) -> PyObject* {
+                     // created at its final size, the items are set by cast_pending
+                     PyObject* out = PyList_New(static_cast<Py_ssize_t>(vec.size()));
+                     if (out) stack.push_back({&vec, nullptr, 0, {}, out});
+                     return out;
+                   },
+                   [&](const kwargscpp::pmr::DictType& dict) -> PyObject* {
+                     PyObject* out = PyDict_New();
+                     if (out) stack.push_back({nullptr, &dict, 0, dict.begin(), out});
+                     return out;
+                   }},
+        static_cast<const kwargscpp::pmr::ValueType::variant&>(src));
+  }
+
+  // Fill the containers of the pushed frames, depth first
+  static bool cast_pending(CastStack& stack) {
+    while (!stack.empty()) {
+      CastFrame& frame = stack.back();
+      PyObject* out = frame.out;
+      if (frame.list) {
+        if (frame.index == frame.list->size()) {
+          stack.pop_back();
+          continue;
+        }
+        const size_t index = frame.index++;
+        PyObject* item = cast_node((*frame.list)[index], stack);  // may push, invalidating `frame`
+        if (!item) return false;
+        PyList_SET_ITEM(out, static_cast<Py_ssize_t>(index), item);  // steals item
+      } else {
+        if (frame.it == frame.dict->end()) {
+          stack.pop_back();
+          continue;
+        }
+        const auto& [key, val] = *frame.it++;
+        py::object py_key = py::reinterpret_steal<py::object>(
+            PyUnicode_FromStringAndSize(key.data(), static_cast<Py_ssize_t>(key.size())));
+        py::object item = py::reinterpret_steal<py::object>(cast_node(val, stack));
+        if (!py_key || !item || PyDict_SetItem(out, py_key.ptr(), item.ptr()) != 0) return false;
+      }
+    }
+    return true;
+  }
+
+  // A list or dict being loaded from Python into `list` or `dict`
+  struct LoadFrame {
+    PyObject* src;
+    kwargscpp::pmr::ListType* list;
+    kwargscpp::pmr::DictType* dict;
+    Py_ssize_t pos;
+    // items left to load, never more than were reserved, so the slots of loaded items stay in place
+    Py_ssize_t remaining;
+  };
+  struct LoadStack {
+    std::vector<LoadFrame> frames;
+
+    // Whether `src` is being loaded, i.e. contains itself. This flavor copies a list or dict met again rather than
+    // sharing it, so only the open frames are searched.
+    bool open(PyObject* src) const {
+      return std::any_of(frames.begin(), frames.end(), [&](const LoadFrame& frame) { return frame.src == src; });
+    }
+  };
+
+  // Load `src` into `dest`, dispatching on the exact built-in types first like the heap-flavor caster. Lists and dicts
+  // are loaded by frames pushed on `stack`.
+  static bool load_node(PyObject* src, kwargscpp::pmr::ValueType& dest, LoadStack& stack) {
+    if (PyBool_Check(src)) {
+      dest = kwargscpp::pmr::ValueType(src == Py_True);
+    } else if (PyLong_Check(src)) {
+      return type_caster<kwargscpp::ValueType>::load_int(src, dest);
+    } else if (PyFloat_Check(src)) {
+      dest = kwargscpp::pmr::ValueType(PyFloat_AsDouble(src));
+    } else if (PyUnicode_Check(src)) {
+      std::string_view str;
+      if (!load_str(src, str)) {
         return false;
       }
-      val = value_caster.value;
+      dest = kwargscpp::pmr::ValueType(str, dest.get_allocator());
+    } else if (PyList_Check(src) || PyDict_Check(src)) {
+      if (Py_REFCNT(src) > 1 && stack.open(src)) return false;
+      if (PyList_Check(src)) {
+        const Py_ssize_t size = PyList_GET_SIZE(src);
+        dest = kwargscpp::pmr::ValueType(kwargscpp::pmr::ListType(dest.get_allocator()));
+        auto& list = std::get<kwargscpp::pmr::ListType>(dest);
+        list.reserve(static_cast<size_t>(size));
+        stack.frames.push_back({src, &list, nullptr, 0, size});
+      } else {
+        dest = kwargscpp::pmr::ValueType(kwargscpp::pmr::DictType(dest.get_allocator()));
+        push_dict(src, std::get<kwargscpp::pmr::DictType>(dest), stack);
+      }
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  static void push_dict(PyObject* src, kwargscpp::pmr::DictType& dict, LoadStack& stack) {
+    const Py_ssize_t size = PyDict_Size(src);
+    dict.reserve(static_cast<size_t>(size));
+    stack.frames.push_back({src, nullptr, &dict, 0, size});
+  }
+
+  // Load the items of the pushed frames, depth first
+  static bool load_pending(LoadStack& stack) {
+    while (!stack.frames.empty()) {
+      LoadFrame& frame = stack.frames.back();
+      PyObject* key = nullptr;
+      PyObject* item = nullptr;
+      bool more = frame.remaining > 0;
+      if (more) {
+        more = frame.list ? frame.pos < PyList_GET_SIZE(frame.src) : PyDict_Next(frame.src, &frame.pos, &key, &item);
+      }
+      if (!more) {
+        stack.frames.pop_back();
+        continue;
+      }
+      --frame.remaining;
+      if (frame.list) {
+        item = PyList_GET_ITEM(frame.src, frame.pos++);
+        // the element is built with the list's allocator, the std::pmr containers pass it on
+        if (!load_node(item, frame.list->emplace_back(), stack)) {  // may push, invalidating `frame`
+          return false;
+        }
+      } else {
+        std::string_view name;
+        if (!load_str(key, name)) {
+          return false;
+        }
+        kwargscpp::pmr::DictType& dict = *frame.dict;
+        if (!load_node(item, dict[kwargscpp::pmr::KeyType(name, dict.get_allocator())], stack)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // View the UTF-8 buffer cached on a Python str, valid as long as the str is alive
+  static bool load_str(PyObject* src, std::string_view& out) {
+    if (!PyUnicode_Check(src)) return false;
+    Py_ssize_t size = 0;
+    const char* data = PyUnicode_AsUTF8AndSize(src, &size);
+    if (!data) {
+      PyErr_Clear();
+      return false;
+    }
+    out = std::string_view(data, static_cast<size_t>(size));
+    return true;
+  }
+};
 
-      dest[key] = val;
+// Type caster for the allocator-aware DictType, loading into kwargscpp::pmr::current_resource()
+template <>
+struct type_caster<kwargscpp::pmr::DictType> {
+ public:
+  PYBIND11_TYPE_CASTER(kwargscpp::pmr::DictType, _("dict[str, kwargs::pmr::ValueType]"));
+
+  bool load(py::handle src, bool convert) {
+    kwargscpp::pmr::DictType loaded(kwargscpp::pmr::current_resource());
+    if (!type_caster<kwargscpp::pmr::ValueType>::load_dict(src, loaded, convert)) {
+      return false;
     }
+    kwargscpp::pmr::detail::replace_with_allocator(value, std::move(loaded));
     return true;
   }
+
+  static py::handle cast(const kwargscpp::pmr::DictType& src, py::return_value_policy policy, py::handle parent) {
+    return type_caster<kwargscpp::pmr::ValueType>::cast_dict(src, policy, parent);
+  }
 };
 }  // namespace detail
 }  // namespace pybind11
 
+namespace kwargscpp {
+namespace detail {
+
+// The UTF-8 view of the Python key `key`, false for one that is not a str and so is never in a SharedDict
+inline bool key_view(py::handle key, std::string_view& out) {
+  Py_ssize_t size = 0;
+  const char* data = PyUnicode_Check(key.ptr()) ? PyUnicode_AsUTF8AndSize(key.ptr(), &size) : nullptr;
+  if (!data) {
+    PyErr_Clear();
+    return false;
+  }
+  out = std::string_view(data, static_cast<size_t>(size));
+  return true;
+}
+
+// The UTF-8 view of the Python key `key` to store, raising TypeError for one that is not a str
+inline std::string_view key_to_store(py::handle key) {
+  std::string_view name;
+  if (!key_view(key, name)) throw py::type_error("Dict keys must be str");
+  return name;
+}
+
+// Raise KeyError(key), as a dict does for a key it does not hold
+[[noreturn]] inline void throw_missing_key(py::handle key) {
+  // passed in a tuple, since a tuple given as the value would be taken as the arguments
+  py::object args = py::reinterpret_steal<py::object>(PyTuple_Pack(1, key.ptr()));
+  if (args) PyErr_SetObject(PyExc_KeyError, args.ptr());
+  throw py::error_already_set();
+}
+
+}  // namespace detail
+
+// Bind SharedDict as the Python class `name` in `m`: a collections.abc.MutableMapping over the C++ dict that converts
+// a value only when it is read, so a large tree returned to Python costs O(keys touched) instead of O(tree). Nested
+// dicts are read as further instances sharing the subtree copy-on-write; writing to one does not change the dict it
+// was read from. The casters accept instances without converting them, a SharedDict or ValueType parameter shares
+// the payload and a DictType parameter copies its top level. Instances pickle as MessagePack, and take structural
+// patches through apply_patch and diff.
+inline py::class_<SharedDict> bind_shared_dict(py::module_& m, const char* name = "Dict") {
+  using Caster = py::detail::type_caster<ValueType>;
+  py::class_<SharedDict> cls(m, name);
+  cls.def(py::init<>())
+      .def(py::init([](DictType dict) { return SharedDict(std::move(dict)); }), py::arg("dict"))
+      .def("__len__", [](const SharedDict& self) { return self->size(); })
+      // keys of any type are looked up, as in a dict, and one that is not a str is never found
+      .def("__contains__",
+           [](const SharedDict& self, py::handle key) {
+             std::string_view name;
+             return detail::key_view(key, name) && has_key(*self, name);
+           })
+      .def("__getitem__",
+           [](const SharedDict& self, py::handle key) -> py::object {
+             std::string_view name;
+             auto it = detail::key_view(key, name) ? detail::find_key(*self, name) : self->end();
+             if (it == self->end()) detail::throw_missing_key(key);
+             if (const auto* dict = it->second.get_if<SharedDict>()) {
+               return py::cast(SharedDict(*dict));
+             }
+             auto item = py::reinterpret_steal<py::object>(
+                 Caster::cast(it->second, py::return_value_policy::automatic, py::handle()));
+             if (!item) throw py::error_already_set();
+             return item;
+           })
+      .def("__setitem__",
+           [](SharedDict& self, py::handle key, ValueType value) {
+             set(self.mutate(), detail::key_to_store(key), std::move(value));
+           })
+      .def("__delitem__",
+           [](SharedDict& self, py::handle key) {
+             std::string_view name;
+             if (!detail::key_view(key, name) || !has_key(*self, name)) detail::throw_missing_key(key);
+             DictType& dict = self.mutate();
+             dict.erase(detail::find_key(dict, name));
+           })
+      .def("__iter__",
+           [](const SharedDict& self) {
+             // iterate over a snapshot of the keys, so writes while iterating are safe
+             py::list keys(self->size());
+             Py_ssize_t i = 0;
+             for (const auto& item : *self) {
+               PyList_SET_ITEM(keys.ptr(), i++, py::str(item.first.data(), item.first.size()).release().ptr());
+             }
+             return py::iter(keys);
+           })
+      .def("to_dict",
+           [](const SharedDict& self) {
+             auto dict = py::reinterpret_steal<py::object>(
+                 Caster::cast_dict(*self, py::return_value_policy::automatic, py::handle()));
+             if (!dict) throw py::error_already_set();
+             return dict;
+           })
+      .def("__repr__", [](const SharedDict& self) { return to_string(*self); })
+      // structural patches, see kwargscpp/patch.h, so a caller can send what changed rather than the whole dict
+      .def(
+          "apply_patch",
+          [](SharedDict& self, const ValueType& patch) { apply_patch(self.mutate(), patch_from_value(patch)); },
+          py::arg("patch"))
+      .def(
+          "diff", [](const SharedDict& self, const DictType& other) { return patch_to_value(diff(*self, other)); },
+          py::arg("other"))
+      // MessagePack, see kwargscpp/msgpack.h, which also backs pickling
+      .def("to_bytes", [](const SharedDict& self) { return py::bytes(serialize(*self)); })
+      .def_static(
+          "from_bytes", [](const py::bytes& data) { return SharedDict(deserialize_dict(std::string_view(data))); },
+          py::arg("data"))
+      .def(py::pickle([](const SharedDict& self) { return py::bytes(serialize(*self)); },
+                      [](const py::bytes& state) { return SharedDict(deserialize_dict(std::string_view(state))); }));
+
+  // keys, items, get, update and the other mixin methods are taken from MutableMapping, built on the methods above
+  py::object mapping = py::module_::import("collections.abc").attr("MutableMapping");
+  for (const char* method :
+       {"keys", "items", "values", "get", "__eq__", "__ne__", "pop", "popitem", "clear", "update", "setdefault"}) {
+    cls.attr(method) = mapping.attr(method);
+  }
+  mapping.attr("register")(cls);
+  return cls;
+}
+
+}  // namespace kwargscpp
+
 #endif  // KWARGS_PYBIND11_H
\ No newline at end of file
@@ -0,0 +1,179 @@
+#ifndef KWARGS_REGISTRY_H
+#define KWARGS_REGISTRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+
+// A config that many threads read while another occasionally replaces it, published RCU style. Every version is an
+// immutable DictType behind a std::shared_ptr: readers take the current one without a lock or a copy and keep it alive
+// for as long as they use it, writers build the next version aside and swap it in, and the last reader of an old
+// version frees it.
+namespace kwargscpp {
+
+class ConfigRegistry {
+ public:
+  using Snapshot = std::shared_ptr<const DictType>;
+  // called with each new version and its number, on the publishing thread once readers can see it. It must not publish
+  // to the same registry, but may subscribe or unsubscribe.
+  using Listener = std::function<void(const Snapshot &snapshot, uint64_t version)>;
+
+  explicit ConfigRegistry(DictType dict = DictType());
+  ~ConfigRegistry() = default;
+  ConfigRegistry(const ConfigRegistry &) = delete;
+  ConfigRegistry &operator=(const ConfigRegistry &) = delete;
+
+  // the current version, which stays valid and unchanged however many versions are published after it
+  Snapshot snapshot() const;
+  // number of the current version, 0 for the initial dict and one more per publish
+  uint64_t version() const noexcept;
+
+  // make `dict` the current version, returning its number
+  uint64_t publish(DictType dict);
+  // publish a copy of the current version changed by `edit(DictType &)`. Writers are serialized, so concurrent updates
+  // all apply; the copy shares nested lists and dicts with the current version until `edit` writes to them.
+  template <typename F>
+  uint64_t update(F &&edit);
+
+  // call `listener` on every version published from now on, returning an id for unsubscribe
+  size_t subscribe(Listener listener);
+  void unsubscribe(size_t id);
+
+ private:
+  Snapshot load() const;
+  // store `snapshot` as the next version and notify the listeners, with write_mutex_ held
+  uint64_t install(Snapshot snapshot);
+
+#if defined(__cpp_lib_atomic_shared_ptr) && __cpp_lib_atomic_shared_ptr >= 201711L
+  std::atomic<Snapshot> current_;
+#else
+  // only accessed through std::atomic_load and std::atomic_store
+  Snapshot current_;
+#endif
+  std::atomic<uint64_t> version_{0};
+  // serializes writers, so versions are numbered and notified in order
+  std::mutex write_mutex_;
+  std::mutex listener_mutex_;
+  std::vector<std::pair<size_t, std::shared_ptr<const Listener>>> listeners_;
+  size_t next_listener_id_ = 0;
+};
+
+// Caches a registry's current version for one thread, so a read costs one atomic load of the version number until a
+// new version is published. Each thread needs its own.
+class ConfigReader {
+ public:
+  explicit ConfigReader(const ConfigRegistry &registry);
+
+  // the current version, valid until the next call to get() or snapshot()
+  const DictType &get();
+  // same, as a snapshot that can be kept past them
+  const ConfigRegistry::Snapshot &snapshot();
+  // number of the version get() last returned
+  uint64_t version() const noexcept { return version_; }
+
+ private:
+  void refresh();
+
+  const ConfigRegistry *registry_;
+  ConfigRegistry::Snapshot snapshot_;
+  uint64_t version_;
+};
+
+inline ConfigRegistry::ConfigRegistry(DictType dict) : current_(std::make_shared<const DictType>(std::move(dict))) {}
+
+inline ConfigRegistry::Snapshot ConfigRegistry::load() const {
+#if defined(__cpp_lib_atomic_shared_ptr) && __cpp_lib_atomic_shared_ptr >= 201711L
+  return current_.load(std::memory_order_acquire);
+#else
+  return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+#endif
+}
+
+inline ConfigRegistry::Snapshot ConfigRegistry::snapshot() const { return load(); }
+
+inline uint64_t ConfigRegistry::version() const noexcept { return version_.load(std::memory_order_acquire); }
+
+inline uint64_t ConfigRegistry::publish(DictType dict) {
+  Snapshot snapshot = std::make_shared<const DictType>(std::move(dict));
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  return install(std::move(snapshot));
+}
+
+template <typename F>
+uint64_t ConfigRegistry::update(F &&edit) {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  DictType dict = *load();
+  std::forward<F>(edit)(dict);
+  return install(std::make_shared<const DictType>(std::move(dict)));
+}
+
+inline uint64_t ConfigRegistry::install(Snapshot snapshot) {
+  const uint64_t version = version_.load(std::memory_order_relaxed) + 1;
+  // the pointer first, so a reader seeing the new number also sees the new dict
+#if defined(__cpp_lib_atomic_shared_ptr) && __cpp_lib_atomic_shared_ptr >= 201711L
+  current_.store(snapshot, std::memory_order_release);
+#else
+  std::atomic_store_explicit(&current_, snapshot, std::memory_order_release);
+#endif
+  version_.store(version, std::memory_order_release);
+
+  // listeners are called without listener_mutex_, so they may subscribe or unsubscribe
+  std::vector<std::shared_ptr<const Listener>> listeners;
+  {
+    std::lock_guard<std::mutex> lock(listener_mutex_);
+    listeners.reserve(listeners_.size());
+    for (const auto &entry : listeners_) listeners.push_back(entry.second);
+  }
+  for (const auto &listener : listeners) (*listener)(snapshot, version);
+  return version;
+}
+
+inline size_t ConfigRegistry::subscribe(Listener listener) {
+  std::lock_guard<std::mutex> lock(listener_mutex_);
+  listeners_.emplace_back(next_listener_id_, std::make_shared<const Listener>(std::move(listener)));
+  return next_listener_id_++;
+}
+
+inline void ConfigRegistry::unsubscribe(size_t id) {
+  std::lock_guard<std::mutex> lock(listener_mutex_);
+  for (auto it = listeners_.begin(); it != listeners_.end(); ++it) {
+    if (it->first == id) {
+      listeners_.erase(it);
+      return;
+    }
+  }
+}
+
+inline ConfigReader::ConfigReader(const ConfigRegistry &registry)
+    : registry_(&registry), version_(registry.version()) {
+  // the snapshot is at least as new as version_, a newer one is reloaded once more on the next read
+  snapshot_ = registry.snapshot();
+}
+
+inline const DictType &ConfigReader::get() {
+  refresh();
+  return *snapshot_;
+}
+
+inline const ConfigRegistry::Snapshot &ConfigReader::snapshot() {
+  refresh();
+  return snapshot_;
+}
+
+inline void ConfigReader::refresh() {
+  const uint64_t version = registry_->version();
+  if (version == version_) return;
+  snapshot_ = registry_->snapshot();
+  version_ = version;
+}
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_REGISTRY_H
@@ -0,0 +1,450 @@
+#ifndef KWARGS_SCHEMA_H
+#define KWARGS_SCHEMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+#include "kwargscpp/patch.h"
+
+// Validation of a DictType against the shape a component expects, declared once instead of a has_key/get_or_die chain:
+//
+//   kwargscpp::Schema optimizer;
+//   optimizer.required("name", kwargscpp::ValueKind::string).one_of({"adam", "sgd"})
+//       .required("lr", kwargscpp::ValueKind::floating).range(0, 1)
+//       .optional("betas", kwargscpp::ValueKind::list);
+//   kwargscpp::Schema schema;
+//   schema.required("optimizer", kwargscpp::ValueKind::dict).nested(optimizer);
+//
+//   std::vector<kwargscpp::SchemaError> errors = schema.validate(dict);
+//
+// The keys are hashed into a table as they are added, so validating walks the dict once, finding each key's rule
+// with one probe, and reports every problem with its path rather than stopping at the first.
+namespace kwargscpp {
+
+// The kinds of value a key accepts, a bit per alternative of ValueType, combined with |
+enum class ValueKind : uint8_t {
+  integer = 1 << 0,
+  unsigned_integer = 1 << 1,
+  floating = 1 << 2,
+  boolean = 1 << 3,
+  string = 1 << 4,
+  list = 1 << 5,
+  dict = 1 << 6,
+  array = 1 << 7,
+  number = integer | unsigned_integer | floating,
+  any = 0xff,
+};
+
+constexpr ValueKind operator|(ValueKind lhs, ValueKind rhs) noexcept {
+  return static_cast<ValueKind>(static_cast<uint8_t>(lhs) | static_cast<uint8_t>(rhs));
+}
+
+// whether `kinds` includes `kind`
+constexpr bool accepts(ValueKind kinds, ValueKind kind) noexcept {
+  return (static_cast<uint8_t>(kinds) & static_cast<uint8_t>(kind)) != 0;
+}
+
+// the kind of `value`
+inline ValueKind kind_of(const ValueType &value) noexcept { return static_cast<ValueKind>(1u << value.index()); }
+
+// A problem found by validation, at a path like "model.layers[2].units" (see kwargscpp/path.h)
+struct SchemaError {
+  std::string path;
+  std::string message;
+};
+
+namespace detail {
+struct SchemaContext;
+}  // namespace detail
+
+class Schema {
+ public:
+  // add a key, which the range, one_of and nested calls after it refine. Adding a key again replaces it.
+  Schema &required(std::string_view key, ValueKind kinds = ValueKind::any);
+  Schema &optional(std::string_view key, ValueKind kinds = ValueKind::any);
+  // the inclusive bounds of the key's value, if it is a number
+  Schema &range(double min, double max);
+  // the values the key's value may have, if it is a string
+  Schema &one_of(std::vector<std::string> allowed);
+  // the schema of the key's value if it is a dict, or of every element if it is a list, which must then be dicts
+  Schema &nested(Schema schema);
+  // whether keys without a rule are an error, by default they are not
+  Schema &allow_unknown(bool allow);
+
+  // every problem with `dict`, none if it is valid
+  std::vector<SchemaError> validate(const DictType &dict) const;
+  // the same, and if there is none, convert in place each number of a kind its key does not accept to one it does,
+  // the first of floating, integer, unsigned_integer and boolean, as get_or_die would. A number outside the range of
+  // that kind, such as 1e30 or NaN for an integer, is reported instead. Only the shared dicts and lists on the paths of
+  // the converted numbers are cloned.
+  std::vector<SchemaError> validate_and_coerce(DictType &dict) const;
+  // throw std::invalid_argument listing every problem with `dict`
+  void validate_or_die(const DictType &dict) const;
+
+ private:
+  struct Rule {
+    KeyType key;
+    size_t hash = 0;
+    ValueKind kinds = ValueKind::any;
+    bool required = false;
+    bool bounded = false;
+    double min = -std::numeric_limits<double>::infinity();
+    double max = std::numeric_limits<double>::infinity();
+    std::vector<std::pair<std::string, size_t>> allowed;  // with their hashes
+    std::shared_ptr<const Schema> schema;
+  };
+
+  Schema &add(std::string_view key, ValueKind kinds, bool required);
+  Rule &last();
+  // the index of the rule for `key`, or rules_.size() if there is none
+  size_t find(std::string_view key, size_t hash) const noexcept;
+  void check(const DictType &dict, detail::SchemaContext &context) const;
+  void check_value(const Rule &rule, std::string_view key, const ValueType &value,
+                   detail::SchemaContext &context) const;
+  void check_missing(const DictType &dict, detail::SchemaContext &context) const;
+
+  std::vector<Rule> rules_;
+  // open-addressing table of the rules, a power of two at least twice their number of slots, each the index of a rule
+  // plus one, or 0 if empty
+  std::vector<uint32_t> slots_;
+  size_t required_count_ = 0;
+  bool allow_unknown_ = true;
+};
+
+namespace detail {
+
+// The state of one validation: the path to the dict being checked, the problems so far and, when coercing, the
+// conversions to apply once the whole dict is known to be valid
+struct SchemaContext {
+  // a key or list index
+  using Step = std::variant<std::string_view, size_t>;
+
+  std::vector<Step> path;
+  std::vector<SchemaError> errors;
+  Patch *coercions = nullptr;
+
+  // record a problem with the value at `last` in the dict being checked
+  void fail(const Step &last, std::string message) {
+    std::string out;
+    path.push_back(last);
+    for (const Step &step : path) {
+      if (const std::string_view *key = std::get_if<std::string_view>(&step)) {
+        if (!out.empty()) out += '.';
+        out += *key;
+      } else {
+        out += '[' + std::to_string(std::get<size_t>(step)) + ']';
+      }
+    }
+    path.pop_back();
+    errors.push_back({std::move(out), std::move(message)});
+  }
+
+  std::vector<PatchStep> patch_path(const Step &last) const {
+    std::vector<PatchStep> out;
+    out.reserve(path.size() + 1);
+    for (const Step &step : path) {
+      if (const std::string_view *key = std::get_if<std::string_view>(&step)) {
+        out.emplace_back(std::in_place_type<KeyType>, *key);
+      } else {
+        out.emplace_back(std::get<size_t>(step));
+      }
+    }
+    out.emplace_back(std::in_place_type<KeyType>, std::get<std::string_view>(last));
+    return out;
+  }
+};
+
+// the names of the kinds in `kinds`, e.g. "int or float"
+inline std::string kind_names(ValueKind kinds) {
+  static const char *const names[] = {"int", "uint", "float", "bool", "string", "list", "dict", "array"};
+  std::string out;
+  for (size_t i = 0; i < 8; ++i) {
+    if (!accepts(kinds, static_cast<ValueKind>(1u << i))) continue;
+    if (!out.empty()) out += " or ";
+    out += names[i];
+  }
+  return out;
+}
+
+// the arithmetic kind a number is coerced to for a key accepting `kinds`, or `any` if the key takes no number
+inline ValueKind coerced_kind(ValueKind kinds) noexcept {
+  for (ValueKind kind : {ValueKind::floating, ValueKind::integer, ValueKind::unsigned_integer, ValueKind::boolean}) {
+    if (accepts(kinds, kind)) return kind;
+  }
+  return ValueKind::any;
+}
+
+// whether the arithmetic `arg` lies within the range of the arithmetic type `To`, so converting it is defined and
+// keeps its value up to a dropped fraction. NaN lies within no integer range.
+template <typename To, typename From>
+bool in_range(From arg) noexcept {
+  if constexpr (std::is_same_v<To, bool> || std::is_floating_point_v<To> || std::is_same_v<From, bool>) {
+    return true;
+  } else if constexpr (std::is_floating_point_v<From>) {
+    // one past the largest To, a power of two and so exact, since To::max() itself may not be
+    constexpr From upper = static_cast<From>(std::numeric_limits<To>::max() / 2 + 1) * 2;
+    if constexpr (std::is_signed_v<To>) {
+      return arg >= -upper && arg < upper;
+    } else {
+      return arg > -1 && arg < upper;
+    }
+  } else if constexpr (std::is_signed_v<From> && !std::is_signed_v<To>) {
+    return arg >= 0;
+  } else if constexpr (!std::is_signed_v<From> && std::is_signed_v<To>) {
+    return arg <= static_cast<std::make_unsigned_t<To>>(std::numeric_limits<To>::max());
+  } else {
+    return true;
+  }
+}
+
+// `value`, an arithmetic ValueType, converted to the arithmetic `kind`, or nothing if it is outside that kind's range
+inline std::optional<ValueType> coerce(const ValueType &value, ValueKind kind) {
+  return visit(
+      [kind](const auto &arg) -> std::optional<ValueType> {
+        using ArgType = std::decay_t<decltype(arg)>;
+        if constexpr (std::is_arithmetic_v<ArgType>) {
+          switch (kind) {
+            case ValueKind::floating:
+              return ValueType(static_cast<double>(arg));
+            case ValueKind::integer:
+              if (!in_range<intmax_t>(arg)) return std::nullopt;
+              return ValueType(static_cast<intmax_t>(arg));
+            case ValueKind::unsigned_integer:
+              if (!in_range<uintmax_t>(arg)) return std::nullopt;
+              return ValueType(static_cast<uintmax_t>(arg));
+            default:
+              return ValueType(static_cast<bool>(arg));
+          }
+        } else {
+          return ValueType(arg);
+        }
+      },
+      value);
+}
+
+}  // namespace detail
+
+inline Schema &Schema::required(std::string_view key, ValueKind kinds) { return add(key, kinds, true); }
+
+inline Schema &Schema::optional(std::string_view key, ValueKind kinds) { return add(key, kinds, false); }
+
+inline Schema &Schema::range(double min, double max) {
+  Rule &rule = last();
+  rule.bounded = true;
+  rule.min = min;
+  rule.max = max;
+  return *this;
+}
+
+inline Schema &Schema::one_of(std::vector<std::string> allowed) {
+  Rule &rule = last();
+  rule.allowed.clear();
+  rule.allowed.reserve(allowed.size());
+  for (std::string &value : allowed) {
+    size_t hash = hash_key(value);
+    rule.allowed.emplace_back(std::move(value), hash);
+  }
+  return *this;
+}
+
+inline Schema &Schema::nested(Schema schema) {
+  last().schema = std::make_shared<const Schema>(std::move(schema));
+  return *this;
+}
+
+inline Schema &Schema::allow_unknown(bool allow) {
+  allow_unknown_ = allow;
+  return *this;
+}
+
+inline Schema &Schema::add(std::string_view key, ValueKind kinds, bool required) {
+  const size_t hash = hash_key(key);
+  size_t index = find(key, hash);
+  if (index != rules_.size()) {
+    required_count_ -= rules_[index].required;
+    rules_.erase(rules_.begin() + static_cast<std::ptrdiff_t>(index));
+  }
+  Rule &rule = rules_.emplace_back();
+  rule.key = KeyType(key);
+  rule.hash = hash;
+  rule.kinds = kinds;
+  rule.required = required;
+  required_count_ += required;
+  // the last rule is the one being refined, so rebuild the table rather than keep indices stable
+  size_t slots = 1;
+  while (slots < 2 * rules_.size()) slots *= 2;
+  slots_.assign(slots, 0);
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    size_t slot = rules_[i].hash & (slots - 1);
+    while (slots_[slot]) slot = (slot + 1) & (slots - 1);
+    slots_[slot] = static_cast<uint32_t>(i + 1);
+  }
+  return *this;
+}
+
+inline Schema::Rule &Schema::last() {
+  if (rules_.empty()) throw std::logic_error("Schema: add a key before refining it");
+  return rules_.back();
+}
+
+inline size_t Schema::find(std::string_view key, size_t hash) const noexcept {
+  if (slots_.empty()) return rules_.size();
+  const size_t mask = slots_.size() - 1;
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    const uint32_t index = slots_[slot];
+    if (!index) return rules_.size();
+    if (rules_[index - 1].hash == hash && rules_[index - 1].key == key) return index - 1;
+  }
+}
+
+inline void Schema::check(const DictType &dict, detail::SchemaContext &context) const {
+  // a dict much larger than the schema, whose extra keys are allowed anyway, is cheaper to probe once per rule
+  if (allow_unknown_ && dict.size() > 4 * rules_.size()) {
+    for (const Rule &rule : rules_) {
+      auto it = detail::find_key(dict, Key(rule.key, rule.hash));
+      if (it != dict.end()) {
+        check_value(rule, it->first, it->second, context);
+      } else if (rule.required) {
+        context.fail(std::string_view(rule.key), "missing required key");
+      }
+    }
+    return;
+  }
+
+  size_t required_seen = 0;
+  for (const auto &item : dict) {
+    const size_t index = find(item.first, hash_key(item.first));
+    if (index == rules_.size() && allow_unknown_) continue;
+    if (index == rules_.size()) {
+      context.fail(std::string_view(item.first), "unexpected key");
+    } else {
+      required_seen += rules_[index].required;
+      check_value(rules_[index], item.first, item.second, context);
+    }
+  }
+  if (required_seen != required_count_) check_missing(dict, context);
+}
+
+inline void Schema::check_missing(const DictType &dict, detail::SchemaContext &context) const {
+  for (const Rule &rule : rules_) {
+    if (!rule.required || detail::find_key(dict, Key(rule.key, rule.hash)) != dict.end()) continue;
+    context.fail(std::string_view(rule.key), "missing required key");
+  }
+}
+
+inline void Schema::check_value(const Rule &rule, std::string_view key, const ValueType &value,
+                                detail::SchemaContext &context) const {
+  const ValueType *checked = &value;
+  ValueType coerced;
+  ValueKind kind = kind_of(value);
+  if (!accepts(rule.kinds, kind)) {
+    const ValueKind target = detail::coerced_kind(rule.kinds);
+    if (!context.coercions || target == ValueKind::any || !accepts(ValueKind::number | ValueKind::boolean, kind)) {
+      context.fail(key, "expected " + detail::kind_names(rule.kinds) + ", got " + detail::kind_names(kind));
+      return;
+    }
+    std::optional<ValueType> converted = detail::coerce(value, target);
+    if (!converted) {
+      context.fail(key, to_json(value) + " is out of range for " + detail::kind_names(target));
+      return;
+    }
+    coerced = std::move(*converted);
+    checked = &coerced;
+    kind = target;
+  }
+
+  if (rule.bounded && accepts(ValueKind::number, kind)) {
+    const double number = visit(
+        [](const auto &arg) -> double {
+          if constexpr (std::is_arithmetic_v<std::decay_t<decltype(arg)>>) {
+            return static_cast<double>(arg);
+          } else {
+            return 0;
+          }
+        },
+        *checked);
+    if (!(number >= rule.min && number <= rule.max)) {
+      context.fail(key, to_json(*checked) + " is out of range [" + to_json(ValueType(rule.min)) + ", " +
+                   to_json(ValueType(rule.max)) + "]");
+    }
+  }
+
+  if (!rule.allowed.empty() && kind == ValueKind::string) {
+    const std::string_view string = checked->as_string();
+    const size_t hash = hash_key(string);
+    bool found = false;
+    for (const auto &allowed : rule.allowed) {
+      if (allowed.second == hash && allowed.first == string) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      std::string message = to_json(*checked) + " is not one of ";
+      for (size_t i = 0; i < rule.allowed.size(); ++i) {
+        if (i) message += ", ";
+        message += to_json(ValueType(rule.allowed[i].first));
+      }
+      context.fail(key, std::move(message));
+    }
+  }
+
+  if (rule.schema && (kind == ValueKind::dict || kind == ValueKind::list)) {
+    context.path.emplace_back(key);
+    if (kind == ValueKind::dict) {
+      rule.schema->check(checked->as_dict(), context);
+    } else {
+      const ListType &list = checked->as_vector();
+      for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i].is_dict()) {
+          context.path.emplace_back(i);
+          rule.schema->check(list[i].as_dict(), context);
+          context.path.pop_back();
+        } else {
+          context.fail(i, "expected dict, got " + detail::kind_names(kind_of(list[i])));
+        }
+      }
+    }
+    context.path.pop_back();
+  }
+
+  if (checked == &coerced) context.coercions->push_back({PatchOp::Kind::replace, context.patch_path(key), coerced});
+}
+
+inline std::vector<SchemaError> Schema::validate(const DictType &dict) const {
+  detail::SchemaContext context;
+  check(dict, context);
+  return std::move(context.errors);
+}
+
+inline std::vector<SchemaError> Schema::validate_and_coerce(DictType &dict) const {
+  Patch coercions;
+  detail::SchemaContext context;
+  context.coercions = &coercions;
+  check(dict, context);
+  if (context.errors.empty()) apply_patch(dict, coercions);
+  return std::move(context.errors);
+}
+
+inline void Schema::validate_or_die(const DictType &dict) const {
+  std::vector<SchemaError> errors = validate(dict);
+  if (errors.empty()) return;
+  std::string message = "Invalid kwargs:";
+  for (const SchemaError &error : errors) message += "\n  " + error.path + ": " + error.message;
+  throw std::invalid_argument(message);
+}
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_SCHEMA_H
@@ -0,0 +1,133 @@
+#ifndef KWARGS_STRING_H
+#define KWARGS_STRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace kwargscpp {
+
+// Immutable string held by ValueType, 16 bytes wide. Up to kInlineCapacity characters are stored inline; longer text
+// goes to a reference-counted heap block, which copies share. The text is always NUL-terminated. A String reads as a
+// std::string_view and converts to std::string.
+//
+// The last byte tells the two forms apart: 0x80 | size inline, kHeap out of line. Both have the high bit set, which
+// ValueType relies on to keep its tag in that same byte for its other alternatives.
+class String {
+ public:
+  static constexpr size_t kInlineCapacity = 14;
+
+  String() noexcept { set_inline(0); }
+  String(std::string_view text) {
+    if (text.size() <= kInlineCapacity) {
+      std::memcpy(bytes_, text.data(), text.size());
+      set_inline(text.size());
+    } else {
+      void *memory = ::operator new(sizeof(Block) + text.size() + 1);
+      Block *block = new (memory) Block{{1}, text.size()};
+      std::memcpy(block->data(), text.data(), text.size());
+      block->data()[text.size()] = '\0';
+      std::memcpy(bytes_, &block, sizeof block);
+      bytes_[kTagByte] = static_cast<char>(kHeap);
+    }
+  }
+  String(const char *text) : String(std::string_view(text)) {}
+  String(const std::string &text) : String(std::string_view(text)) {}
+
+  String(const String &other) noexcept {
+    std::memcpy(bytes_, other.bytes_, sizeof bytes_);
+    if (!is_inline()) block()->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  String(String &&other) noexcept {
+    std::memcpy(bytes_, other.bytes_, sizeof bytes_);
+    other.set_inline(0);
+  }
+  String &operator=(String other) noexcept {
+    swap(other);
+    return *this;
+  }
+  ~String() {
+    if (!is_inline() && block()->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      Block *heap = block();
+      heap->~Block();
+      ::operator delete(heap);
+    }
+  }
+
+  void swap(String &other) noexcept {
+    char bytes[sizeof bytes_];
+    std::memcpy(bytes, bytes_, sizeof bytes);
+    std::memcpy(bytes_, other.bytes_, sizeof bytes);
+    std::memcpy(other.bytes_, bytes, sizeof bytes);
+  }
+
+  const char *data() const noexcept { return is_inline() ? bytes_ : block()->data(); }
+  const char *c_str() const noexcept { return data(); }
+  size_t size() const noexcept { return is_inline() ? tag() & 0x7f : block()->size; }
+  size_t length() const noexcept { return size(); }
+  bool empty() const noexcept { return size() == 0; }
+  const char *begin() const noexcept { return data(); }
+  const char *end() const noexcept { return data() + size(); }
+  char operator[](size_t index) const noexcept { return data()[index]; }
+
+  // whether the text is stored inline, without a heap block
+  bool is_inline() const noexcept { return tag() != kHeap; }
+
+  operator std::string_view() const noexcept { return std::string_view(data(), size()); }
+  operator std::string() const { return std::string(data(), size()); }
+
+  friend bool operator==(const String &lhs, const String &rhs) noexcept { return view(lhs) == view(rhs); }
+  friend bool operator==(const String &lhs, std::string_view rhs) noexcept { return view(lhs) == rhs; }
+  friend bool operator==(const String &lhs, const std::string &rhs) noexcept { return view(lhs) == rhs; }
+  friend bool operator==(const String &lhs, const char *rhs) noexcept { return view(lhs) == rhs; }
+  friend bool operator==(std::string_view lhs, const String &rhs) noexcept { return lhs == view(rhs); }
+  friend bool operator==(const std::string &lhs, const String &rhs) noexcept { return lhs == view(rhs); }
+  friend bool operator==(const char *lhs, const String &rhs) noexcept { return lhs == view(rhs); }
+  template <typename T>
+  friend auto operator!=(const String &lhs, const T &rhs) noexcept -> decltype(!(lhs == rhs)) {
+    return !(lhs == rhs);
+  }
+  template <typename T, std::enable_if_t<!std::is_same_v<T, String>, bool> = true>
+  friend auto operator!=(const T &lhs, const String &rhs) noexcept -> decltype(!(lhs == rhs)) {
+    return !(lhs == rhs);
+  }
+  friend bool operator<(const String &lhs, const String &rhs) noexcept { return view(lhs) < view(rhs); }
+
+  friend std::ostream &operator<<(std::ostream &os, const String &text) { return os << view(text); }
+
+ private:
+  static constexpr size_t kTagByte = 15;
+  static constexpr unsigned char kHeap = 0xff;
+
+  struct Block {
+    std::atomic<size_t> refs;
+    size_t size;
+    char *data() noexcept { return reinterpret_cast<char *>(this + 1); }
+  };
+
+  static std::string_view view(const String &text) noexcept { return text; }
+
+  unsigned char tag() const noexcept { return static_cast<unsigned char>(bytes_[kTagByte]); }
+  void set_inline(size_t size) noexcept {
+    bytes_[size] = '\0';
+    bytes_[kTagByte] = static_cast<char>(0x80 | size);
+  }
+  Block *block() const noexcept {
+    Block *block;
+    std::memcpy(&block, bytes_, sizeof block);
+    return block;
+  }
+
+  alignas(8) char bytes_[16];
+};
+
+static_assert(sizeof(String) == 16, "String is two words");
+
+}  // namespace kwargscpp
+
+#endif  // KWARGS_STRING_H
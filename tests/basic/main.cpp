@@ -124,9 +124,9 @@ TEST_CASE("Test std::vector<ValueType> support") {
     kwargscpp::set(dict, "vector_val", vec);
 
     auto retrieved_vec = kwargscpp::get_or_die<std::vector<kwargscpp::ValueType>>(dict, "vector_val");
-    CHECK(std::get<intmax_t>(retrieved_vec[0]) == 42);
-    CHECK(doctest::Approx(std::get<double>(retrieved_vec[1])) == 3.14);
-    CHECK(std::get<std::string>(retrieved_vec[2]) == "hello");
+    CHECK(retrieved_vec[0].get<intmax_t>() == 42);
+    CHECK(doctest::Approx(retrieved_vec[1].get<double>()) == 3.14);
+    CHECK(retrieved_vec[2].get<kwargscpp::String>() == "hello");
 
     std::cout<<kwargscpp::to_string(vec)<<std::endl;
 }
@@ -146,4 +146,179 @@ TEST_CASE("Test nested DictType support") {
     CHECK(kwargscpp::get_or_die<std::string>(retrieved_dict, "nested_key2") == "nested_value");
 
     std::cout<<kwargscpp::to_string(dict)<<std::endl;
-}
\ No newline at end of file
+}
+TEST_CASE("Test lookup by string_view and precomputed Key") {
+    using namespace kwargscpp::literals;
+    kwargscpp::DictType dict;
+
+    constexpr kwargscpp::Key epochs = "epochs"_kw;
+    static_assert(epochs.hash == kwargscpp::hash_key("epochs"));
+
+    kwargscpp::set(dict, epochs, 10);
+    kwargscpp::set(dict, std::string_view("lr"), 0.1);
+    kwargscpp::set(dict, std::string("name"), "resnet");
+
+    CHECK(kwargscpp::get_or_die<int>(dict, epochs) == 10);
+    CHECK(kwargscpp::get_or_die<int>(dict, "epochs") == 10);
+    CHECK(kwargscpp::get<double>(dict, "lr"_kw, 0.0) == doctest::Approx(0.1));
+    CHECK(kwargscpp::get<std::string>(dict, "name"_kw, "") == "resnet");
+    CHECK(kwargscpp::get<int>(dict, "missing"_kw, -1) == -1);
+    CHECK(kwargscpp::has_key(dict, "lr"_kw));
+    CHECK_FALSE(kwargscpp::has_key(dict, "missing"_kw));
+    CHECK_THROWS_AS(kwargscpp::get_or_die<int>(dict, "missing"_kw), std::runtime_error);
+
+    // the dict hashes its keys the same way, so a Key finds entries set with a plain string
+    kwargscpp::set(dict, epochs, 20);
+    CHECK(dict.size() == 3);
+    CHECK(dict.at("epochs").as_int() == 20);
+
+    // keys longer than the small-string buffer, and a dict rehashed between lookups
+    for (int i = 0; i < 64; ++i) kwargscpp::set(dict, "a_rather_long_key_name_" + std::to_string(i), i);
+    CHECK(kwargscpp::get_or_die<int>(dict, "a_rather_long_key_name_63"_kw) == 63);
+    CHECK(kwargscpp::get_or_die<int>(dict, std::string_view("a_rather_long_key_name_7")) == 7);
+    CHECK(kwargscpp::get_or_die<int>(dict, epochs) == 20);
+#ifndef KWARGSCPP_ORDERED_DICT
+    // the hash a Key carries is the one probed
+    CHECK_FALSE(kwargscpp::has_key(dict, kwargscpp::Key("epochs", epochs.hash + 1)));
+#endif
+}
+
+TEST_CASE("Test try_get reports missing keys and wrong types without throwing") {
+    kwargscpp::DictType dict;
+    kwargscpp::set(dict, "int_val", 42);
+    kwargscpp::set(dict, "bool_val", true);
+    kwargscpp::set(dict, "string_val", "hello");
+
+    auto int_val = kwargscpp::try_get<int>(dict, "int_val");
+    REQUIRE(int_val);
+    CHECK(*int_val == 42);
+    CHECK(int_val.error() == kwargscpp::ErrorCode::ok);
+
+    // same coercions as get_or_die
+    CHECK(kwargscpp::try_get<double>(dict, "bool_val").value() == doctest::Approx(1.0));
+    CHECK(kwargscpp::try_get<bool>(dict, "int_val").value() == true);
+    CHECK(kwargscpp::try_get<std::string>(dict, "string_val").value() == "hello");
+
+    auto missing = kwargscpp::try_get<int>(dict, "missing_key");
+    CHECK_FALSE(missing.has_value());
+    CHECK(missing.error() == kwargscpp::ErrorCode::key_not_found);
+    CHECK(missing.value_or(-1) == -1);
+    CHECK_THROWS_AS(missing.value(), std::runtime_error);
+
+    auto wrong_type = kwargscpp::try_get<int>(dict, "string_val");
+    CHECK_FALSE(wrong_type.has_value());
+    CHECK(wrong_type.error() == kwargscpp::ErrorCode::wrong_type);
+    CHECK_THROWS_AS(wrong_type.value(), std::bad_variant_access);
+    CHECK(kwargscpp::get<int>(dict, "string_val", 7) == 7);
+}
+
+TEST_CASE("Test set, merge and with_prefix move subtrees instead of copying") {
+    std::vector<kwargscpp::ValueType> list(100, kwargscpp::ValueType(1));
+    const kwargscpp::ValueType* list_data = list.data();
+
+    kwargscpp::DictType dict;
+    kwargscpp::set(dict, "list", std::move(list));
+    kwargscpp::set(dict, "shared", 1);
+    CHECK(dict.at("list").as_vector().data() == list_data);
+
+    kwargscpp::DictType nested;
+    kwargscpp::set(nested, "inner", std::string(64, 'x'));
+    const char* string_data = nested.at("inner").as_string().data();
+    kwargscpp::ValueType nested_value(std::move(nested));
+    CHECK(nested_value.as_dict().at("inner").as_string().data() == string_data);
+
+    kwargscpp::DictType other;
+    kwargscpp::set(other, "nested", std::move(nested_value));
+    kwargscpp::set(other, "shared", 2);
+
+    auto merged = kwargscpp::merge(std::move(dict), std::move(other));
+    CHECK(merged.size() == 3);
+    CHECK(kwargscpp::get_or_die<int>(merged, "shared") == 2);
+    CHECK(merged.at("list").as_vector().data() == list_data);
+    CHECK(merged.at("nested").as_dict().at("inner").as_string().data() == string_data);
+
+    kwargscpp::DictType defaults;
+    kwargscpp::set(defaults, "shared", 3);
+    auto overridden = kwargscpp::merge(std::move(merged), defaults);
+    CHECK(kwargscpp::get_or_die<int>(overridden, "shared") == 3);
+    CHECK(overridden.at("list").as_vector().data() == list_data);
+
+    auto prefixed = kwargscpp::with_prefix(std::move(overridden), "pre_");
+    CHECK(prefixed.size() == 3);
+    CHECK(kwargscpp::get_or_die<int>(prefixed, "pre_shared") == 3);
+    CHECK(prefixed.at("pre_list").as_vector().data() == list_data);
+}
+
+TEST_CASE("Test copies of lists and dicts share their payload until written") {
+    kwargscpp::DictType nested;
+    kwargscpp::set(nested, "inner", 1);
+    kwargscpp::ValueType value(std::move(nested));
+
+    kwargscpp::ValueType copy = value;
+    CHECK(&copy.as_dict() == &value.as_dict());
+    CHECK(copy == value);
+
+    // writing clones the payload, the other copy is unchanged
+    kwargscpp::set(copy.mutable_dict(), "inner", 2);
+    CHECK(&copy.as_dict() != &value.as_dict());
+    CHECK(kwargscpp::get_or_die<int>(value.as_dict(), "inner") == 1);
+    CHECK(kwargscpp::get_or_die<int>(copy.as_dict(), "inner") == 2);
+    CHECK(copy != value);
+
+    // a value that is not shared is written in place
+    const kwargscpp::DictType* payload = &copy.as_dict();
+    kwargscpp::set(copy.mutable_dict(), "other", 3);
+    CHECK(&copy.as_dict() == payload);
+
+    // reading a subtree as ValueType shares it instead of copying
+    kwargscpp::DictType dict;
+    kwargscpp::set(dict, "list", std::vector<kwargscpp::ValueType>{1, 2, 3});
+    auto list = kwargscpp::get_or_die<kwargscpp::ValueType>(dict, "list");
+    CHECK(&list.as_vector() == &dict.at("list").as_vector());
+    list.mutable_vector().push_back(4);
+    CHECK(dict.at("list").as_vector().size() == 3);
+    CHECK(list.as_vector().size() == 4);
+
+    // a SharedDict stored as a value shares its payload as well
+    kwargscpp::SharedDict shared(std::move(dict));
+    kwargscpp::ValueType shared_value(shared);
+    CHECK(&shared_value.as_dict() == &shared.get());
+}
+
+TEST_CASE("Test get_ref and get_view borrow from the dict") {
+    using namespace kwargscpp::literals;
+    kwargscpp::DictType dict;
+    kwargscpp::set(dict, "name", std::string(64, 'x'));
+    kwargscpp::set(dict, "list", std::vector<kwargscpp::ValueType>{1, 2, 3});
+    kwargscpp::DictType nested;
+    kwargscpp::set(nested, "inner", 1);
+    kwargscpp::set(dict, "nested", std::move(nested));
+    kwargscpp::set(dict, "int_val", 42);
+
+    const kwargscpp::String& name = kwargscpp::get_ref<kwargscpp::String>(dict, "name");
+    CHECK(&name == &dict.at("name").as_string());
+    CHECK(&kwargscpp::get_ref<kwargscpp::DictType>(dict, "nested"_kw) == &dict.at("nested").as_dict());
+    CHECK(kwargscpp::get_ref<intmax_t>(dict, "int_val") == 42);
+
+    std::string_view view = kwargscpp::get_view<std::string_view>(dict, "name");
+    CHECK(view.data() == name.data());
+    CHECK(view.size() == 64);
+    CHECK(kwargscpp::get_view<std::string_view>(dict, "missing", "default") == "default");
+
+    auto list = kwargscpp::get_view<kwargscpp::Span<const kwargscpp::ValueType>>(dict, "list"_kw);
+    CHECK(list.data() == dict.at("list").as_vector().data());
+    REQUIRE(list.size() == 3);
+    intmax_t sum = 0;
+    for (const auto& item : list) sum += item.as_int();
+    CHECK(sum == 6);
+
+    kwargscpp::ErrorCode error;
+    CHECK(kwargscpp::try_get_ref<kwargscpp::String>(dict, "int_val", &error) == nullptr);
+    CHECK(error == kwargscpp::ErrorCode::wrong_type);
+    CHECK(kwargscpp::try_get_ref<kwargscpp::String>(dict, "missing", &error) == nullptr);
+    CHECK(error == kwargscpp::ErrorCode::key_not_found);
+    CHECK(kwargscpp::try_get_view<std::string_view>(dict, "list").error() == kwargscpp::ErrorCode::wrong_type);
+    // no coercion for borrowed access, the stored type must match
+    CHECK_THROWS_AS(kwargscpp::get_ref<double>(dict, "int_val"), std::bad_variant_access);
+    CHECK_THROWS_AS(kwargscpp::get_view<std::string_view>(dict, "missing"), std::runtime_error);
+}
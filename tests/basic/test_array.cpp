@@ -0,0 +1,93 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+#include "kwargscpp/pmr.h"
+
+TEST_CASE("Test Array stores typed elements contiguously with a shape") {
+  kwargscpp::Array weights(kwargscpp::DType::float32, {2, 3});
+  CHECK(weights.size() == 6);
+  CHECK(weights.nbytes() == 24);
+  float* data = weights.mutable_data_as<float>();
+  for (int i = 0; i < 6; ++i) data[i] = static_cast<float>(i);
+
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "weights", weights);
+  kwargscpp::set(dict, "ids", kwargscpp::Array(std::vector<int64_t>{7, 8, 9}));
+
+  const kwargscpp::ValueType& value = dict.at("weights");
+  REQUIRE(value.is_array());
+  CHECK(value.as_array().dtype() == kwargscpp::DType::float32);
+  CHECK(value.as_array().shape() == std::vector<size_t>{2, 3});
+  // copies share the buffer
+  CHECK(value.as_array().data() == weights.data());
+  CHECK(kwargscpp::to_string(value) == "[[0.0, 1.0, 2.0], [3.0, 4.0, 5.0]]");
+
+  auto view = kwargscpp::get_view<kwargscpp::Span<const float>>(dict, "weights");
+  CHECK(view.data() == weights.data());
+  CHECK(view.size() == 6);
+  CHECK(view[5] == 5.0f);
+  CHECK(kwargscpp::try_get_view<kwargscpp::Span<const double>>(dict, "weights").error() ==
+        kwargscpp::ErrorCode::wrong_type);
+  CHECK(kwargscpp::get_view<kwargscpp::Span<const int64_t>>(dict, "ids")[2] == 9);
+  CHECK_THROWS_AS(weights.data_as<double>(), std::bad_variant_access);
+
+  // writing a shared buffer clones it
+  dict.at("weights").mutable_array().mutable_data_as<float>()[0] = 10.0f;
+  CHECK(weights.data_as<float>()[0] == 0.0f);
+  CHECK(dict.at("weights").as_array().data_as<float>()[0] == 10.0f);
+  CHECK(dict.at("weights").as_array() != weights);
+  CHECK(kwargscpp::get_or_die<kwargscpp::Array>(dict, "ids") == kwargscpp::Array(std::vector<int64_t>{7, 8, 9}));
+}
+
+TEST_CASE("Test Array can borrow memory owned elsewhere") {
+  auto buffer = std::make_shared<std::vector<double>>(std::vector<double>{1.5, 2.5});
+  kwargscpp::Array borrowed(kwargscpp::DType::float64, {2}, buffer, buffer->data());
+  CHECK(borrowed.data() == buffer->data());
+
+  // the owner's memory is never written, the first write makes a private copy
+  borrowed.mutable_data_as<double>()[0] = 0.0;
+  CHECK(borrowed.data() != buffer->data());
+  CHECK((*buffer)[0] == 1.5);
+}
+
+TEST_CASE("Test Array is held out of line in ValueType") {
+  // the shape and buffer sit behind one pointer, so an Array fits in the first word of a ValueType
+  static_assert(sizeof(kwargscpp::Array) == sizeof(void *));
+  static_assert(sizeof(kwargscpp::ValueType) == 16);
+
+  kwargscpp::Array empty;
+  CHECK(empty.size() == 0);
+  CHECK(empty.shape() == std::vector<size_t>{0});
+  CHECK(empty.dtype() == kwargscpp::DType::float64);
+  CHECK(empty == kwargscpp::Array(kwargscpp::DType::float64, {0}));
+  CHECK(empty.mutable_data() != nullptr);
+
+  kwargscpp::Array grid(kwargscpp::DType::int64, {2, 2});
+  const kwargscpp::Array copy = grid;
+  CHECK(&copy.shape() == &grid.shape());
+  grid.mutable_data_as<int64_t>()[3] = 4;
+  CHECK(copy.shape() == grid.shape());
+  CHECK(copy.data_as<int64_t>()[3] == 0);
+  // an unshared array is written in place
+  const void* data = grid.data();
+  grid.mutable_data_as<int64_t>()[0] = 1;
+  CHECK(grid.data() == data);
+
+  kwargscpp::Array moved = std::move(grid);
+  CHECK(moved.data_as<int64_t>()[3] == 4);
+}
+
+TEST_CASE("Test Array converts to a list in the pmr flavor") {
+  kwargscpp::ValueType value(kwargscpp::Array(std::vector<uint8_t>{1, 2, 3}));
+  auto list = kwargscpp::pmr::to_pmr(value);
+  REQUIRE(list.is_vector());
+  CHECK(list.as_vector().size() == 3);
+  CHECK(list.as_vector()[2].as_uint() == 3);
+}
@@ -0,0 +1,127 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "kwargscpp/fields.h"
+#include "kwargscpp/kwargs.h"
+
+namespace train {
+
+struct LayerOpts {
+  int units = 32;
+  std::string act = "relu";
+};
+KWARGSCPP_FIELDS(LayerOpts, units, act)
+
+struct TrainOpts {
+  double lr = 0.001;
+  int epochs = 10;
+  bool verbose = false;
+  float momentum = 0.9f;
+  std::string name = "default";
+  LayerOpts head;
+  std::vector<LayerOpts> layers;
+  std::vector<double> weights;
+  std::optional<uint64_t> seed;
+  kwargscpp::DictType extra;
+};
+KWARGSCPP_FIELDS(TrainOpts, lr, epochs, verbose, momentum, name, head, layers, weights, seed, extra)
+
+}  // namespace train
+
+TEST_CASE("Test from_kwargs binds a dict into a struct") {
+  static_assert(kwargscpp::is_bound_v<train::TrainOpts>);
+  static_assert(!kwargscpp::is_bound_v<std::string>);
+
+  kwargscpp::DictType layer;
+  kwargscpp::set(layer, "units", 128);
+  kwargscpp::DictType head;
+  kwargscpp::set(head, "act", "tanh");
+  kwargscpp::DictType extra;
+  kwargscpp::set(extra, "note", "x");
+
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "lr", 0.01);
+  // the numeric and bool conversions of get_or_die
+  kwargscpp::set(dict, "epochs", 3.0);
+  kwargscpp::set(dict, "verbose", 1);
+  kwargscpp::set(dict, "name", "run");
+  kwargscpp::set(dict, "head", head);
+  kwargscpp::set(dict, "layers", std::vector<kwargscpp::ValueType>{layer, kwargscpp::DictType()});
+  kwargscpp::set(dict, "weights", kwargscpp::Array(std::vector<float>{0.5f, 2.0f}));
+  kwargscpp::set(dict, "seed", 42);
+  kwargscpp::set(dict, "extra", extra);
+  kwargscpp::set(dict, "unknown", "ignored");
+
+  train::TrainOpts opts = kwargscpp::from_kwargs<train::TrainOpts>(dict);
+  CHECK(opts.lr == 0.01);
+  CHECK(opts.epochs == 3);
+  CHECK(opts.verbose);
+  CHECK(opts.momentum == 0.9f);
+  CHECK(opts.name == "run");
+  CHECK(opts.head.units == 32);
+  CHECK(opts.head.act == "tanh");
+  REQUIRE(opts.layers.size() == 2);
+  CHECK(opts.layers[0].units == 128);
+  CHECK(opts.layers[0].act == "relu");
+  CHECK(opts.layers[1].units == 32);
+  CHECK(opts.weights == std::vector<double>{0.5, 2.0});
+  CHECK(opts.seed == std::optional<uint64_t>(42));
+  CHECK(opts.extra == extra);
+
+  // an existing struct keeps the fields the dict lacks
+  kwargscpp::DictType update;
+  kwargscpp::set(update, "epochs", 20);
+  kwargscpp::set(update, "weights", std::vector<kwargscpp::ValueType>{1, 2.5});
+  kwargscpp::from_kwargs(update, opts);
+  CHECK(opts.epochs == 20);
+  CHECK(opts.name == "run");
+  CHECK(opts.weights == std::vector<double>{1.0, 2.5});
+
+  // a dict much larger than the struct takes the per-field lookups
+  kwargscpp::DictType shared = update;
+  for (int i = 0; i < 64; ++i) kwargscpp::set(shared, "other_" + std::to_string(i), i);
+  kwargscpp::set(shared, "name", "shared");
+  kwargscpp::from_kwargs(shared, opts);
+  CHECK(opts.epochs == 20);
+  CHECK(opts.name == "shared");
+
+  kwargscpp::DictType wrong;
+  kwargscpp::set(wrong, "epochs", "ten");
+  CHECK_THROWS_AS(kwargscpp::from_kwargs<train::TrainOpts>(wrong), std::bad_variant_access);
+  kwargscpp::set(wrong, "epochs", 1);
+  kwargscpp::set(wrong, "head", 1);
+  CHECK_THROWS_AS(kwargscpp::from_kwargs<train::TrainOpts>(wrong), std::bad_variant_access);
+}
+
+TEST_CASE("Test to_kwargs round trips a struct") {
+  train::TrainOpts opts;
+  opts.name = "run";
+  opts.layers = {train::LayerOpts{64, "gelu"}};
+  opts.weights = {0.25};
+  kwargscpp::set(opts.extra, "note", "x");
+
+  kwargscpp::DictType dict = kwargscpp::to_kwargs(opts);
+  // the empty optional seed is left out
+  CHECK(dict.size() == 9);
+  CHECK_FALSE(kwargscpp::has_key(dict, "seed"));
+  CHECK(kwargscpp::get_or_die<double>(dict, "momentum") == static_cast<double>(0.9f));
+  CHECK(kwargscpp::get_or_die<kwargscpp::DictType>(dict, "head").size() == 2);
+  const kwargscpp::ListType& layers = kwargscpp::get_ref<kwargscpp::ListType>(dict, "layers");
+  REQUIRE(layers.size() == 1);
+  CHECK(kwargscpp::get_or_die<std::string>(layers[0].as_dict(), "act") == "gelu");
+
+  opts.seed = 7;
+  train::TrainOpts back = kwargscpp::from_kwargs<train::TrainOpts>(kwargscpp::to_kwargs(opts));
+  CHECK(back.seed == std::optional<uint64_t>(7));
+  CHECK(back.layers.size() == 1);
+  CHECK(back.layers[0].units == 64);
+  CHECK(back.weights == opts.weights);
+  CHECK(back.extra == opts.extra);
+  CHECK(kwargscpp::to_kwargs(back) == kwargscpp::to_kwargs(opts));
+}
@@ -0,0 +1,198 @@
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "kwargscpp/flat.h"
+#include "kwargscpp/kwargs.h"
+
+using namespace kwargscpp::literals;
+
+namespace {
+
+kwargscpp::DictType make_config() {
+  kwargscpp::DictType layer_dict;
+  kwargscpp::set(layer_dict, "units", 64);
+  kwargscpp::set(layer_dict, "dropout", 0.1);
+  // one payload referenced twice
+  kwargscpp::ValueType layer(std::move(layer_dict));
+  kwargscpp::DictType encoder;
+  kwargscpp::set(encoder, "layers", std::vector<kwargscpp::ValueType>{layer, layer, "final"});
+  kwargscpp::set(encoder, "embedding", kwargscpp::Array(std::vector<float>{0.5f, 1.5f, 2.5f}));
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "name", "model");
+  kwargscpp::set(dict, "epochs", 10);
+  kwargscpp::set(dict, "seed", uintmax_t(7));
+  kwargscpp::set(dict, "verbose", true);
+  kwargscpp::set(dict, "encoder", encoder);
+  kwargscpp::set(dict, "empty", kwargscpp::DictType());
+  return dict;
+}
+
+}  // namespace
+
+TEST_CASE("Test DictView queries the flat layout in place") {
+  kwargscpp::DictType dict = make_config();
+  kwargscpp::FlatFile file = kwargscpp::FlatFile::from_bytes(kwargscpp::to_flat(dict));
+  kwargscpp::DictView root = file.root();
+
+  CHECK(root.size() == dict.size());
+  CHECK(root.has_key("epochs"));
+  CHECK(root.has_key("epochs"_kw));
+  CHECK_FALSE(root.has_key("missing"));
+  CHECK(root.get_or_die<int>("epochs") == 10);
+  CHECK(root.get_or_die<double>("epochs") == 10.0);
+  CHECK(root.get_or_die<std::string_view>("name") == "model");
+  CHECK(root.find("seed")->is_uint());
+  CHECK(root.get<bool>("verbose", false));
+  CHECK(root.get<int>("missing", -1) == -1);
+  CHECK(root.try_get<int>("name").error() == kwargscpp::ErrorCode::wrong_type);
+  CHECK(root.try_get<int>("missing").error() == kwargscpp::ErrorCode::key_not_found);
+  CHECK_THROWS_AS(root.get_or_die<int>("missing"), std::runtime_error);
+  CHECK(root.get_or_die<kwargscpp::DictView>("empty").empty());
+
+  CHECK(root.get_path<int>("encoder.layers[1].units") == 64);
+  CHECK(root.get_path<std::string>("encoder.layers[2]") == "final");
+  CHECK(root.try_get_path<int>("encoder.layers[3]").error() == kwargscpp::ErrorCode::index_out_of_range);
+  CHECK(root.try_get_path<int>("name.first").error() == kwargscpp::ErrorCode::wrong_type);
+  CHECK_THROWS_AS(root.get_path<int>("encoder..layers"), std::invalid_argument);
+  CHECK(root.try_get_path<int>("encoder..layers").error() == kwargscpp::ErrorCode::malformed_path);
+
+  size_t count = 0;
+  for (const auto& [key, value] : root) {
+    REQUIRE(dict.count(std::string(key)));
+    CHECK(value.to_value() == dict.at(std::string(key)));
+    ++count;
+  }
+  CHECK(count == dict.size());
+  CHECK(root.to_dict() == dict);
+
+  kwargscpp::ListView layers = root.get_path<kwargscpp::ListView>("encoder.layers");
+  CHECK(layers.size() == 3);
+  CHECK(layers[0].as_dict().get_or_die<double>("dropout") == 0.1);
+  CHECK_THROWS_AS(layers.at(3), std::out_of_range);
+  CHECK_THROWS_AS(layers[2].as_int(), std::bad_variant_access);
+}
+
+TEST_CASE("Test flat files are mapped and shared blocks written once") {
+  kwargscpp::DictType dict = make_config();
+  const std::string path = "test_flat_config.kwflat";
+  kwargscpp::save_flat(dict, path);
+
+  kwargscpp::Array embedding;
+  {
+    kwargscpp::FlatFile file = kwargscpp::FlatFile::map(path);
+    CHECK(file.root().to_dict() == dict);
+    embedding = file.root().get_path<kwargscpp::Array>("encoder.embedding");
+    CHECK(embedding.data_as<float>()[2] == 2.5f);
+  }
+  // the Array keeps the mapping alive
+  CHECK(embedding.data_as<float>()[1] == 1.5f);
+  std::remove(path.c_str());
+
+  // both layers share one payload, which is written once unless one of them is cloned
+  kwargscpp::DictType deep = dict;
+  kwargscpp::DictType& encoder = deep.at("encoder").mutable_dict();
+  encoder.at("layers").mutable_vector()[1].mutable_dict();
+  CHECK(kwargscpp::to_flat(dict).size() < kwargscpp::to_flat(deep).size());
+  CHECK(kwargscpp::FlatFile::from_bytes(kwargscpp::to_flat(deep)).root().to_dict() == dict);
+
+  CHECK_THROWS_AS(kwargscpp::FlatFile::from_bytes("not a flat file, just some text"), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::FlatFile::map("no_such_file.kwflat"), std::system_error);
+}
+
+TEST_CASE("Test flat blocks written once are read back as one shared payload") {
+  // each level references the next twice, 2^64 paths through 64 blocks
+  kwargscpp::DictType leaf;
+  kwargscpp::set(leaf, "leaf", "x");
+  kwargscpp::ValueType node(std::move(leaf));
+  for (int i = 0; i < 64; ++i) {
+    kwargscpp::DictType level;
+    kwargscpp::set(level, "a", node);
+    kwargscpp::set(level, "b", node);
+    kwargscpp::set(level, "list", std::vector<kwargscpp::ValueType>{node});
+    node = std::move(level);
+  }
+  const std::string bytes = kwargscpp::to_flat(node.as_dict());
+  kwargscpp::FlatFile file = kwargscpp::FlatFile::from_bytes(bytes);
+
+  kwargscpp::DictType read = file.root().to_dict();
+  const kwargscpp::DictType* level = &read;
+  for (int i = 0; i < 64; ++i) {
+    const kwargscpp::DictType& next = level->at("a").as_dict();
+    CHECK(&level->at("b").as_dict() == &next);
+    CHECK(&level->at("list").as_vector()[0].as_dict() == &next);
+    level = &next;
+  }
+  CHECK(level->at("leaf").as_string() == "x");
+
+  // writing through one reference clones the payload instead of changing the others
+  kwargscpp::set(read.at("a").mutable_dict().at("a").mutable_dict(), "leaf", 1);
+  CHECK(&read.at("a").as_dict() != &read.at("b").as_dict());
+  CHECK(kwargscpp::has_key(read.at("a").as_dict().at("a").as_dict(), "leaf"));
+  CHECK_FALSE(kwargscpp::has_key(read.at("b").as_dict().at("a").as_dict(), "leaf"));
+}
+
+TEST_CASE("Test concurrent save_flat calls each write a whole file") {
+  const std::string path = "test_flat_concurrent.kwflat";
+  std::vector<kwargscpp::DictType> dicts(4, make_config());
+  for (size_t i = 0; i < dicts.size(); ++i) kwargscpp::set(dicts[i], "writer", i);
+
+  // each writer has its own temporary, so none fails or renames another's half-written file
+  std::atomic<int> failures{0};
+  std::vector<std::thread> writers;
+  for (const auto& dict : dicts) {
+    writers.emplace_back([&] {
+      for (int round = 0; round < 20; ++round) {
+        try {
+          kwargscpp::save_flat(dict, path);
+        } catch (const std::system_error&) {
+          ++failures;
+        }
+      }
+    });
+  }
+  for (auto& writer : writers) writer.join();
+  CHECK(failures == 0);
+  kwargscpp::DictType saved = kwargscpp::FlatFile::map(path).root().to_dict();
+  CHECK(saved == dicts.at(kwargscpp::get_or_die<size_t>(saved, "writer")));
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Test corrupt flat files throw instead of reading outside the file") {
+  const kwargscpp::DictType dict = make_config();
+  const std::string bytes = kwargscpp::to_flat(dict);
+
+  // cut short with the size in the header to match: the root opens, the blocks past the end throw when reached
+  std::string cut = bytes.substr(0, bytes.size() / 2 / 8 * 8);
+  const uint64_t cut_size = cut.size();
+  std::memcpy(&cut[8], &cut_size, sizeof cut_size);
+  kwargscpp::FlatFile file = kwargscpp::FlatFile::from_bytes(cut);
+  CHECK_THROWS_AS(file.root().to_dict(), std::invalid_argument);
+
+  // each word past the header in turn pointing past the end, at the header or back at the root: the whole file is
+  // read or std::invalid_argument is thrown, never memory outside it
+  int rejected = 0;
+  for (size_t at = 32; at < bytes.size(); at += 8) {
+    for (uint64_t value : {uint64_t(bytes.size()), ~uint64_t(7), uint64_t(8), uint64_t(32)}) {
+      std::string corrupt = bytes;
+      std::memcpy(&corrupt[at], &value, sizeof value);
+      try {
+        kwargscpp::FlatFile opened = kwargscpp::FlatFile::from_bytes(corrupt);
+        kwargscpp::DictView root = opened.root();
+        root.to_dict();
+        for (const auto& item : dict) root.find(item.first);
+      } catch (const std::invalid_argument&) {
+        ++rejected;
+      }
+    }
+  }
+  CHECK(rejected > 0);
+}
@@ -0,0 +1,104 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "kwargscpp/frozen.h"
+#include "kwargscpp/kwargs.h"
+
+TEST_CASE("Test freeze keeps every key of a dict reachable") {
+  using namespace kwargscpp::literals;
+  kwargscpp::DictType layer;
+  kwargscpp::set(layer, "units", 64);
+  const kwargscpp::ValueType shared(layer);
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "lr", 0.01);
+  kwargscpp::set(dict, "epochs", 10);
+  kwargscpp::set(dict, "name", "run");
+  kwargscpp::set(dict, "debug", false);
+  kwargscpp::set(dict, "layers", std::vector<kwargscpp::ValueType>{shared, shared});
+  kwargscpp::set(dict, "head", shared);
+  kwargscpp::set(dict, "weights", kwargscpp::Array(std::vector<double>{1.0, 2.0}));
+
+  const kwargscpp::FrozenDict frozen = kwargscpp::freeze(dict);
+  CHECK(frozen.size() == dict.size());
+  CHECK(frozen.get_or_die<double>("lr") == 0.01);
+  CHECK(frozen.get_or_die<double>("lr"_kw) == 0.01);
+  CHECK(frozen.get_or_die<int>("epochs") == 10);
+  CHECK(frozen.get_or_die<float>("epochs") == 10.0f);
+  CHECK(frozen.get_or_die<std::string_view>("name") == "run");
+  CHECK_FALSE(frozen.get_or_die<bool>("debug"));
+  CHECK(frozen.get<int>("missing", -1) == -1);
+  CHECK(frozen.has_key("head"));
+  CHECK_FALSE(frozen.has_key("missing"));
+  CHECK(frozen.find("missing") == nullptr);
+  CHECK_THROWS_AS(frozen.get_or_die<int>("missing"), std::runtime_error);
+  CHECK_THROWS_AS(frozen.get_or_die<int>("name"), std::bad_variant_access);
+
+  const kwargscpp::FrozenList& layers = frozen.find("layers")->as_vector();
+  REQUIRE(layers.size() == 2);
+  CHECK(layers[1].as_dict().get_or_die<int>("units") == 64);
+  CHECK_THROWS_AS(layers.at(2), std::out_of_range);
+  // a subtree shared in the source is frozen once
+  CHECK(layers[0].as_dict().find("units") == layers[1].as_dict().find("units"));
+  CHECK(frozen.get_or_die<kwargscpp::FrozenDict>("head").find("units") == layers[0].as_dict().find("units"));
+  CHECK(frozen.get_or_die<kwargscpp::Array>("weights").size() == 2);
+
+  size_t count = 0;
+  for (const auto& [key, value] : frozen) {
+    CHECK(frozen.find(key) == &value);
+    ++count;
+  }
+  CHECK(count == dict.size());
+
+  // back to a mutable dict, sharing what was shared
+  kwargscpp::DictType thawed = frozen.to_dict();
+  CHECK(thawed == dict);
+#ifdef KWARGSCPP_ORDERED_DICT
+  CHECK(kwargscpp::to_json(thawed) == kwargscpp::to_json(dict));
+#endif
+  const kwargscpp::ListType& thawed_layers = thawed.at("layers").as_vector();
+  CHECK(&thawed_layers[0].as_dict() == &thawed_layers[1].as_dict());
+  CHECK(frozen.get_or_die<kwargscpp::ValueType>("head") == kwargscpp::ValueType(layer));
+  CHECK(frozen.get_or_die<kwargscpp::ListType>("layers").size() == 2);
+
+  const kwargscpp::FrozenDict empty = kwargscpp::freeze(kwargscpp::DictType());
+  CHECK(empty.empty());
+  CHECK_FALSE(empty.has_key("lr"));
+  CHECK(empty.begin() == empty.end());
+  CHECK(kwargscpp::FrozenDict().to_dict().empty());
+}
+
+TEST_CASE("Test freeze builds a perfect hash over many keys") {
+  for (size_t size : {1, 2, 3, 17, 1000, 5000}) {
+    kwargscpp::DictType dict;
+    for (size_t i = 0; i < size; ++i) kwargscpp::set(dict, "key_" + std::to_string(i), static_cast<intmax_t>(i));
+    const kwargscpp::FrozenDict frozen = kwargscpp::freeze(dict);
+    REQUIRE(frozen.size() == size);
+    for (size_t i = 0; i < size; ++i) {
+      const kwargscpp::FrozenValue* value = frozen.find("key_" + std::to_string(i));
+      REQUIRE(value != nullptr);
+      CHECK(value->as_int() == static_cast<intmax_t>(i));
+      CHECK_FALSE(frozen.has_key("other_" + std::to_string(i)));
+    }
+    CHECK(frozen.to_dict() == dict);
+  }
+
+  // nested dicts are frozen at every level
+  kwargscpp::DictType deep;
+  kwargscpp::set(deep, "leaf", 1);
+  for (int i = 0; i < 1000; ++i) {
+    kwargscpp::DictType parent;
+    kwargscpp::set(parent, "child", std::move(deep));
+    deep = std::move(parent);
+  }
+  const kwargscpp::FrozenDict frozen = kwargscpp::freeze(deep);
+  const kwargscpp::FrozenDict* node = &frozen;
+  for (int i = 0; i < 1000; ++i) node = &node->find("child")->as_dict();
+  CHECK(node->get_or_die<int>("leaf") == 1);
+  CHECK(frozen.to_dict() == deep);
+}
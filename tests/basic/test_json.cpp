@@ -0,0 +1,149 @@
+#include <doctest/doctest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "kwargscpp/json.h"
+#include "kwargscpp/kwargs.h"
+
+TEST_CASE("Test from_json maps JSON onto ValueType") {
+  kwargscpp::DictType dict = kwargscpp::from_json(R"( {
+      "name": "model", "epochs": 10, "lr": 1e-3, "ratio": 0.1, "verbose": true, "quiet": false,
+      "layers": [64, 128, {"act": "relu"}], "empty": {}, "none": [],
+      "small": -9223372036854775808, "big": 18446744073709551615, "huge": 18446744073709551616
+    } )")
+                                 .as_dict();
+  CHECK(kwargscpp::get_or_die<std::string>(dict, "name") == "model");
+  CHECK(dict.at("epochs").as_int() == 10);
+  CHECK(dict.at("lr").as_double() == 1e-3);
+  CHECK(dict.at("ratio").as_double() == 0.1);
+  CHECK(dict.at("verbose").as_bool());
+  CHECK_FALSE(dict.at("quiet").as_bool());
+  CHECK(dict.at("layers").as_vector().size() == 3);
+  CHECK(dict.at("layers").as_vector()[2].as_dict().at("act").as_string() == "relu");
+  CHECK(dict.at("empty").as_dict().empty());
+  CHECK(dict.at("none").as_vector().empty());
+  CHECK(dict.at("small").as_int() == std::numeric_limits<intmax_t>::min());
+  CHECK(dict.at("big").as_uint() == std::numeric_limits<uintmax_t>::max());
+  CHECK(dict.at("huge").as_double() == 18446744073709551616.0);
+
+  CHECK(kwargscpp::from_json("-0").as_int() == 0);
+  CHECK(kwargscpp::from_json("2.5E+2").as_double() == 250.0);
+  CHECK(std::isinf(kwargscpp::from_json("1e400").as_double()));
+  CHECK(kwargscpp::from_json("[1, 2, 3]").as_vector().size() == 3);
+  CHECK(kwargscpp::from_json_dict(R"({"a": 1, "a": 2})").at("a").as_int() == 2);
+}
+
+TEST_CASE("Test from_json decodes string escapes") {
+  // long enough to cross the 16 byte blocks scanned at once
+  std::string plain(100, 'x');
+  CHECK(kwargscpp::from_json("\"" + plain + "\"").as_string() == plain);
+  CHECK(kwargscpp::from_json(R"("a\"b\\c\/d\b\f\n\r\t")").as_string() == "a\"b\\c/d\b\f\n\r\t");
+  CHECK(kwargscpp::from_json(R"("caf\u00e9 \u20ac \ud83d\ude00")").as_string() ==
+        "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80");
+  CHECK(kwargscpp::from_json("\"caf\xc3\xa9\"").as_string() == "caf\xc3\xa9");
+  CHECK(kwargscpp::from_json("\"" + plain + "\\n" + plain + "\"").as_string() == plain + "\n" + plain);
+}
+
+TEST_CASE("Test from_json handles deep nesting") {
+  std::string text = std::string(1000, '[') + "1" + std::string(1000, ']');
+  kwargscpp::ValueType value = kwargscpp::from_json(text);
+  for (int i = 0; i < 1000; ++i) value = kwargscpp::ValueType(value.as_vector()[0]);
+  CHECK(value.as_int() == 1);
+}
+
+TEST_CASE("Test from_json rejects malformed input") {
+  for (const char* text : {"", "{", "[1,]", "{\"a\" 1}", "{\"a\": 1,}", "{1: 2}", "01", "1.", "1e", "-", "tru",
+                           "null", "[null]", "\"abc", "\"a\\x\"", "\"\\ud800\"", "\"\\udc00\"", "\"a\nb\"",
+                           "{} {}", "[1] 2", "+1", ".5", "nan", "NaNa", "-NaN", "Inf", "-Infinit", "+Infinity"}) {
+    CHECK_THROWS_AS(kwargscpp::from_json(text), std::invalid_argument);
+  }
+  CHECK_THROWS_AS(kwargscpp::from_json_dict("[1]"), std::invalid_argument);
+  std::string message;
+  try {
+    kwargscpp::from_json("[1, 2, x]");
+  } catch (const std::invalid_argument& e) {
+    message = e.what();
+  }
+  CHECK(message == "invalid JSON at offset 7: unexpected character");
+}
+
+TEST_CASE("Test to_json writes valid JSON that reads back") {
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "quote\"key", "line\nbreak\ttab \\ \x01 caf\xc3\xa9");
+  kwargscpp::set(dict, "int", -42);
+  kwargscpp::set(dict, "big", std::numeric_limits<uintmax_t>::max());
+  kwargscpp::set(dict, "tenth", 0.1);
+  kwargscpp::set(dict, "whole", 100.0);
+  kwargscpp::set(dict, "tiny", 5e-324);
+  kwargscpp::set(dict, "list", std::vector<kwargscpp::ValueType>{true, false, kwargscpp::DictType()});
+  kwargscpp::set(dict, "weights", kwargscpp::Array(std::vector<float>{0.1f, 2.0f}));
+
+  std::string text = kwargscpp::to_json(dict);
+  CHECK(text == kwargscpp::to_string(dict));
+  kwargscpp::DictType parsed = kwargscpp::from_json_dict(text);
+  CHECK(parsed.size() == dict.size());
+  for (const char* key : {"quote\"key", "int", "big", "tenth", "whole", "tiny", "list"}) {
+    CHECK(parsed.at(key) == dict.at(key));
+  }
+  // float32 elements in the shortest form that reads back as the same float
+  CHECK(kwargscpp::to_json(dict.at("weights")) == "[0.1, 2.0]");
+
+  CHECK(kwargscpp::to_json(kwargscpp::ValueType("\x01\x1f\"")) == R"("\u0001\u001f\"")");
+  CHECK(kwargscpp::to_json(kwargscpp::ValueType(0.1)) == "0.1");
+  CHECK(kwargscpp::to_json(kwargscpp::ValueType(-2.0)) == "-2.0");
+  CHECK(kwargscpp::to_json(kwargscpp::ValueType(1e300)) == "1e+300");
+  CHECK(kwargscpp::to_json(kwargscpp::ValueType(std::numeric_limits<double>::infinity())) == "Infinity");
+  CHECK(kwargscpp::to_json(kwargscpp::ValueType(std::nan(""))) == "NaN");
+  CHECK(kwargscpp::to_json(kwargscpp::ValueType(std::vector<kwargscpp::ValueType>())) == "[]");
+}
+
+TEST_CASE("Test non-finite doubles round-trip through JSON") {
+  // written as Python's json.dumps writes them, and read back as json.loads reads them
+  const double inf = std::numeric_limits<double>::infinity();
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "inf", inf);
+  kwargscpp::set(dict, "neg_inf", -inf);
+  kwargscpp::set(dict, "nan", std::nan(""));
+  kwargscpp::set(dict, "list", std::vector<kwargscpp::ValueType>{-inf, 1.5});
+
+  kwargscpp::DictType parsed = kwargscpp::from_json_dict(kwargscpp::to_json(dict));
+  CHECK(parsed.at("inf").as_double() == inf);
+  CHECK(parsed.at("neg_inf").as_double() == -inf);
+  CHECK(std::isnan(parsed.at("nan").as_double()));
+  CHECK(parsed.at("list") == dict.at("list"));
+  const kwargscpp::JsonOptions sorted{true};
+  CHECK(kwargscpp::to_json(parsed, sorted) == kwargscpp::to_json(dict, sorted));
+  CHECK(kwargscpp::from_json("[NaN, -Infinity,Infinity]").as_vector().size() == 3);
+}
+
+TEST_CASE("Test to_json sorts keys and streams") {
+  kwargscpp::DictType inner;
+  kwargscpp::set(inner, "y", 1);
+  kwargscpp::set(inner, "x", 2);
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "b", inner);
+  kwargscpp::set(dict, "a", std::vector<kwargscpp::ValueType>{inner, "z"});
+  kwargscpp::set(dict, "c", 3);
+  kwargscpp::JsonOptions options;
+  options.sort_keys = true;
+  CHECK(kwargscpp::to_json(dict, options) == R"({"a": [{"x": 2, "y": 1}, "z"], "b": {"x": 2, "y": 1}, "c": 3})");
+
+  // appends, and the stream output matches, also for strings longer than its buffer
+  kwargscpp::set(dict, "long", std::string(10000, 'x'));
+  std::string out = "log: ";
+  kwargscpp::to_json(dict, out, options);
+  std::ostringstream os;
+  os << "log: ";
+  kwargscpp::to_json(dict, os, options);
+  CHECK(os.str() == out);
+
+  std::string text = std::string(1000, '[') + "1" + std::string(1000, ']');
+  std::ostringstream deep;
+  kwargscpp::to_json(kwargscpp::from_json(text), deep);
+  CHECK(deep.str() == text);
+}
@@ -0,0 +1,104 @@
+#include <doctest/doctest.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+
+namespace {
+
+kwargscpp::DictType make_defaults() {
+  kwargscpp::DictType optimizer;
+  kwargscpp::set(optimizer, "name", "adam");
+  kwargscpp::set(optimizer, "lr", 0.001);
+  kwargscpp::set(optimizer, "betas", std::vector<kwargscpp::ValueType>{0.9, 0.999});
+  kwargscpp::DictType data;
+  kwargscpp::set(data, "path", "/data");
+  kwargscpp::set(data, "workers", 4);
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "optimizer", optimizer);
+  kwargscpp::set(dict, "data", data);
+  kwargscpp::set(dict, "tags", std::vector<kwargscpp::ValueType>{"base"});
+  return dict;
+}
+
+}  // namespace
+
+TEST_CASE("Test deep_merge_into merges nested dicts in place") {
+  const kwargscpp::DictType defaults = make_defaults();
+  kwargscpp::DictType target = defaults;
+
+  kwargscpp::DictType optimizer;
+  kwargscpp::set(optimizer, "lr", 0.01);
+  kwargscpp::set(optimizer, "betas", std::vector<kwargscpp::ValueType>{0.8});
+  kwargscpp::DictType overrides;
+  kwargscpp::set(overrides, "optimizer", optimizer);
+  kwargscpp::set(overrides, "seed", 7);
+  // a shallow merge drops optimizer.name
+  CHECK(kwargscpp::merge(defaults, overrides).at("optimizer").as_dict().size() == 2);
+  kwargscpp::deep_merge_into(target, std::move(overrides));
+  CHECK(overrides.empty());
+
+  const kwargscpp::DictType& merged = target.at("optimizer").as_dict();
+  CHECK(merged.at("lr").as_double() == 0.01);
+  CHECK(merged.at("name").as_string() == "adam");
+  CHECK(merged.at("betas").as_vector().size() == 1);
+  CHECK(target.at("seed").as_int() == 7);
+  // the untouched subtree is still the defaults' payload, the merged one a clone
+  CHECK(&target.at("data").as_dict() == &defaults.at("data").as_dict());
+  CHECK(defaults.at("optimizer").as_dict().at("lr").as_double() == 0.001);
+
+  // a value that is not a dict replaces a dict, and the other way round
+  kwargscpp::DictType replace;
+  kwargscpp::set(replace, "data", "none");
+  kwargscpp::set(replace, "tags", kwargscpp::DictType());
+  kwargscpp::deep_merge_into(target, replace);
+  CHECK(target.at("data").as_string() == "none");
+  CHECK(target.at("tags").is_dict());
+}
+
+TEST_CASE("Test deep_merge_into list policies, conflicts and layers") {
+  kwargscpp::DictType site;
+  kwargscpp::set(site, "tags", std::vector<kwargscpp::ValueType>{"site"});
+  kwargscpp::DictType site_data;
+  kwargscpp::set(site_data, "path", "/mnt/site");
+  kwargscpp::set(site, "data", site_data);
+  kwargscpp::DictType request;
+  kwargscpp::set(request, "tags", std::vector<kwargscpp::ValueType>{"request"});
+  kwargscpp::DictType request_data;
+  kwargscpp::set(request_data, "workers", 16);
+  kwargscpp::set(request, "data", request_data);
+
+  const kwargscpp::DictType defaults = make_defaults();
+  kwargscpp::MergeOptions append;
+  append.lists = kwargscpp::ListMerge::append;
+  kwargscpp::DictType config = kwargscpp::merge_layers({defaults, site, request}, append);
+  CHECK(config.at("tags") == kwargscpp::ValueType(std::vector<kwargscpp::ValueType>{"base", "site", "request"}));
+  CHECK(kwargscpp::get_or_die<std::string>(config.at("data").as_dict(), "path") == "/mnt/site");
+  CHECK(kwargscpp::get_or_die<int>(config.at("data").as_dict(), "workers") == 16);
+  CHECK(&config.at("optimizer").as_dict() == &defaults.at("optimizer").as_dict());
+  CHECK(defaults.at("tags").as_vector().size() == 1);
+
+  config = kwargscpp::merge_layers({defaults, site, request});
+  CHECK(config.at("tags").as_vector().size() == 1);
+  CHECK(config.at("tags").as_vector()[0].as_string() == "request");
+
+  // conflicts are resolved by the callback, which sees the dotted path
+  std::vector<std::string> paths;
+  kwargscpp::MergeOptions keep;
+  keep.on_conflict = [&](const std::string& path, kwargscpp::ValueType&, kwargscpp::ValueType&&) {
+    paths.push_back(path);
+  };
+  config = defaults;
+  kwargscpp::deep_merge_into(config, request, keep);
+  CHECK(paths == std::vector<std::string>{"tags", "data.workers"});
+  CHECK(config == defaults);
+
+  kwargscpp::MergeOptions strict;
+  strict.on_conflict = [](const std::string& path, kwargscpp::ValueType&, kwargscpp::ValueType&&) {
+    throw std::invalid_argument("conflict at " + path);
+  };
+  config = defaults;
+  CHECK_THROWS_AS(kwargscpp::deep_merge_into(config, site, strict), std::invalid_argument);
+}
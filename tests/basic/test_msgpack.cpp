@@ -0,0 +1,110 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+#include "kwargscpp/msgpack.h"
+
+namespace {
+
+std::string bytes(std::initializer_list<int> values) {
+  std::string out;
+  for (int value : values) out.push_back(static_cast<char>(value));
+  return out;
+}
+
+kwargscpp::DictType make_config() {
+  kwargscpp::DictType inner;
+  kwargscpp::set(inner, "lr", 0.001);
+  kwargscpp::set(inner, "layers", std::vector<kwargscpp::ValueType>{64, 128, "relu", false});
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "name", "model");
+  kwargscpp::set(dict, "steps", -70000);
+  kwargscpp::set(dict, "seed", uintmax_t(42));
+  kwargscpp::set(dict, "big", std::numeric_limits<intmax_t>::min());
+  kwargscpp::set(dict, "huge", std::numeric_limits<uintmax_t>::max());
+  kwargscpp::set(dict, "long_text", std::string(300, 'x'));
+  kwargscpp::set(dict, "optim", inner);
+  kwargscpp::set(dict, "empty", kwargscpp::DictType());
+  kwargscpp::set(dict, "weights", kwargscpp::Array(std::vector<float>{1.5f, -2.0f, 3.25f}));
+  return dict;
+}
+
+}  // namespace
+
+TEST_CASE("Test serialize writes standard MessagePack") {
+  using kwargscpp::serialize;
+  using kwargscpp::ValueType;
+  CHECK(serialize(ValueType(5)) == bytes({0x05}));
+  CHECK(serialize(ValueType(-3)) == bytes({0xfd}));
+  CHECK(serialize(ValueType(200)) == bytes({0xcc, 0xc8}));
+  CHECK(serialize(ValueType(-200)) == bytes({0xd1, 0xff, 0x38}));
+  CHECK(serialize(ValueType(uintmax_t(1))) == bytes({0xcf, 0, 0, 0, 0, 0, 0, 0, 1}));
+  CHECK(serialize(ValueType(1.0)) == bytes({0xcb, 0x3f, 0xf0, 0, 0, 0, 0, 0, 0}));
+  CHECK(serialize(ValueType(true)) == bytes({0xc3}));
+  CHECK(serialize(ValueType("abc")) == bytes({0xa3, 'a', 'b', 'c'}));
+  CHECK(serialize(ValueType(std::vector<ValueType>{1, false})) == bytes({0x92, 0x01, 0xc2}));
+
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "a", 1);
+  CHECK(serialize(dict) == bytes({0x81, 0xa1, 'a', 0x01}));
+  CHECK(serialize(ValueType(dict)) == serialize(dict));
+}
+
+TEST_CASE("Test deserialize round trips every value type") {
+  kwargscpp::DictType dict = make_config();
+  std::string data = kwargscpp::serialize(dict);
+  kwargscpp::DictType back = kwargscpp::deserialize_dict(data);
+  CHECK(back == dict);
+  CHECK(back.at("seed").is_uint());
+  CHECK(back.at("steps").is_int());
+  CHECK(back.at("weights").as_array().dtype() == kwargscpp::DType::float32);
+
+  kwargscpp::ValueType value(dict);
+  CHECK(kwargscpp::deserialize(kwargscpp::serialize(value)) == value);
+
+  // other MessagePack writers may use float 32 and bin
+  CHECK(kwargscpp::deserialize(bytes({0xca, 0x3f, 0xc0, 0, 0})).as_double() == 1.5);
+  CHECK(kwargscpp::deserialize(bytes({0xc4, 0x02, 'h', 'i'})).as_string() == "hi");
+}
+
+TEST_CASE("Test MsgpackWriter streams through a small buffer") {
+  kwargscpp::DictType dict = make_config();
+  char buffer[7];
+  std::string out;
+  size_t flushes = 0;
+  kwargscpp::MsgpackWriter writer(buffer, sizeof buffer, [&](const char* data, size_t size) {
+    CHECK(size <= sizeof buffer);
+    out.append(data, size);
+    ++flushes;
+  });
+  writer.write(dict);
+  writer.flush();
+  CHECK(out == kwargscpp::serialize(dict));
+  CHECK(flushes > 1);
+}
+
+TEST_CASE("Test serialize handles deep nesting") {
+  kwargscpp::ValueType value = 1;
+  for (int i = 0; i < 1000; ++i) value = std::vector<kwargscpp::ValueType>{std::move(value)};
+  std::string data = kwargscpp::serialize(value);
+  CHECK(kwargscpp::serialize(kwargscpp::deserialize(data)) == data);
+}
+
+TEST_CASE("Test deserialize rejects malformed data") {
+  std::string data = kwargscpp::serialize(make_config());
+  CHECK_THROWS_AS(kwargscpp::deserialize(data.substr(0, data.size() - 1)), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::deserialize(data + bytes({0x01})), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::deserialize(""), std::invalid_argument);
+  // nil, a non-string key, a map claiming 2^32-1 entries, an Array whose shape does not match its data
+  CHECK_THROWS_AS(kwargscpp::deserialize(bytes({0xc0})), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::deserialize(bytes({0x81, 0x01, 0x01})), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::deserialize(bytes({0xdf, 0xff, 0xff, 0xff, 0xff})), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::deserialize(bytes({0xc7, 0x0b, 0x01, 0x03, 0x01, 0, 0, 0, 0, 0, 0, 0, 0x02, 0x07})),
+                  std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::deserialize_dict(bytes({0x90})), std::invalid_argument);
+}
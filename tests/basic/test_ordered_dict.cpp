@@ -0,0 +1,164 @@
+#include <doctest/doctest.h>
+
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+#include "kwargscpp/ordered_dict.h"
+
+TEST_CASE("Test OrderedDict keeps insertion order") {
+  kwargscpp::OrderedDict<std::string, int> dict;
+  std::vector<std::string> keys = {"zeta", "alpha", "mid", "beta"};
+  for (size_t i = 0; i < keys.size(); ++i) dict[keys[i]] = static_cast<int>(i);
+
+  std::vector<std::string> seen;
+  for (const auto& [key, value] : dict) seen.push_back(key);
+  CHECK(seen == keys);
+
+  // overwriting keeps the original position
+  dict["alpha"] = 10;
+  CHECK(std::next(dict.begin(), 1)->first == "alpha");
+  CHECK(dict.at("alpha") == 10);
+  CHECK(dict.size() == 4);
+}
+
+TEST_CASE("Test OrderedDict lookup across the small size threshold") {
+  kwargscpp::OrderedDict<std::string, int> dict;
+  const int count = 1000;
+  for (int i = 0; i < count; ++i) {
+    CHECK(dict.try_emplace("key_" + std::to_string(i), i).second);
+    if (i == static_cast<int>(dict.kIndexThreshold) || i == count - 1) {
+      for (int j = 0; j <= i; ++j) {
+        auto it = dict.find("key_" + std::to_string(j));
+        REQUIRE(it != dict.end());
+        CHECK(it->second == j);
+      }
+      CHECK(dict.find("missing") == dict.end());
+    }
+  }
+  CHECK_FALSE(dict.try_emplace("key_5", -1).second);
+  CHECK(dict.at("key_5") == 5);
+  CHECK_THROWS_AS(dict.at("missing"), std::out_of_range);
+
+  int expected = 0;
+  for (const auto& [key, value] : dict) CHECK(value == expected++);
+}
+
+TEST_CASE("Test OrderedDict erase keeps order and index") {
+  kwargscpp::OrderedDict<std::string, int> dict;
+  for (int i = 0; i < 40; ++i) dict["key_" + std::to_string(i)] = i;
+
+  CHECK(dict.erase("key_3") == 1);
+  CHECK(dict.erase("key_3") == 0);
+  CHECK(dict.size() == 39);
+  CHECK(dict.find("key_3") == dict.end());
+  CHECK(dict.at("key_39") == 39);
+  CHECK(std::next(dict.begin(), 3)->first == "key_4");
+
+  // shrink back below the threshold, where lookups scan
+  while (dict.size() > 5) dict.erase(dict.begin());
+  CHECK(dict.begin()->first == "key_35");
+  CHECK(dict.at("key_36") == 36);
+  CHECK(dict.count("key_0") == 0);
+}
+
+TEST_CASE("Test OrderedDict erase leaves tombstones") {
+  for (int count : {8, 40}) {
+    kwargscpp::OrderedDict<std::string, int> dict;
+    for (int i = 0; i < count; ++i) dict["key_" + std::to_string(i)] = i;
+
+    // other entries stay where they are, and erase returns the next live one
+    int& last = dict.at("key_" + std::to_string(count - 1));
+    auto it = dict.erase(dict.find("key_2"));
+    REQUIRE(it != dict.end());
+    CHECK(it->first == "key_3");
+    it = dict.erase(it);
+    CHECK(it->first == "key_4");
+    CHECK(&dict.at("key_" + std::to_string(count - 1)) == &last);
+    CHECK(dict.size() == static_cast<size_t>(count - 2));
+
+    // reinserting goes to the end, and churn reclaims the tombstones
+    dict["key_2"] = -2;
+    for (int round = 0; round < 1000; ++round) {
+      dict.erase("key_0");
+      dict["key_0"] = round;
+    }
+    std::vector<std::string> seen;
+    for (const auto& [key, value] : dict) seen.push_back(key);
+    REQUIRE(seen.size() == static_cast<size_t>(count - 1));
+    CHECK(seen[0] == "key_1");
+    CHECK(seen[1] == "key_4");
+    CHECK(seen[seen.size() - 2] == "key_2");
+    CHECK(seen.back() == "key_0");
+    CHECK(dict.at("key_0") == 999);
+    CHECK(dict.count("key_3") == 0);
+
+    for (auto pos = dict.begin(); pos != dict.end();) pos = dict.erase(pos);
+    CHECK(dict.empty());
+    CHECK(dict.begin() == dict.end());
+    dict["again"] = 1;
+    CHECK(dict.begin()->first == "again");
+  }
+}
+
+TEST_CASE("Test OrderedDict holds small dicts inline") {
+  using Dict = kwargscpp::OrderedDict<std::string, int>;
+  auto inside = [](const Dict& dict, const void* item) {
+    const char* at = static_cast<const char*>(item);
+    return at >= reinterpret_cast<const char*>(&dict) && at < reinterpret_cast<const char*>(&dict + 1);
+  };
+  Dict dict = {{"x", 1}, {"y", 2}, {"z", 3}};
+  CHECK(inside(dict, &*dict.begin()));
+
+  // copies and moves of an inline dict are inline themselves
+  Dict copy = dict;
+  Dict moved = std::move(dict);
+  CHECK(inside(copy, &*copy.begin()));
+  CHECK(inside(moved, &*moved.begin()));
+  CHECK(copy == moved);
+  CHECK(dict.empty());
+
+  // past kIndexThreshold entries they move to the heap, keeping their order
+  for (size_t i = 0; i <= Dict::kIndexThreshold; ++i) moved["key_" + std::to_string(i)] = static_cast<int>(i);
+  CHECK_FALSE(inside(moved, &*moved.begin()));
+  CHECK(moved.begin()->first == "x");
+  CHECK(moved.at("key_16") == 16);
+  moved.swap(copy);
+  CHECK(copy.size() == 3 + Dict::kIndexThreshold + 1);
+  CHECK(moved.size() == 3);
+  CHECK(inside(moved, &*moved.begin()));
+  CHECK(copy.at("z") == 3);
+  copy = moved;
+  CHECK(copy == moved);
+}
+
+TEST_CASE("Test OrderedDict equality ignores order") {
+  kwargscpp::OrderedDict<std::string, int> a = {{"x", 1}, {"y", 2}};
+  kwargscpp::OrderedDict<std::string, int> b = {{"y", 2}, {"x", 1}};
+  CHECK(a == b);
+  b["y"] = 3;
+  CHECK(a != b);
+  b.insert_or_assign("y", 2);
+  CHECK(a == b);
+  b.emplace("z", 0);
+  CHECK(a != b);
+}
+
+#ifdef KWARGSCPP_ORDERED_DICT
+TEST_CASE("Test DictType keeps insertion order") {
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "b", 1);
+  kwargscpp::set(dict, "a", "two");
+  kwargscpp::DictType nested;
+  kwargscpp::set(nested, "z", true);
+  kwargscpp::set(nested, "y", 2.5);
+  kwargscpp::set(dict, "nested", nested);
+
+  CHECK(kwargscpp::to_string(dict) == "{\"b\": 1, \"a\": \"two\", \"nested\": {\"z\": true, \"y\": 2.5}}");
+  auto merged = kwargscpp::merge(dict, kwargscpp::DictType{{"a", 3}, {"c", 4}});
+  CHECK(kwargscpp::to_string(merged) ==
+        "{\"b\": 1, \"a\": 3, \"nested\": {\"z\": true, \"y\": 2.5}, \"c\": 4}");
+}
+#endif
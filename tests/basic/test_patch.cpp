@@ -0,0 +1,109 @@
+#include <doctest/doctest.h>
+
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+#include "kwargscpp/msgpack.h"
+#include "kwargscpp/patch.h"
+
+namespace {
+
+kwargscpp::DictType make_config() {
+  kwargscpp::DictType layer;
+  kwargscpp::set(layer, "units", 64);
+  kwargscpp::set(layer, "act", "relu");
+  kwargscpp::DictType model;
+  kwargscpp::set(model, "layers", std::vector<kwargscpp::ValueType>{layer, layer, layer});
+  kwargscpp::set(model, "dropout", 0.1);
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "model", model);
+  kwargscpp::set(dict, "lr", 0.01);
+  kwargscpp::set(dict, "debug", true);
+  kwargscpp::set(dict, "tags", std::vector<kwargscpp::ValueType>{"a", "b"});
+  return dict;
+}
+
+}  // namespace
+
+TEST_CASE("Test diff finds the changed paths and apply_patch replays them") {
+  const kwargscpp::DictType from = make_config();
+  kwargscpp::DictType to = from;
+  kwargscpp::set(to, "lr", 0.001);
+  to.erase("debug");
+  kwargscpp::set(to, "seed", 7);
+  kwargscpp::DictType& model = to.at("model").mutable_dict();
+  model.at("layers").mutable_vector()[1].mutable_dict().at("units") = 128;
+  to.at("tags").mutable_vector() = {"a", "c", "d"};
+
+  kwargscpp::Patch patch = kwargscpp::diff(from, to);
+  // lr, debug, seed, units, tags[1] and tags[2]
+  CHECK(patch.size() == 6);
+  bool found_units = false;
+  for (const kwargscpp::PatchOp& op : patch) {
+    if (op.path.size() == 4) {
+      found_units = true;
+      CHECK(op.kind == kwargscpp::PatchOp::Kind::replace);
+      CHECK(std::get<size_t>(op.path[2]) == 1);
+      CHECK(std::get<std::string>(op.path[3]) == "units");
+      CHECK(op.value.as_int() == 128);
+    }
+  }
+  CHECK(found_units);
+
+  kwargscpp::DictType patched = from;
+  kwargscpp::apply_patch(patched, patch);
+  CHECK(patched == to);
+  // untouched subtrees still share their payload with the original
+  const auto& layers = patched.at("model").as_dict().at("layers").as_vector();
+  CHECK(&layers[0].as_dict() == &from.at("model").as_dict().at("layers").as_vector()[0].as_dict());
+  CHECK(kwargscpp::diff(patched, to).empty());
+
+  // shrinking a list removes from the back
+  kwargscpp::DictType shorter = to;
+  shorter.at("tags").mutable_vector().resize(1);
+  patched = to;
+  kwargscpp::apply_patch(patched, kwargscpp::diff(to, shorter));
+  CHECK(patched == shorter);
+}
+
+TEST_CASE("Test patches convert to and from ValueType") {
+  const kwargscpp::DictType from = make_config();
+  kwargscpp::DictType to = from;
+  kwargscpp::set(to, "debug", false);
+  to.at("tags").mutable_vector().push_back("c");
+  to.erase("lr");
+
+  kwargscpp::ValueType value = kwargscpp::patch_to_value(kwargscpp::diff(from, to));
+  REQUIRE(value.is_vector());
+  // e.g. what Python sends, round tripped through bytes
+  kwargscpp::Patch patch = kwargscpp::patch_from_value(kwargscpp::deserialize(kwargscpp::serialize(value)));
+  kwargscpp::DictType patched = from;
+  kwargscpp::apply_patch(patched, patch);
+  CHECK(patched == to);
+
+  const auto parse = [](const std::string& op, std::vector<kwargscpp::ValueType> path) {
+    kwargscpp::DictType item;
+    kwargscpp::set(item, "op", op);
+    kwargscpp::set(item, "path", std::move(path));
+    kwargscpp::set(item, "value", 1);
+    return kwargscpp::patch_from_value(std::vector<kwargscpp::ValueType>{item});
+  };
+  CHECK(parse("add", {"model", "layers", 0}).front().kind == kwargscpp::PatchOp::Kind::add);
+  CHECK_THROWS_AS(parse("move", {"lr"}), std::invalid_argument);
+  CHECK_THROWS_AS(parse("add", {"lr", -1}), std::invalid_argument);
+  CHECK_THROWS_AS(parse("add", {"lr", 0.5}), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::patch_from_value(kwargscpp::ValueType(1)), std::invalid_argument);
+
+  kwargscpp::DictType dict = make_config();
+  CHECK_THROWS_AS(kwargscpp::apply_patch(dict, parse("replace", {"missing"})), std::runtime_error);
+  CHECK_THROWS_AS(kwargscpp::apply_patch(dict, parse("replace", {"tags", 2})), std::out_of_range);
+  CHECK_THROWS_AS(kwargscpp::apply_patch(dict, parse("replace", {"lr", "x"})), std::bad_variant_access);
+  CHECK_THROWS_AS(kwargscpp::apply_patch(dict, parse("replace", {})), std::invalid_argument);
+  kwargscpp::apply_patch(dict, parse("add", {"tags", 2}));
+  CHECK(dict.at("tags").as_vector().size() == 3);
+  kwargscpp::apply_patch(dict, parse("add", {"tags", 0}));
+  CHECK(dict.at("tags").as_vector()[0].as_int() == 1);
+}
@@ -0,0 +1,82 @@
+#include <doctest/doctest.h>
+
+#include <string>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+#include "kwargscpp/path.h"
+
+namespace {
+
+kwargscpp::DictType make_config() {
+  kwargscpp::DictType layer0;
+  kwargscpp::set(layer0, "dropout", 0.1);
+  kwargscpp::DictType layer1;
+  kwargscpp::set(layer1, "dropout", 0.2);
+  kwargscpp::set(layer1, "sizes", std::vector<kwargscpp::ValueType>{64, 128});
+
+  kwargscpp::DictType encoder;
+  kwargscpp::set(encoder, "layers", std::vector<kwargscpp::ValueType>{layer0, layer1});
+  kwargscpp::set(encoder, "name", "transformer");
+
+  kwargscpp::DictType model;
+  kwargscpp::set(model, "encoder", encoder);
+
+  kwargscpp::DictType config;
+  kwargscpp::set(config, "model", model);
+  kwargscpp::set(config, "epochs", 10);
+  return config;
+}
+
+}  // namespace
+
+TEST_CASE("Test get_path walks nested dicts and lists") {
+  const kwargscpp::DictType config = make_config();
+
+  CHECK(kwargscpp::get_path<int>(config, "epochs") == 10);
+  CHECK(kwargscpp::get_path<std::string>(config, "model.encoder.name") == "transformer");
+  CHECK(kwargscpp::get_path<double>(config, "model.encoder.layers[1].dropout") == doctest::Approx(0.2));
+  CHECK(kwargscpp::get_path<int>(config, "model.encoder.layers[1].sizes[1]") == 128);
+  CHECK(kwargscpp::get_path<int>(config, "model.encoder.missing", -1) == -1);
+
+  // the value is found in place, not copied out of the tree
+  const kwargscpp::ValueType* layers = kwargscpp::find_path(config, "model.encoder.layers");
+  REQUIRE(layers != nullptr);
+  CHECK(layers == &config.at("model").as_dict().at("encoder").as_dict().at("layers"));
+}
+
+TEST_CASE("Test Path is reusable and reports errors") {
+  const kwargscpp::DictType config = make_config();
+
+  const kwargscpp::Path dropout("model.encoder.layers[0].dropout");
+  CHECK(dropout.size() == 5);
+  CHECK(kwargscpp::get_path<double>(config, dropout) == doctest::Approx(0.1));
+  CHECK(kwargscpp::get_path<double>(make_config(), dropout) == doctest::Approx(0.1));
+
+  CHECK(kwargscpp::try_get_path<int>(config, kwargscpp::Path("model.decoder")).error() ==
+        kwargscpp::ErrorCode::key_not_found);
+  CHECK(kwargscpp::try_get_path<int>(config, "epochs.value").error() == kwargscpp::ErrorCode::wrong_type);
+  CHECK(kwargscpp::try_get_path<int>(config, "model[0]").error() == kwargscpp::ErrorCode::wrong_type);
+  CHECK(kwargscpp::try_get_path<int>(config, "model.encoder.layers[2]").error() ==
+        kwargscpp::ErrorCode::index_out_of_range);
+  CHECK(kwargscpp::try_get_path<int>(config, "model.encoder.name").error() == kwargscpp::ErrorCode::wrong_type);
+  CHECK_THROWS_AS(kwargscpp::get_path<double>(config, "model.encoder.layers[5].dropout"), std::out_of_range);
+  CHECK_THROWS_AS(kwargscpp::get_path<int>(config, "model.missing"), std::runtime_error);
+
+  CHECK_THROWS_AS(kwargscpp::Path(""), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::Path("model..encoder"), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::Path("layers[x]"), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::Path("layers[1"), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::Path("layers[1]x"), std::invalid_argument);
+  CHECK_THROWS_AS(kwargscpp::Path("layers[99999999999999999999999]"), std::invalid_argument);
+
+  // a malformed path is an error whatever the tree holds, never an exception from the try_ API
+  for (const char* path : {"missing..b", "model..b", "model.encoder.layers[0]x", "model[18446744073709551616]", ""}) {
+    CHECK(kwargscpp::try_get_path<int>(config, path).error() == kwargscpp::ErrorCode::malformed_path);
+    kwargscpp::ErrorCode error = kwargscpp::ErrorCode::ok;
+    CHECK(kwargscpp::find_path(config, path, &error) == nullptr);
+    CHECK(error == kwargscpp::ErrorCode::malformed_path);
+    CHECK_THROWS_AS(kwargscpp::get_path<int>(config, path), std::invalid_argument);
+    CHECK(kwargscpp::get_path<int>(config, path, -1) == -1);
+  }
+}
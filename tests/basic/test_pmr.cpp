@@ -0,0 +1,105 @@
+#include <doctest/doctest.h>
+
+#include <memory_resource>
+
+#include "kwargscpp/pmr.h"
+
+namespace {
+
+// Fails every allocation that reaches the default resource while in scope
+struct DefaultResourceGuard {
+  std::pmr::memory_resource* previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+  ~DefaultResourceGuard() { std::pmr::set_default_resource(previous); }
+};
+
+}  // namespace
+
+TEST_CASE("Test pmr set and get build into the arena") {
+  std::pmr::monotonic_buffer_resource arena;
+  DefaultResourceGuard guard;
+
+  kwargscpp::pmr::DictType dict(&arena);
+  kwargscpp::pmr::set(dict, "int_val", -42);
+  kwargscpp::pmr::set(dict, "uint_val", 42u);
+  kwargscpp::pmr::set(dict, "double_val", 2.5);
+  kwargscpp::pmr::set(dict, "bool_val", true);
+  // temporaries are built in the arena too, the default resource is never touched
+  kwargscpp::pmr::set(dict, "string_val",
+                      kwargscpp::pmr::ValueType("a string long enough to need an allocation", &arena));
+
+  kwargscpp::pmr::ListType list(&arena);
+  list.emplace_back(1);
+  list.emplace_back("another string long enough to need an allocation");
+  kwargscpp::pmr::set(dict, "list_val", kwargscpp::pmr::ValueType(std::move(list)));
+
+  kwargscpp::pmr::DictType nested(&arena);
+  kwargscpp::pmr::set(nested, "inner", 7);
+  kwargscpp::pmr::set(dict, "nested", kwargscpp::pmr::ValueType(std::move(nested)));
+
+  CHECK(kwargscpp::pmr::get_or_die<intmax_t>(dict, "int_val") == -42);
+  CHECK(kwargscpp::pmr::get_or_die<uintmax_t>(dict, "uint_val") == 42u);
+  CHECK(kwargscpp::pmr::get_or_die<double>(dict, "double_val") == doctest::Approx(2.5));
+  CHECK(kwargscpp::pmr::get_or_die<bool>(dict, "bool_val") == true);
+  CHECK(kwargscpp::pmr::get_or_die<int>(dict, "bool_val") == 1);
+  CHECK(kwargscpp::pmr::get<int>(dict, "missing", -1) == -1);
+  CHECK(kwargscpp::pmr::try_get<int>(dict, "missing").error() == kwargscpp::ErrorCode::key_not_found);
+  CHECK(kwargscpp::pmr::try_get<int>(dict, "string_val").error() == kwargscpp::ErrorCode::wrong_type);
+  CHECK(kwargscpp::pmr::has_key(dict, "nested"));
+  // lookups never build a key, so long keys do not reach the default resource either
+  kwargscpp::pmr::set(dict, "a key long enough to need an allocation", 1);
+  kwargscpp::pmr::set(dict, "a key long enough to need an allocation", 2);
+  CHECK(kwargscpp::pmr::get_or_die<int>(dict, "a key long enough to need an allocation") == 2);
+  CHECK_FALSE(kwargscpp::pmr::has_key(dict, "another key long enough to need an allocation"));
+  CHECK(dict.at("list_val").as_vector()[1].as_string() == "another string long enough to need an allocation");
+  CHECK(dict.at("nested").as_dict().at("inner").as_int() == 7);
+  CHECK(dict.at("nested").get_allocator().resource() == &arena);
+  CHECK(dict.at("nested").as_dict().get_allocator().resource() == &arena);
+  CHECK_THROWS_AS(kwargscpp::pmr::get_or_die<int>(dict, "string_val"), std::bad_variant_access);
+  CHECK_THROWS_AS(kwargscpp::pmr::get_or_die<int>(dict, "missing"), std::runtime_error);
+
+  // merge and with_prefix allocate from the resource of their first argument
+  auto prefixed = kwargscpp::pmr::with_prefix(dict, "pre_");
+  auto merged = kwargscpp::pmr::merge(dict, prefixed);
+  CHECK(merged.size() == 2 * dict.size());
+  CHECK(merged.at("pre_nested").as_dict().get_allocator().resource() == &arena);
+}
+
+TEST_CASE("Test pmr values copied into another dict use its resource") {
+  std::pmr::monotonic_buffer_resource arena1, arena2;
+  kwargscpp::pmr::DictType dict1(&arena1), dict2(&arena2);
+
+  kwargscpp::pmr::set(dict1, "key", "a string long enough to need an allocation");
+  kwargscpp::pmr::set(dict2, "key", dict1.at("key"));
+  dict2["other"] = dict1.at("key");
+
+  CHECK(dict2.at("key").get_allocator().resource() == &arena2);
+  CHECK(dict2.at("other").get_allocator().resource() == &arena2);
+  CHECK(dict2.at("other").as_string().get_allocator().resource() == &arena2);
+  CHECK(kwargscpp::pmr::get_or_die<std::string>(dict2, "other") == "a string long enough to need an allocation");
+}
+
+TEST_CASE("Test pmr round trip with the heap flavor") {
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "int", 1);
+  kwargscpp::set(dict, "string", "hello");
+  kwargscpp::set(dict, "list", std::vector<kwargscpp::ValueType>{1, 2.5, "three"});
+  kwargscpp::DictType nested;
+  kwargscpp::set(nested, "inner", false);
+  kwargscpp::set(dict, "nested", nested);
+
+  std::pmr::monotonic_buffer_resource arena;
+  kwargscpp::pmr::DictType pmr_dict = kwargscpp::pmr::to_pmr(dict, &arena);
+  CHECK(pmr_dict.get_allocator().resource() == &arena);
+  CHECK(kwargscpp::pmr::from_pmr(pmr_dict) == dict);
+  CHECK(kwargscpp::pmr::to_string(pmr_dict.at("list")) == kwargscpp::to_string(dict.at("list")));
+}
+
+TEST_CASE("Test pmr ResourceScope") {
+  std::pmr::monotonic_buffer_resource arena;
+  CHECK(kwargscpp::pmr::current_resource() == std::pmr::get_default_resource());
+  {
+    kwargscpp::pmr::ResourceScope scope(&arena);
+    CHECK(kwargscpp::pmr::current_resource() == &arena);
+  }
+  CHECK(kwargscpp::pmr::current_resource() == std::pmr::get_default_resource());
+}
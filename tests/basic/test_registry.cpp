@@ -0,0 +1,91 @@
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+#include "kwargscpp/registry.h"
+
+TEST_CASE("Test ConfigRegistry publishes immutable versions") {
+  kwargscpp::DictType initial;
+  kwargscpp::set(initial, "threads", 4);
+  kwargscpp::ConfigRegistry registry(initial);
+  CHECK(registry.version() == 0);
+
+  kwargscpp::ConfigRegistry::Snapshot first = registry.snapshot();
+  CHECK(*first == initial);
+
+  std::vector<uint64_t> notified;
+  size_t id = registry.subscribe([&](const kwargscpp::ConfigRegistry::Snapshot& snapshot, uint64_t version) {
+    CHECK(snapshot == registry.snapshot());
+    notified.push_back(version);
+  });
+
+  kwargscpp::DictType next;
+  kwargscpp::set(next, "threads", 8);
+  CHECK(registry.publish(next) == 1);
+  CHECK(registry.update([](kwargscpp::DictType& dict) { kwargscpp::set(dict, "verbose", true); }) == 2);
+  CHECK(registry.version() == 2);
+  CHECK(notified == std::vector<uint64_t>{1, 2});
+
+  // the old version is untouched and still alive
+  CHECK(kwargscpp::get_or_die<int>(*first, "threads") == 4);
+  CHECK_FALSE(kwargscpp::has_key(*first, "verbose"));
+  kwargscpp::ConfigRegistry::Snapshot current = registry.snapshot();
+  CHECK(kwargscpp::get_or_die<int>(*current, "threads") == 8);
+  CHECK(kwargscpp::get_or_die<bool>(*current, "verbose"));
+
+  registry.unsubscribe(id);
+  registry.publish(initial);
+  CHECK(notified.size() == 2);
+
+  kwargscpp::ConfigReader reader(registry);
+  CHECK(reader.version() == 3);
+  CHECK(reader.get() == initial);
+  registry.publish(next);
+  CHECK(reader.get() == next);
+  CHECK(reader.version() == 4);
+}
+
+TEST_CASE("Test ConfigRegistry readers race a writer") {
+  // every version keeps "a" and "b" equal, which a torn read would break
+  const auto make = [](intmax_t n) {
+    kwargscpp::DictType dict;
+    kwargscpp::set(dict, "a", n);
+    kwargscpp::set(dict, "b", n);
+    return dict;
+  };
+  kwargscpp::ConfigRegistry registry(make(0));
+  std::atomic<bool> done{false};
+  std::atomic<int> failures{0};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&] {
+      kwargscpp::ConfigReader reader(registry);
+      intmax_t last = 0;
+      while (!done.load()) {
+        const kwargscpp::DictType& dict = reader.get();
+        intmax_t a = kwargscpp::get_or_die<intmax_t>(dict, "a");
+        if (a != kwargscpp::get_or_die<intmax_t>(dict, "b") || a < last) ++failures;
+        last = a;
+      }
+    });
+  }
+  for (intmax_t n = 1; n <= 200; ++n) {
+    if (n % 2) {
+      registry.publish(make(n));
+    } else {
+      registry.update([n](kwargscpp::DictType& dict) {
+        kwargscpp::set(dict, "a", n);
+        kwargscpp::set(dict, "b", n);
+      });
+    }
+    std::this_thread::yield();
+  }
+  done = true;
+  for (std::thread& reader : readers) reader.join();
+  CHECK(failures.load() == 0);
+  CHECK(registry.version() == 200);
+}
@@ -0,0 +1,160 @@
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+#include "kwargscpp/schema.h"
+
+namespace {
+
+kwargscpp::Schema make_schema() {
+  using kwargscpp::ValueKind;
+  kwargscpp::Schema optimizer;
+  optimizer.required("name", ValueKind::string)
+      .one_of({"adam", "sgd"})
+      .required("lr", ValueKind::floating)
+      .range(0, 1)
+      .optional("betas", ValueKind::list | ValueKind::array);
+  kwargscpp::Schema layer;
+  layer.required("units", ValueKind::integer).range(1, 4096).allow_unknown(false);
+  kwargscpp::Schema schema;
+  schema.required("optimizer", ValueKind::dict)
+      .nested(optimizer)
+      .optional("layers", ValueKind::list)
+      .nested(layer)
+      .optional("epochs", ValueKind::integer)
+      .range(1, 1000)
+      .optional("verbose", ValueKind::boolean);
+  return schema;
+}
+
+kwargscpp::DictType make_dict() {
+  kwargscpp::DictType optimizer;
+  kwargscpp::set(optimizer, "name", "adam");
+  kwargscpp::set(optimizer, "lr", 0.01);
+  kwargscpp::DictType layer;
+  kwargscpp::set(layer, "units", 64);
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "optimizer", optimizer);
+  kwargscpp::set(dict, "layers", std::vector<kwargscpp::ValueType>{layer, layer});
+  kwargscpp::set(dict, "epochs", 10);
+  kwargscpp::set(dict, "extra", "allowed");
+  return dict;
+}
+
+}  // namespace
+
+TEST_CASE("Test Schema reports every error with its path") {
+  const kwargscpp::Schema schema = make_schema();
+  kwargscpp::DictType dict = make_dict();
+  CHECK(schema.validate(dict).empty());
+  CHECK_NOTHROW(schema.validate_or_die(dict));
+
+  kwargscpp::DictType& optimizer = dict.at("optimizer").mutable_dict();
+  kwargscpp::set(optimizer, "name", "adamw");
+  optimizer.erase("lr");
+  kwargscpp::ListType& layers = dict.at("layers").mutable_vector();
+  kwargscpp::set(layers[1].mutable_dict(), "units", 0);
+  kwargscpp::set(layers[1].mutable_dict(), "bias", true);
+  layers.push_back(3);
+  kwargscpp::set(dict, "epochs", "ten");
+
+  std::vector<kwargscpp::SchemaError> errors = schema.validate(dict);
+  std::vector<std::string> found;
+  for (const kwargscpp::SchemaError& error : errors) found.push_back(error.path + ": " + error.message);
+  std::sort(found.begin(), found.end());
+  CHECK(found == std::vector<std::string>{
+                     "epochs: expected int, got string",
+                     "layers[1].bias: unexpected key",
+                     "layers[1].units: 0 is out of range [1.0, 4096.0]",
+                     "layers[2]: expected dict, got int",
+                     "optimizer.lr: missing required key",
+                     "optimizer.name: \"adamw\" is not one of \"adam\", \"sgd\"",
+                 });
+  CHECK_THROWS_AS(schema.validate_or_die(dict), std::invalid_argument);
+
+  errors = schema.validate(kwargscpp::DictType());
+  REQUIRE(errors.size() == 1);
+  CHECK(errors[0].path == "optimizer");
+
+  // a dict much larger than the schema is checked one rule at a time
+  dict = make_dict();
+  for (int i = 0; i < 64; ++i) kwargscpp::set(dict, "other_" + std::to_string(i), i);
+  CHECK(schema.validate(dict).empty());
+  dict.erase("optimizer");
+  kwargscpp::set(dict, "verbose", "yes");
+  CHECK(schema.validate(dict).size() == 2);
+
+  CHECK_THROWS_AS(kwargscpp::Schema().range(0, 1), std::logic_error);
+}
+
+TEST_CASE("Test Schema coerces numbers in place") {
+  const kwargscpp::Schema schema = make_schema();
+  const kwargscpp::DictType original = make_dict();
+  kwargscpp::DictType dict = original;
+  kwargscpp::set(dict.at("optimizer").mutable_dict(), "lr", 1);
+  kwargscpp::set(dict, "epochs", 20.0);
+  kwargscpp::set(dict, "verbose", 1);
+  CHECK(schema.validate(dict).size() == 3);
+
+  const kwargscpp::DictType before = dict;
+  CHECK(schema.validate_and_coerce(dict).empty());
+  CHECK(dict.at("optimizer").as_dict().at("lr").is_double());
+  CHECK(dict.at("epochs").is_int());
+  CHECK(dict.at("epochs").as_int() == 20);
+  CHECK(dict.at("verbose").is_bool());
+  CHECK(schema.validate(dict).empty());
+  // the copy taken before, and the untouched subtrees, are not written through
+  CHECK(before.at("optimizer").as_dict().at("lr").is_int());
+  CHECK(&dict.at("layers").as_vector() == &original.at("layers").as_vector());
+
+  // a coerced number is still range checked, and nothing is written if any check fails
+  dict = original;
+  kwargscpp::set(dict, "epochs", 5000.0);
+  kwargscpp::set(dict, "verbose", 1);
+  CHECK(schema.validate_and_coerce(dict).size() == 1);
+  CHECK(dict.at("verbose").is_int());
+  // strings are never coerced
+  kwargscpp::set(dict, "epochs", "10");
+  CHECK(schema.validate_and_coerce(dict).size() == 1);
+}
+
+TEST_CASE("Test Schema reports numbers out of range for the coerced kind") {
+  kwargscpp::Schema schema;
+  schema.required("steps", kwargscpp::ValueKind::integer).required("seed", kwargscpp::ValueKind::unsigned_integer);
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "steps", 1e30);
+  kwargscpp::set(dict, "seed", -1);
+  // past the range of the kind, so reported rather than converted, which would be undefined for a double
+  std::vector<kwargscpp::SchemaError> errors = schema.validate_and_coerce(dict);
+  REQUIRE(errors.size() == 2);
+  CHECK(std::any_of(errors.begin(), errors.end(), [](const kwargscpp::SchemaError& error) {
+    return error.path == "steps" && error.message == "1e+30 is out of range for int";
+  }));
+  CHECK(dict.at("steps").is_double());
+  for (double bad : {std::nan(""), std::numeric_limits<double>::infinity(), 0x1p63, -0x1p63 * 1.5}) {
+    kwargscpp::set(dict, "steps", bad);
+    kwargscpp::set(dict, "seed", 0x1p64);
+    CHECK(schema.validate_and_coerce(dict).size() == 2);
+  }
+
+  // the ends of the ranges still convert
+  kwargscpp::set(dict, "steps", -0x1p63);
+  kwargscpp::set(dict, "seed", -0.5);
+  CHECK(schema.validate_and_coerce(dict).empty());
+  CHECK(dict.at("steps").as_int() == INTMAX_MIN);
+  CHECK(dict.at("seed").as_uint() == 0);
+  kwargscpp::set(dict, "steps", std::numeric_limits<uintmax_t>::max());
+  kwargscpp::set(dict, "seed", 0x1p64 - 2048);
+  CHECK(schema.validate_and_coerce(dict).size() == 1);
+  kwargscpp::set(dict, "steps", uintmax_t(INTMAX_MAX));
+  CHECK(schema.validate_and_coerce(dict).empty());
+  CHECK(dict.at("steps").as_int() == INTMAX_MAX);
+  CHECK(dict.at("seed").as_uint() == UINTMAX_MAX - 2047);
+}
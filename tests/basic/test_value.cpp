@@ -0,0 +1,124 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "kwargscpp/kwargs.h"
+
+TEST_CASE("Test ValueType is a tagged 16-byte value") {
+  static_assert(sizeof(kwargscpp::ValueType) == 16);
+  static_assert(sizeof(kwargscpp::String) == 16);
+
+  const std::vector<kwargscpp::ValueType> values{intmax_t(-1), uintmax_t(1), 2.5,  true, "short",
+                                                 std::string(40, 'x'), std::vector<kwargscpp::ValueType>{1},
+                                                 kwargscpp::DictType(), kwargscpp::Array(std::vector<double>{1.0})};
+  const size_t indices[] = {0, 1, 2, 3, 4, 4, 5, 6, 7};
+  for (size_t i = 0; i < values.size(); ++i) {
+    CHECK(values[i].index() == indices[i]);
+    CHECK(kwargscpp::ValueType(values[i]) == values[i]);
+  }
+  CHECK(kwargscpp::ValueType().is_int());
+  CHECK(kwargscpp::ValueType().as_int() == 0);
+  CHECK(values[0].as_int() == -1);
+  CHECK(values[1].as_uint() == 1);
+  CHECK(values[3].as_bool());
+  CHECK(values[4].as_string() == "short");
+  CHECK(values[5].as_string() == std::string(40, 'x'));
+
+  CHECK(values[2].holds<double>());
+  CHECK(values[2].get_if<double>() != nullptr);
+  CHECK(values[2].get_if<intmax_t>() == nullptr);
+  CHECK(values[4].get_if<kwargscpp::String>()->size() == 5);
+  CHECK_THROWS_AS(values[2].get<intmax_t>(), std::bad_variant_access);
+  CHECK_THROWS_AS(values[2].as_string(), std::bad_variant_access);
+  CHECK(values[4] != values[5]);
+  CHECK(kwargscpp::ValueType(intmax_t(1)) != kwargscpp::ValueType(uintmax_t(1)));
+}
+
+TEST_CASE("Test String holds short text inline and shares long text") {
+  const kwargscpp::String empty;
+  CHECK(empty.empty());
+  CHECK(empty.is_inline());
+  CHECK(std::string_view(empty.c_str()).empty());
+
+  const kwargscpp::String short_text(std::string(kwargscpp::String::kInlineCapacity, 'a'));
+  CHECK(short_text.is_inline());
+  CHECK(short_text.size() == kwargscpp::String::kInlineCapacity);
+  CHECK(short_text.c_str()[short_text.size()] == '\0');
+
+  const kwargscpp::String long_text(std::string(kwargscpp::String::kInlineCapacity + 1, 'b'));
+  CHECK(!long_text.is_inline());
+  CHECK(long_text == std::string(kwargscpp::String::kInlineCapacity + 1, 'b'));
+  CHECK(long_text.c_str()[long_text.size()] == '\0');
+  kwargscpp::String copy = long_text;
+  CHECK(copy.data() == long_text.data());
+  kwargscpp::String moved = std::move(copy);
+  CHECK(moved.data() == long_text.data());
+  CHECK(copy.empty());
+
+  CHECK(short_text != long_text);
+  CHECK(short_text < long_text);
+  CHECK(std::string(short_text) == std::string(kwargscpp::String::kInlineCapacity, 'a'));
+
+  // copies of a value share the heap text, as they share list and dict payloads
+  const kwargscpp::ValueType value(long_text);
+  const kwargscpp::ValueType shared = value;
+  CHECK(shared.as_string().data() == long_text.data());
+}
+
+TEST_CASE("Test visit calls the visitor with the held alternative") {
+  const auto name = [](const kwargscpp::ValueType& value) {
+    return kwargscpp::visit(
+        [](const auto& arg) -> std::string {
+          using T = std::decay_t<decltype(arg)>;
+          if constexpr (std::is_same_v<T, kwargscpp::String>) {
+            return "string " + std::string(arg);
+          } else if constexpr (std::is_same_v<T, kwargscpp::Cow<kwargscpp::ListType>>) {
+            return "list of " + std::to_string(arg->size());
+          } else if constexpr (std::is_arithmetic_v<T>) {
+            return "number";
+          } else {
+            return "other";
+          }
+        },
+        value);
+  };
+  CHECK(name(kwargscpp::ValueType(3)) == "number");
+  CHECK(name(kwargscpp::ValueType("abc")) == "string abc");
+  CHECK(name(kwargscpp::ValueType(std::vector<kwargscpp::ValueType>{1, 2})) == "list of 2");
+  CHECK(name(kwargscpp::ValueType(kwargscpp::DictType())) == "other");
+
+  kwargscpp::ValueType number(1.5);
+  kwargscpp::visit(
+      [](auto& arg) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(arg)>, double>) arg *= 2;
+      },
+      number);
+  CHECK(number.as_double() == 3.0);
+}
+
+TEST_CASE("Test ValueType assigned an element of its own subtree") {
+  kwargscpp::ValueType value(std::vector<kwargscpp::ValueType>{std::string(32, 'y'), 2});
+  value = value.as_vector()[0];
+  CHECK(value.as_string() == std::string(32, 'y'));
+
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "inner", std::vector<kwargscpp::ValueType>{1, 2});
+  kwargscpp::ValueType nested(std::move(dict));
+  nested = std::move(nested.mutable_dict().begin()->second);
+  REQUIRE(nested.is_vector());
+  CHECK(nested.as_vector().size() == 2);
+}
+
+TEST_CASE("Test strings are read back as std::string or String") {
+  kwargscpp::DictType dict;
+  kwargscpp::set(dict, "name", "value");
+  CHECK(kwargscpp::get_or_die<std::string>(dict, "name") == "value");
+  CHECK(kwargscpp::get_or_die<kwargscpp::String>(dict, "name") == "value");
+  CHECK(kwargscpp::get<std::string>(dict, "missing", "fallback") == "fallback");
+  CHECK(kwargscpp::get_ref<kwargscpp::String>(dict, "name").data() == dict.at("name").as_string().data());
+}
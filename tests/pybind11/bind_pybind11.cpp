@@ -3,9 +3,13 @@
 #include <pybind11/stl_bind.h>
 #include <pybind11/functional.h>
 
+#include <memory_resource>
 #include <variant>
 
+#include "kwargscpp/json.h"
 #include "kwargscpp/kwargs.h"
+#include "kwargscpp/msgpack.h"
+#include "kwargscpp/pmr.h"
 #include "kwargscpp/pybind11/binding.h"
 
 namespace py = pybind11;
@@ -36,7 +40,36 @@ kwargscpp::DictType generate_dict()
   return dict;
 }
 
+py::object echo_pmr_dict(py::dict kwargs) {
+  // load the whole tree into a per-call arena, released at once on return
+  std::pmr::monotonic_buffer_resource arena;
+  kwargscpp::pmr::ResourceScope scope(&arena);
+  auto dict = py::cast<kwargscpp::pmr::DictType>(kwargs);
+  return py::cast(dict);
+}
+
+kwargscpp::SharedDict generate_shared_dict() { return kwargscpp::SharedDict(generate_dict()); }
+
+// whether `value` holds the payload of `dict` itself, i.e. the dict was passed without conversion
+bool shares_payload(const kwargscpp::SharedDict& dict, const kwargscpp::ValueType& value) {
+  return value.is_dict() && &value.as_dict() == &dict.get();
+}
+
+// MessagePack round trip of any value
+py::bytes dumps(const kwargscpp::ValueType& value) { return py::bytes(kwargscpp::serialize(value)); }
+kwargscpp::ValueType loads(const py::bytes& data) { return kwargscpp::deserialize(std::string_view(data)); }
+
+// parse JSON text natively, without going through Python objects
+kwargscpp::DictType load_json(const std::string& text) { return kwargscpp::from_json_dict(text); }
+
 PYBIND11_MODULE(bind_pybind11, m) {
+  kwargscpp::bind_shared_dict(m, "Dict");
   m.def("echo_dict", &echo_dict, "Echo the input dictionary");
   m.def("generate_dict", &generate_dict, "Generate a dictionary");
+  m.def("echo_pmr_dict", &echo_pmr_dict, "Echo the input dictionary through an arena-allocated DictType");
+  m.def("generate_shared_dict", &generate_shared_dict, "Generate a dictionary as an opaque Dict");
+  m.def("shares_payload", &shares_payload, "Whether the value holds the payload of the Dict");
+  m.def("dumps", &dumps, "Serialize a value as MessagePack");
+  m.def("loads", &loads, "Deserialize a MessagePack value");
+  m.def("load_json", &load_json, "Parse a JSON object into a dictionary");
 }
\ No newline at end of file
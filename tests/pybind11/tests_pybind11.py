@@ -1,8 +1,16 @@
 import sys
 sys.dont_write_bytecode = True
+import collections.abc
+import json
+import pickle
 import unittest
 import bind_pybind11
 
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
 
 class TestBindNanobind(unittest.TestCase):
     def test_generate_dict(self):
@@ -29,6 +37,160 @@ class TestBindNanobind(unittest.TestCase):
         echoed_dict = bind_pybind11.echo_dict(py_dict)
         self.assertEqual(echoed_dict, py_dict)
 
+    def test_echo_keeps_types(self):
+        py_dict = {
+            "bool": True,
+            "false": False,
+            "int_max": 2**63 - 1,
+            "int_min": -2**63,
+            "uint": 2**64 - 1,
+            "bools": [True, False, 1],
+        }
+        echoed_dict = bind_pybind11.echo_dict(py_dict)
+        self.assertEqual(echoed_dict, py_dict)
+        self.assertIs(echoed_dict["bool"], True)
+        self.assertIs(echoed_dict["false"], False)
+        self.assertEqual([type(v) for v in echoed_dict["bools"]], [bool, bool, int])
+        # values beyond uintmax_t, keys that are not str and unsupported types are rejected
+        for bad in ({"big": 2**64}, {1: "one"}, {"none": None}, {"tuple": (1, 2)}):
+            with self.assertRaises(TypeError):
+                bind_pybind11.echo_dict(bad)
+
+    def test_echo_subclasses(self):
+        class Str(str):
+            pass
+
+        class Int(int):
+            pass
+
+        echoed_dict = bind_pybind11.echo_dict({"str": Str("sub"), "int": Int(7), "list": [Str("x")]})
+        self.assertEqual(echoed_dict, {"str": "sub", "int": 7, "list": ["x"]})
+
+    def test_shared_dict(self):
+        shared = bind_pybind11.generate_shared_dict()
+        expected_dict = bind_pybind11.generate_dict()
+        self.assertIsInstance(shared, collections.abc.MutableMapping)
+        self.assertEqual(len(shared), len(expected_dict))
+        self.assertEqual(shared["int"], 42)
+        self.assertIs(shared["bool"], True)
+        self.assertIsInstance(shared["nested"], bind_pybind11.Dict)
+        self.assertEqual(shared["nested"]["inner_key"], 42)
+        self.assertEqual(sorted(shared), sorted(expected_dict))
+        self.assertEqual(shared, expected_dict)
+        self.assertEqual(shared.to_dict(), expected_dict)
+        with self.assertRaises(KeyError):
+            shared["missing"]
+        # passed back into C++ without conversion
+        self.assertTrue(bind_pybind11.shares_payload(shared, shared))
+        self.assertEqual(bind_pybind11.echo_dict(shared), expected_dict)
+        self.assertEqual(bind_pybind11.echo_dict({"child": shared}), {"child": expected_dict})
+
+    def test_shared_dict_other_keys(self):
+        # a key that is not a str is never held, as a dict would answer for one it does not hold
+        shared = bind_pybind11.generate_shared_dict()
+        for key in (1, None, ("int",), b"int"):
+            self.assertNotIn(key, shared)
+            self.assertIsNone(shared.get(key))
+            self.assertEqual(shared.get(key, "default"), "default")
+            with self.assertRaises(KeyError) as raised:
+                shared[key]
+            self.assertEqual(raised.exception.args, (key,))
+            with self.assertRaises(KeyError):
+                del shared[key]
+        for key in (1, b"int"):
+            with self.assertRaises(TypeError):
+                shared[key] = "one"
+        self.assertEqual(shared.to_dict(), bind_pybind11.generate_dict())
+
+    def test_shared_dict_writes(self):
+        shared = bind_pybind11.Dict({"a": 1, "nested": {"b": 2}})
+        shared["c"] = [1, "two"]
+        del shared["a"]
+        shared.update(d=4.5)
+        self.assertEqual(shared.to_dict(), {"nested": {"b": 2}, "c": [1, "two"], "d": 4.5})
+        with self.assertRaises(KeyError):
+            del shared["a"]
+        # a nested dict is a copy-on-write snapshot until it is assigned back
+        nested = shared["nested"]
+        nested["b"] = 3
+        self.assertEqual(shared["nested"]["b"], 2)
+        shared["nested"] = nested
+        self.assertEqual(shared["nested"]["b"], 3)
+
+    def test_shared_dict_patch(self):
+        shared = bind_pybind11.generate_shared_dict()
+        shared.apply_patch([
+            {"op": "replace", "path": ["nested", "inner_key"], "value": 7},
+            {"op": "add", "path": ["vector_val", 4], "value": "tail"},
+            {"op": "remove", "path": ["bool"]},
+        ])
+        expected = bind_pybind11.generate_dict()
+        expected["nested"]["inner_key"] = 7
+        expected["vector_val"].append("tail")
+        del expected["bool"]
+        self.assertEqual(shared.to_dict(), expected)
+        # diff gives the patch back, which turns the original into the patched dict
+        patch = bind_pybind11.Dict(bind_pybind11.generate_dict()).diff(expected)
+        self.assertEqual(len(patch), 3)
+        original = bind_pybind11.generate_shared_dict()
+        original.apply_patch(patch)
+        self.assertEqual(original.to_dict(), expected)
+        with self.assertRaises(ValueError):
+            shared.apply_patch([{"op": "move", "path": ["int"]}])
+
+    def test_shared_dict_bytes_and_pickle(self):
+        shared = bind_pybind11.generate_shared_dict()
+        data = shared.to_bytes()
+        self.assertIsInstance(data, bytes)
+        self.assertEqual(bind_pybind11.Dict.from_bytes(data).to_dict(), shared.to_dict())
+        restored = pickle.loads(pickle.dumps(shared))
+        self.assertIsInstance(restored, bind_pybind11.Dict)
+        self.assertEqual(restored.to_dict(), shared.to_dict())
+        with self.assertRaises(ValueError):
+            bind_pybind11.Dict.from_bytes(data[:-1])
+
+    def test_dumps_loads(self):
+        value = {"int": -5, "big": 2**64 - 1, "float": 0.5, "flag": True, "text": "hi", "list": [1, [2, {}]]}
+        data = bind_pybind11.dumps(value)
+        # standard MessagePack, a map of 6 entries
+        self.assertEqual(data[:1], b"\x86")
+        self.assertEqual(bind_pybind11.loads(data), value)
+        with self.assertRaises(ValueError):
+            bind_pybind11.loads(data + b"\x00")
+
+    def test_load_json(self):
+        value = {"int": -5, "big": 2**64 - 1, "float": 0.5, "flag": True, "text": "caf\u00e9", "list": [1, [2, {}]]}
+        text = json.dumps(value)
+        self.assertEqual(bind_pybind11.load_json(text), json.loads(text))
+        with self.assertRaises(ValueError):
+            bind_pybind11.load_json(text[:-1])
+
+    def test_echo_cycles_and_shared_blocks(self):
+        cyclic = {"a": 1}
+        cyclic["self"] = cyclic
+        with self.assertRaises(TypeError):
+            bind_pybind11.echo_dict(cyclic)
+        looped = [1]
+        looped.append(looped)
+        with self.assertRaises(TypeError):
+            bind_pybind11.echo_dict({"list": looped})
+        # a block referenced from several places is not a cycle
+        block = {"lr": 0.1, "layers": [64, 64]}
+        dag = {"encoder": block, "decoder": block, "heads": [block, block["layers"]]}
+        self.assertEqual(bind_pybind11.echo_dict(dag), dag)
+
+    def test_echo_deep_dict(self):
+        deep = node = {}
+        for _ in range(10000):
+            node["child"] = {}
+            node = node["child"]
+        echoed = bind_pybind11.echo_dict(deep)
+        depth = 0
+        while echoed:
+            echoed = echoed["child"]
+            depth += 1
+        self.assertEqual(depth, 10000)
+
     def test_exchange_dict(self):
         from_cpp = bind_pybind11.generate_dict()
         # add some new key-value pairs to the dict
@@ -41,6 +203,61 @@ class TestBindNanobind(unittest.TestCase):
         echo_from_cpp = bind_pybind11.echo_dict(from_cpp)
         self.assertEqual(from_cpp, echo_from_cpp)
 
+    def test_echo_pmr_dict(self):
+        py_dict = {
+            "int": 42,
+            "double": 3.14,
+            "bool": True,
+            "string": "a string long enough to be allocated in the arena",
+            "nested": {"inner_key": 42},
+            "vector_val": [42, 3.14, "hello", True],
+        }
+        echoed_dict = bind_pybind11.echo_pmr_dict(py_dict)
+        self.assertEqual(echoed_dict, py_dict)
+        self.assertIs(type(echoed_dict["bool"]), bool)
+
+    def test_echo_pmr_dict_matches_heap_flavor(self):
+        # ints past intmax_t load as uintmax_t, as in the heap flavor
+        py_dict = {"big": 2**64 - 1, "neg": -(2**63), "block": {"a": [1]}}
+        py_dict["again"] = py_dict["block"]
+        self.assertEqual(bind_pybind11.echo_pmr_dict(py_dict), py_dict)
+        # echo_pmr_dict loads through py::cast, whose failure is a RuntimeError
+        with self.assertRaises(RuntimeError):
+            bind_pybind11.echo_pmr_dict({"big": 2**64})
+
+        cyclic = {"list": []}
+        cyclic["list"].append(cyclic)
+        with self.assertRaises(RuntimeError):
+            bind_pybind11.echo_pmr_dict(cyclic)
+
+        deep = node = {}
+        for _ in range(10000):
+            node["child"] = {}
+            node = node["child"]
+        echoed = bind_pybind11.echo_pmr_dict(deep)
+        depth = 0
+        while echoed:
+            echoed = echoed["child"]
+            depth += 1
+        self.assertEqual(depth, 10000)
+
+    @unittest.skipIf(np is None, "numpy is not installed")
+    def test_echo_arrays(self):
+        py_dict = {
+            "weights": np.arange(6, dtype=np.float32).reshape(2, 3),
+            "ids": np.array([7, 8, 9], dtype=np.int64),
+            "mask": np.array([1, 0, 1], dtype=np.uint8),
+        }
+        echoed_dict = bind_pybind11.echo_dict(py_dict)
+        for key in ("weights", "ids", "mask"):
+            self.assertIsInstance(echoed_dict[key], np.ndarray)
+            self.assertEqual(echoed_dict[key].dtype, py_dict[key].dtype)
+            np.testing.assert_array_equal(echoed_dict[key], py_dict[key])
+        # the returned array shares the C++ buffer, which is read-only
+        self.assertFalse(echoed_dict["weights"].flags.writeable)
+        # non-contiguous arrays are rejected rather than copied element by element
+        with self.assertRaises(TypeError):
+            bind_pybind11.echo_dict({"strided": np.arange(10, dtype=np.float64)[::2]})
 
 if __name__ == "__main__":
     unittest.main()